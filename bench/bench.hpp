@@ -0,0 +1,102 @@
+#pragma once
+
+// Minimal microbenchmark harness: each benchmark prints one JSON line on stdout,
+//   {"bench":"hll.add","params":"p=14,encoding=dense","ns_per_op":..,"keys_per_s":..,"bytes_per_key":..,"ops":..}
+// where an op is one key fed to the structure (or one call, for estimate/merge), and bytes_per_key is
+// the structure's size divided by the distinct keys fed to it (the key length for hash benchmarks).
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+// Keeps the value at p observable so the computation producing it is not optimised away
+template <class T> inline void do_not_optimize(const T& v) {
+  asm volatile("" : : "g"(&v) : "memory");
+}
+
+struct key_set {
+  std::vector<std::string> owned;
+  std::vector<std::string_view> views;
+};
+
+// n distinct, deterministic keys of exactly len bytes (at least 8): a unique decimal prefix padded
+// with pseudo-random printable bytes, so short keys do not share a common prefix
+inline auto make_keys(std::size_t n, std::size_t len, std::uint64_t seed) -> key_set {
+  key_set ks;
+  ks.owned.reserve(n);
+  std::uint64_t state = seed;
+  for (std::size_t i = 0; i < n; ++i) {
+    std::string k = std::to_string(i);
+    k.push_back('-');
+    while (k.size() < len) {
+      // splitmix64 step
+      state += 0x9E3779B97F4A7C15ULL;
+      std::uint64_t z = state;
+      z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+      k.push_back(static_cast<char>('!' + ((z ^ (z >> 31U)) % 94U)));
+    }
+    ks.owned.push_back(std::move(k));
+  }
+  ks.views.assign(ks.owned.begin(), ks.owned.end());
+  return ks;
+}
+
+struct options {
+  std::string filter; // run only benchmarks whose name contains this
+  std::chrono::milliseconds min_time{200};
+};
+
+class runner {
+public:
+  explicit runner(options o) : opt_(std::move(o)) {}
+
+  [[nodiscard]] auto enabled(std::string_view name) const -> bool {
+    return opt_.filter.empty() || name.find(opt_.filter) != std::string_view::npos;
+  }
+
+  // Calls fn() (each call performs ops_per_call ops) once to warm up, then until min_time has
+  // elapsed, and prints the result line
+  template <class Fn>
+  void run(std::string_view name, std::string_view params, std::size_t ops_per_call, double bytes_per_key, Fn&& fn) {
+    if (!enabled(name)) {
+      return;
+    }
+    using clock = std::chrono::steady_clock;
+    fn();
+    std::uint64_t calls = 0;
+    const auto start = clock::now();
+    auto now = start;
+    do {
+      fn();
+      ++calls;
+      now = clock::now();
+    } while (now - start < opt_.min_time);
+    const double ns = std::chrono::duration<double, std::nano>(now - start).count();
+    const double ops = static_cast<double>(calls) * static_cast<double>(ops_per_call);
+    std::printf(R"({"bench":"%.*s","params":"%.*s","ns_per_op":%.3f,"keys_per_s":%.0f,"bytes_per_key":%.4f,)"
+                R"("ops":%.0f})"
+                "\n",
+                static_cast<int>(name.size()), name.data(), static_cast<int>(params.size()), params.data(), ns / ops,
+                ops * 1e9 / ns, bytes_per_key, ops);
+    std::fflush(stdout);
+  }
+
+private:
+  options opt_;
+};
+
+void run_hash_bench(runner& r);
+void run_bloom_bench(runner& r);
+void run_hll_bench(runner& r);
+void run_cms_bench(runner& r);
+void run_fuse_bench(runner& r);
+
+} // namespace bench
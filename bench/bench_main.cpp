@@ -0,0 +1,38 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+
+#include "bench.hpp"
+
+// usage: probkit_bench [--filter=<substring>] [--min-time-ms=<ms>]
+auto main(int argc, char** argv) -> int {
+  bench::options opt{};
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view a{argv[i]};
+    if (a.starts_with("--filter=")) {
+      opt.filter = a.substr(std::string_view{"--filter="}.size());
+    } else if (a.starts_with("--min-time-ms=")) {
+      const auto v = a.substr(std::string_view{"--min-time-ms="}.size());
+      unsigned ms = 0;
+      const auto [p, ec] = std::from_chars(v.data(), v.data() + v.size(), ms);
+      if (ec != std::errc{} || p != v.data() + v.size()) {
+        std::fputs("error: invalid --min-time-ms\n", stderr);
+        return 2;
+      }
+      opt.min_time = std::chrono::milliseconds(ms);
+    } else {
+      std::fputs("usage: probkit_bench [--filter=<substring>] [--min-time-ms=<ms>]\n", stderr);
+      return a == "--help" ? 0 : 2;
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  bench::runner r{opt};
+  bench::run_hash_bench(r);
+  bench::run_bloom_bench(r);
+  bench::run_hll_bench(r);
+  bench::run_cms_bench(r);
+  bench::run_fuse_bench(r);
+  return 0;
+}
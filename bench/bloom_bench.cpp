@@ -0,0 +1,62 @@
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "probkit/bloom.hpp"
+
+using probkit::bloom::filter;
+using probkit::bloom::Layout;
+
+namespace bench {
+
+void run_bloom_bench(runner& r) {
+  struct tier {
+    const char* name;
+    std::size_t bytes;
+  };
+  // Filter sizes chosen to sit in L1, in L3, and well past any last-level cache
+  constexpr std::array<tier, 3> kTiers{tier{"l1", std::size_t{32} << 10U}, tier{"l3", std::size_t{4} << 20U},
+                                       tier{"dram", std::size_t{256} << 20U}};
+  constexpr std::size_t kKeys = std::size_t{1} << 16U;
+  const auto keys = make_keys(kKeys, 16, 7);
+  const auto absent = make_keys(kKeys, 16, 8);
+  // Lookups alternate inserted and never-inserted keys
+  std::vector<std::string_view> probes;
+  probes.reserve(2U * kKeys);
+  for (std::size_t i = 0; i < kKeys; ++i) {
+    probes.push_back(keys.views[i]);
+    probes.push_back(absent.views[(i * 7919U) % kKeys]);
+  }
+
+  for (const Layout layout : {Layout::standard, Layout::blocked}) {
+    for (const tier& t : kTiers) {
+      auto made = layout == Layout::blocked ? filter::make_blocked_by_mem(t.bytes) : filter::make_by_mem(t.bytes);
+      if (!made) {
+        continue;
+      }
+      filter f = std::move(made.value());
+      const std::string params = std::string("layout=") + (layout == Layout::blocked ? "blocked" : "standard") +
+                                 ",tier=" + t.name + ",bytes=" + std::to_string(f.byte_size());
+      const double bpk = static_cast<double>(f.byte_size()) / static_cast<double>(kKeys);
+
+      r.run("bloom.add", params, kKeys, bpk, [&]() -> void {
+        for (const auto k : keys.views) {
+          (void)f.add(k);
+        }
+      });
+      r.run("bloom.add_batch", params, kKeys, bpk, [&]() -> void { (void)f.add_batch(keys.views); });
+      r.run("bloom.might_contain", params, probes.size(), bpk, [&]() -> void {
+        std::size_t hits = 0;
+        for (const auto k : probes) {
+          hits += f.might_contain(k).value() ? 1U : 0U;
+        }
+        do_not_optimize(hits);
+      });
+    }
+  }
+}
+
+} // namespace bench
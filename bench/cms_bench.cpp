@@ -0,0 +1,81 @@
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#include "bench.hpp"
+#include "probkit/cms.hpp"
+
+using probkit::cms::CounterWidth;
+using probkit::cms::sketch;
+using probkit::cms::UpdateRule;
+
+namespace bench {
+
+namespace {
+
+constexpr std::size_t kKeys = std::size_t{1} << 16U;
+
+void bench_config(runner& r, const probkit::cms::Config& cfg, const std::string& params, const key_set& keys,
+                  const key_set& other_keys) {
+  auto a = sketch::make(cfg);
+  auto b = sketch::make(cfg);
+  if (!a || !b) {
+    return;
+  }
+  sketch s = std::move(a.value());
+  sketch other = std::move(b.value());
+  (void)other.inc_batch(other_keys.views);
+  const double bpk = static_cast<double>(s.byte_size()) / static_cast<double>(kKeys);
+
+  r.run("cms.inc", params, kKeys, bpk, [&]() -> void {
+    for (const auto k : keys.views) {
+      (void)s.inc(k);
+    }
+  });
+  r.run("cms.inc_batch", params, kKeys, bpk, [&]() -> void { (void)s.inc_batch(keys.views); });
+  r.run("cms.estimate", params, kKeys, bpk, [&]() -> void {
+    std::uint64_t acc = 0;
+    for (const auto k : keys.views) {
+      acc += s.estimate(k).value();
+    }
+    do_not_optimize(acc);
+  });
+  r.run("cms.merge", params, 1, bpk, [&]() -> void { (void)s.merge(other); });
+}
+
+auto format_double(double v) -> std::string {
+  std::array<char, 32> buf{};
+  std::snprintf(buf.data(), buf.size(), "%g", v);
+  return buf.data();
+}
+
+} // namespace
+
+void run_cms_bench(runner& r) {
+  const auto keys = make_keys(kKeys, 16, 5);
+  const auto other_keys = make_keys(kKeys, 16, 6);
+  for (const double eps : {1e-2, 1e-3, 1e-4}) {
+    for (const double delta : {1e-2, 1e-4}) {
+      bench_config(r, probkit::cms::Config{.eps = eps, .delta = delta},
+                   "eps=" + format_double(eps) + ",delta=" + format_double(delta) + ",counter_bits=64,update=standard",
+                   keys, other_keys);
+    }
+  }
+  // Counter width and update rule variants at the CLI defaults
+  for (const CounterWidth w : {CounterWidth::u32, CounterWidth::u16}) {
+    bench_config(r, probkit::cms::Config{.eps = 1e-3, .delta = 1e-4, .counter_width = w},
+                 "eps=0.001,delta=0.0001,counter_bits=" + std::to_string(8U * static_cast<unsigned>(w)) +
+                     ",update=standard",
+                 keys, other_keys);
+  }
+  for (const CounterWidth w : {CounterWidth::u64, CounterWidth::u32}) {
+    const probkit::cms::Config cfg{.eps = 1e-3, .delta = 1e-4, .counter_width = w, .update = UpdateRule::conservative};
+    bench_config(r, cfg,
+                 "eps=0.001,delta=0.0001,counter_bits=" + std::to_string(8U * static_cast<unsigned>(w)) +
+                     ",update=conservative",
+                 keys, other_keys);
+  }
+}
+
+} // namespace bench
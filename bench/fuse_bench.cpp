@@ -0,0 +1,70 @@
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "probkit/fuse.hpp"
+
+using probkit::fuse::Config;
+using probkit::fuse::filter;
+using probkit::fuse::Fingerprint;
+
+namespace bench {
+
+void run_fuse_bench(runner& r) {
+  struct tier {
+    const char* name;
+    std::size_t keys;
+  };
+  // Key counts whose f8 tables sit in L2, in L3, and past any last-level cache (keys fit SSO strings)
+  constexpr std::array<tier, 3> kTiers{tier{"l2", std::size_t{1} << 15U}, tier{"l3", std::size_t{1} << 19U},
+                                       tier{"dram", std::size_t{1} << 24U}};
+  constexpr std::size_t kProbes = std::size_t{1} << 16U;
+  const auto absent = make_keys(kProbes, 12, 8);
+
+  for (const tier& t : kTiers) {
+    const auto keys = make_keys(t.keys, 12, 7);
+    // Lookups alternate members and never-inserted keys
+    std::vector<std::string_view> probes;
+    probes.reserve(2U * kProbes);
+    for (std::size_t i = 0; i < kProbes; ++i) {
+      probes.push_back(keys.views[(i * 7919U) % t.keys]);
+      probes.push_back(absent.views[i]);
+    }
+    const auto out = std::make_unique<bool[]>(probes.size()); // NOLINT(*-avoid-c-arrays)
+    for (const Fingerprint fp : {Fingerprint::f8, Fingerprint::f16}) {
+      const std::string params = std::string("fingerprint=") + (fp == Fingerprint::f8 ? "8" : "16") +
+                                 ",tier=" + t.name + ",keys=" + std::to_string(t.keys);
+      auto made = filter::build(keys.views, Config{.fingerprint = fp});
+      if (!made) {
+        continue;
+      }
+      const filter f = std::move(made.value());
+      const double bpk = static_cast<double>(f.byte_size()) / static_cast<double>(t.keys);
+
+      if (t.keys <= (std::size_t{1} << 19U)) { // building the largest tier repeatedly takes too long
+        r.run("fuse.build", params, t.keys, bpk, [&]() -> void {
+          auto g = filter::build(keys.views, Config{.fingerprint = fp});
+          do_not_optimize(g);
+        });
+      }
+      r.run("fuse.might_contain", params, probes.size(), bpk, [&]() -> void {
+        std::size_t hits = 0;
+        for (const auto k : probes) {
+          hits += f.might_contain(k).value() ? 1U : 0U;
+        }
+        do_not_optimize(hits);
+      });
+      r.run("fuse.might_contain_batch", params, probes.size(), bpk, [&]() -> void {
+        (void)f.might_contain_batch(probes, std::span<bool>(out.get(), probes.size()));
+        do_not_optimize(out[0]);
+      });
+    }
+  }
+}
+
+} // namespace bench
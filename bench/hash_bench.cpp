@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "probkit/hash.hpp"
+
+using probkit::hashing::HashConfig;
+using probkit::hashing::HashKind;
+
+namespace bench {
+
+void run_hash_bench(runner& r) {
+  constexpr std::array<std::size_t, 8> kLengths{8, 16, 32, 64, 128, 256, 1024, 4096};
+  constexpr std::size_t kSetBytes = std::size_t{1} << 20U; // keep each key set cache-resident
+  for (const HashKind kind : {HashKind::wyhash, HashKind::xxhash, HashKind::xxh3, HashKind::aes}) {
+    const HashConfig cfg{.kind = kind, .seed = 1, .thread_salt = 0};
+    for (const std::size_t len : kLengths) {
+      const std::size_t n = std::clamp<std::size_t>(kSetBytes / len, 256, 4096);
+      const auto keys = make_keys(n, len, len);
+      const std::string params =
+          "kind=" + std::string(probkit::hashing::to_string(kind)) + ",len=" + std::to_string(len);
+      const auto bpk = static_cast<double>(len);
+
+      r.run("hash.hash64", params, n, bpk, [&]() -> void {
+        std::uint64_t acc = 0;
+        for (const auto k : keys.views) {
+          acc ^= probkit::hashing::hash64(k, cfg);
+        }
+        do_not_optimize(acc);
+      });
+
+      std::vector<std::uint64_t> out(n);
+      r.run("hash.hash64_batch", params, n, bpk, [&]() -> void {
+        probkit::hashing::hash64_batch(keys.views, cfg, out);
+        do_not_optimize(out);
+      });
+    }
+  }
+}
+
+} // namespace bench
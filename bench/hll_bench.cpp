@@ -0,0 +1,62 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bench.hpp"
+#include "probkit/hll.hpp"
+
+using probkit::hll::Encoding;
+using probkit::hll::sketch;
+
+namespace bench {
+
+void run_hll_bench(runner& r) {
+  constexpr std::array<std::uint8_t, 5> kPrecisions{10, 12, 14, 16, 18};
+  constexpr std::size_t kKeys = std::size_t{1} << 16U;
+  const auto keys = make_keys(kKeys, 16, 3);
+  const auto other_keys = make_keys(kKeys, 16, 4);
+
+  for (const std::uint8_t p : kPrecisions) {
+    for (const Encoding enc : {Encoding::dense, Encoding::packed}) {
+      const probkit::hll::Config cfg{.precision = p, .encoding = enc};
+      auto a = sketch::make(cfg);
+      auto b = sketch::make(cfg);
+      if (!a || !b) {
+        continue;
+      }
+      sketch s = std::move(a.value());
+      sketch other = std::move(b.value());
+      (void)other.add_batch(other_keys.views);
+      const std::string params =
+          "p=" + std::to_string(p) + ",encoding=" + (enc == Encoding::packed ? "packed" : "dense");
+      const double bpk = static_cast<double>(s.byte_size()) / static_cast<double>(kKeys);
+
+      r.run("hll.add", params, kKeys, bpk, [&]() -> void {
+        for (const auto k : keys.views) {
+          (void)s.add(k);
+        }
+      });
+      r.run("hll.add_batch", params, kKeys, bpk, [&]() -> void { (void)s.add_batch(keys.views); });
+      r.run("hll.estimate", params, 1, bpk, [&]() -> void {
+        const double e = s.estimate().value();
+        do_not_optimize(e);
+      });
+      r.run("hll.merge", params, 1, bpk, [&]() -> void { (void)s.merge(other); });
+    }
+
+    // O(1) estimates from the maintained rank histogram
+    auto t = sketch::make(probkit::hll::Config{.precision = p, .track_estimate = true});
+    if (t) {
+      sketch s = std::move(t.value());
+      (void)s.add_batch(keys.views);
+      const double bpk = static_cast<double>(s.byte_size()) / static_cast<double>(kKeys);
+      r.run("hll.estimate", "p=" + std::to_string(p) + ",encoding=dense,track_estimate=1", 1, bpk, [&]() -> void {
+        const double e = s.estimate().value();
+        do_not_optimize(e);
+      });
+    }
+  }
+}
+
+} // namespace bench
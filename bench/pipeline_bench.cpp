@@ -0,0 +1,311 @@
+// End-to-end pipeline benchmark: runs the CLI subcommands in-process (the same reader -> spsc_ring ->
+// worker -> merge code as `probkit hll|cms|bloom`) over synthetic key streams, sweeping thread count
+// and ring capacity. One JSON line per configuration on stdout:
+//   {"bench":"pipeline.hll","params":"dist=zipf,len=16,mode=ring,threads=2,ring=16","lines":..,
+//    "wall_s":..,"lines_per_s":..,"reader_cpu_s":..,"worker_cpu_s":..,"other_cpu_s":..,"scaling_efficiency":..}
+// other_cpu_s is the calling thread's share outside the stages (setup, final merge and output); a
+// one-worker run processes lines inline on the calling thread, so all of its time lands there.
+// scaling_efficiency compares lines/s per thread against the smallest thread count of the sweep.
+// mode=ring forces the reader thread over a regular file; mode=mapped (hll/cms) is the --file fast
+// path without a reader or rings, reported for comparison (no per-stage split).
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "options.hpp"
+#include "util/stage_cpu.hpp"
+
+using probkit::cli::CommandResult;
+using probkit::cli::GlobalOptions;
+
+namespace {
+
+struct sweep {
+  std::uint64_t lines{2000000};
+  std::vector<std::uint64_t> threads{1, 2, 4};
+  std::vector<std::uint64_t> rings{4, 16, 64};
+  std::vector<std::uint64_t> lengths{16, 64};
+  std::vector<std::string_view> commands{"hll", "cms", "bloom"};
+  std::vector<std::string_view> dists{"uniform", "zipf"};
+  unsigned reps{3};
+};
+
+auto parse_list(std::string_view v, std::vector<std::uint64_t>& out) -> bool {
+  out.clear();
+  while (!v.empty()) {
+    const auto comma = v.find(',');
+    const auto item = v.substr(0, comma);
+    std::uint64_t x = 0;
+    const auto [p, ec] = std::from_chars(item.data(), item.data() + item.size(), x);
+    if (ec != std::errc{} || p != item.data() + item.size() || x == 0U) {
+      return false;
+    }
+    out.push_back(x);
+    v = comma == std::string_view::npos ? std::string_view{} : v.substr(comma + 1U);
+  }
+  return !out.empty();
+}
+
+auto parse_words(std::string_view v, std::vector<std::string_view>& out) -> bool {
+  out.clear();
+  while (!v.empty()) {
+    const auto comma = v.find(',');
+    out.push_back(v.substr(0, comma));
+    v = comma == std::string_view::npos ? std::string_view{} : v.substr(comma + 1U);
+  }
+  return !out.empty();
+}
+
+// Writes `lines` keys drawn from lines/4 distinct keys of length len: uniformly or Zipf(1.0)
+auto write_stream(const std::string& path, std::string_view dist, std::uint64_t lines, std::size_t len) -> bool {
+  const std::size_t distinct = std::max<std::size_t>(1, static_cast<std::size_t>(lines / 4U));
+  const auto keys = bench::make_keys(distinct, len, len);
+  std::vector<double> cdf;
+  if (dist == "zipf") {
+    cdf.resize(distinct);
+    double sum = 0.0;
+    for (std::size_t i = 0; i < distinct; ++i) {
+      sum += 1.0 / static_cast<double>(i + 1U);
+      cdf[i] = sum;
+    }
+    for (auto& c : cdf) {
+      c /= sum;
+    }
+  }
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  std::uint64_t state = 0x243F6A8885A308D3ULL;
+  std::string buf;
+  buf.reserve(std::size_t{1} << 20U);
+  for (std::uint64_t i = 0; i < lines; ++i) {
+    // xorshift64*: cheap and good enough to pick keys
+    state ^= state >> 12U;
+    state ^= state << 25U;
+    state ^= state >> 27U;
+    const std::uint64_t r = state * 0x2545F4914F6CDD1DULL;
+    std::size_t k = 0;
+    if (cdf.empty()) {
+      k = static_cast<std::size_t>(r % distinct);
+    } else {
+      const double u = static_cast<double>(r >> 11U) * 0x1.0p-53;
+      k = static_cast<std::size_t>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+      k = std::min(k, distinct - 1U);
+    }
+    buf.append(keys.views[k]);
+    buf.push_back('\n');
+    if (buf.size() >= (std::size_t{1} << 20U)) {
+      std::fwrite(buf.data(), 1, buf.size(), f);
+      buf.clear();
+    }
+  }
+  std::fwrite(buf.data(), 1, buf.size(), f);
+  return std::fclose(f) == 0;
+}
+
+auto process_cpu_s() -> double {
+  rusage ru{};
+  getrusage(RUSAGE_SELF, &ru);
+  const auto tv = [](const timeval& t) -> double {
+    return static_cast<double>(t.tv_sec) + (static_cast<double>(t.tv_usec) * 1e-6);
+  };
+  return tv(ru.ru_utime) + tv(ru.ru_stime);
+}
+
+struct run_result {
+  double wall_s{};
+  double total_cpu_s{};
+  double reader_cpu_s{};
+  double worker_cpu_s{};
+};
+
+// Runs one subcommand with stdout sent to /dev/null (the commands print their results there)
+auto run_once(std::string_view cmd, std::vector<std::string> args, GlobalOptions g) -> run_result {
+  probkit::cli::util::stage_cpu sink;
+  g.stage_cpu = &sink;
+  std::vector<char*> argv;
+  argv.reserve(args.size());
+  for (auto& a : args) {
+    argv.push_back(a.data());
+  }
+  const int argc = static_cast<int>(argv.size());
+
+  std::fflush(stdout);
+  const int saved = dup(STDOUT_FILENO);
+  const int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+
+  const double cpu0 = process_cpu_s();
+  const auto t0 = std::chrono::steady_clock::now();
+  CommandResult rc = CommandResult::GeneralError;
+  if (cmd == "hll") {
+    rc = probkit::cli::cmd_hll(argc, argv.data(), g);
+  } else if (cmd == "cms") {
+    rc = probkit::cli::cmd_cms(argc, argv.data(), g);
+  } else if (cmd == "bloom") {
+    rc = probkit::cli::cmd_bloom(argc, argv.data(), g);
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  const double cpu1 = process_cpu_s();
+
+  std::fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  if (rc != CommandResult::Success) {
+    std::fprintf(stderr, "error: %.*s failed\n", static_cast<int>(cmd.size()), cmd.data());
+  }
+  return run_result{.wall_s = std::chrono::duration<double>(t1 - t0).count(),
+                    .total_cpu_s = cpu1 - cpu0,
+                    .reader_cpu_s = static_cast<double>(sink.reader_ns.load()) * 1e-9,
+                    .worker_cpu_s = static_cast<double>(sink.worker_ns.load()) * 1e-9};
+}
+
+auto command_args(std::string_view cmd, std::uint64_t lines) -> std::vector<std::string> {
+  if (cmd == "cms") {
+    return {"--topk=10"};
+  }
+  if (cmd == "bloom") {
+    return {"--action=dedup", "--fp=0.01", "--capacity-hint=" + std::to_string(lines / 4U)};
+  }
+  return {};
+}
+
+void report(std::string_view cmd, const std::string& params, std::uint64_t lines, const run_result& r, bool staged,
+            double efficiency) {
+  const double lps = static_cast<double>(lines) / r.wall_s;
+  std::printf(R"({"bench":"pipeline.%.*s","params":"%s","lines":%llu,"wall_s":%.4f,"lines_per_s":%.0f,)",
+              static_cast<int>(cmd.size()), cmd.data(), params.c_str(), static_cast<unsigned long long>(lines),
+              r.wall_s, lps);
+  if (staged) {
+    std::printf(R"("reader_cpu_s":%.4f,"worker_cpu_s":%.4f,"other_cpu_s":%.4f,)", r.reader_cpu_s, r.worker_cpu_s,
+                std::max(0.0, r.total_cpu_s - r.reader_cpu_s - r.worker_cpu_s));
+  } else {
+    std::printf(R"("total_cpu_s":%.4f,)", r.total_cpu_s);
+  }
+  std::printf(R"("scaling_efficiency":%.3f})"
+              "\n",
+              efficiency);
+  std::fflush(stdout);
+}
+
+auto best_of(unsigned reps, std::string_view cmd, std::uint64_t lines, const GlobalOptions& g) -> run_result {
+  run_result best{};
+  for (unsigned i = 0; i < reps; ++i) {
+    const run_result r = run_once(cmd, command_args(cmd, lines), g);
+    if (i == 0 || r.wall_s < best.wall_s) {
+      best = r;
+    }
+  }
+  return best;
+}
+
+void run_sweep(const sweep& sw) {
+  std::error_code ec;
+  const auto dir = std::filesystem::temp_directory_path(ec);
+  for (const auto dist : sw.dists) {
+    for (const std::uint64_t len : sw.lengths) {
+      const std::string path =
+          (dir / ("probkit_pipeline_" + std::string(dist) + "_" + std::to_string(len) + ".txt")).string();
+      if (!write_stream(path, dist, sw.lines, static_cast<std::size_t>(len))) {
+        std::fprintf(stderr, "error: cannot write %s\n", path.c_str());
+        continue;
+      }
+      const std::string stream = "dist=" + std::string(dist) + ",len=" + std::to_string(len);
+      for (const auto cmd : sw.commands) {
+        for (const std::uint64_t ring : sw.rings) {
+          double base = 0.0; // lines/s per thread at the first thread count
+          for (const std::uint64_t t : sw.threads) {
+            GlobalOptions g{};
+            g.threads = static_cast<int>(t);
+            g.file_path = path;
+            g.stop_after = sw.lines; // a line limit keeps regular files on the reader -> ring path
+            g.ring_batches = static_cast<std::size_t>(ring);
+            const run_result r = best_of(sw.reps, cmd, sw.lines, g);
+            const double per_thread = static_cast<double>(sw.lines) / r.wall_s / static_cast<double>(t);
+            base = base == 0.0 ? per_thread : base;
+            report(cmd, stream + ",mode=ring,threads=" + std::to_string(t) + ",ring=" + std::to_string(ring),
+                   sw.lines, r, true, per_thread / base);
+          }
+        }
+        if (cmd == "bloom") {
+          continue; // dedup has no mapped path
+        }
+        double base = 0.0;
+        for (const std::uint64_t t : sw.threads) {
+          GlobalOptions g{};
+          g.threads = static_cast<int>(t);
+          g.file_path = path;
+          const run_result r = best_of(sw.reps, cmd, sw.lines, g);
+          const double per_thread = static_cast<double>(sw.lines) / r.wall_s / static_cast<double>(t);
+          base = base == 0.0 ? per_thread : base;
+          report(cmd, stream + ",mode=mapped,threads=" + std::to_string(t), sw.lines, r, false, per_thread / base);
+        }
+      }
+      std::filesystem::remove(path, ec);
+    }
+  }
+}
+
+constexpr std::string_view kUsage =
+    "usage: probkit_pipeline_bench [--lines=<n>] [--threads=<n,..>] [--ring=<batches,..>] [--len=<bytes,..>]\n"
+    "                              [--cmd=hll,cms,bloom] [--dist=uniform,zipf] [--reps=<n>]\n";
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+  sweep sw;
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view a{argv[i]};
+    const auto value = [&a](std::string_view flag) -> std::string_view { return a.substr(flag.size()); };
+    std::vector<std::uint64_t> one;
+    bool ok = true;
+    if (a.starts_with("--lines=")) {
+      ok = parse_list(value("--lines="), one) && one.size() == 1U;
+      sw.lines = ok ? one[0] : 0U;
+    } else if (a.starts_with("--threads=")) {
+      ok = parse_list(value("--threads="), sw.threads);
+    } else if (a.starts_with("--ring=")) {
+      ok = parse_list(value("--ring="), sw.rings);
+    } else if (a.starts_with("--len=")) {
+      ok = parse_list(value("--len="), sw.lengths);
+    } else if (a.starts_with("--cmd=")) {
+      ok = parse_words(value("--cmd="), sw.commands) &&
+           std::all_of(sw.commands.begin(), sw.commands.end(),
+                       [](std::string_view c) -> bool { return c == "hll" || c == "cms" || c == "bloom"; });
+    } else if (a.starts_with("--dist=")) {
+      ok = parse_words(value("--dist="), sw.dists) &&
+           std::all_of(sw.dists.begin(), sw.dists.end(),
+                       [](std::string_view d) -> bool { return d == "uniform" || d == "zipf"; });
+    } else if (a.starts_with("--reps=")) {
+      ok = parse_list(value("--reps="), one) && one.size() == 1U;
+      sw.reps = ok ? static_cast<unsigned>(one[0]) : 0U;
+    } else {
+      std::fputs(kUsage.data(), a == "--help" ? stdout : stderr);
+      return a == "--help" ? 0 : 2;
+    }
+    if (!ok) {
+      std::fprintf(stderr, "error: invalid %.*s\n%s", static_cast<int>(a.size()), a.data(), kUsage.data());
+      return 2;
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  run_sweep(sw);
+  return 0;
+}
@@ -1,16 +1,26 @@
 #include "options.hpp"
 #include "probkit/bloom.hpp"
+#include "probkit/fuse.hpp"
 #include "probkit/hash.hpp"
+#include "util/affinity.hpp"
+#include "util/fixed_dispatch.hpp"
+#include "util/line_reader.hpp"
+#include "util/mapped_input.hpp"
+#include "util/metrics.hpp"
 #include "util/parse.hpp"
 #include "util/spsc_ring.hpp"
 #include "util/string_utils.hpp"
 #include "util/threads.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
-#include <iostream>
+#include <memory>
 #include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -18,11 +28,12 @@
 
 using probkit::cli::CommandResult;
 using probkit::cli::util::decide_num_workers;
+using probkit::cli::util::line_batch;
+using probkit::cli::util::line_reader;
 using probkit::cli::util::parse_double;
 using probkit::cli::util::parse_u64;
 using probkit::cli::util::spsc_ring;
 using probkit::cli::util::sv_starts_with;
-using probkit::hashing::hash64;
 
 namespace probkit::cli {
 
@@ -35,17 +46,52 @@ struct BloomOptions {
   std::uint64_t mem{0};
   bool have_cap{false};
   std::uint64_t cap{0};
-  enum class Action : std::uint8_t { none, dedup };
+  // query/exclude print the lines a --filter holds / does not hold
+  enum class Action : std::uint8_t { none, dedup, query, exclude };
   Action action{Action::none};
+  // --build: a static fuse filter from every input line, written to --save
+  enum class Build : std::uint8_t { none, fuse8, fuse16 };
+  Build build{Build::none};
+  std::string filter_path; // saved bloom or fuse filter to query
+  probkit::bloom::Layout layout{probkit::bloom::Layout::standard};
+  hashing::IndexMap index_map{hashing::IndexMap::modulo};
+  std::string load_path; // start from a saved filter instead of sizing a new one
+  std::string save_path;
+  std::size_t partitions{0}; // --partitions of a new filter; 0 picks the default for the action
 };
 
+// Partitions of a new dedup filter without --partitions. Fixed rather than taken from --threads, so
+// images saved on machines with different core counts share a geometry and merge; workers take
+// partitions round-robin, so up to this many of them run in parallel
+constexpr std::size_t kDefaultDedupPartitions = 16;
+constexpr std::size_t kMaxPartitions = 4096;
+
 constexpr std::string_view kFP = "--fp=";
 constexpr std::string_view kCAP = "--capacity-hint=";
 constexpr std::string_view kMEM = "--mem-budget=";
 constexpr std::string_view kACT = "--action=";
+constexpr std::string_view kLAYOUT = "--layout=";
+constexpr std::string_view kINDEX_MAP = "--index-map=";
+constexpr std::string_view kLOAD = "--load=";
+constexpr std::string_view kSAVE = "--save=";
+constexpr std::string_view kBUILD = "--build=";
+constexpr std::string_view kFILTER = "--filter=";
+constexpr std::string_view kPARTITIONS = "--partitions=";
 
 inline void print_usage() {
-  std::fputs("usage: probkit bloom [--fp=<p> [--capacity-hint=<n>]] | [--mem-budget=<bytes>] [--action=dedup]\n",
+  std::fputs("usage: probkit bloom [--fp=<p> [--capacity-hint=<n>]] | [--mem-budget=<bytes>] [--action=dedup]\n"
+             "                     [--layout=standard|blocked] [--index-map=modulo|pow2|fastrange]\n"
+             "                     [--partitions=<n>] [--load=<file>] [--save=<file>]\n"
+             "       probkit bloom --build=fuse8|fuse16 --save=<file>\n"
+             "       probkit bloom --filter=<file> --action=query|exclude\n"
+             "  --partitions splits a new filter into n partitions (dedup default 16, else 1); the count is\n"
+             "  part of the saved geometry and does not follow --threads, so images built anywhere with one\n"
+             "  setting merge. Dedup workers take partitions round-robin, so a filter runs with at most as\n"
+             "  many workers as it has partitions\n"
+             "  --build makes a static binary fuse filter of the input lines (about 9 bits/key at FP 2^-8 for\n"
+             "  fuse8, 18 bits/key at 2^-16 for fuse16), built a partition per worker for large key sets\n"
+             "  --filter maps a saved bloom or fuse filter read-only; query prints the input lines it may\n"
+             "  hold, exclude those it does not\n",
              stdout);
 }
 
@@ -106,6 +152,10 @@ auto parse_bloom_options(const std::vector<std::string_view>& args) -> BloomOpti
       auto v = arg.substr(kACT.size());
       if (v == std::string_view{"dedup"}) {
         opts.action = BloomOptions::Action::dedup;
+      } else if (v == std::string_view{"query"}) {
+        opts.action = BloomOptions::Action::query;
+      } else if (v == std::string_view{"exclude"}) {
+        opts.action = BloomOptions::Action::exclude;
       } else {
         std::fputs("error: invalid --action\n", stderr);
         opts.show_help = true;
@@ -113,55 +163,107 @@ auto parse_bloom_options(const std::vector<std::string_view>& args) -> BloomOpti
       }
       continue;
     }
+    if (sv_starts_with(arg, kLAYOUT)) {
+      auto v = arg.substr(kLAYOUT.size());
+      if (v == std::string_view{"standard"}) {
+        opts.layout = probkit::bloom::Layout::standard;
+      } else if (v == std::string_view{"blocked"}) {
+        opts.layout = probkit::bloom::Layout::blocked;
+      } else {
+        std::fputs("error: invalid --layout\n", stderr);
+        opts.show_help = true;
+        break;
+      }
+      continue;
+    }
+    if (sv_starts_with(arg, kINDEX_MAP)) {
+      if (!hashing::parse_index_map(arg.substr(kINDEX_MAP.size()), opts.index_map)) {
+        std::fputs("error: invalid --index-map\n", stderr);
+        opts.show_help = true;
+        break;
+      }
+      continue;
+    }
+    if (sv_starts_with(arg, kLOAD)) {
+      opts.load_path = std::string(arg.substr(kLOAD.size()));
+      continue;
+    }
+    if (sv_starts_with(arg, kPARTITIONS)) {
+      std::uint64_t value = 0;
+      if (!parse_u64(arg.substr(kPARTITIONS.size()), value) || value == 0U || value > kMaxPartitions) {
+        std::fputs("error: invalid --partitions\n", stderr);
+        opts.show_help = true;
+        break;
+      }
+      opts.partitions = static_cast<std::size_t>(value);
+      continue;
+    }
+    if (sv_starts_with(arg, kSAVE)) {
+      opts.save_path = std::string(arg.substr(kSAVE.size()));
+      continue;
+    }
+    if (sv_starts_with(arg, kBUILD)) {
+      auto v = arg.substr(kBUILD.size());
+      if (v == std::string_view{"fuse8"}) {
+        opts.build = BloomOptions::Build::fuse8;
+      } else if (v == std::string_view{"fuse16"}) {
+        opts.build = BloomOptions::Build::fuse16;
+      } else {
+        std::fputs("error: invalid --build (expected fuse8|fuse16)\n", stderr);
+        opts.show_help = true;
+        break;
+      }
+      continue;
+    }
+    if (sv_starts_with(arg, kFILTER)) {
+      opts.filter_path = std::string(arg.substr(kFILTER.size()));
+      continue;
+    }
   }
   return opts;
 }
 
-inline auto make_filter_from(const BloomOptions& opt, const hashing::HashConfig& h)
-    -> probkit::result<probkit::bloom::filter> {
+inline auto make_filter_from(const BloomOptions& opt, const hashing::HashConfig& h, std::size_t partitions = 1,
+                             probkit::AllocPolicy alloc = {}) -> probkit::result<probkit::bloom::filter> {
+  probkit::bloom::Config c{};
+  c.alloc = alloc;
+  c.layout = opt.layout;
+  c.index_map = opt.index_map;
+  c.partitions = partitions;
   if (opt.have_fp) {
+    c.fp = opt.fp;
     if (opt.have_cap) {
-      return probkit::bloom::filter::make_by_fp(opt.fp, h, static_cast<std::size_t>(opt.cap));
+      c.capacity_hint = static_cast<std::size_t>(opt.cap);
     }
-    return probkit::bloom::filter::make_by_fp(opt.fp, h);
+    return probkit::bloom::filter::make(c, h);
   }
-  if (opt.have_mem) {
-    return probkit::bloom::filter::make_by_mem(static_cast<std::size_t>(opt.mem), h);
+  if (opt.have_mem && opt.mem > 0U) {
+    c.mem_budget_bytes = static_cast<std::size_t>(opt.mem);
+    return probkit::bloom::filter::make(c, h);
   }
   return probkit::result<probkit::bloom::filter>::from_error(
       probkit::make_error(probkit::errc::invalid_argument, "missing args"));
 }
 
-struct LineItem {
-  std::string data;
+// Dedup must route every occurrence of a key to the worker owning its filter partition, so the reader
+// splits each block by partition; the shards' views share the block's bytes
+struct sharded_block {
+  std::shared_ptr<const util::line_block> block;
+  std::vector<std::vector<std::string_view>> shards;
 };
 
-inline auto open_input(const GlobalOptions& g, std::ifstream& file_in, std::istream*& in) -> bool {
-  if (g.file_path.empty() || g.file_path == "-") {
-    in = &std::cin;
-    return true;
-  }
-  file_in.open(g.file_path, std::ios::in);
-  if (!file_in.is_open()) {
-    std::fputs("error: failed to open --file\n", stderr);
+inline auto open_input(const GlobalOptions& g, line_reader& in) -> bool {
+  if (!in.open(input_spec_from(g))) {
+    std::fputs("error: failed to open input\n", stderr);
     return false;
   }
-  in = &file_in;
+  in.set_line_limit(g.stop_after);
   return true;
 }
 
-inline void dispatch_line(spsc_ring<LineItem>& ring, const std::string& line) {
-  using namespace std::chrono_literals;
-  int spins = 0;
-  while (!ring.try_emplace(line)) {
-    if (spins < 16) {
-      std::this_thread::yield();
-      ++spins;
-    } else {
-      std::this_thread::sleep_for(50us);
-    }
-  }
-}
+auto run_bloom(const BloomOptions& opt, const GlobalOptions& g, probkit::bloom::filter f) -> CommandResult;
+auto run_fuse_build(const BloomOptions& opt, const GlobalOptions& g) -> CommandResult;
+auto run_query(const BloomOptions& opt, const GlobalOptions& g) -> CommandResult;
 } // end anonymous namespace
 
 auto cmd_bloom_sv(const std::vector<std::string_view>& args, const hashing::HashConfig& default_hash) -> CommandResult {
@@ -235,57 +337,122 @@ auto cmd_bloom(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
     return CommandResult::GeneralError;
   }
 
+  const bool querying = opt.action == BloomOptions::Action::query || opt.action == BloomOptions::Action::exclude;
+  if (querying != !opt.filter_path.empty()) {
+    std::fputs("error: --action=query|exclude and --filter=<file> go together\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  if (querying) {
+    return run_query(opt, g);
+  }
+  if (opt.build != BloomOptions::Build::none) {
+    if (opt.save_path.empty() || opt.action != BloomOptions::Action::none || !opt.load_path.empty() ||
+        opt.partitions != 0U) {
+      std::fputs("error: --build needs --save=<file> and takes no --action, --load or --partitions\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    return run_fuse_build(opt, g);
+  }
+
   const auto hash = g.hash;
-  auto r = make_filter_from(opt, hash);
+  if (!opt.load_path.empty()) {
+    if (opt.partitions != 0U) {
+      std::fputs("error: --partitions sizes a new filter and takes no --load\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    // Copy-on-write: dedup updates stay private to this run until --save writes them out
+    auto loaded = probkit::bloom::filter::load(opt.load_path, {.mode = serialize::LoadMode::map_copy_on_write});
+    if (!loaded) {
+      std::fprintf(stderr, "error: failed to load %s: %s\n", opt.load_path.c_str(), loaded.error().message().c_str());
+      return CommandResult::IOError;
+    }
+    return run_bloom(opt, g, std::move(loaded.value()));
+  }
+  // Threaded dedup gives every worker its own partitions of the one filter, sized from the same budget.
+  // The default never splits a --mem-budget below one cache line per partition
+  std::size_t partitions = opt.partitions;
+  if (partitions == 0U && opt.action == BloomOptions::Action::dedup) {
+    partitions = kDefaultDedupPartitions;
+    if (!opt.have_fp && opt.have_mem) {
+      partitions = std::clamp<std::size_t>(static_cast<std::size_t>(opt.mem / 64U), 1U, partitions);
+    }
+  }
+  partitions = std::max<std::size_t>(partitions, 1U);
+  auto r = make_filter_from(opt, hash, partitions, alloc_policy_from(g));
   if (!r) {
     if (!opt.have_fp && !opt.have_mem) {
       std::fputs("error: missing args (specify --fp or --mem-budget)\n", stderr);
     } else {
-      std::fputs("error: failed to build bloom filter\n", stderr);
+      std::fprintf(stderr, "error: failed to build bloom filter: %s\n", r.error().message().c_str());
     }
     return CommandResult::GeneralError;
   }
-  probkit::bloom::filter f = std::move(r.value());
+  return run_bloom(opt, g, std::move(r.value()));
+}
+
+namespace {
+inline auto save_filter(const BloomOptions& opt, const probkit::bloom::filter& f) -> CommandResult {
+  if (opt.save_path.empty()) {
+    return CommandResult::Success;
+  }
+  auto saved = f.save(opt.save_path);
+  if (!saved) {
+    std::fprintf(stderr, "error: failed to save %s: %s\n", opt.save_path.c_str(), saved.error().message().c_str());
+    return CommandResult::IOError;
+  }
+  return CommandResult::Success;
+}
+
+auto run_bloom(const BloomOptions& opt, const GlobalOptions& g, probkit::bloom::filter f) -> CommandResult {
   if (opt.action != BloomOptions::Action::dedup) {
+    const bool blocked = f.layout() == probkit::bloom::Layout::blocked;
     if (g.json) {
-      std::fprintf(stdout, "{\"m_bits\":%zu,\"k\":%u}\n", f.bit_size(), static_cast<unsigned>(f.k()));
+      std::fprintf(stdout, "{\"m_bits\":%zu,\"k\":%u,\"layout\":\"%s\"}\n", f.bit_size(), static_cast<unsigned>(f.k()),
+                   blocked ? "blocked" : "standard");
     } else {
-      std::fprintf(stdout, "bloom: m_bits=%zu k=%u\n", f.bit_size(), static_cast<unsigned>(f.k()));
+      std::fprintf(stdout, "bloom: m_bits=%zu k=%u%s\n", f.bit_size(), static_cast<unsigned>(f.k()),
+                   blocked ? " layout=blocked" : "");
     }
-    return CommandResult::Success;
+    return save_filter(opt, f);
   }
 
-  // dedup streaming: single-thread path, then multi-thread sharded path
+  // dedup streaming: single-thread path, then multi-thread partitioned path
   {
-    const int num_workers = decide_num_workers(g.threads);
+    // Worker w owns the partitions p with p % workers == w, so there are never more workers than partitions
+    const int num_workers = static_cast<int>(std::min<std::size_t>(
+        static_cast<std::size_t>(decide_num_workers(g.threads, g.cpu_affinity.size())), f.partitions()));
+    // With --cpu-affinity/--numa each worker's ring is built on a thread pinned like the worker, so
+    // first touch puts its pages on that worker's node
+    const util::placement place = util::placement::make(g.cpu_affinity, g.numa);
+    util::pipeline_metrics metrics{static_cast<std::size_t>(num_workers)};
+    util::metrics_reporter reporter{metrics, report_options_from(g, "bloom")};
+    util::pipeline_metrics* const m = reporter.active() ? &metrics : nullptr;
+    util::thread_counters* const reader_counters = util::reader_counters(m);
+    const util::bloom_ops ops = util::bloom_ops_for(f);
     if (num_workers <= 1) {
-      std::ifstream file_in_local;
-      std::istream* in = nullptr;
-      if (!open_input(g, file_in_local, in)) {
+      place.pin_worker(0);
+      line_reader in;
+      if (!open_input(g, in)) {
         return CommandResult::IOError;
       }
+      metrics.set_sketch_bytes(f.byte_size());
       std::uint64_t seen = 0;
       std::uint64_t passed = 0;
-      std::string line;
-      line.reserve(256);
-      while (true) {
-        if (!std::getline(*in, line)) {
-          break;
-        }
-        ++seen;
-        auto maybe_cont = f.might_contain(line);
-        if (!maybe_cont) {
-          std::fputs("error: bloom query failed\n", stderr);
-          return CommandResult::GeneralError;
-        }
-        if (!maybe_cont.value()) {
-          (void)f.add(line);
-          std::fputs(line.c_str(), stdout);
-          std::fputc('\n', stdout);
-          ++passed;
-        }
-        if ((g.stop_after != 0U) && seen >= g.stop_after) {
-          break;
+      while (const auto blk = in.next()) {
+        util::count_lines(reader_counters, blk->lines);
+        for (const std::string_view line : blk->lines) {
+          ++seen;
+          auto maybe_cont = ops.might_contain(f, line);
+          if (!maybe_cont) {
+            std::fputs("error: bloom query failed\n", stderr);
+            return CommandResult::GeneralError;
+          }
+          if (!maybe_cont.value()) {
+            (void)ops.add(f, line);
+            std::fwrite(line.data(), 1, line.size(), stdout);
+            std::fputc('\n', stdout);
+            ++passed;
+          }
         }
       }
       if (g.json) {
@@ -297,63 +464,72 @@ auto cmd_bloom(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
                        static_cast<unsigned long long>(passed));
         }
       }
-      return CommandResult::Success;
+      return save_filter(opt, f);
     }
 
-    // Multi-thread sharded dedup
-    const std::size_t ring_capacity = 1U << 14;
-    std::vector<std::unique_ptr<spsc_ring<LineItem>>> ring_storage;
-    std::vector<spsc_ring<LineItem>*> rings;
+    // Multi-thread partitioned dedup: workers share f, each probing and setting only its own partitions
+    const std::size_t ring_capacity = g.ring_batches; // batches, each one shard of an input block
+    std::vector<std::unique_ptr<spsc_ring<line_batch>>> ring_storage;
+    std::vector<spsc_ring<line_batch>*> rings;
     ring_storage.reserve(static_cast<std::size_t>(num_workers));
     rings.reserve(static_cast<std::size_t>(num_workers));
+    const auto make_ring = [ring_capacity]() -> std::unique_ptr<spsc_ring<line_batch>> {
+      return std::make_unique<spsc_ring<line_batch>>(ring_capacity);
+    };
     for (int i = 0; i < num_workers; ++i) {
-      ring_storage.emplace_back(new spsc_ring<LineItem>(ring_capacity));
+      ring_storage.push_back(place.on_worker_node(static_cast<std::size_t>(i), make_ring));
       rings.push_back(ring_storage.back().get());
     }
 
-    std::vector<probkit::bloom::filter> locals;
-    locals.reserve(static_cast<std::size_t>(num_workers));
-    for (int i = 0; i < num_workers; ++i) {
-      hashing::HashConfig hc = g.hash;
-      const std::uint64_t thread_index = static_cast<std::uint64_t>(i) + 1ULL;
-      hc.thread_salt = probkit::hashing::derive_thread_salt(hc.seed, thread_index);
-      auto rlocal = make_filter_from(opt, hc);
-      if (!rlocal) {
-        std::fputs("error: failed to init bloom shard\n", stderr);
-        return CommandResult::ConfigError;
-      }
-      locals.emplace_back(std::move(rlocal.value()));
-    }
+    metrics.set_sketch_bytes(f.byte_size());
 
     std::mutex out_mtx;
-    std::atomic<bool> done{false};
     std::atomic<std::uint64_t> seen{0};
     std::atomic<std::uint64_t> passed{0};
 
     auto worker_fn = [&](int wi) -> void {
       auto& ring = *rings[static_cast<std::size_t>(wi)];
-      auto& flt = locals[static_cast<std::size_t>(wi)];
-      LineItem item;
+      util::thread_counters* const counters = util::worker_counters(m, static_cast<std::size_t>(wi));
+      place.pin_worker(static_cast<std::size_t>(wi));
+      line_batch item;
+      util::backoff idle{g.wait};
+      std::string out; // this batch's new lines, written under one lock
       while (true) {
-        if (ring.pop(item)) {
-          seen.fetch_add(1, std::memory_order_relaxed);
-          auto mc = flt.might_contain(item.data);
-          if (!mc) {
-            continue; // skip on error
+        if (ring.pop_n_wait(std::span<line_batch>(&item, 1), idle) != 0U) {
+          seen.fetch_add(item.lines.size(), std::memory_order_relaxed);
+          std::uint64_t fresh = 0;
+          for (const std::string_view line : item.lines) {
+            auto mc = ops.might_contain(f, line);
+            if (!mc) {
+              continue; // skip on error
+            }
+            if (!mc.value()) {
+              (void)ops.add(f, line);
+              out.append(line);
+              out.push_back('\n');
+              ++fresh;
+            }
           }
-          if (!mc.value()) {
-            (void)flt.add(item.data);
+          item = line_batch{}; // drop this worker's reference to the block
+          if (fresh != 0U) {
             std::scoped_lock lk(out_mtx);
-            std::fputs(item.data.c_str(), stdout);
-            std::fputc('\n', stdout);
-            passed.fetch_add(1, std::memory_order_relaxed);
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            passed.fetch_add(fresh, std::memory_order_relaxed);
           }
-        } else if (done.load(std::memory_order_acquire)) {
-          break;
+          out.clear();
         } else {
-          std::this_thread::sleep_for(std::chrono::microseconds(50));
+          util::count_idle(counters);
+          if (ring.closed() && ring.empty()) {
+            break;
+          }
         }
       }
+      util::charge_worker(g.stage_cpu);
+    };
+    const auto close_rings = [&rings]() -> void {
+      for (auto* r : rings) {
+        r->close();
+      }
     };
 
     std::vector<std::thread> workers;
@@ -362,27 +538,36 @@ auto cmd_bloom(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
       workers.emplace_back(worker_fn, wi);
     }
 
-    std::ifstream file_in_local;
-    std::istream* in = nullptr;
-    if (!open_input(g, file_in_local, in)) {
-      done.store(true, std::memory_order_release);
+    // This thread is the reader
+    place.pin_reader();
+    const std::uint64_t read_start = util::thread_cpu_ns();
+    line_reader in;
+    if (!open_input(g, in)) {
+      close_rings();
       for (auto& w : workers) {
         w.join();
       }
       return CommandResult::IOError;
     }
-    std::string line;
-    line.reserve(256);
-    std::uint64_t limit_counter = 0;
-    while (std::getline(*in, line)) {
-      const std::uint64_t hv = hash64(line, g.hash);
-      const int shard = static_cast<int>(hv % static_cast<std::uint64_t>(num_workers));
-      dispatch_line(*rings[static_cast<std::size_t>(shard)], line);
-      if ((g.stop_after != 0U) && ++limit_counter >= g.stop_after) {
-        break;
+    const auto shard_count = static_cast<std::size_t>(num_workers);
+    while (const auto blk = in.next()) {
+      util::count_lines(reader_counters, blk->lines);
+      auto split = std::make_shared<sharded_block>();
+      split->block = blk;
+      split->shards.resize(shard_count);
+      for (const std::string_view line : blk->lines) {
+        split->shards[f.partition_of(line) % shard_count].push_back(line);
+      }
+      const std::shared_ptr<const sharded_block> shared = split;
+      for (std::size_t w = 0; w < shard_count; ++w) {
+        if (!shared->shards[w].empty()) {
+          util::count_stall(reader_counters,
+                            rings[w]->push_wait(line_batch{.owner = shared, .lines = shared->shards[w]}, g.wait));
+        }
       }
     }
-    done.store(true, std::memory_order_release);
+    close_rings();
+    util::charge_reader(g.stage_cpu, read_start);
     for (auto& w : workers) {
       w.join();
     }
@@ -397,8 +582,196 @@ auto cmd_bloom(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
                      static_cast<unsigned long long>(passed.load()));
       }
     }
-    return CommandResult::Success;
+    return save_filter(opt, f);
+  }
+}
+
+// Below this many keys a fuse partition needs more than the asymptotic 1.125 cells per key
+constexpr std::size_t kMinFuseKeysPerPartition = 1000000;
+constexpr std::size_t kQueryFlushBytes = std::size_t{1} << 16U;
+
+// Hash every input line: on a mapped regular file each worker hashes its own range, otherwise the
+// reader hashes block by block
+auto read_key_hashes(const GlobalOptions& g, std::size_t workers, std::vector<std::uint64_t>& out) -> bool {
+  util::mapped_input mapped;
+  if (g.stop_after == 0U && mapped.open(g.file_path)) {
+    std::vector<std::vector<std::uint64_t>> parts(workers);
+    util::parallel_for_lines(mapped.bytes(), workers, g.fields,
+                             [&](std::size_t w, std::span<const std::string_view> lines) -> void {
+                               auto& v = parts[w];
+                               const std::size_t at = v.size();
+                               v.resize(at + lines.size());
+                               hashing::hash64_batch(lines, g.hash, std::span(v).subspan(at));
+                             });
+    std::size_t total = 0;
+    for (const auto& v : parts) {
+      total += v.size();
+    }
+    out.reserve(total);
+    for (auto& v : parts) {
+      out.insert(out.end(), v.begin(), v.end());
+      std::vector<std::uint64_t>().swap(v);
+    }
+    return true;
+  }
+  line_reader in;
+  if (!open_input(g, in)) {
+    return false;
+  }
+  while (const auto blk = in.next()) {
+    const std::size_t at = out.size();
+    out.resize(at + blk->lines.size());
+    hashing::hash64_batch(blk->lines, g.hash, std::span(out).subspan(at));
+  }
+  return true;
+}
+
+auto run_fuse_build(const BloomOptions& opt, const GlobalOptions& g) -> CommandResult {
+  const auto workers = static_cast<std::size_t>(decide_num_workers(g.threads, g.cpu_affinity.size()));
+  std::vector<std::uint64_t> hashes;
+  if (!read_key_hashes(g, workers, hashes)) {
+    return CommandResult::IOError;
   }
+  const probkit::fuse::Config c{
+      .fingerprint =
+          opt.build == BloomOptions::Build::fuse16 ? probkit::fuse::Fingerprint::f16 : probkit::fuse::Fingerprint::f8,
+      .partitions = std::clamp<std::size_t>(hashes.size() / kMinFuseKeysPerPartition, 1U, workers),
+      .build_threads = static_cast<unsigned>(workers)};
+  auto built = probkit::fuse::filter::build_hashed(hashes, c, g.hash);
+  if (!built) {
+    std::fprintf(stderr, "error: failed to build fuse filter: %s\n", built.error().message().c_str());
+    return CommandResult::GeneralError;
+  }
+  const probkit::fuse::filter& f = built.value();
+  if (g.json) {
+    std::fprintf(stdout, "{\"keys\":%llu,\"fingerprint_bits\":%u,\"bits_per_key\":%.3f,\"partitions\":%zu}\n",
+                 static_cast<unsigned long long>(f.size()), static_cast<unsigned>(f.fingerprint()), f.bits_per_key(),
+                 f.partitions());
+  } else {
+    std::fprintf(stdout, "fuse: keys=%llu fingerprint_bits=%u bits_per_key=%.3f partitions=%zu\n",
+                 static_cast<unsigned long long>(f.size()), static_cast<unsigned>(f.fingerprint()), f.bits_per_key(),
+                 f.partitions());
+  }
+  auto saved = f.save(opt.save_path);
+  if (!saved) {
+    std::fprintf(stderr, "error: failed to save %s: %s\n", opt.save_path.c_str(), saved.error().message().c_str());
+    return CommandResult::IOError;
+  }
+  return CommandResult::Success;
+}
+
+// Appends to out the lines whose membership is `want`, hit[i] being lines[i]'s; returns how many
+inline auto select_lines(std::span<const std::string_view> lines, std::span<const bool> hit, bool want,
+                         std::string& out) -> std::uint64_t {
+  std::uint64_t n = 0;
+  for (std::size_t i = 0; i < lines.size(); ++i) {
+    if (hit[i] == want) {
+      out.append(lines[i]);
+      out.push_back('\n');
+      ++n;
+    }
+  }
+  return n;
+}
+
+// contains(lines, hits) fills hits[i] for lines[i]. A mapped regular file is scanned on every worker
+// (output order across workers is not kept, as with threaded dedup); other input on the reader.
+template <class Contains>
+auto query_lines(const BloomOptions& opt, const GlobalOptions& g, const Contains& contains) -> CommandResult {
+  const bool want = opt.action == BloomOptions::Action::query;
+  std::atomic<std::uint64_t> seen{0};
+  std::atomic<std::uint64_t> selected{0};
+  util::mapped_input mapped;
+  if (g.stop_after == 0U && mapped.open(g.file_path)) {
+    const auto workers = static_cast<std::size_t>(decide_num_workers(g.threads, g.cpu_affinity.size()));
+    const util::placement place = util::placement::make(g.cpu_affinity, g.numa);
+    std::mutex out_mtx;
+    std::vector<std::string> outs(workers);
+    const auto flush = [&](std::string& out) -> void {
+      std::scoped_lock lk(out_mtx);
+      std::fwrite(out.data(), 1, out.size(), stdout);
+      out.clear();
+    };
+    util::parallel_for_lines(
+        mapped.bytes(), workers, g.fields,
+        [&](std::size_t w, std::span<const std::string_view> lines) -> void {
+          std::array<bool, 256> hits{}; // for_each_line_batch hands out at most 256 lines
+          contains(lines, std::span<bool>(hits).first(lines.size()));
+          selected.fetch_add(select_lines(lines, hits, want, outs[w]), std::memory_order_relaxed);
+          seen.fetch_add(lines.size(), std::memory_order_relaxed);
+          if (outs[w].size() >= kQueryFlushBytes) {
+            flush(outs[w]);
+          }
+        },
+        [&place](std::size_t w) -> void { place.pin_worker(w); });
+    for (auto& out : outs) {
+      flush(out);
+    }
+  } else {
+    line_reader in;
+    if (!open_input(g, in)) {
+      return CommandResult::IOError;
+    }
+    std::unique_ptr<bool[]> hits; // NOLINT(*-avoid-c-arrays)
+    std::size_t hits_size = 0;
+    std::string out;
+    while (const auto blk = in.next()) {
+      if (blk->lines.size() > hits_size) {
+        hits_size = blk->lines.size();
+        hits = std::make_unique<bool[]>(hits_size); // NOLINT(*-avoid-c-arrays)
+      }
+      const std::span<bool> h(hits.get(), blk->lines.size());
+      contains(blk->lines, h);
+      selected += select_lines(blk->lines, h, want, out);
+      seen += blk->lines.size();
+      std::fwrite(out.data(), 1, out.size(), stdout);
+      out.clear();
+    }
+  }
+  if (g.json) {
+    std::fprintf(stderr, "{\"seen\":%llu,\"%s\":%llu}\n", static_cast<unsigned long long>(seen.load()),
+                 want ? "hits" : "excluded", static_cast<unsigned long long>(selected.load()));
+  }
+  return CommandResult::Success;
+}
+
+auto run_query(const BloomOptions& opt, const GlobalOptions& g) -> CommandResult {
+  auto kind = serialize::sketch_kind(opt.filter_path);
+  if (!kind) {
+    std::fprintf(stderr, "error: %s: %s\n", opt.filter_path.c_str(), kind.error().message().c_str());
+    return CommandResult::IOError;
+  }
+  // Queries never write, so the filter is used in place from the page cache
+  const serialize::LoadOptions lo{.mode = serialize::LoadMode::map_read_only};
+  if (kind.value() == serialize::SketchKind::fuse) {
+    auto f = probkit::fuse::filter::load(opt.filter_path, lo);
+    if (!f) {
+      std::fprintf(stderr, "error: failed to load %s: %s\n", opt.filter_path.c_str(), f.error().message().c_str());
+      return CommandResult::IOError;
+    }
+    const probkit::fuse::filter& ff = f.value();
+    return query_lines(opt, g, [&ff](std::span<const std::string_view> lines, std::span<bool> hits) -> void {
+      (void)ff.might_contain_batch(lines, hits);
+    });
+  }
+  if (kind.value() != serialize::SketchKind::bloom) {
+    std::fprintf(stderr, "error: %s holds neither a bloom nor a fuse filter\n", opt.filter_path.c_str());
+    return CommandResult::ConfigError;
+  }
+  auto f = probkit::bloom::filter::load(opt.filter_path, lo);
+  if (!f) {
+    std::fprintf(stderr, "error: failed to load %s: %s\n", opt.filter_path.c_str(), f.error().message().c_str());
+    return CommandResult::IOError;
+  }
+  const probkit::bloom::filter& bf = f.value();
+  const util::bloom_ops ops = util::bloom_ops_for(bf);
+  return query_lines(opt, g, [&bf, ops](std::span<const std::string_view> lines, std::span<bool> hits) -> void {
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+      auto q = ops.might_contain(bf, lines[i]);
+      hits[i] = q.has_value() && q.value();
+    }
+  });
 }
+} // namespace
 
 } // namespace probkit::cli
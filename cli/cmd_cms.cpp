@@ -1,11 +1,22 @@
 #include "options.hpp"
 #include "probkit/cms.hpp"
 #include "probkit/hash.hpp"
+#include "util/affinity.hpp"
+#include "util/bucket_epoch.hpp"
 #include "util/duration.hpp"
+#include "util/fixed_dispatch.hpp"
+#include "util/json.hpp"
+#include "util/line_reader.hpp"
+#include "util/mapped_input.hpp"
+#include "util/metrics.hpp"
 #include "util/parse.hpp"
+#include "util/saturation.hpp"
+#include "util/sliding_window.hpp"
 #include "util/spsc_ring.hpp"
 #include "util/string_utils.hpp"
 #include "util/threads.hpp"
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cstddef>
@@ -13,9 +24,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
-#include <iostream>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -47,6 +58,8 @@ using probkit::cli::util::timeutil::Timebase;
 namespace probkit::cli {
 
 namespace {
+using probkit::cli::util::line_batch;
+using probkit::cli::util::line_reader;
 using probkit::cli::util::parse_double;
 using probkit::cli::util::parse_u64;
 using probkit::cli::util::spsc_ring;
@@ -58,15 +71,31 @@ struct CmsOptions {
   double eps{1e-3};
   double delta{1e-4};
   std::size_t topk{0};
+  probkit::hashing::IndexMap index_map{probkit::hashing::IndexMap::modulo};
+  probkit::cms::RowHash row_hash{probkit::cms::RowHash::independent};
+  probkit::cms::CounterWidth counter_width{probkit::cms::CounterWidth::u64};
+  probkit::cms::UpdateRule update{probkit::cms::UpdateRule::standard};
+  probkit::AllocPolicy alloc{}; // from --alloc/--prefault
+  std::string save_path;        // write the final sketch here, for probkit merge
 };
 
-struct LineItem {
-  std::string data;
+// The sketches one worker writes to: the shared sketch when set, else sketches[bucket_epoch::slot(e)]
+// with --bucket and sketches[0] without
+struct worker_slots {
+  probkit::cms::concurrent_sketch* shared{nullptr};
+  std::array<probkit::cms::sketch*, 2> sketches{};
+  util::bucket_epoch* epoch{nullptr}; // null without time buckets
+  std::size_t index{0};
+  util::stage_cpu* cpu{nullptr};            // GlobalOptions::stage_cpu
+  util::thread_counters* counters{nullptr}; // this worker's metrics slot, null without --stats/--prom
+  const util::placement* place{nullptr};    // pins the worker thread when set
+  util::cms_inc_fn inc{nullptr};            // batch update of the per-worker sketches
+  util::saturation_flag* saturated{nullptr}; // raised when an update clamps a counter
 };
 
 struct Rings {
-  std::vector<std::unique_ptr<spsc_ring<LineItem>>> store;
-  std::vector<spsc_ring<LineItem>*> views;
+  std::vector<std::unique_ptr<spsc_ring<line_batch>>> store;
+  std::vector<spsc_ring<line_batch>*> views;
 };
 
 struct RingConfig {
@@ -75,49 +104,56 @@ struct RingConfig {
 };
 
 #if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-using StatsThread = std::jthread;
 using WorkerThread = std::jthread;
 using ReaderThread = std::jthread;
 using ReducerThread = std::jthread;
 #else
-using StatsThread = std::thread;
 using WorkerThread = std::thread;
 using ReaderThread = std::thread;
 using ReducerThread = std::thread;
 #endif
 
-auto make_rings(const RingConfig& config) -> Rings;
+auto make_rings(const RingConfig& config, const util::placement& place) -> Rings;
+auto config_from(const CmsOptions& co) -> probkit::cms::Config;
+auto make_sketch_from(const CmsOptions& co, const probkit::hashing::HashConfig& h)
+    -> probkit::result<probkit::cms::sketch>;
 void print_dims(FILE* out, const probkit::cms::sketch& sk);
 void print_help();
-void json_escape_and_print(FILE* out, std::string_view s);
 template <class Items> void print_topk_json(FILE* out, const Items& items);
-void dispatch_line(spsc_ring<LineItem>& ring, std::string& line);
-auto open_input(const GlobalOptions& g, std::ifstream& file_in, std::istream*& in) -> bool;
-auto build_locals(int num_workers, const CmsOptions& co, const GlobalOptions& g, std::vector<probkit::cms::sketch>& out)
-    -> bool;
+void close_rings(const std::vector<spsc_ring<line_batch>*>& rings);
+auto open_input(const GlobalOptions& g, line_reader& in) -> bool;
+auto build_locals(int num_workers, const CmsOptions& co, const GlobalOptions& g, const util::placement& place,
+                  std::vector<probkit::cms::sketch>& out) -> bool;
 auto parse_cms_opts(int argc, char** argv) -> CmsOptions;
 template <class StopQ>
-void worker_loop(spsc_ring<LineItem>& ring, probkit::cms::sketch& sk, StopQ stopq, std::atomic<bool>* merging,
-                 std::atomic<int>* paused);
-void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<LineItem>& ring, probkit::cms::sketch& sk,
-                  std::atomic<bool>& done, std::atomic<bool>* merging, std::atomic<int>* paused);
-auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*>& rings, int num_workers,
-                  std::atomic<bool>& done, std::atomic<std::uint64_t>& processed_total) -> ReaderThread;
-auto start_stats_if_enabled(const GlobalOptions& g, std::atomic<bool>& done,
-                            std::atomic<std::uint64_t>& processed_total, StatsThread& thr_out) -> bool;
-auto start_reducer_cms(const GlobalOptions& g, std::vector<probkit::cms::sketch>& locals, const CmsOptions& co,
-                       std::atomic<bool>& done, std::atomic<int>& paused, std::atomic<bool>& merging, int num_workers,
-                       std::atomic<bool>& workers_ended) -> ReducerThread;
+void worker_loop(spsc_ring<line_batch>& ring, const worker_slots& slots, StopQ stopq, util::wait_strategy ws);
+void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<line_batch>& ring, const worker_slots& slots,
+                  std::atomic<bool>& done, util::wait_strategy wait);
+auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<line_batch>*>& rings, int num_workers,
+                  std::atomic<bool>& done, util::thread_counters* counters, const util::placement& place)
+    -> ReaderThread;
+auto start_reducer_cms(const GlobalOptions& g, std::array<std::vector<probkit::cms::sketch>*, 2> pools,
+                       const CmsOptions& co, const std::vector<spsc_ring<line_batch>*>& rings, std::atomic<bool>& done,
+                       util::bucket_epoch& epoch, std::atomic<bool>& workers_ended, util::pipeline_metrics* m,
+                       const util::placement& place, util::saturation_flag& saturated) -> ReducerThread;
 auto run_cms_pipeline(const CmsOptions& co, const GlobalOptions& g) -> CommandResult;
+auto finish_cms(const CmsOptions& co, const GlobalOptions& g, probkit::cms::sketch global,
+                std::vector<probkit::cms::sketch>& locals, util::pipeline_metrics* m, util::saturation_flag& saturated)
+    -> CommandResult;
 
 } // namespace
 
 auto cmd_cms(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
-  const CmsOptions co = parse_cms_opts(argc, argv);
+  CmsOptions co = parse_cms_opts(argc, argv);
+  co.alloc = alloc_policy_from(g);
   if (co.show_help) {
     print_help();
     return CommandResult::Success;
   }
+  if (!co.save_path.empty() && !g.bucket.empty()) {
+    std::fputs("error: --save takes no --bucket\n", stderr);
+    return CommandResult::ConfigError;
+  }
   return run_cms_pipeline(co, g);
 }
 
@@ -128,57 +164,126 @@ namespace probkit::cli {
 namespace {
 
 inline auto run_cms_pipeline(const CmsOptions& co, const GlobalOptions& g) -> CommandResult {
-  auto global_r =
-      probkit::cms::sketch::make_by_eps_delta(co.have_eps ? co.eps : 1e-3, co.have_delta ? co.delta : 1e-4, g.hash);
+  auto global_r = make_sketch_from(co, g.hash);
   if (!global_r) {
-    std::fputs("error: failed to init cms\n", stderr);
+    std::fprintf(stderr, "error: failed to init cms: %s\n", global_r.error().message().c_str());
     return CommandResult::ConfigError;
   }
 
-  const int num_workers = util::decide_num_workers(g.threads);
-  const std::size_t ring_capacity = 1U << 14;
-  auto rings =
-      make_rings(RingConfig{.capacity = ring_capacity, .worker_count = static_cast<unsigned int>(num_workers)});
+  const int num_workers = util::decide_num_workers(g.threads, g.cpu_affinity.size());
+  // With --cpu-affinity/--numa each worker's ring and sketch are built on a thread pinned like the
+  // worker, so first touch puts their pages on its node
+  const util::placement place = util::placement::make(g.cpu_affinity, g.numa);
+  util::pipeline_metrics metrics{static_cast<std::size_t>(num_workers)};
+  util::metrics_reporter reporter{metrics, report_options_from(g, "cms")};
+  util::pipeline_metrics* const m = reporter.active() ? &metrics : nullptr;
+  const std::size_t ring_capacity = g.ring_batches; // batches, each a share of one input block
+  auto rings = make_rings(
+      RingConfig{.capacity = ring_capacity, .worker_count = static_cast<unsigned int>(num_workers)}, place);
+
+  // Past --mem-budget, workers share one table with atomic counter updates instead of keeping one
+  // each (except with --bucket, whose rotation double-buffers per-worker sketches, and with
+  // --conservative, which needs a single writer per table). Each worker feeds its own candidate tracker.
+  const bool use_shared = g.bucket.empty() && co.update == probkit::cms::UpdateRule::standard &&
+                          util::prefer_shared_sketch(g.mem_budget_bytes, num_workers, global_r.value().byte_size());
+  probkit::cms::concurrent_sketch shared;
+  if (use_shared) {
+    auto r = probkit::cms::concurrent_sketch::make(config_from(co), g.hash, static_cast<std::size_t>(num_workers));
+    if (!r) {
+      std::fputs("error: failed to init shared cms\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    shared = std::move(r.value());
+  }
 
   std::vector<probkit::cms::sketch> locals;
-  if (!build_locals(num_workers, co, g, locals)) {
+  if (!use_shared && !build_locals(num_workers, co, g, place, locals)) {
     std::fputs("error: failed to init worker cms\n", stderr);
     return CommandResult::ConfigError;
   }
+  std::uint64_t sketch_bytes = global_r.value().byte_size(); // the shared table is the same size
+  for (const auto& tl : locals) {
+    sketch_bytes += tl.byte_size();
+  }
+  metrics.set_sketch_bytes(sketch_bytes);
 
   std::atomic<bool> done{false};
-  std::atomic<std::uint64_t> processed_total{0};
-  std::atomic<bool> merging{false};
-  std::atomic<int> paused_workers{0};
   std::atomic<bool> workers_ended{false};
+  util::saturation_flag saturated;
+
+  // Regular files without time buckets or a line limit: map the file and let every worker scan its
+  // own newline-aligned range, with no reader thread or ring hop
+  util::mapped_input mapped;
+  if (g.bucket.empty() && g.stop_after == 0U && mapped.open(g.file_path)) {
+    const util::cms_inc_fn inc = util::cms_incrementer(global_r.value());
+    util::parallel_for_lines(mapped.bytes(), static_cast<std::size_t>(num_workers), g.fields,
+                             [&](std::size_t w, std::span<const std::string_view> lines) -> void {
+                               saturated.note(use_shared ? shared.inc_batch(lines, 1, w) : inc(locals[w], lines, 1));
+                               util::count_lines(util::worker_counters(m, w), lines);
+                             },
+                             [&place](std::size_t w) -> void { place.pin_worker(w); });
+    if (use_shared) {
+      return finish_cms(co, g, std::move(shared).release(), locals, m, saturated);
+    }
+    return finish_cms(co, g, std::move(global_r.value()), locals, m, saturated);
+  }
+
+  // Bucket mode double-buffers every worker (see util/bucket_epoch.hpp), so rotation never stops ingest
+  const bool bucket_mode = !g.bucket.empty();
+  std::vector<probkit::cms::sketch> spares;
+  if (bucket_mode && !build_locals(num_workers, co, g, place, spares)) {
+    std::fputs("error: failed to init worker cms\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  for (const auto& sp : spares) {
+    sketch_bytes += sp.byte_size();
+  }
+  metrics.set_sketch_bytes(sketch_bytes);
+  util::bucket_epoch epoch{static_cast<std::size_t>(num_workers)};
 
   std::vector<WorkerThread> workers;
   workers.reserve(static_cast<std::size_t>(num_workers));
-  for (int wi = 0; wi < num_workers; ++wi) {
-    spawn_worker(workers, *rings.views[static_cast<std::size_t>(wi)], locals[static_cast<std::size_t>(wi)], done,
-                 &merging, &paused_workers);
+  for (std::size_t wi = 0; wi < static_cast<std::size_t>(num_workers); ++wi) {
+    worker_slots slots{.shared = nullptr,
+                       .sketches = {},
+                       .epoch = nullptr,
+                       .index = wi,
+                       .cpu = g.stage_cpu,
+                       .counters = util::worker_counters(m, wi),
+                       .place = &place,
+                       .inc = util::cms_incrementer(global_r.value()),
+                       .saturated = &saturated};
+    if (use_shared) {
+      slots.shared = &shared;
+    } else {
+      slots.sketches = {&locals[wi], &locals[wi]};
+    }
+    if (bucket_mode) {
+      slots.sketches[1] = &spares[wi];
+      slots.epoch = &epoch;
+    }
+    spawn_worker(workers, *rings.views[wi], slots, done, g.wait);
   }
 
-  ReaderThread reader = start_reader(g, rings.views, num_workers, done, processed_total);
+  ReaderThread reader = start_reader(g, rings.views, num_workers, done, util::reader_counters(m), place);
 
-  const bool bucket_mode = !g.bucket.empty();
   ReducerThread reducer;
   bool reducer_started = false;
   if (bucket_mode) {
-    reducer = start_reducer_cms(g, locals, co, done, paused_workers, merging, num_workers, workers_ended);
+    reducer = start_reducer_cms(g, {&locals, &spares}, co, rings.views, done, epoch, workers_ended, m, place,
+                                saturated);
     reducer_started = true;
   }
 
-  StatsThread stats_thr;
-  const bool stats_enabled = start_stats_if_enabled(g, done, processed_total, stats_thr);
-
   reader.join();
 #if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
   for (auto& w : workers) {
     w.request_stop();
   }
-  if (stats_enabled) {
-    stats_thr.request_stop();
+  for (auto& w : workers) {
+    if (w.joinable()) {
+      w.join();
+    }
   }
 #else
   for (auto& w : workers) {
@@ -191,19 +296,31 @@ inline auto run_cms_pipeline(const CmsOptions& co, const GlobalOptions& g) -> Co
     if (reducer.joinable()) {
       reducer.join();
     }
+    saturated.warn_if_hit(co.counter_width);
     return CommandResult::Success;
   }
-  if (stats_enabled) {
-#if !(PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN)
-    if (stats_thr.joinable()) {
-      stats_thr.join();
-    }
-#endif
+
+  if (use_shared) {
+    return finish_cms(co, g, std::move(shared).release(), locals, m, saturated);
   }
+  return finish_cms(co, g, std::move(global_r.value()), locals, m, saturated);
+}
 
-  auto global = std::move(global_r.value());
-  for (auto& tl : locals) {
-    (void)global.merge(tl);
+// Merge the worker sketches, save the result with --save and print it (non-bucketed)
+inline auto finish_cms(const CmsOptions& co, const GlobalOptions& g, probkit::cms::sketch global,
+                       std::vector<probkit::cms::sketch>& locals, util::pipeline_metrics* m,
+                       util::saturation_flag& saturated) -> CommandResult {
+  util::timed_merge(m, [&]() -> void {
+    for (auto& tl : locals) {
+      saturated.note(global.merge(tl));
+    }
+  });
+  saturated.warn_if_hit(co.counter_width);
+  if (!co.save_path.empty()) {
+    if (auto saved = global.save(co.save_path); !saved) {
+      std::fprintf(stderr, "error: failed to save %s: %s\n", co.save_path.c_str(), saved.error().message().c_str());
+      return CommandResult::IOError;
+    }
   }
 
   if (co.topk > 0) {
@@ -229,12 +346,15 @@ inline auto run_cms_pipeline(const CmsOptions& co, const GlobalOptions& g) -> Co
   }
   return CommandResult::Success;
 }
-inline auto make_rings(const RingConfig& config) -> Rings {
+inline auto make_rings(const RingConfig& config, const util::placement& place) -> Rings {
   Rings r{};
   r.store.reserve(static_cast<std::size_t>(config.worker_count));
   r.views.reserve(static_cast<std::size_t>(config.worker_count));
+  const auto make_ring = [&config]() -> std::unique_ptr<spsc_ring<line_batch>> {
+    return std::make_unique<spsc_ring<line_batch>>(config.capacity);
+  };
   for (unsigned int i = 0; i < config.worker_count; ++i) {
-    r.store.emplace_back(new spsc_ring<LineItem>(config.capacity));
+    r.store.push_back(place.on_worker_node(i, make_ring));
     r.views.push_back(r.store.back().get());
   }
   return r;
@@ -246,94 +366,62 @@ inline void print_dims(FILE* out, const probkit::cms::sketch& sk) {
 }
 
 inline void print_help() {
-  std::fputs("usage: probkit cms [--eps=<e>] [--delta=<d>] [--topk=<k>]\n", stdout);
+  std::fputs("usage: probkit cms [--eps=<e>] [--delta=<d>] [--topk=<k>] [--index-map=modulo|pow2|fastrange]\n"
+             "                   [--row-hash=independent|double] [--counter-bits=16|32|64] [--conservative]\n"
+             "                   [--save=<file>]\n"
+             "  --save writes the final sketch as an image for probkit merge (not with --bucket)\n",
+             stdout);
 }
 
-// Minimal JSON string escaper for keys in --topk output
-inline void json_escape_and_print(FILE* out, std::string_view s) {
-  std::fputc('"', out);
-  for (const char c : s) {
-    const auto ch = static_cast<unsigned char>(c);
-    switch (ch) {
-    case '\\':
-      std::fputs("\\\\", out);
-      break;
-    case '"':
-      std::fputs("\\\"", out);
-      break;
-    case '\b':
-      std::fputs("\\b", out);
-      break;
-    case '\f':
-      std::fputs("\\f", out);
-      break;
-    case '\n':
-      std::fputs("\\n", out);
-      break;
-    case '\r':
-      std::fputs("\\r", out);
-      break;
-    case '\t':
-      std::fputs("\\t", out);
-      break;
-    default:
-      if (ch < 0x20) {
-        std::fprintf(out, "\\u%04x", ch);
-      } else {
-        std::fputc(ch, out);
-      }
-    }
-  }
-  std::fputc('"', out);
+inline auto config_from(const CmsOptions& co) -> probkit::cms::Config {
+  probkit::cms::Config c{};
+  c.eps = co.have_eps ? co.eps : 1e-3;
+  c.delta = co.have_delta ? co.delta : 1e-4;
+  c.topk = co.topk;
+  c.index_map = co.index_map;
+  c.row_hash = co.row_hash;
+  c.counter_width = co.counter_width;
+  c.update = co.update;
+  c.alloc = co.alloc;
+  return c;
+}
+
+inline auto make_sketch_from(const CmsOptions& co, const probkit::hashing::HashConfig& h)
+    -> probkit::result<probkit::cms::sketch> {
+  return probkit::cms::sketch::make(config_from(co), h);
 }
 
 template <class Items> inline void print_topk_json(FILE* out, const Items& items) {
-  std::fputs("{\"topk\":[", out);
-  for (std::size_t i = 0; i < items.size(); ++i) {
-    const auto& it = items[i];
-    if (i != 0U) {
-      std::fputc(',', out);
-    }
-    std::fputs(R"({"key":)", out);
-    json_escape_and_print(out, it.key);
-    std::fprintf(out, R"(,"est":%llu})", static_cast<unsigned long long>(it.est));
-  }
-  std::fputs("]}\n", out);
+  std::fputs("{\"topk\":", out);
+  util::print_topk_array(out, items);
+  std::fputs("}\n", out);
 }
 
-inline void dispatch_line(spsc_ring<LineItem>& ring, std::string& line) {
-  using namespace std::chrono_literals;
-  int spins = 0;
-  while (!ring.try_emplace(std::move(line))) {
-    if (spins < 16) {
-      std::this_thread::yield();
-      ++spins;
-    } else {
-      std::this_thread::sleep_for(50us);
-    }
+// Batches taken per ring handoff by a worker
+constexpr std::size_t kPopBatches = 4;
+
+// Reader is done: wake parked workers so they drain their ring and exit
+inline void close_rings(const std::vector<spsc_ring<line_batch>*>& rings) {
+  for (auto* r : rings) {
+    r->close();
   }
 }
 
-inline auto open_input(const GlobalOptions& g, std::ifstream& file_in, std::istream*& in) -> bool {
-  if (g.file_path.empty() || g.file_path == "-") {
-    in = &std::cin;
-    return true;
-  }
-  file_in.open(g.file_path, std::ios::in);
-  if (!file_in.is_open()) {
-    std::fputs("error: failed to open --file\n", stderr);
+inline auto open_input(const GlobalOptions& g, line_reader& in) -> bool {
+  if (!in.open(input_spec_from(g))) {
+    std::fputs("error: failed to open input\n", stderr);
     return false;
   }
-  in = &file_in;
+  in.set_line_limit(g.stop_after);
   return true;
 }
 
-inline auto build_locals(int num_workers, const CmsOptions& co, const GlobalOptions& g,
+inline auto build_locals(int num_workers, const CmsOptions& co, const GlobalOptions& g, const util::placement& place,
                          std::vector<probkit::cms::sketch>& out) -> bool {
   out.reserve(static_cast<std::size_t>(num_workers));
+  const auto make_local = [&]() -> probkit::result<probkit::cms::sketch> { return make_sketch_from(co, g.hash); };
   for (int i = 0; i < num_workers; ++i) {
-    auto s =
-        probkit::cms::sketch::make_by_eps_delta(co.have_eps ? co.eps : 1e-3, co.have_delta ? co.delta : 1e-4, g.hash);
+    auto s = place.on_worker_node(static_cast<std::size_t>(i), make_local);
     if (!s) {
       return false;
     }
@@ -342,35 +430,6 @@ inline auto build_locals(int num_workers, const CmsOptions& co, const GlobalOpti
   return true;
 }
 
-inline auto start_stats_if_enabled(const GlobalOptions& g, std::atomic<bool>& done,
-                                   std::atomic<std::uint64_t>& processed_total, StatsThread& thr_out) -> bool {
-  if (!g.stats) {
-    return false;
-  }
-#if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-  thr_out = std::jthread([&](std::stop_token st) {
-#else
-  thr_out = std::thread([&]() -> void {
-#endif
-    const auto interval = std::chrono::seconds(g.stats ? g.stats_interval_seconds : 1U);
-    while (
-#if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-        !st.stop_requested()
-#else
-        true
-#endif
-    ) {
-      std::this_thread::sleep_for(interval);
-      const auto proc = processed_total.load(std::memory_order_relaxed);
-      std::fprintf(stderr, "processed=%llu\n", static_cast<unsigned long long>(proc));
-      if (done.load(std::memory_order_acquire)) {
-        break;
-      }
-    }
-  });
-  return true;
-}
-
 auto parse_cms_opts(int argc, char** argv) -> CmsOptions {
   CmsOptions o{};
   // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
@@ -400,12 +459,46 @@ auto parse_cms_opts(int argc, char** argv) -> CmsOptions {
       o.delta = v;
     } else if (sv_starts_with(a, std::string_view{"--topk="})) {
       std::uint64_t v = 0;
-      if (!parse_u64(a.substr(std::string_view{"--topk="}.size()), v)) {
+      if (!parse_u64(a.substr(std::string_view{"--topk="}.size()), v) || v > probkit::cms::kMaxTopk) {
         std::fputs("error: invalid --topk\n", stderr);
         o.show_help = true;
         break;
       }
       o.topk = static_cast<std::size_t>(v);
+    } else if (sv_starts_with(a, std::string_view{"--index-map="})) {
+      if (!probkit::hashing::parse_index_map(a.substr(std::string_view{"--index-map="}.size()), o.index_map)) {
+        std::fputs("error: invalid --index-map\n", stderr);
+        o.show_help = true;
+        break;
+      }
+    } else if (sv_starts_with(a, std::string_view{"--row-hash="})) {
+      const auto v = a.substr(std::string_view{"--row-hash="}.size());
+      if (v == std::string_view{"independent"}) {
+        o.row_hash = probkit::cms::RowHash::independent;
+      } else if (v == std::string_view{"double"}) {
+        o.row_hash = probkit::cms::RowHash::double_hash;
+      } else {
+        std::fputs("error: invalid --row-hash\n", stderr);
+        o.show_help = true;
+        break;
+      }
+    } else if (sv_starts_with(a, std::string_view{"--counter-bits="})) {
+      const auto v = a.substr(std::string_view{"--counter-bits="}.size());
+      if (v == std::string_view{"16"}) {
+        o.counter_width = probkit::cms::CounterWidth::u16;
+      } else if (v == std::string_view{"32"}) {
+        o.counter_width = probkit::cms::CounterWidth::u32;
+      } else if (v == std::string_view{"64"}) {
+        o.counter_width = probkit::cms::CounterWidth::u64;
+      } else {
+        std::fputs("error: invalid --counter-bits\n", stderr);
+        o.show_help = true;
+        break;
+      }
+    } else if (a == std::string_view{"--conservative"}) {
+      o.update = probkit::cms::UpdateRule::conservative;
+    } else if (sv_starts_with(a, std::string_view{"--save="})) {
+      o.save_path = std::string(a.substr(std::string_view{"--save="}.size()));
     }
   }
   // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
@@ -413,108 +506,117 @@ auto parse_cms_opts(int argc, char** argv) -> CmsOptions {
 }
 
 template <class StopQ>
-inline void worker_loop(spsc_ring<LineItem>& ring, probkit::cms::sketch& sk, StopQ stopq, std::atomic<bool>* merging,
-                        std::atomic<int>* paused) {
-  LineItem item;
-  bool counted_pause = false;
+inline void worker_loop(spsc_ring<line_batch>& ring, const worker_slots& slots, StopQ stopq, util::wait_strategy ws) {
+  std::array<line_batch, kPopBatches> items{};
+  util::backoff idle{ws};
+  std::uint32_t seen = 0;
+  probkit::cms::sketch* active = slots.sketches[0];
+  if (slots.place != nullptr) {
+    slots.place->pin_worker(slots.index);
+  }
   while (true) {
-    if (merging != nullptr && merging->load(std::memory_order_acquire)) {
-      if (!counted_pause) {
-        if (paused != nullptr) {
-          paused->fetch_add(1, std::memory_order_acq_rel);
-        }
-        counted_pause = true;
-      }
-      std::this_thread::sleep_for(std::chrono::microseconds(50));
-      continue;
-    }
-    if (counted_pause) {
-      counted_pause = false;
+    if (slots.epoch != nullptr && slots.epoch->observe(slots.index, seen)) {
+      active = slots.sketches[util::bucket_epoch::slot(seen)];
     }
-    if (ring.pop(item)) {
-      (void)sk.inc(item.data);
-    } else if (stopq()) {
-      break;
+    if (const std::size_t n = ring.pop_n_wait(items, idle); n != 0U) {
+      for (std::size_t i = 0; i < n; ++i) {
+        slots.saturated->note(slots.shared != nullptr ? slots.shared->inc_batch(items[i].lines, 1, slots.index)
+                                                       : slots.inc(*active, items[i].lines, 1));
+        items[i] = line_batch{}; // drop this worker's reference to the block
+      }
     } else {
-      std::this_thread::yield();
+      util::count_idle(slots.counters);
+      if (stopq() && ring.empty()) {
+        break;
+      }
     }
   }
+  if (slots.epoch != nullptr) {
+    slots.epoch->retire(slots.index);
+  }
+  util::charge_worker(slots.cpu);
 }
 
 #if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<LineItem>& ring, probkit::cms::sketch& sk,
-                  std::atomic<bool>& done, std::atomic<bool>* merging, std::atomic<int>* paused) {
-  auto* merging_p = merging;
-  auto* paused_p = paused;
-  ws.emplace_back([&, merging_p, paused_p](std::stop_token st) {
+void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<line_batch>& ring, const worker_slots& slots,
+                  std::atomic<bool>& done, util::wait_strategy wait) {
+  ws.emplace_back([&, slots, wait](std::stop_token st) {
     auto stopq = [&]() -> bool { return done.load(std::memory_order_acquire) || st.stop_requested(); };
-    worker_loop(ring, sk, stopq, merging_p, paused_p);
+    worker_loop(ring, slots, stopq, wait);
   });
 }
 
-auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*>& rings, int num_workers,
-                  std::atomic<bool>& done, std::atomic<std::uint64_t>& processed_total) -> ReaderThread {
-  return ReaderThread([&](std::stop_token rst) {
-    std::ifstream file_in;
-    std::istream* in = nullptr;
-    if (!open_input(g, file_in, in)) {
+auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<line_batch>*>& rings, int num_workers,
+                  std::atomic<bool>& done, util::thread_counters* counters, const util::placement& place)
+    -> ReaderThread {
+  return ReaderThread([&, num_workers, counters](std::stop_token rst) {
+    place.pin_reader();
+    line_reader in;
+    if (!open_input(g, in)) {
       done.store(true, std::memory_order_release);
+      close_rings(rings);
       return;
     }
-    std::string line;
-    line.reserve(256);
-    std::uint64_t processed = 0;
+    // Counter merges are additive and candidates are re-estimated on merge, so each worker takes a
+    // contiguous share of every block instead of hashing each line here to pick a shard
+    const auto workers = static_cast<std::size_t>(num_workers);
     while (!rst.stop_requested()) {
-      if (!std::getline(*in, line)) {
+      const std::shared_ptr<const util::line_block> blk = in.next();
+      if (!blk) {
         break;
       }
-      const std::uint64_t hv = hashing::hash64(line, g.hash);
-      const int shard = static_cast<int>(hv % static_cast<std::uint64_t>(num_workers));
-      dispatch_line(*rings[static_cast<std::size_t>(shard)], line);
-      processed_total.fetch_add(1, std::memory_order_relaxed);
-      if (g.stop_after && ++processed >= g.stop_after) {
-        break;
+      for (std::size_t w = 0; w < workers; ++w) {
+        auto batch = util::slice_for_worker(blk, w, workers);
+        if (!batch.lines.empty()) {
+          util::count_stall(counters, rings[w]->push_wait(std::move(batch), g.wait));
+        }
       }
+      util::count_lines(counters, blk->lines);
     }
     done.store(true, std::memory_order_release);
+    close_rings(rings);
+    util::charge_reader(g.stage_cpu);
   });
 }
 #else
-void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<LineItem>& ring, probkit::cms::sketch& sk,
-                  std::atomic<bool>& done, std::atomic<bool>* merging, std::atomic<int>* paused) {
-  auto* merging_p = merging;
-  auto* paused_p = paused;
-  ws.emplace_back([&, merging_p, paused_p]() -> void {
+void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<line_batch>& ring, const worker_slots& slots,
+                  std::atomic<bool>& done, util::wait_strategy wait) {
+  ws.emplace_back([&, slots, wait]() -> void {
     auto stopq = [&]() -> bool { return done.load(std::memory_order_acquire); };
-    worker_loop(ring, sk, stopq, merging_p, paused_p);
+    worker_loop(ring, slots, stopq, wait);
   });
 }
 
-auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*>& rings, int num_workers,
-                  std::atomic<bool>& done, std::atomic<std::uint64_t>& processed_total) -> ReaderThread {
-  return ReaderThread([&]() -> void {
-    std::ifstream file_in;
-    std::istream* in = nullptr;
-    if (!open_input(g, file_in, in)) {
+auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<line_batch>*>& rings, int num_workers,
+                  std::atomic<bool>& done, util::thread_counters* counters, const util::placement& place)
+    -> ReaderThread {
+  return ReaderThread([&, num_workers, counters]() -> void {
+    place.pin_reader();
+    line_reader in;
+    if (!open_input(g, in)) {
       done.store(true, std::memory_order_release);
+      close_rings(rings);
       return;
     }
-    std::string line;
-    line.reserve(256);
-    std::uint64_t processed = 0;
+    // Counter merges are additive and candidates are re-estimated on merge, so each worker takes a
+    // contiguous share of every block instead of hashing each line here to pick a shard
+    const auto workers = static_cast<std::size_t>(num_workers);
     while (true) {
-      if (!std::getline(*in, line)) {
+      const std::shared_ptr<const util::line_block> blk = in.next();
+      if (!blk) {
         break;
       }
-      const std::uint64_t hv = hashing::hash64(line, g.hash);
-      const int shard = static_cast<int>(hv % static_cast<std::uint64_t>(num_workers));
-      dispatch_line(*rings[static_cast<std::size_t>(shard)], line);
-      processed_total.fetch_add(1, std::memory_order_relaxed);
-      if (g.stop_after && ++processed >= g.stop_after) {
-        break;
+      for (std::size_t w = 0; w < workers; ++w) {
+        auto batch = util::slice_for_worker(blk, w, workers);
+        if (!batch.lines.empty()) {
+          util::count_stall(counters, rings[w]->push_wait(std::move(batch), g.wait));
+        }
       }
+      util::count_lines(counters, blk->lines);
     }
     done.store(true, std::memory_order_release);
+    close_rings(rings);
+    util::charge_reader(g.stage_cpu);
   });
 }
 #endif
@@ -524,14 +626,16 @@ auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*
 // ==================== Reducer (bucketed output) ====================
 namespace probkit::cli {
 namespace {
-auto start_reducer_cms(const GlobalOptions& g, std::vector<probkit::cms::sketch>& locals, const CmsOptions& co,
-                       std::atomic<bool>& done, std::atomic<int>& paused, std::atomic<bool>& merging, int num_workers,
-                       std::atomic<bool>& workers_ended) -> ReducerThread {
+auto start_reducer_cms(const GlobalOptions& g, std::array<std::vector<probkit::cms::sketch>*, 2> pools,
+                       const CmsOptions& co, const std::vector<spsc_ring<line_batch>*>& rings, std::atomic<bool>& done,
+                       util::bucket_epoch& epoch, std::atomic<bool>& workers_ended, util::pipeline_metrics* m,
+                       const util::placement& place, util::saturation_flag& saturated) -> ReducerThread {
 #if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-  return ReducerThread([&](std::stop_token st) {
+  return ReducerThread([&, pools, m](std::stop_token st) {
 #else
-  return ReducerThread([&]() -> void {
+  return ReducerThread([&, pools, m]() -> void {
 #endif
+    place.pin_reader();
     std::chrono::nanoseconds bucket_ns{};
     if (!parse_duration(g.bucket, bucket_ns)) {
       std::fputs("error: invalid --bucket value\n", stderr);
@@ -546,17 +650,30 @@ auto start_reducer_cms(const GlobalOptions& g, std::vector<probkit::cms::sketch>
     auto bucket_end = bucket_start + bucket_ns;
 
     auto make_sketch = [&](probkit::hashing::HashConfig hc) -> probkit::result<probkit::cms::sketch> {
-      auto s =
-          probkit::cms::sketch::make_by_eps_delta(co.have_eps ? co.eps : 1e-3, co.have_delta ? co.delta : 1e-4, hc);
-      return s;
+      return make_sketch_from(co, hc);
     };
 
-    auto acc_r = make_sketch(locals.empty() ? g.hash : locals.front().hash_config());
+    auto acc_r = make_sketch(pools[0]->empty() ? g.hash : pools[0]->front().hash_config());
     if (!acc_r) {
       std::fputs("error: cms reducer init failed\n", stderr);
       return;
     }
     auto acc = std::move(acc_r.value());
+    const probkit::hashing::HashConfig acc_hash = acc.hash_config();
+    // --window: each finished bucket joins a two-stack window (util/sliding_window.hpp) and the
+    // window's sum is reported, stamped with its first bucket's start
+    std::chrono::nanoseconds window_ns{};
+    (void)parse_duration(g.window, window_ns); // validated with the global options
+    util::sliding_window window{util::window_buckets(bucket_ns, window_ns),
+                                [&make_sketch, acc_hash]() -> std::optional<probkit::cms::sketch> {
+                                  auto r = make_sketch(acc_hash);
+                                  if (!r) {
+                                    return std::nullopt;
+                                  }
+                                  return std::move(r.value());
+                                }};
+
+    std::vector<probkit::cms::PairView> top; // each bucket's report, viewing the reported sketch's keys
 
     const auto sleep_quanta = std::chrono::milliseconds(50);
     while (
@@ -566,72 +683,76 @@ auto start_reducer_cms(const GlobalOptions& g, std::vector<probkit::cms::sketch>
         true
 #endif
     ) {
-      std::this_thread::sleep_for(sleep_quanta);
+      std::this_thread::sleep_until(std::min(bucket_end, std::chrono::steady_clock::now() + sleep_quanta));
       const auto now = std::chrono::steady_clock::now();
       const bool finishing = done.load(std::memory_order_acquire) && workers_ended.load(std::memory_order_acquire);
       const bool need_rotate = now >= bucket_end || finishing;
       if (!need_rotate) {
         continue;
       }
+      // Flip workers to their other sketch and merge the retired one while ingest continues
+      const auto rotate_start = std::chrono::steady_clock::now();
+      std::uint32_t retired_epoch = epoch.current();
       if (!finishing) {
-        merging.store(true, std::memory_order_release);
-        while (paused.load(std::memory_order_acquire) < num_workers) {
-          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        retired_epoch = epoch.advance() - 1U;
+        for (auto* r : rings) {
+          r->wake_consumer(); // a worker parked on an empty ring flips (and acknowledges) right away
+        }
+        epoch.wait_for_acks(retired_epoch + 1U);
+      }
+      auto& retired = *pools[util::bucket_epoch::slot(retired_epoch)];
+      for (auto& tl : retired) {
+        saturated.note(acc.merge(tl));
+      }
+      if (m != nullptr) {
+        m->add_merge(std::chrono::steady_clock::now() - rotate_start);
+      }
+      std::optional<probkit::cms::sketch> rolled;
+      const probkit::cms::sketch* report = &acc;
+      auto report_start = bucket_start;
+      if (window.span() > 0U) {
+        if (window.push(std::move(acc))) {
+          rolled = window.query();
         }
+        report = rolled ? &*rolled : nullptr;
+        report_start -= static_cast<std::chrono::nanoseconds::rep>(window.size() - 1U) * bucket_ns;
       }
-      for (auto& tl : locals) {
-        (void)acc.merge(tl);
+      // ,"buckets":n / buckets=n with --window
+      std::string held;
+      if (window.span() > 0U) {
+        held = (g.json ? R"(,"buckets":)" : " buckets=") + std::to_string(window.size());
       }
-      if (co.topk > 0) {
-        auto r = acc.topk(co.topk);
-        if (r) {
-          const auto ts = format_utc_iso8601(tb.to_system(bucket_start));
+      const auto ts = format_utc_iso8601(tb.to_system(report_start));
+      if (report == nullptr) {
+        std::fputs("error: cms window merge failed\n", stderr);
+      } else if (co.topk > 0) {
+        if (report->topk(co.topk, top)) {
           if (g.json) {
-            std::fputs(R"({"ts":")", stdout);
-            std::fputs(ts.c_str(), stdout);
-            std::fputs(R"(","topk":[)", stdout);
-            const auto& items = r.value();
-            for (std::size_t i = 0; i < items.size(); ++i) {
-              const auto& it = items[i];
-              if (i != 0U) {
-                std::fputc(',', stdout);
-              }
-              std::fputs("{\"key\":", stdout);
-              json_escape_and_print(stdout, it.key);
-              std::fprintf(stdout, ",\"est\":%llu}", static_cast<unsigned long long>(it.est));
-            }
-            std::fputs("]}\n", stdout);
+            std::printf(R"({"ts":"%s"%s,"topk":)", ts.c_str(), held.c_str());
+            util::print_topk_array(stdout, top);
+            std::fputs("}\n", stdout);
           } else {
-            std::fprintf(stdout, "%s\titems=%zu\n", ts.c_str(), r.value().size());
+            std::fprintf(stdout, "%s\titems=%zu%s\n", ts.c_str(), top.size(), held.c_str());
           }
         } else {
           std::fputs("error: cms topk failed\n", stderr);
         }
+      } else if (g.json) {
+        auto [d, w] = report->dims();
+        std::fprintf(stdout, "{\"ts\":\"%s\",\"depth\":%zu,\"width\":%zu%s}\n", ts.c_str(), d, w, held.c_str());
       } else {
-        const auto ts = format_utc_iso8601(tb.to_system(bucket_start));
-        if (g.json) {
-          auto [d, w] = acc.dims();
-          std::fprintf(stdout, "{\"ts\":\"%s\",\"depth\":%zu,\"width\":%zu}\n", ts.c_str(), d, w);
-        } else {
-          std::fprintf(stdout, "%s\trotated\n", ts.c_str());
-        }
+        std::fprintf(stdout, "%s\trotated%s\n", ts.c_str(), held.c_str());
       }
 
-      for (auto& tl : locals) {
-        auto s = make_sketch(tl.hash_config());
-        if (s) {
-          tl = std::move(s.value());
-        }
+      // Clear in place for the next bucket: counters and candidate arenas keep their storage
+      for (auto& tl : retired) {
+        (void)tl.reset();
       }
-      auto new_acc_r = make_sketch(acc.hash_config());
-      if (new_acc_r) {
+      if (window.span() == 0U) {
+        (void)acc.reset();
+      } else if (auto new_acc_r = make_sketch(acc_hash); new_acc_r) { // acc moved into the window
         acc = std::move(new_acc_r.value());
       }
-      if (!finishing) {
-        paused.store(0, std::memory_order_release);
-        merging.store(false, std::memory_order_release);
-      }
-
       if (finishing) {
         break;
       }
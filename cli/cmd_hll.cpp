@@ -1,11 +1,20 @@
 #include "options.hpp"
 #include "probkit/hash.hpp"
 #include "probkit/hll.hpp"
+#include "util/affinity.hpp"
+#include "util/bucket_epoch.hpp"
 #include "util/duration.hpp"
+#include "util/fixed_dispatch.hpp"
+#include "util/line_reader.hpp"
+#include "util/mapped_input.hpp"
+#include "util/metrics.hpp"
 #include "util/parse.hpp"
+#include "util/sliding_window.hpp"
 #include "util/spsc_ring.hpp"
 #include "util/string_utils.hpp"
 #include "util/threads.hpp"
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cstddef>
@@ -13,9 +22,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
-#include <iostream>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -40,12 +49,13 @@
 #endif
 
 using probkit::cli::CommandResult;
+using probkit::cli::util::line_batch;
+using probkit::cli::util::line_reader;
 using probkit::cli::util::parse_u64;
 using probkit::cli::util::sv_starts_with;
 using probkit::cli::util::timeutil::format_utc_iso8601;
 using probkit::cli::util::timeutil::parse_duration;
 using probkit::cli::util::timeutil::Timebase;
-using probkit::hashing::hash64;
 
 namespace probkit::cli {
 
@@ -56,10 +66,28 @@ struct HllOptions {
   bool show_help{false};
   bool have_precision{false};
   std::uint8_t precision{14};
+  probkit::hll::Encoding encoding{probkit::hll::Encoding::dense};
+  bool sparse{false};
+  std::string save_path; // write the final sketch here, for probkit merge
+};
+
+// The sketches one worker writes to: the shared sketch when set, else sketches[bucket_epoch::slot(e)]
+// with --bucket and sketches[0] without
+struct worker_slots {
+  probkit::hll::concurrent_sketch* shared{nullptr};
+  std::array<probkit::hll::sketch*, 2> sketches{};
+  util::bucket_epoch* epoch{nullptr}; // null without time buckets
+  std::size_t index{0};
+  util::stage_cpu* cpu{nullptr};            // GlobalOptions::stage_cpu
+  util::thread_counters* counters{nullptr}; // this worker's metrics slot, null without --stats/--prom
+  const util::placement* place{nullptr};    // pins the worker thread when set
+  util::hll_add_fn add{nullptr};            // batch update of the per-worker sketches
 };
 
 inline void print_help() {
-  std::fputs("usage: probkit hll [--precision=<p>]\n", stdout);
+  std::fputs("usage: probkit hll [--precision=<p>] [--encoding=dense|packed] [--sparse] [--save=<file>]\n"
+             "  --save writes the final sketch as an image for probkit merge (not with --bucket)\n",
+             stdout);
 }
 
 auto parse_hll_opts(int argc, char** argv) -> HllOptions {
@@ -80,24 +108,36 @@ auto parse_hll_opts(int argc, char** argv) -> HllOptions {
       }
       o.have_precision = true;
       o.precision = static_cast<std::uint8_t>(v);
+    } else if (sv_starts_with(a, std::string_view{"--encoding="})) {
+      const auto v = a.substr(std::string_view{"--encoding="}.size());
+      if (v == std::string_view{"dense"}) {
+        o.encoding = probkit::hll::Encoding::dense;
+      } else if (v == std::string_view{"packed"}) {
+        o.encoding = probkit::hll::Encoding::packed;
+      } else {
+        std::fputs("error: invalid --encoding\n", stderr);
+        o.show_help = true;
+        break;
+      }
+    } else if (a == std::string_view{"--sparse"}) {
+      o.sparse = true;
+    } else if (sv_starts_with(a, std::string_view{"--save="})) {
+      o.save_path = std::string(a.substr(std::string_view{"--save="}.size()));
     }
   }
   // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
   return o;
 }
-struct LineItem {
-  std::string data;
-};
-
-struct InputPair;
-static auto open_input(const GlobalOptions& g, std::ifstream& file_in, std::istream*& in) -> bool;
-static void dispatch_line(spsc_ring<LineItem>& ring, std::string& line);
-static auto run_hll_single_non_bucket(std::istream& in, probkit::hll::sketch global, const GlobalOptions& g)
+static auto open_input(const GlobalOptions& g, line_reader& in) -> bool;
+static auto print_estimate(const probkit::hll::sketch& sk, const HllOptions& o, const GlobalOptions& g)
     -> CommandResult;
-static auto run_hll_single_bucketed(std::istream& in, std::uint8_t p, const GlobalOptions& g) -> CommandResult;
+static void close_rings(const std::vector<spsc_ring<line_batch>*>& rings);
+static auto run_hll_single_non_bucket(line_reader& in, probkit::hll::sketch global, const HllOptions& o,
+                                      const GlobalOptions& g, util::thread_counters* counters) -> CommandResult;
+static auto run_hll_single_bucketed(line_reader& in, const probkit::hll::Config& hc, const GlobalOptions& g,
+                                    util::thread_counters* counters) -> CommandResult;
 template <class StopQ>
-static void worker_loop(spsc_ring<LineItem>& ring, probkit::hll::sketch& sk, StopQ stopq, std::atomic<bool>* merging,
-                        std::atomic<int>* paused);
+static void worker_loop(spsc_ring<line_batch>& ring, const worker_slots& slots, StopQ stopq, util::wait_strategy ws);
 #if PROBKIT_HAS_JTHREAD
 using WorkerThread = std::jthread;
 using ReaderThread = std::jthread;
@@ -107,13 +147,15 @@ using WorkerThread = std::thread;
 using ReaderThread = std::thread;
 using ReducerThread = std::thread;
 #endif
-static void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<LineItem>& ring, probkit::hll::sketch& sk,
-                         std::atomic<bool>& done, std::atomic<bool>* merging, std::atomic<int>* paused);
-static auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*>& rings, int num_workers,
-                         std::atomic<bool>& done) -> ReaderThread;
-static auto start_reducer_hll(const GlobalOptions& g, std::vector<probkit::hll::sketch>& locals, std::uint8_t p,
-                              std::atomic<bool>& done, std::atomic<int>& paused, std::atomic<bool>& merging,
-                              int num_workers, std::atomic<bool>& workers_ended) -> ReducerThread;
+static void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<line_batch>& ring, const worker_slots& slots,
+                         std::atomic<bool>& done, util::wait_strategy wait);
+static auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<line_batch>*>& rings, int num_workers,
+                         std::atomic<bool>& done, util::thread_counters* counters, const util::placement& place)
+    -> ReaderThread;
+static auto start_reducer_hll(const GlobalOptions& g, std::array<std::vector<probkit::hll::sketch>*, 2> pools,
+                              const probkit::hll::Config& hc, const std::vector<spsc_ring<line_batch>*>& rings,
+                              std::atomic<bool>& done, util::bucket_epoch& epoch, std::atomic<bool>& workers_ended,
+                              util::pipeline_metrics* m, const util::placement& place) -> ReducerThread;
 } // namespace
 
 // Reader → Workers → Reducer minimal pipeline for HLL
@@ -123,56 +165,134 @@ auto cmd_hll(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
     print_help();
     return CommandResult::Success;
   }
+  if (!ho.save_path.empty() && !g.bucket.empty()) {
+    std::fputs("error: --save takes no --bucket\n", stderr);
+    return CommandResult::ConfigError;
+  }
 
-  const std::uint8_t p = ho.have_precision ? ho.precision : 14;
-  auto sketch_r = probkit::hll::sketch::make_by_precision(p, g.hash);
+  const probkit::hll::Config hc{
+      .precision = ho.have_precision ? ho.precision : std::uint8_t{14}, .encoding = ho.encoding, .sparse = ho.sparse};
+  auto sketch_r = probkit::hll::sketch::make(hc, g.hash);
   if (!sketch_r) {
     std::fputs("error: failed to init hll\n", stderr);
     return CommandResult::ConfigError;
   }
 
-  const int num_workers = probkit::cli::util::decide_num_workers(g.threads);
-  const std::size_t ring_capacity = 1U << 14; // 16384 slots
+  const int num_workers = probkit::cli::util::decide_num_workers(g.threads, g.cpu_affinity.size());
+  // With --cpu-affinity/--numa each worker's ring and sketch are built on a thread pinned like the
+  // worker, so first touch puts their pages on its node
+  const util::placement place = util::placement::make(g.cpu_affinity, g.numa);
+  util::pipeline_metrics metrics{static_cast<std::size_t>(num_workers)};
+  util::metrics_reporter reporter{metrics, report_options_from(g, "hll")};
+  util::pipeline_metrics* const m = reporter.active() ? &metrics : nullptr;
+  const std::size_t ring_capacity = g.ring_batches; // batches, each a share of one input block
 
-  std::vector<spsc_ring<LineItem>*> rings;
+  std::vector<spsc_ring<line_batch>*> rings;
   rings.reserve(static_cast<std::size_t>(num_workers));
-  std::vector<std::unique_ptr<spsc_ring<LineItem>>> ring_storage;
+  std::vector<std::unique_ptr<spsc_ring<line_batch>>> ring_storage;
   ring_storage.reserve(static_cast<std::size_t>(num_workers));
+  const auto make_ring = [ring_capacity]() -> std::unique_ptr<spsc_ring<line_batch>> {
+    return std::make_unique<spsc_ring<line_batch>>(ring_capacity);
+  };
   for (int i = 0; i < num_workers; ++i) {
-    ring_storage.emplace_back(new spsc_ring<LineItem>(ring_capacity));
+    ring_storage.push_back(place.on_worker_node(static_cast<std::size_t>(i), make_ring));
     rings.push_back(ring_storage.back().get());
   }
 
+  // Past --mem-budget, workers share one sketch with atomic register updates instead of keeping one
+  // each (except with --bucket, whose rotation double-buffers per-worker sketches)
+  const bool use_shared = g.bucket.empty() && util::prefer_shared_sketch(g.mem_budget_bytes, num_workers,
+                                                                         probkit::hll::sketch::dense_byte_size(hc));
+  probkit::hll::concurrent_sketch shared;
+  if (use_shared) {
+    auto r = probkit::hll::concurrent_sketch::make(hc, g.hash);
+    if (!r) {
+      std::fputs("error: failed to init shared hll\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    shared = std::move(r.value());
+  }
+
   // thread-local sketches (use identical hash config across workers)
   std::vector<probkit::hll::sketch> locals;
   locals.reserve(static_cast<std::size_t>(num_workers));
-  for (int i = 0; i < num_workers; ++i) {
-    auto s = probkit::hll::sketch::make_by_precision(p, g.hash);
+  const auto make_local = [&]() -> probkit::result<probkit::hll::sketch> {
+    return probkit::hll::sketch::make(hc, g.hash);
+  };
+  for (int i = 0; i < num_workers && !use_shared; ++i) {
+    auto s = place.on_worker_node(static_cast<std::size_t>(i), make_local);
     if (!s) {
       std::fputs("error: failed to init worker sketch\n", stderr);
       return CommandResult::ConfigError;
     }
     locals.emplace_back(std::move(s.value()));
   }
+  std::uint64_t sketch_bytes = use_shared ? shared.byte_size() : sketch_r.value().byte_size();
+  for (const auto& tl : locals) {
+    sketch_bytes += tl.byte_size();
+  }
+  metrics.set_sketch_bytes(sketch_bytes);
+
+  // Regular files without time buckets or a line limit: map the file and let every worker scan its
+  // own newline-aligned range, with no reader thread or ring hop
+  util::mapped_input mapped;
+  if (g.bucket.empty() && g.stop_after == 0U && mapped.open(g.file_path)) {
+    const util::hll_add_fn add = util::hll_adder(sketch_r.value());
+    util::parallel_for_lines(mapped.bytes(), static_cast<std::size_t>(num_workers), g.fields,
+                             [&](std::size_t w, std::span<const std::string_view> lines) -> void {
+                               (void)(use_shared ? shared.add_batch(lines) : add(locals[w], lines));
+                               util::count_lines(util::worker_counters(m, w), lines);
+                             },
+                             [&place](std::size_t w) -> void { place.pin_worker(w); });
+    if (use_shared) {
+      return print_estimate(std::move(shared).release(), ho, g);
+    }
+    auto global = std::move(sketch_r.value());
+    util::timed_merge(m, [&]() -> void {
+      for (auto& tl : locals) {
+        (void)global.merge(tl);
+      }
+    });
+    return print_estimate(global, ho, g);
+  }
 
   std::atomic<bool> done{false};
-  std::atomic<bool> merging{false};
-  std::atomic<int> paused_workers{0};
   std::atomic<bool> workers_ended{false};
 
   // Single-thread fallback (stability)
   if (num_workers <= 1) {
-    std::ifstream file_in;
-    std::istream* in = nullptr;
-    if (!open_input(g, file_in, in)) {
+    place.pin_worker(0);
+    line_reader in;
+    if (!open_input(g, in)) {
       return CommandResult::IOError;
     }
     const bool bucket_mode = !g.bucket.empty();
     if (!bucket_mode) {
-      return run_hll_single_non_bucket(*in, std::move(sketch_r.value()), g);
+      return run_hll_single_non_bucket(in, std::move(sketch_r.value()), ho, g, util::reader_counters(m));
+    }
+    return run_hll_single_bucketed(in, hc, g, util::reader_counters(m));
+  }
+
+  // Bucket mode double-buffers every worker: ingest continues into spares[w] (or locals[w]) while
+  // the reducer merges and resets the sketch retired at the last rotation
+  const bool bucket_mode = !g.bucket.empty();
+  std::vector<probkit::hll::sketch> spares;
+  if (bucket_mode) {
+    spares.reserve(locals.size());
+    for (std::size_t wi = 0; wi < locals.size(); ++wi) {
+      auto s = place.on_worker_node(wi, [&]() -> probkit::result<probkit::hll::sketch> {
+        return probkit::hll::sketch::make(hc, locals[wi].hash_config());
+      });
+      if (!s) {
+        std::fputs("error: failed to init worker sketch\n", stderr);
+        return CommandResult::ConfigError;
+      }
+      spares.emplace_back(std::move(s.value()));
+      sketch_bytes += spares.back().byte_size();
     }
-    return run_hll_single_bucketed(*in, p, g);
+    metrics.set_sketch_bytes(sketch_bytes);
   }
+  util::bucket_epoch epoch{static_cast<std::size_t>(num_workers)};
 
   // Workers
 #if PROBKIT_HAS_JTHREAD
@@ -181,20 +301,35 @@ auto cmd_hll(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
   std::vector<std::thread> workers;
 #endif
   workers.reserve(static_cast<std::size_t>(num_workers));
-  for (int wi = 0; wi < num_workers; ++wi) {
-    spawn_worker(workers, *rings[static_cast<std::size_t>(wi)], locals[static_cast<std::size_t>(wi)], done, &merging,
-                 &paused_workers);
+  for (std::size_t wi = 0; wi < static_cast<std::size_t>(num_workers); ++wi) {
+    worker_slots slots{.shared = nullptr,
+                       .sketches = {},
+                       .epoch = nullptr,
+                       .index = wi,
+                       .cpu = g.stage_cpu,
+                       .counters = util::worker_counters(m, wi),
+                       .place = &place,
+                       .add = util::hll_adder(sketch_r.value())};
+    if (use_shared) {
+      slots.shared = &shared;
+    } else {
+      slots.sketches = {&locals[wi], &locals[wi]};
+    }
+    if (bucket_mode) {
+      slots.sketches[1] = &spares[wi];
+      slots.epoch = &epoch;
+    }
+    spawn_worker(workers, *rings[wi], slots, done, g.wait);
   }
 
   // Reader
-  ReaderThread reader = start_reader(g, rings, num_workers, done);
+  ReaderThread reader = start_reader(g, rings, num_workers, done, util::reader_counters(m), place);
 
   // Optional reducer for bucket mode
-  const bool bucket_mode = !g.bucket.empty();
   ReducerThread reducer;
   bool reducer_started = false;
   if (bucket_mode) {
-    reducer = start_reducer_hll(g, locals, p, done, paused_workers, merging, num_workers, workers_ended);
+    reducer = start_reducer_hll(g, {&locals, &spares}, hc, rings, done, epoch, workers_ended, m, place);
     reducer_started = true;
   }
 
@@ -225,24 +360,18 @@ auto cmd_hll(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
     return CommandResult::Success;
   }
 
+  if (use_shared) {
+    return print_estimate(std::move(shared).release(), ho, g);
+  }
   // Reducer: merge locals
   auto global = std::move(sketch_r.value());
-  for (auto& tl : locals) {
-    (void)global.merge(tl);
-  }
+  util::timed_merge(m, [&]() -> void {
+    for (auto& tl : locals) {
+      (void)global.merge(tl);
+    }
+  });
 
-  // Final output (non-bucket)
-  auto est = global.estimate();
-  if (!est) {
-    std::fputs("error: hll estimate failed\n", stderr);
-    return CommandResult::ConfigError;
-  }
-  if (g.json) {
-    std::printf("{\"uu\":%.0f,\"m\":%zu}\n", est.value(), global.m());
-  } else {
-    std::printf("uu=%.0f m=%zu\n", est.value(), global.m());
-  }
-  return CommandResult::Success;
+  return print_estimate(global, ho, g);
 }
 
 } // namespace probkit::cli
@@ -250,89 +379,143 @@ auto cmd_hll(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
 // ==================== Details (helper implementations) ====================
 namespace probkit::cli {
 namespace {
-inline auto open_input(const GlobalOptions& g, std::ifstream& file_in, std::istream*& in) -> bool {
-  if (g.file_path.empty() || g.file_path == "-") {
-    in = &std::cin;
-    return true;
-  }
-  file_in.open(g.file_path, std::ios::in);
-  if (!file_in.is_open()) {
-    std::fputs("error: failed to open --file\n", stderr);
+inline auto open_input(const GlobalOptions& g, line_reader& in) -> bool {
+  if (!in.open(input_spec_from(g))) {
+    std::fputs("error: failed to open input\n", stderr);
     return false;
   }
-  in = &file_in;
+  in.set_line_limit(g.stop_after);
   return true;
 }
 
-inline void dispatch_line(spsc_ring<LineItem>& ring, std::string& line) {
-  using namespace std::chrono_literals;
-  // two-phase backoff: initial yields to reduce CPU, then sleep
-  int spins = 0;
-  while (!ring.try_emplace(std::move(line))) {
-    if (spins < 16) {
-      std::this_thread::yield();
-      ++spins;
-    } else {
-      std::this_thread::sleep_for(50us);
+inline auto print_estimate(const probkit::hll::sketch& sk, const HllOptions& o, const GlobalOptions& g)
+    -> CommandResult {
+  if (!o.save_path.empty()) {
+    if (auto saved = sk.save(o.save_path); !saved) {
+      std::fprintf(stderr, "error: failed to save %s: %s\n", o.save_path.c_str(), saved.error().message().c_str());
+      return CommandResult::IOError;
     }
   }
+  auto est = sk.estimate();
+  if (!est) {
+    std::fputs("error: hll estimate failed\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  if (g.json) {
+    std::printf("{\"uu\":%.0f,\"m\":%zu}\n", est.value(), sk.m());
+  } else {
+    std::printf("uu=%.0f m=%zu\n", est.value(), sk.m());
+  }
+  return CommandResult::Success;
 }
 
-template <class StopQ>
-inline void worker_loop(spsc_ring<LineItem>& ring, probkit::hll::sketch& sk, StopQ stopq, std::atomic<bool>* merging,
-                        std::atomic<int>* paused) {
-  LineItem item;
-  bool counted_pause = false;
-  while (true) {
-    if (merging != nullptr && merging->load(std::memory_order_acquire)) {
-      if (!counted_pause) {
-        if (paused != nullptr) {
-          paused->fetch_add(1, std::memory_order_acq_rel);
-        }
-        counted_pause = true;
-      }
-      std::this_thread::sleep_for(std::chrono::microseconds(50));
-      continue;
+// --window over buckets of bucket_ns (span 0, unused, without --window); empty buckets share hash
+inline auto make_hll_window(const GlobalOptions& g, std::chrono::nanoseconds bucket_ns, const probkit::hll::Config& hc,
+                            probkit::hashing::HashConfig hash) {
+  std::chrono::nanoseconds window_ns{};
+  (void)parse_duration(g.window, window_ns); // validated with the global options
+  return util::sliding_window{util::window_buckets(bucket_ns, window_ns),
+                              [hc, hash]() -> std::optional<probkit::hll::sketch> {
+                                auto r = probkit::hll::sketch::make(hc, hash);
+                                if (!r) {
+                                  return std::nullopt;
+                                }
+                                return std::move(r.value());
+                              }};
+}
+
+// Print a finished bucket starting at start; with --window it joins the window (and is moved from),
+// and the line reports the union of the window's buckets, stamped with the first one's start
+template <class Window>
+void report_hll_bucket(const GlobalOptions& g, const Timebase& tb, std::chrono::steady_clock::time_point start,
+                       std::chrono::nanoseconds bucket_ns, probkit::hll::sketch& bucket, Window& window) {
+  std::optional<probkit::hll::sketch> rolled;
+  const probkit::hll::sketch* s = &bucket;
+  if (window.span() > 0U) {
+    if (window.push(std::move(bucket))) {
+      rolled = window.query();
     }
-    if (counted_pause) {
-      counted_pause = false;
+    if (!rolled) {
+      std::fputs("error: hll window merge failed\n", stderr);
+      return;
     }
-    if (ring.pop(item)) {
-      (void)sk.add(item.data);
-    } else if (stopq()) {
-      break;
+    s = &*rolled;
+    start -= static_cast<std::chrono::nanoseconds::rep>(window.size() - 1U) * bucket_ns;
+  }
+  auto est = s->estimate();
+  if (!est) {
+    std::fputs("error: hll estimate failed\n", stderr);
+    return;
+  }
+  const auto ts = format_utc_iso8601(tb.to_system(start));
+  if (window.span() > 0U) {
+    if (g.json) {
+      std::printf("{\"ts\":\"%s\",\"uu\":%.0f,\"m\":%zu,\"buckets\":%zu}\n", ts.c_str(), est.value(), s->m(),
+                  window.size());
     } else {
-      // lighter backoff under normal idle
-      std::this_thread::yield();
+      std::printf("%s\tuu=%.0f m=%zu buckets=%zu\n", ts.c_str(), est.value(), s->m(), window.size());
     }
+  } else if (g.json) {
+    std::printf("{\"ts\":\"%s\",\"uu\":%.0f,\"m\":%zu}\n", ts.c_str(), est.value(), s->m());
+  } else {
+    std::printf("%s\tuu=%.0f m=%zu\n", ts.c_str(), est.value(), s->m());
   }
 }
 
-inline auto run_hll_single_non_bucket(std::istream& in, probkit::hll::sketch global, const GlobalOptions& g)
-    -> CommandResult {
-  std::string line;
-  line.reserve(256);
-  std::uint64_t processed = 0;
-  while (std::getline(in, line)) {
-    (void)global.add(line);
-    if ((g.stop_after != 0U) && ++processed >= g.stop_after) {
-      break;
+// Batches taken per ring handoff by a worker
+constexpr std::size_t kPopBatches = 4;
+
+// Reader is done: wake parked workers so they drain their ring and exit
+inline void close_rings(const std::vector<spsc_ring<line_batch>*>& rings) {
+  for (auto* r : rings) {
+    r->close();
+  }
+}
+
+template <class StopQ>
+inline void worker_loop(spsc_ring<line_batch>& ring, const worker_slots& slots, StopQ stopq, util::wait_strategy ws) {
+  std::array<line_batch, kPopBatches> items{};
+  util::backoff idle{ws};
+  std::uint32_t seen = 0;
+  probkit::hll::sketch* active = slots.sketches[0];
+  if (slots.place != nullptr) {
+    slots.place->pin_worker(slots.index);
+  }
+  while (true) {
+    // Bucket boundaries are taken between handoffs; the reducer never waits on a paused worker
+    if (slots.epoch != nullptr && slots.epoch->observe(slots.index, seen)) {
+      active = slots.sketches[util::bucket_epoch::slot(seen)];
+    }
+    if (const std::size_t n = ring.pop_n_wait(items, idle); n != 0U) {
+      for (std::size_t i = 0; i < n; ++i) {
+        (void)(slots.shared != nullptr ? slots.shared->add_batch(items[i].lines) : slots.add(*active, items[i].lines));
+        items[i] = line_batch{}; // drop this worker's reference to the block
+      }
+    } else {
+      util::count_idle(slots.counters);
+      if (stopq() && ring.empty()) {
+        break;
+      }
     }
   }
-  auto est = global.estimate();
-  if (!est) {
-    std::fputs("error: hll estimate failed\n", stderr);
-    return CommandResult::ConfigError;
+  if (slots.epoch != nullptr) {
+    slots.epoch->retire(slots.index);
   }
-  if (g.json) {
-    std::printf("{\"uu\":%.0f,\"m\":%zu}\n", est.value(), global.m());
-  } else {
-    std::printf("uu=%.0f m=%zu\n", est.value(), global.m());
+  util::charge_worker(slots.cpu);
+}
+
+inline auto run_hll_single_non_bucket(line_reader& in, probkit::hll::sketch global, const HllOptions& o,
+                                      const GlobalOptions& g, util::thread_counters* counters) -> CommandResult {
+  const util::hll_add_fn add = util::hll_adder(global);
+  while (const auto blk = in.next()) {
+    (void)add(global, blk->lines);
+    util::count_lines(counters, blk->lines);
   }
-  return CommandResult::Success;
+  return print_estimate(global, o, g);
 }
 
-inline auto run_hll_single_bucketed(std::istream& in, std::uint8_t p, const GlobalOptions& g) -> CommandResult {
+inline auto run_hll_single_bucketed(line_reader& in, const probkit::hll::Config& hc, const GlobalOptions& g,
+                                    util::thread_counters* counters) -> CommandResult {
   std::chrono::nanoseconds bucket_ns{};
   if (!parse_duration(g.bucket, bucket_ns)) {
     std::fputs("error: invalid --bucket value\n", stderr);
@@ -344,119 +527,118 @@ inline auto run_hll_single_bucketed(std::istream& in, std::uint8_t p, const Glob
   Timebase tb{};
   auto bucket_start = std::chrono::steady_clock::now();
   auto bucket_end = bucket_start + bucket_ns;
-  auto bucket_sk_r = probkit::hll::sketch::make_by_precision(p, g.hash);
+  auto bucket_sk_r = probkit::hll::sketch::make(hc, g.hash);
   if (!bucket_sk_r) {
     std::fputs("error: failed to init hll bucket\n", stderr);
     return CommandResult::ConfigError;
   }
   auto bucket_sk = std::move(bucket_sk_r.value());
-  std::string line;
-  line.reserve(256);
-  std::uint64_t processed = 0;
+  const util::hll_add_fn add = util::hll_adder(bucket_sk);
+  auto window = make_hll_window(g, bucket_ns, hc, g.hash);
   auto flush_bucket = [&](std::chrono::steady_clock::time_point ts_steady) -> void {
-    auto est = bucket_sk.estimate();
-    if (est) {
-      const auto ts = format_utc_iso8601(tb.to_system(ts_steady));
-      if (g.json) {
-        std::printf("{\"ts\":\"%s\",\"uu\":%.0f,\"m\":%zu}\n", ts.c_str(), est.value(), bucket_sk.m());
-      } else {
-        std::printf("%s\tuu=%.0f m=%zu\n", ts.c_str(), est.value(), bucket_sk.m());
-      }
-    }
-    auto r = probkit::hll::sketch::make_by_precision(p, g.hash);
+    report_hll_bucket(g, tb, ts_steady, bucket_ns, bucket_sk, window);
+    auto r = probkit::hll::sketch::make(hc, g.hash);
     if (r) {
       bucket_sk = std::move(r.value());
     }
   };
-  while (std::getline(in, line)) {
+  // Buckets rotate on block boundaries; read(2) returns as soon as data arrives, so slow inputs
+  // still produce small, timely blocks
+  while (const auto blk = in.next()) {
     const auto now = std::chrono::steady_clock::now();
     if (now >= bucket_end) {
       flush_bucket(bucket_start);
       bucket_start = bucket_end;
       bucket_end = bucket_start + bucket_ns;
     }
-    (void)bucket_sk.add(line);
-    if ((g.stop_after != 0U) && ++processed >= g.stop_after) {
-      break;
-    }
+    (void)add(bucket_sk, blk->lines);
+    util::count_lines(counters, blk->lines);
   }
   flush_bucket(bucket_start);
   return CommandResult::Success;
 }
 #if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-static void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<LineItem>& ring, probkit::hll::sketch& sk,
-                         std::atomic<bool>& done, std::atomic<bool>* merging, std::atomic<int>* paused) {
+static void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<line_batch>& ring, const worker_slots& slots,
+                         std::atomic<bool>& done, util::wait_strategy wait) {
   auto* ring_p = &ring;
-  auto* sk_p = &sk;
   auto* done_p = &done;
-  auto* merging_p = merging;
-  auto* paused_p = paused;
-  ws.emplace_back([ring_p, sk_p, done_p, merging_p, paused_p](std::stop_token st) {
+  ws.emplace_back([ring_p, slots, done_p, wait](std::stop_token st) {
     auto stopq = [done_p, &st]() -> bool { return done_p->load(std::memory_order_acquire) || st.stop_requested(); };
-    worker_loop(*ring_p, *sk_p, stopq, merging_p, paused_p);
+    worker_loop(*ring_p, slots, stopq, wait);
   });
 }
-static ReaderThread start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*>& rings,
-                                 int num_workers, std::atomic<bool>& done) {
-  return ReaderThread([&](std::stop_token rst) {
-    std::ifstream file_in;
-    std::istream* in = nullptr;
-    if (!open_input(g, file_in, in)) {
+static ReaderThread start_reader(const GlobalOptions& g, const std::vector<spsc_ring<line_batch>*>& rings,
+                                 int num_workers, std::atomic<bool>& done, util::thread_counters* counters,
+                                 const util::placement& place) {
+  return ReaderThread([&, num_workers, counters](std::stop_token rst) {
+    place.pin_reader();
+    line_reader in;
+    if (!open_input(g, in)) {
       done.store(true, std::memory_order_release);
+      close_rings(rings);
       return;
     }
-    std::string line;
-    line.reserve(256);
-    std::uint64_t processed = 0;
+    // HLL merges are order- and partition-independent, so each worker takes a contiguous share of
+    // every block instead of hashing each line here to pick a shard
+    const auto workers = static_cast<std::size_t>(num_workers);
     while (!rst.stop_requested()) {
-      if (!std::getline(*in, line))
-        break;
-      const std::uint64_t hv = hash64(line, g.hash);
-      const int shard = static_cast<int>(hv % static_cast<std::uint64_t>(num_workers));
-      dispatch_line(*rings[static_cast<std::size_t>(shard)], line);
-      if (g.stop_after && ++processed >= g.stop_after)
+      const std::shared_ptr<const util::line_block> blk = in.next();
+      if (!blk) {
         break;
+      }
+      for (std::size_t w = 0; w < workers; ++w) {
+        auto batch = util::slice_for_worker(blk, w, workers);
+        if (!batch.lines.empty()) {
+          util::count_stall(counters, rings[w]->push_wait(std::move(batch), g.wait));
+        }
+      }
+      util::count_lines(counters, blk->lines);
     }
     done.store(true, std::memory_order_release);
+    close_rings(rings);
+    util::charge_reader(g.stage_cpu);
   });
 }
 #else
-void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<LineItem>& ring, probkit::hll::sketch& sk,
-                  std::atomic<bool>& done, std::atomic<bool>* merging, std::atomic<int>* paused) {
+void spawn_worker(std::vector<WorkerThread>& ws, spsc_ring<line_batch>& ring, const worker_slots& slots,
+                  std::atomic<bool>& done, util::wait_strategy wait) {
   auto* ring_p = &ring;
-  auto* sk_p = &sk;
   auto* done_p = &done;
-  auto* merging_p = merging;
-  auto* paused_p = paused;
-  ws.emplace_back([ring_p, sk_p, done_p, merging_p, paused_p]() -> void {
+  ws.emplace_back([ring_p, slots, done_p, wait]() -> void {
     auto stopq = [done_p]() -> bool { return done_p->load(std::memory_order_acquire); };
-    worker_loop(*ring_p, *sk_p, stopq, merging_p, paused_p);
+    worker_loop(*ring_p, slots, stopq, wait);
   });
 }
-auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*>& rings, int num_workers,
-                  std::atomic<bool>& done) -> ReaderThread {
-  return ReaderThread([&]() -> void {
-    std::ifstream file_in;
-    std::istream* in = nullptr;
-    if (!open_input(g, file_in, in)) {
+auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<line_batch>*>& rings, int num_workers,
+                  std::atomic<bool>& done, util::thread_counters* counters, const util::placement& place)
+    -> ReaderThread {
+  return ReaderThread([&, num_workers, counters]() -> void {
+    place.pin_reader();
+    line_reader in;
+    if (!open_input(g, in)) {
       done.store(true, std::memory_order_release);
+      close_rings(rings);
       return;
     }
-    std::string line;
-    line.reserve(256);
-    std::uint64_t processed = 0;
+    // HLL merges are order- and partition-independent, so each worker takes a contiguous share of
+    // every block instead of hashing each line here to pick a shard
+    const auto workers = static_cast<std::size_t>(num_workers);
     while (true) {
-      if (!std::getline(*in, line)) {
+      const std::shared_ptr<const util::line_block> blk = in.next();
+      if (!blk) {
         break;
       }
-      const std::uint64_t hv = hash64(line, g.hash);
-      const int shard = static_cast<int>(hv % static_cast<std::uint64_t>(num_workers));
-      dispatch_line(*rings[static_cast<std::size_t>(shard)], line);
-      if (g.stop_after && ++processed >= g.stop_after) {
-        break;
+      for (std::size_t w = 0; w < workers; ++w) {
+        auto batch = util::slice_for_worker(blk, w, workers);
+        if (!batch.lines.empty()) {
+          util::count_stall(counters, rings[w]->push_wait(std::move(batch), g.wait));
+        }
       }
+      util::count_lines(counters, blk->lines);
     }
     done.store(true, std::memory_order_release);
+    close_rings(rings);
+    util::charge_reader(g.stage_cpu);
   });
 }
 #endif
@@ -466,14 +648,16 @@ auto start_reader(const GlobalOptions& g, const std::vector<spsc_ring<LineItem>*
 // ==================== Reducer (bucketed output) ====================
 namespace probkit::cli {
 namespace {
-auto start_reducer_hll(const GlobalOptions& g, std::vector<probkit::hll::sketch>& locals, std::uint8_t p,
-                       std::atomic<bool>& done, std::atomic<int>& paused, std::atomic<bool>& merging, int num_workers,
-                       std::atomic<bool>& workers_ended) -> ReducerThread {
+auto start_reducer_hll(const GlobalOptions& g, std::array<std::vector<probkit::hll::sketch>*, 2> pools,
+                       const probkit::hll::Config& hc, const std::vector<spsc_ring<line_batch>*>& rings,
+                       std::atomic<bool>& done, util::bucket_epoch& epoch, std::atomic<bool>& workers_ended,
+                       util::pipeline_metrics* m, const util::placement& place) -> ReducerThread {
 #if PROBKIT_HAS_JTHREAD && PROBKIT_HAS_STOP_TOKEN
-  return ReducerThread([&, p](std::stop_token st) {
+  return ReducerThread([&, pools, hc, m](std::stop_token st) {
 #else
-  return ReducerThread([&, p]() -> void {
+  return ReducerThread([&, pools, hc, m]() -> void {
 #endif
+    place.pin_reader();
     std::chrono::nanoseconds bucket_ns{};
     if (!parse_duration(g.bucket, bucket_ns)) {
       std::fputs("error: invalid --bucket value\n", stderr);
@@ -487,12 +671,14 @@ auto start_reducer_hll(const GlobalOptions& g, std::vector<probkit::hll::sketch>
     auto bucket_start = std::chrono::steady_clock::now();
     auto bucket_end = bucket_start + bucket_ns;
 
-    auto acc_r = probkit::hll::sketch::make_by_precision(p, locals.empty() ? g.hash : locals.front().hash_config());
+    auto acc_r = probkit::hll::sketch::make(hc, pools[0]->empty() ? g.hash : pools[0]->front().hash_config());
     if (!acc_r) {
       std::fputs("error: hll reducer init failed\n", stderr);
       return;
     }
     auto acc = std::move(acc_r.value());
+    const probkit::hashing::HashConfig acc_hash = acc.hash_config();
+    auto window = make_hll_window(g, bucket_ns, hc, acc_hash);
 
     const auto sleep_quanta = std::chrono::milliseconds(50);
     while (
@@ -502,52 +688,44 @@ auto start_reducer_hll(const GlobalOptions& g, std::vector<probkit::hll::sketch>
         true
 #endif
     ) {
-      std::this_thread::sleep_for(sleep_quanta);
+      std::this_thread::sleep_until(std::min(bucket_end, std::chrono::steady_clock::now() + sleep_quanta));
       const auto now = std::chrono::steady_clock::now();
       const bool finishing = done.load(std::memory_order_acquire) && workers_ended.load(std::memory_order_acquire);
       const bool need_rotate = now >= bucket_end || finishing;
       if (!need_rotate) {
         continue;
       }
-      // Pause workers and wait only if not finishing
+      // Flip workers to their other sketch and take the retired one; once workers have ended, the
+      // sketches of the current epoch hold the final partial bucket
+      const auto rotate_start = std::chrono::steady_clock::now();
+      std::uint32_t retired_epoch = epoch.current();
       if (!finishing) {
-        merging.store(true, std::memory_order_release);
-        while (paused.load(std::memory_order_acquire) < num_workers) {
-          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        retired_epoch = epoch.advance() - 1U;
+        for (auto* r : rings) {
+          r->wake_consumer(); // a worker parked on an empty ring flips (and acknowledges) right away
         }
+        epoch.wait_for_acks(retired_epoch + 1U);
       }
-      // Merge locals into accumulator
-      for (auto& tl : locals) {
+      auto& retired = *pools[util::bucket_epoch::slot(retired_epoch)];
+      // Merge the retired sketches into the accumulator while ingest continues on the others
+      for (auto& tl : retired) {
         (void)acc.merge(tl);
       }
-      // Emit
-      auto est = acc.estimate();
-      if (est) {
-        const auto ts = format_utc_iso8601(tb.to_system(bucket_start));
-        if (g.json) {
-          std::printf("{\"ts\":\"%s\",\"uu\":%.0f,\"m\":%zu}\n", ts.c_str(), est.value(), acc.m());
-        } else {
-          std::printf("%s\tuu=%.0f m=%zu\n", ts.c_str(), est.value(), acc.m());
-        }
-      } else {
-        std::fputs("error: hll estimate failed\n", stderr);
+      if (m != nullptr) {
+        m->add_merge(std::chrono::steady_clock::now() - rotate_start);
       }
+      report_hll_bucket(g, tb, bucket_start, bucket_ns, acc, window);
       // Reset
-      for (auto& tl : locals) {
-        auto s = probkit::hll::sketch::make_by_precision(p, tl.hash_config());
+      for (auto& tl : retired) {
+        auto s = probkit::hll::sketch::make(hc, tl.hash_config());
         if (s) {
           tl = std::move(s.value());
         }
       }
-      auto new_acc_r = probkit::hll::sketch::make_by_precision(p, acc.hash_config());
+      auto new_acc_r = probkit::hll::sketch::make(hc, acc_hash); // acc may have moved into the window
       if (new_acc_r) {
         acc = std::move(new_acc_r.value());
       }
-      if (!finishing) {
-        paused.store(0, std::memory_order_release);
-        merging.store(false, std::memory_order_release);
-      }
-
       if (finishing) {
         break;
       }
@@ -0,0 +1,372 @@
+#include "options.hpp"
+#include "probkit/bloom.hpp"
+#include "probkit/cms.hpp"
+#include "probkit/error.hpp"
+#include "probkit/hll.hpp"
+#include "probkit/serialize.hpp"
+#include "util/affinity.hpp"
+#include "util/json.hpp"
+#include "util/metrics.hpp"
+#include "util/parse.hpp"
+#include "util/string_utils.hpp"
+#include "util/threads.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using probkit::cli::CommandResult;
+using probkit::cli::util::decide_num_workers;
+using probkit::cli::util::parse_u64;
+using probkit::cli::util::sv_starts_with;
+using probkit::serialize::LoadMode;
+
+namespace probkit::cli {
+
+namespace {
+// Fold saved images of one sketch kind into one. Every thread pulls the next input, maps it read-only
+// and merges it into its own accumulator; the accumulators are then merged pairwise, log2(threads)
+// rounds deep. Only one accumulator and one mapped input per thread are resident at a time, and each
+// input is unmapped as soon as it is merged.
+struct MergeOptions {
+  bool show_help{false};
+  bool error{false};
+  std::string out;
+  std::size_t topk{10};
+  bool verify{true};
+  std::vector<std::string> inputs; // image files or directories of them
+};
+
+constexpr std::string_view kOUT = "--out=";
+constexpr std::string_view kTOPK = "--topk=";
+
+inline void print_help() {
+  std::fputs("usage: probkit merge [--out=<file>] [--topk=<k>] [--no-verify] <image|dir>...\n"
+             "  merges hll, cms or bloom images saved with one geometry and hash config (a directory\n"
+             "  stands for every file in it); --threads reduce in parallel, --no-verify skips the body\n"
+             "  checksums of trusted inputs\n",
+             stdout);
+}
+
+auto parse_merge_opts(int argc, char** argv) -> MergeOptions {
+  MergeOptions o{};
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (int i = 0; i < argc && !o.error; ++i) {
+    const std::string_view a{argv[i]};
+    if (a == std::string_view{"--help"}) {
+      o.show_help = true;
+      break;
+    }
+    if (sv_starts_with(a, kOUT)) {
+      o.out = std::string(a.substr(kOUT.size()));
+    } else if (sv_starts_with(a, kTOPK)) {
+      std::uint64_t v = 0;
+      if (!parse_u64(a.substr(kTOPK.size()), v)) {
+        std::fputs("error: invalid --topk\n", stderr);
+        o.error = true;
+      }
+      o.topk = static_cast<std::size_t>(v);
+    } else if (a == std::string_view{"--no-verify"}) {
+      o.verify = false;
+    } else if (sv_starts_with(a, "--")) {
+      std::fprintf(stderr, "error: unknown merge option %.*s\n", static_cast<int>(a.size()), a.data());
+      o.error = true;
+    } else {
+      o.inputs.emplace_back(a);
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  return o;
+}
+
+// Directories expand to their regular files in name order
+auto expand_inputs(const std::vector<std::string>& args, std::vector<std::string>& files) -> bool {
+  for (const auto& a : args) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(a, ec)) {
+      files.push_back(a);
+      continue;
+    }
+    std::vector<std::string> found;
+    for (std::filesystem::directory_iterator it{a, ec}, end; !ec && it != end; it.increment(ec)) {
+      if (it->is_regular_file(ec)) {
+        found.push_back(it->path().string());
+      }
+    }
+    if (ec) {
+      std::fprintf(stderr, "error: cannot list %s: %s\n", a.c_str(), ec.message().c_str());
+      return false;
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+  }
+  if (files.empty()) {
+    std::fputs("error: merge needs at least one image\n", stderr);
+    return false;
+  }
+  return true;
+}
+
+// First failure of any reduction thread; the others stop before their next input
+struct merge_failure {
+  std::atomic<bool> failed{false};
+  std::mutex mtx;
+  std::string message;
+
+  void set(std::string msg) {
+    const std::scoped_lock lk(mtx);
+    if (!failed.exchange(true)) {
+      message = std::move(msg);
+    }
+  }
+};
+
+struct reduction_state {
+  merge_failure fail;
+  std::atomic<bool> saturated{false}; // a cms counter clamped; the merge itself still completed
+  util::pipeline_metrics* metrics{nullptr};
+};
+
+template <class Sketch> auto load_input(const std::string& path, LoadMode mode, bool verify, reduction_state& st)
+    -> std::optional<Sketch> {
+  auto r = Sketch::load(path, {.mode = mode, .verify_checksum = verify});
+  if (!r) {
+    st.fail.set("error: " + path + ": " + r.error().message());
+    return std::nullopt;
+  }
+  return std::move(r.value());
+}
+
+template <class Sketch> auto merge_into(Sketch& acc, const Sketch& in, const std::string& what, reduction_state& st)
+    -> bool {
+  std::optional<result<void>> r;
+  util::timed_merge(st.metrics, [&]() -> void { r.emplace(acc.merge(in)); });
+  if (r->has_value()) {
+    return true;
+  }
+  if (r->error().code == make_error_code(errc::overflow)) {
+    st.saturated.store(true, std::memory_order_relaxed);
+    return true;
+  }
+  st.fail.set("error: " + what + ": " + r->error().message());
+  return false;
+}
+
+// One accumulator per thread in accs; returns the merged sketch, or nullopt after a failure
+template <class Sketch>
+auto reduce(const std::vector<std::string>& files, const MergeOptions& o, const util::placement& place,
+            reduction_state& st, std::size_t threads) -> std::optional<Sketch> {
+  // Inputs are checked against the first one, so a mismatch names both files. Its mapping is
+  // only read for the header fields.
+  auto ref = load_input<Sketch>(files[0], LoadMode::map_read_only, false, st);
+  if (!ref) {
+    return std::nullopt;
+  }
+  std::vector<std::optional<Sketch>> accs(threads);
+  std::atomic<std::size_t> next{0};
+  const auto leaf = [&](std::size_t w) -> void {
+    place.pin_worker(w);
+    std::optional<Sketch>& acc = accs[w];
+    for (std::size_t i = next.fetch_add(1U); i < files.size() && !st.fail.failed.load(); i = next.fetch_add(1U)) {
+      // A thread's first input becomes its (owned, writable) accumulator
+      auto in = load_input<Sketch>(files[i], acc ? LoadMode::map_read_only : LoadMode::copy, o.verify, st);
+      if (!in) {
+        return;
+      }
+      if (!in->same_params(*ref)) {
+        st.fail.set("error: " + files[i] + ": parameters differ from " + files[0]);
+        return;
+      }
+      if (!acc) {
+        acc = std::move(in);
+      } else if (!merge_into(*acc, *in, files[i], st)) {
+        return;
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(threads);
+  for (std::size_t w = 0; w < threads; ++w) {
+    pool.emplace_back(leaf, w);
+  }
+  for (auto& t : pool) {
+    t.join();
+  }
+  if (st.metrics != nullptr) {
+    std::uint64_t bytes = 0;
+    for (const auto& a : accs) {
+      bytes += a ? a->byte_size() : 0U;
+    }
+    st.metrics->set_sketch_bytes(bytes);
+  }
+
+  for (std::size_t stride = 1; stride < threads && !st.fail.failed.load(); stride *= 2U) {
+    pool.clear();
+    for (std::size_t i = 0; i + stride < threads; i += 2U * stride) {
+      pool.emplace_back([&, i, stride]() -> void {
+        place.pin_worker(i);
+        std::optional<Sketch>& into = accs[i];
+        std::optional<Sketch>& from = accs[i + stride];
+        if (!from) {
+          return;
+        }
+        if (!into) {
+          into = std::move(from);
+        } else if (!merge_into(*into, *from, "partial merge", st)) {
+          return;
+        }
+        from.reset();
+      });
+    }
+    for (auto& t : pool) {
+      t.join();
+    }
+  }
+  if (st.fail.failed.load()) {
+    return std::nullopt;
+  }
+  return std::move(accs[0]);
+}
+
+// Kind-specific summary: the same lines (or JSON object) the building subcommand prints
+auto summarize(const probkit::hll::sketch& s, const MergeOptions& /*o*/, bool json) -> bool {
+  auto est = s.estimate();
+  if (!est) {
+    std::fputs("error: hll estimate failed\n", stderr);
+    return false;
+  }
+  if (json) {
+    std::printf(R"("hll":{"uu":%.0f,"m":%zu})", est.value(), s.m());
+  } else {
+    std::printf("uu=%.0f m=%zu\n", est.value(), s.m());
+  }
+  return true;
+}
+
+auto summarize(const probkit::cms::sketch& s, const MergeOptions& o, bool json) -> bool {
+  std::vector<probkit::cms::Pair> top;
+  if (o.topk > 0U && s.candidate_capacity() > 0U) {
+    auto r = s.topk(o.topk);
+    if (!r) {
+      std::fputs("error: cms topk failed\n", stderr);
+      return false;
+    }
+    top = std::move(r.value());
+  }
+  const auto [d, w] = s.dims();
+  if (json) {
+    std::printf(R"("cms":{"depth":%zu,"width":%zu,"topk":)", d, w);
+    util::print_topk_array(stdout, top);
+    std::fputc('}', stdout);
+    return true;
+  }
+  std::printf("cms: depth=%zu width=%zu\n", d, w);
+  for (const auto& it : top) {
+    std::fprintf(stdout, "%s\t%llu\n", it.key.c_str(), static_cast<unsigned long long>(it.est));
+  }
+  return true;
+}
+
+auto summarize(const probkit::bloom::filter& f, const MergeOptions& /*o*/, bool json) -> bool {
+  if (json) {
+    std::printf(R"("bloom":{"m_bits":%zu,"k":%u})", f.bit_size(), static_cast<unsigned>(f.k()));
+  } else {
+    std::printf("bloom: m_bits=%zu k=%u\n", f.bit_size(), static_cast<unsigned>(f.k()));
+  }
+  return true;
+}
+
+template <class Sketch>
+auto run_merge(const std::vector<std::string>& files, const MergeOptions& o, const GlobalOptions& g,
+               const char* kind) -> CommandResult {
+  const auto threads = std::min(static_cast<std::size_t>(decide_num_workers(g.threads, g.cpu_affinity.size())),
+                                files.size());
+  const util::placement place = util::placement::make(g.cpu_affinity, g.numa);
+  util::pipeline_metrics metrics{threads};
+  util::metrics_reporter reporter{metrics, report_options_from(g, "merge")};
+  reduction_state st;
+  st.metrics = reporter.active() ? &metrics : nullptr;
+  place.pin_reader();
+
+  std::optional<Sketch> merged = reduce<Sketch>(files, o, place, st, threads);
+  if (!merged) {
+    std::fprintf(stderr, "%s\n", st.fail.message.c_str());
+    return CommandResult::GeneralError;
+  }
+  if (st.saturated.load()) {
+    std::fputs("warning: cms counters saturated; clamped cells hold the counter maximum\n", stderr);
+  }
+  if (!o.out.empty()) {
+    if (auto saved = merged->save(o.out); !saved) {
+      std::fprintf(stderr, "error: failed to write --out %s: %s\n", o.out.c_str(), saved.error().message().c_str());
+      return CommandResult::IOError;
+    }
+  }
+  if (g.json) {
+    std::printf(R"({"merged":%zu,"kind":"%s",)", files.size(), kind);
+  } else {
+    std::printf("merged=%zu kind=%s\n", files.size(), kind);
+  }
+  if (!summarize(*merged, o, g.json)) {
+    return CommandResult::ConfigError;
+  }
+  if (g.json) {
+    std::fputs("}\n", stdout);
+  }
+  return CommandResult::Success;
+}
+} // namespace
+
+auto cmd_merge(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
+  const MergeOptions o = parse_merge_opts(argc, argv);
+  if (o.show_help) {
+    print_help();
+    return CommandResult::Success;
+  }
+  if (o.error) {
+    return CommandResult::ConfigError;
+  }
+  if (!g.bucket.empty()) {
+    std::fputs("error: merge does not support --bucket\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  if (!g.file_path.empty() || !g.listen.empty()) {
+    std::fputs("error: merge reads the images named on its command line, not --file or --listen\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  std::vector<std::string> files;
+  if (!expand_inputs(o.inputs, files)) {
+    return CommandResult::ConfigError;
+  }
+  // The first image decides the kind; a different kind further on fails its load
+  auto kind = serialize::sketch_kind(files[0]);
+  if (!kind) {
+    std::fprintf(stderr, "error: %s: %s\n", files[0].c_str(), kind.error().message().c_str());
+    return CommandResult::GeneralError;
+  }
+  switch (kind.value()) {
+  case serialize::SketchKind::hll:
+    return run_merge<probkit::hll::sketch>(files, o, g, "hll");
+  case serialize::SketchKind::cms:
+    return run_merge<probkit::cms::sketch>(files, o, g, "cms");
+  case serialize::SketchKind::fuse:
+    std::fprintf(stderr, "error: %s: fuse filters are static; build one from the combined keys instead\n",
+                 files[0].c_str());
+    return CommandResult::GeneralError;
+  case serialize::SketchKind::bloom:
+    break;
+  }
+  return run_merge<probkit::bloom::filter>(files, o, g, "bloom");
+}
+
+} // namespace probkit::cli
@@ -0,0 +1,532 @@
+#include "options.hpp"
+#include "probkit/bloom.hpp"
+#include "probkit/cms.hpp"
+#include "probkit/hash.hpp"
+#include "probkit/hll.hpp"
+#include "util/affinity.hpp"
+#include "util/json.hpp"
+#include "util/line_reader.hpp"
+#include "util/metrics.hpp"
+#include "util/parse.hpp"
+#include "util/saturation.hpp"
+#include "util/spsc_ring.hpp"
+#include "util/string_utils.hpp"
+#include "util/threads.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using probkit::cli::CommandResult;
+using probkit::cli::util::decide_num_workers;
+using probkit::cli::util::line_reader;
+using probkit::cli::util::parse_double;
+using probkit::cli::util::parse_u64;
+using probkit::cli::util::spsc_ring;
+using probkit::cli::util::sv_starts_with;
+
+namespace probkit::cli {
+
+namespace {
+// hll, cms and bloom over one pass of the input. Every line is hashed once with the global hash
+// config and that hash feeds all three (the sketches' *_hashed entry points), hence cms rows use
+// RowHash::double_hash and the filter ProbeHash::derived.
+struct MultiOptions {
+  bool show_help{false};
+  bool error{false};
+  bool hll{false};
+  bool cms{false};
+  bool bloom{false};
+  std::uint8_t precision{14};
+  double eps{1e-3};
+  double delta{1e-4};
+  std::size_t topk{10};
+  double fp{0.01};
+  std::size_t cap{probkit::bloom::Config{}.capacity_hint};
+  std::string dedup_out; // --bloom: first occurrences are written here
+};
+
+constexpr std::string_view kPRECISION = "--precision=";
+constexpr std::string_view kEPS = "--eps=";
+constexpr std::string_view kDELTA = "--delta=";
+constexpr std::string_view kTOPK = "--topk=";
+constexpr std::string_view kFP = "--fp=";
+constexpr std::string_view kCAP = "--capacity-hint=";
+constexpr std::string_view kDEDUP_OUT = "--dedup-out=";
+
+inline void print_help() {
+  std::fputs("usage: probkit multi [--hll [--precision=<p>]] [--cms [--eps=<e>] [--delta=<d>] [--topk=<k>]]\n"
+             "                     [--bloom [--fp=<p>] [--capacity-hint=<n>] [--dedup-out=<file>]]\n"
+             "  one read of the input and one hash per line feed every selected sketch; the bloom filter\n"
+             "  dedups (counts, and writes first occurrences to --dedup-out)\n",
+             stdout);
+}
+
+inline auto fail(MultiOptions& o, const char* msg) -> MultiOptions& {
+  std::fputs(msg, stderr);
+  o.error = true;
+  return o;
+}
+
+auto parse_multi_opts(int argc, char** argv) -> MultiOptions {
+  MultiOptions o{};
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (int i = 0; i < argc && !o.error; ++i) {
+    const std::string_view a{argv[i]};
+    if (a == std::string_view{"--help"}) {
+      o.show_help = true;
+      break;
+    }
+    if (a == std::string_view{"--hll"}) {
+      o.hll = true;
+    } else if (a == std::string_view{"--cms"}) {
+      o.cms = true;
+    } else if (a == std::string_view{"--bloom"}) {
+      o.bloom = true;
+    } else if (sv_starts_with(a, kPRECISION)) {
+      std::uint64_t v = 0;
+      if (!parse_u64(a.substr(kPRECISION.size()), v) || v > 24) {
+        return fail(o, "error: invalid --precision\n");
+      }
+      o.precision = static_cast<std::uint8_t>(v);
+    } else if (sv_starts_with(a, kEPS)) {
+      if (!parse_double(a.substr(kEPS.size()), o.eps) || o.eps <= 0.0 || o.eps >= 1.0) {
+        return fail(o, "error: invalid --eps\n");
+      }
+    } else if (sv_starts_with(a, kDELTA)) {
+      if (!parse_double(a.substr(kDELTA.size()), o.delta) || o.delta <= 0.0 || o.delta >= 1.0) {
+        return fail(o, "error: invalid --delta\n");
+      }
+    } else if (sv_starts_with(a, kTOPK)) {
+      std::uint64_t v = 0;
+      if (!parse_u64(a.substr(kTOPK.size()), v) || v > probkit::cms::kMaxTopk) {
+        return fail(o, "error: invalid --topk\n");
+      }
+      o.topk = static_cast<std::size_t>(v);
+    } else if (sv_starts_with(a, kFP)) {
+      if (!parse_double(a.substr(kFP.size()), o.fp) || o.fp <= 0.0 || o.fp >= 1.0) {
+        return fail(o, "error: --fp must be in (0,1)\n");
+      }
+    } else if (sv_starts_with(a, kCAP)) {
+      std::uint64_t v = 0;
+      if (!parse_u64(a.substr(kCAP.size()), v) || v == 0U) {
+        return fail(o, "error: --capacity-hint must be > 0\n");
+      }
+      o.cap = static_cast<std::size_t>(v);
+    } else if (sv_starts_with(a, kDEDUP_OUT)) {
+      o.dedup_out = std::string(a.substr(kDEDUP_OUT.size()));
+    } else {
+      std::fprintf(stderr, "error: unknown multi option %.*s\n", static_cast<int>(a.size()), a.data());
+      o.error = true;
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  return o;
+}
+
+// A worker's lines with their hashes. With the filter on, the reader hashes every line to route it to
+// the worker owning its partition and ships the hashes along; otherwise hashes is empty and the worker
+// hashes its contiguous share itself. owner keeps lines and hashes alive.
+struct hashed_batch {
+  std::shared_ptr<const void> owner;
+  std::span<const std::string_view> lines;
+  std::span<const std::uint64_t> hashes;
+};
+
+struct routed_block {
+  std::shared_ptr<const util::line_block> block;
+  std::vector<std::vector<std::string_view>> lines;
+  std::vector<std::vector<std::uint64_t>> hashes;
+};
+
+// First occurrences found by the dedup filter, shared by the workers
+struct dedup_sink {
+  std::FILE* out{nullptr}; // --dedup-out, or null to only count
+  std::mutex mtx;
+  std::atomic<std::uint64_t> seen{0};
+  std::atomic<std::uint64_t> passed{0};
+};
+
+// What one worker updates: its own hll and cms, and its partitions of the shared filter
+struct sinks {
+  probkit::hll::sketch* hll{nullptr};
+  probkit::cms::sketch* cms{nullptr};
+  probkit::bloom::filter* bloom{nullptr};
+  dedup_sink* dedup{nullptr};
+  util::saturation_flag* saturated{nullptr}; // raised when a cms update clamps a counter
+};
+
+// Feed one batch to every selected sketch; hs[i] == hash64(lines[i], GlobalOptions::hash)
+inline void apply(const sinks& s, std::span<const std::string_view> lines, std::span<const std::uint64_t> hs,
+                  std::string& out) {
+  if (s.hll != nullptr) {
+    (void)s.hll->add_hashed_batch(hs);
+  }
+  if (s.cms != nullptr) {
+    s.saturated->note(s.cms->inc_hashed_batch(lines, hs));
+  }
+  if (s.bloom == nullptr) {
+    return;
+  }
+  std::uint64_t fresh = 0;
+  for (std::size_t i = 0; i < lines.size(); ++i) {
+    auto mc = s.bloom->might_contain_hashed(hs[i]);
+    if (mc && !mc.value()) {
+      (void)s.bloom->add_hashed(hs[i]);
+      if (s.dedup->out != nullptr) {
+        out.append(lines[i]);
+        out.push_back('\n');
+      }
+      ++fresh;
+    }
+  }
+  s.dedup->seen.fetch_add(lines.size(), std::memory_order_relaxed);
+  s.dedup->passed.fetch_add(fresh, std::memory_order_relaxed);
+  if (!out.empty()) {
+    const std::scoped_lock lk(s.dedup->mtx);
+    std::fwrite(out.data(), 1, out.size(), s.dedup->out);
+    out.clear();
+  }
+}
+
+inline auto open_input(const GlobalOptions& g, line_reader& in) -> bool {
+  if (!in.open(input_spec_from(g))) {
+    std::fputs("error: failed to open input\n", stderr);
+    return false;
+  }
+  in.set_line_limit(g.stop_after);
+  return true;
+}
+
+auto report(const MultiOptions& o, const GlobalOptions& g, const probkit::hll::sketch* hll,
+            const probkit::cms::sketch* cms, const dedup_sink& dedup) -> CommandResult;
+auto run_multi(const MultiOptions& o, const GlobalOptions& g, const util::placement& place,
+               std::vector<probkit::hll::sketch>& hlls, std::vector<probkit::cms::sketch>& cmss,
+               probkit::bloom::filter* f, dedup_sink& dedup) -> CommandResult;
+} // namespace
+
+auto cmd_multi(int argc, char** argv, const GlobalOptions& g) -> CommandResult {
+  const MultiOptions o = parse_multi_opts(argc, argv);
+  if (o.show_help) {
+    print_help();
+    return CommandResult::Success;
+  }
+  if (o.error) {
+    return CommandResult::ConfigError;
+  }
+  if (!o.hll && !o.cms && !o.bloom) {
+    std::fputs("error: select at least one of --hll, --cms, --bloom\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  if (!g.bucket.empty()) {
+    std::fputs("error: multi does not support --bucket\n", stderr);
+    return CommandResult::ConfigError;
+  }
+  if (!o.dedup_out.empty() && !o.bloom) {
+    std::fputs("error: --dedup-out needs --bloom\n", stderr);
+    return CommandResult::ConfigError;
+  }
+
+  const int num_workers = decide_num_workers(g.threads, g.cpu_affinity.size());
+  const util::placement place = util::placement::make(g.cpu_affinity, g.numa);
+  std::vector<probkit::hll::sketch> hlls;
+  std::vector<probkit::cms::sketch> cmss;
+  for (int i = 0; i < num_workers; ++i) {
+    // Built on the worker's node, like the single-sketch subcommands' locals
+    const bool ok = place.on_worker_node(static_cast<std::size_t>(i), [&]() -> bool {
+      if (o.hll) {
+        auto r = probkit::hll::sketch::make(probkit::hll::Config{.precision = o.precision}, g.hash);
+        if (!r) {
+          return false;
+        }
+        hlls.push_back(std::move(r.value()));
+      }
+      if (o.cms) {
+        auto r = probkit::cms::sketch::make(probkit::cms::Config{.eps = o.eps,
+                                                                 .delta = o.delta,
+                                                                 .topk = o.topk,
+                                                                 .row_hash = probkit::cms::RowHash::double_hash,
+                                                                 .alloc = alloc_policy_from(g)},
+                                            g.hash);
+        if (!r) {
+          return false;
+        }
+        cmss.push_back(std::move(r.value()));
+      }
+      return true;
+    });
+    if (!ok) {
+      std::fputs("error: failed to init sketches\n", stderr);
+      return CommandResult::ConfigError;
+    }
+  }
+
+  std::optional<probkit::bloom::filter> f;
+  if (o.bloom) {
+    auto r = probkit::bloom::filter::make(probkit::bloom::Config{.fp = o.fp,
+                                                                 .capacity_hint = o.cap,
+                                                                 .partitions = static_cast<std::size_t>(num_workers),
+                                                                 .probe_hash = probkit::bloom::ProbeHash::derived,
+                                                                 .alloc = alloc_policy_from(g)},
+                                          g.hash);
+    if (!r) {
+      std::fputs("error: failed to build bloom filter\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    f.emplace(std::move(r.value()));
+  }
+
+  dedup_sink dedup;
+  if (!o.dedup_out.empty()) {
+    dedup.out = std::fopen(o.dedup_out.c_str(), "wb");
+    if (dedup.out == nullptr) {
+      std::fprintf(stderr, "error: failed to open --dedup-out %s\n", o.dedup_out.c_str());
+      return CommandResult::IOError;
+    }
+  }
+  const CommandResult r = run_multi(o, g, place, hlls, cmss, f ? &*f : nullptr, dedup);
+  if (dedup.out != nullptr && std::fclose(dedup.out) != 0) {
+    std::fprintf(stderr, "error: failed to write --dedup-out %s\n", o.dedup_out.c_str());
+    return CommandResult::IOError;
+  }
+  return r;
+}
+
+namespace {
+auto run_multi(const MultiOptions& o, const GlobalOptions& g, const util::placement& place,
+               std::vector<probkit::hll::sketch>& hlls, std::vector<probkit::cms::sketch>& cmss,
+               probkit::bloom::filter* f, dedup_sink& dedup) -> CommandResult {
+  const auto workers = static_cast<std::size_t>(decide_num_workers(g.threads, g.cpu_affinity.size()));
+  util::pipeline_metrics metrics{workers};
+  util::metrics_reporter reporter{metrics, report_options_from(g, "multi")};
+  util::pipeline_metrics* const m = reporter.active() ? &metrics : nullptr;
+  util::thread_counters* const reader_counters = util::reader_counters(m);
+  std::uint64_t bytes = f != nullptr ? f->byte_size() : 0U;
+  for (const auto& s : hlls) {
+    bytes += s.byte_size();
+  }
+  for (const auto& s : cmss) {
+    bytes += s.byte_size();
+  }
+  metrics.set_sketch_bytes(bytes);
+  util::saturation_flag saturated;
+  const auto sinks_for = [&](std::size_t w) -> sinks {
+    return sinks{.hll = o.hll ? &hlls[w] : nullptr,
+                 .cms = o.cms ? &cmss[w] : nullptr,
+                 .bloom = f,
+                 .dedup = &dedup,
+                 .saturated = &saturated};
+  };
+  const auto finish = [&]() -> CommandResult {
+    util::timed_merge(m, [&]() -> void {
+      for (std::size_t w = 1; w < workers; ++w) {
+        if (o.hll) {
+          (void)hlls[0].merge(hlls[w]);
+        }
+        if (o.cms) {
+          saturated.note(cmss[0].merge(cmss[w]));
+        }
+      }
+    });
+    if (o.cms) {
+      saturated.warn_if_hit(cmss[0].counter_width());
+    }
+    return report(o, g, o.hll ? hlls.data() : nullptr, o.cms ? cmss.data() : nullptr, dedup);
+  };
+
+  if (workers <= 1U) {
+    place.pin_worker(0);
+    line_reader in;
+    if (!open_input(g, in)) {
+      return CommandResult::IOError;
+    }
+    const sinks s = sinks_for(0);
+    std::vector<std::uint64_t> hs;
+    std::string out;
+    while (const auto blk = in.next()) {
+      util::count_lines(reader_counters, blk->lines);
+      hs.resize(blk->lines.size());
+      hashing::hash64_batch(blk->lines, g.hash, hs);
+      apply(s, blk->lines, hs, out);
+    }
+    return finish();
+  }
+
+  std::vector<std::unique_ptr<spsc_ring<hashed_batch>>> ring_storage;
+  std::vector<spsc_ring<hashed_batch>*> rings;
+  ring_storage.reserve(workers);
+  rings.reserve(workers);
+  const auto make_ring = [&g]() -> std::unique_ptr<spsc_ring<hashed_batch>> {
+    return std::make_unique<spsc_ring<hashed_batch>>(g.ring_batches);
+  };
+  for (std::size_t w = 0; w < workers; ++w) {
+    ring_storage.push_back(place.on_worker_node(w, make_ring));
+    rings.push_back(ring_storage.back().get());
+  }
+
+  auto worker_fn = [&](std::size_t w) -> void {
+    auto& ring = *rings[w];
+    util::thread_counters* const counters = util::worker_counters(m, w);
+    place.pin_worker(w);
+    const sinks s = sinks_for(w);
+    hashed_batch item;
+    util::backoff idle{g.wait};
+    std::vector<std::uint64_t> hs;
+    std::string out;
+    while (true) {
+      if (ring.pop_n_wait(std::span<hashed_batch>(&item, 1), idle) != 0U) {
+        if (item.hashes.empty()) {
+          hs.resize(item.lines.size());
+          hashing::hash64_batch(item.lines, g.hash, hs);
+          apply(s, item.lines, hs, out);
+        } else {
+          apply(s, item.lines, item.hashes, out);
+        }
+        item = hashed_batch{}; // drop this worker's reference to the block
+      } else {
+        util::count_idle(counters);
+        if (ring.closed() && ring.empty()) {
+          break;
+        }
+      }
+    }
+    util::charge_worker(g.stage_cpu);
+  };
+  const auto close_rings = [&rings]() -> void {
+    for (auto* r : rings) {
+      r->close();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(workers);
+  for (std::size_t w = 0; w < workers; ++w) {
+    threads.emplace_back(worker_fn, w);
+  }
+
+  // This thread is the reader
+  place.pin_reader();
+  const std::uint64_t read_start = util::thread_cpu_ns();
+  line_reader in;
+  if (!open_input(g, in)) {
+    close_rings();
+    for (auto& t : threads) {
+      t.join();
+    }
+    return CommandResult::IOError;
+  }
+  std::vector<std::uint64_t> hs;
+  while (const auto blk = in.next()) {
+    util::count_lines(reader_counters, blk->lines);
+    if (f == nullptr) {
+      // Nothing to route by key: contiguous shares, hashed by their worker
+      for (std::size_t w = 0; w < workers; ++w) {
+        const util::line_batch share = util::slice_for_worker(blk, w, workers);
+        if (!share.lines.empty()) {
+          util::count_stall(reader_counters,
+                            rings[w]->push_wait(hashed_batch{.owner = share.owner, .lines = share.lines, .hashes = {}},
+                                                g.wait));
+        }
+      }
+      continue;
+    }
+    // Dedup needs every occurrence of a key on the worker owning its partition: the routing hash is
+    // the key hash every sketch takes, so it travels with the line
+    hs.resize(blk->lines.size());
+    hashing::hash64_batch(blk->lines, g.hash, hs);
+    auto routed = std::make_shared<routed_block>();
+    routed->block = blk;
+    routed->lines.resize(workers);
+    routed->hashes.resize(workers);
+    for (std::size_t i = 0; i < hs.size(); ++i) {
+      const std::size_t w = f->partition_of_hashed(hs[i]) % workers;
+      routed->lines[w].push_back(blk->lines[i]);
+      routed->hashes[w].push_back(hs[i]);
+    }
+    const std::shared_ptr<const routed_block> shared = routed;
+    for (std::size_t w = 0; w < workers; ++w) {
+      if (!shared->lines[w].empty()) {
+        util::count_stall(reader_counters,
+                          rings[w]->push_wait(
+                              hashed_batch{.owner = shared, .lines = shared->lines[w], .hashes = shared->hashes[w]},
+                              g.wait));
+      }
+    }
+  }
+  close_rings();
+  util::charge_reader(g.stage_cpu, read_start);
+  for (auto& t : threads) {
+    t.join();
+  }
+  return finish();
+}
+
+auto report(const MultiOptions& o, const GlobalOptions& g, const probkit::hll::sketch* hll,
+            const probkit::cms::sketch* cms, const dedup_sink& dedup) -> CommandResult {
+  double uu = 0.0;
+  if (hll != nullptr) {
+    auto est = hll->estimate();
+    if (!est) {
+      std::fputs("error: hll estimate failed\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    uu = est.value();
+  }
+  std::vector<probkit::cms::Pair> top;
+  if (cms != nullptr && o.topk > 0U) {
+    auto r = cms->topk(o.topk);
+    if (!r) {
+      std::fputs("error: cms topk failed\n", stderr);
+      return CommandResult::ConfigError;
+    }
+    top = std::move(r.value());
+  }
+  const auto seen = static_cast<unsigned long long>(dedup.seen.load());
+  const auto passed = static_cast<unsigned long long>(dedup.passed.load());
+
+  if (!g.json) {
+    if (hll != nullptr) {
+      std::printf("uu=%.0f m=%zu\n", uu, hll->m());
+    }
+    if (cms != nullptr && o.topk == 0U) {
+      std::fputs("cms: processed\n", stdout);
+    }
+    for (const auto& it : top) {
+      std::fprintf(stdout, "%s\t%llu\n", it.key.c_str(), static_cast<unsigned long long>(it.est));
+    }
+    if (o.bloom) {
+      std::printf("bloom: seen=%llu passed=%llu\n", seen, passed);
+    }
+    return CommandResult::Success;
+  }
+  const char* sep = "";
+  std::fputc('{', stdout);
+  if (hll != nullptr) {
+    std::printf(R"("hll":{"uu":%.0f,"m":%zu})", uu, hll->m());
+    sep = ",";
+  }
+  if (cms != nullptr) {
+    auto [d, w] = cms->dims();
+    std::printf(R"(%s"cms":{"depth":%zu,"width":%zu,"topk":)", sep, d, w);
+    util::print_topk_array(stdout, top);
+    std::fputc('}', stdout);
+    sep = ",";
+  }
+  if (o.bloom) {
+    std::printf(R"(%s"bloom":{"seen":%llu,"passed":%llu,"fp_target":%.6f})", sep, seen, passed, o.fp);
+  }
+  std::fputs("}\n", stdout);
+  return CommandResult::Success;
+}
+} // namespace
+
+} // namespace probkit::cli
@@ -9,35 +9,22 @@
 
 using probkit::cli::CommandResult;
 using probkit::cli::ExitCode;
+using probkit::cli::print_root_help;
 using probkit::cli::to_int;
 
 namespace {
 
-inline void print_root_help() {
-  std::fputs("probkit: approximate stream summarization (Bloom/HLL/CMS)\n"
-             "usage: probkit <subcommand> [global-options] [subcommand-options]\n"
-             "  subcommands: hll | bloom | cms\n\n"
-             "global-options:\n"
-             "  --threads=<N>           number of worker threads (default: HW threads)\n"
-             "  --file=<path>          read from file (default: stdin)\n"
-             "  --json                  machine-readable output\n"
-             "  --hash=wyhash|xxhash   hash algorithm\n"
-             "  --stop-after=<count>   stop after processing N lines\n"
-             "  --stats[=<seconds>]    print periodic stats (default interval: 5s)\n"
-             "  --bucket=<dur>         output per time-bucket (e.g., 30s, 1m)\n"
-             "  --prom[=<path>]        emit Prometheus textfile (to path or stdout)\n",
-             stdout);
-}
-
 struct SubCmd {
   std::string_view name;
   CommandResult (*fn)(int, char**, const probkit::cli::GlobalOptions&);
 };
 
-constexpr std::array<SubCmd, 3> kSubCmds{{
+constexpr std::array<SubCmd, 5> kSubCmds{{
     {.name = "bloom", .fn = probkit::cli::cmd_bloom},
     {.name = "hll", .fn = probkit::cli::cmd_hll},
     {.name = "cms", .fn = probkit::cli::cmd_cms},
+    {.name = "multi", .fn = probkit::cli::cmd_multi},
+    {.name = "merge", .fn = probkit::cli::cmd_merge},
 }}; // std::array to avoid C-style array warning
 
 [[nodiscard]] inline auto dispatch_command(int argc, char** argv, int cmd_start, const probkit::cli::GlobalOptions& g)
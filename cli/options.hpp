@@ -1,9 +1,18 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "probkit/hash.hpp"
+#include "probkit/memory.hpp"
+#include "util/line_reader.hpp"
+#include "util/metrics.hpp"
+#include "util/stage_cpu.hpp"
+#include "util/threads.hpp"
+#include "util/wait.hpp"
 
 namespace probkit::cli {
 
@@ -26,21 +35,57 @@ constexpr auto to_int(ExitCode r) -> int {
 struct GlobalOptions {
   int threads{0};        // 0 => use hardware_concurrency
   std::string file_path; // empty => stdin
+  std::string listen;    // --listen=tcp://host:port | udp://host:port instead of file or stdin
+  util::input_io io{util::input_io::read};
+  util::field_spec fields{}; // --delim/--field/--json-key
   bool json{false};
   std::uint64_t stop_after{0}; // lines; 0 => unlimited
   probkit::hashing::HashConfig hash{};
-  // Observability / rotation flags (parsed; functionality may be enabled in later PRs)
+  // Observability / rotation flags
   bool stats{false};
   unsigned stats_interval_seconds{5}; // default interval when --stats is present without value
   std::string bucket;                 // e.g., "30s", "1m"; empty => no rotation
+  std::string window;                 // with --bucket: every bucket reports the last window of buckets
   bool prom{false};
   std::string prom_path; // empty => stdout
   // Memory upper bound hint (global). Subcommands may override their own sizing.
   std::uint64_t mem_budget_bytes{0};
+  // cms/bloom table backing (--alloc) and whether to fault it in up front with the worker count (--prefault)
+  probkit::Backing alloc{probkit::Backing::heap};
+  bool prefault{false};
+  // How idle pipeline threads wait for work (spin | yield | block)
+  util::wait_strategy wait{util::wait_strategy::block};
+  // Capacity of each reader->worker ring, in batches (one batch is a worker's share of a ~1 MiB block)
+  std::size_t ring_batches{16};
+  // Thread placement: CPUs to pin pipeline threads to (empty => unpinned) and NUMA-node spreading
+  std::vector<int> cpu_affinity;
+  bool numa{false};
+  // Not a flag: embedders (the pipeline benchmark) point this at a sink for per-stage CPU time
+  util::stage_cpu* stage_cpu{nullptr};
 };
 
+inline auto input_spec_from(const GlobalOptions& g) -> util::input_spec {
+  return util::input_spec{.path = g.file_path, .listen = g.listen, .io = g.io, .fields = g.fields};
+}
+
+inline auto alloc_policy_from(const GlobalOptions& g) -> probkit::AllocPolicy {
+  const int workers = util::decide_num_workers(g.threads, g.cpu_affinity.size());
+  return probkit::AllocPolicy{.backing = g.alloc, .prefault_threads = g.prefault ? static_cast<unsigned>(workers) : 0U};
+}
+
+// --stats/--prom settings for one subcommand's metrics_reporter
+inline auto report_options_from(const GlobalOptions& g, std::string_view command) -> util::report_options {
+  return util::report_options{.command = command,
+                              .stats = g.stats,
+                              .prom = g.prom,
+                              .prom_path = g.prom_path,
+                              .interval_seconds = g.stats_interval_seconds};
+}
+
 auto cmd_bloom(int argc, char** argv, const GlobalOptions& g) -> CommandResult;
 auto cmd_hll(int argc, char** argv, const GlobalOptions& g) -> CommandResult;
 auto cmd_cms(int argc, char** argv, const GlobalOptions& g) -> CommandResult;
+auto cmd_multi(int argc, char** argv, const GlobalOptions& g) -> CommandResult;
+auto cmd_merge(int argc, char** argv, const GlobalOptions& g) -> CommandResult;
 
 } // namespace probkit::cli
@@ -1,10 +1,16 @@
 #include "options_parse.hpp"
 
 #include "probkit/hash.hpp"
+#include "util/affinity.hpp"
+#include "util/duration.hpp"
+#include "util/line_reader.hpp"
+#include "util/net_input.hpp"
 #include "util/parse.hpp"
 #include "util/string_utils.hpp"
 
 #include <array>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <iterator>
 #include <string>
@@ -12,28 +18,48 @@
 
 using probkit::cli::OptionResult;
 using probkit::cli::util::parse_u64;
+using probkit::cli::util::parse_wait_strategy;
 using probkit::cli::util::sv_starts_with;
 using probkit::hashing::parse_hash_kind;
 
 namespace probkit::cli {
-namespace {
 
-inline void print_root_help() {
+void print_root_help() {
   std::fputs("probkit: approximate stream summarization (Bloom/HLL/CMS)\n"
              "usage: probkit <subcommand> [global-options] [subcommand-options]\n"
-             "  subcommands: hll | bloom | cms\n\n"
+             "  subcommands: hll | bloom | cms | multi (hll, cms and bloom in one pass)\n"
+             "               merge (combine saved images of one kind)\n\n"
              "global-options:\n"
              "  --threads=<N>           number of worker threads (default: HW threads)\n"
              "  --file=<path>          read from file (default: stdin)\n"
+             "  --listen=<addr>        read from the network instead: tcp://[host]:port takes one connection,\n"
+             "                         udp://[host]:port one line per datagram until an empty one\n"
+             "  --io=read|uring        input reads: blocking read(2), or io_uring with reads queued ahead\n"
+             "  --field=<N>            key is column N (1-based) of each line; lines with fewer columns are skipped\n"
+             "  --delim=<c>            --field column separator: one character or \\t (default: tab)\n"
+             "  --json-key=<name>      key is the value of member <name> of each JSON line (strings unescaped\n"
+             "                         as-is, numbers as written); lines without it are skipped\n"
              "  --json                  machine-readable output\n"
-             "  --hash=wyhash|xxhash   hash algorithm\n"
+             "  --hash=<kind>          hash algorithm: wyhash (default), xxhash, xxh3 (faster on long keys), aes\n"
+             "                         (fastest where the CPU has AES instructions, slow software rounds otherwise)\n"
              "  --stop-after=<count>   stop after processing N lines\n"
-             "  --stats[=<seconds>]    print periodic stats (default interval: 5s)\n"
+             "  --stats[=<seconds>]    print processed=<lines> to stderr periodically (default interval: 5s)\n"
              "  --bucket=<dur>         output per time-bucket (e.g., 30s, 1m)\n"
-             "  --prom[=<path>]        emit Prometheus textfile (to path or stdout)\n",
+             "  --window=<dur>         hll/cms with --bucket: each bucket reports the rolling window ending with it\n"
+             "  --prom[=<path>]        Prometheus metrics: textfile rewritten every stats interval, or stdout at exit\n"
+             "  --ring-capacity=<n>    batches queued per worker ring (default: 16)\n"
+             "  --mem-budget=<bytes>   hll/cms: share one sketch across workers if per-worker copies exceed it\n"
+             "  --alloc=<kind>         cms/bloom table memory: heap (zero-filled, default), lazy (zeroed on first\n"
+             "                         touch), thp (lazy on transparent huge pages) or hugetlb (reserved huge pages)\n"
+             "  --prefault             with a mapped --alloc: fault table pages in up front, one thread per worker\n"
+             "  --wait=spin|yield|block  idle wait strategy for worker threads (default: block)\n"
+             "  --cpu-affinity=<cpus>  pin reader and workers to CPUs, e.g. 0-7,16 (one CPU per thread)\n"
+             "  --numa                 spread workers over NUMA nodes; rings and sketches allocated on each node\n",
              stdout);
 }
 
+namespace {
+
 using HandlerFn = OptionResult (*)(std::string_view, probkit::cli::GlobalOptions&);
 
 inline auto handle_json(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
@@ -66,6 +92,78 @@ inline auto handle_file(std::string_view a, probkit::cli::GlobalOptions& g) -> O
   g.file_path = std::string(val);
   return OptionResult::Handled;
 }
+inline auto handle_listen(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--listen=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--listen="}.size());
+  probkit::cli::util::listen_addr addr;
+  if (!probkit::cli::util::parse_listen(val, addr)) {
+    std::fputs("error: invalid --listen value (expected tcp://[host]:port or udp://[host]:port)\n", stderr);
+    return OptionResult::Error;
+  }
+  g.listen = std::string(val);
+  return OptionResult::Handled;
+}
+inline auto handle_io(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--io=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--io="}.size());
+  if (!probkit::cli::util::parse_input_io(val, g.io)) {
+    std::fputs("error: invalid --io value (expected read|uring)\n", stderr);
+    return OptionResult::Error;
+  }
+  return OptionResult::Handled;
+}
+inline auto handle_field(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--field=")) {
+    return OptionResult::NotHandled;
+  }
+  std::uint64_t v = 0;
+  auto val = a;
+  val.remove_prefix(std::string_view{"--field="}.size());
+  if (!parse_u64(val, v) || v == 0U || v > UINT32_MAX) {
+    std::fputs("error: invalid --field value (columns count from 1)\n", stderr);
+    return OptionResult::Error;
+  }
+  g.fields.field = static_cast<std::size_t>(v);
+  return OptionResult::Handled;
+}
+inline auto handle_delim(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--delim=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--delim="}.size());
+  if (val == "\\t") {
+    g.fields.delim = '\t';
+  } else if (val.size() == 1U && val.front() != '\n') {
+    g.fields.delim = val.front();
+  } else {
+    std::fputs("error: invalid --delim value (expected one character or \\t)\n", stderr);
+    return OptionResult::Error;
+  }
+  return OptionResult::Handled;
+}
+inline auto handle_json_key(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--json-key=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--json-key="}.size());
+  if (val.empty() || val.find_first_of("\"\\") != std::string_view::npos) {
+    std::fputs("error: invalid --json-key value (a member name without quotes or backslashes)\n", stderr);
+    return OptionResult::Error;
+  }
+  std::string& needle = g.fields.json_needle;
+  needle.assign(1, '"');
+  needle.append(val);
+  needle.push_back('"');
+  return OptionResult::Handled;
+}
 inline auto handle_hash(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
   if (!sv_starts_with(a, "--hash=")) {
     return OptionResult::NotHandled;
@@ -127,6 +225,20 @@ inline auto handle_bucket(std::string_view a, probkit::cli::GlobalOptions& g) ->
   g.bucket = std::string(val);
   return OptionResult::Handled;
 }
+inline auto handle_window(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--window=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--window="}.size());
+  std::chrono::nanoseconds ns{};
+  if (!probkit::cli::util::timeutil::parse_duration(val, ns) || ns.count() <= 0) {
+    std::fputs("error: invalid --window value\n", stderr);
+    return OptionResult::Error;
+  }
+  g.window = std::string(val);
+  return OptionResult::Handled;
+}
 inline auto handle_prom(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
   if (a == "--prom") {
     g.prom = true;
@@ -157,9 +269,90 @@ inline auto handle_mem_budget(std::string_view a, probkit::cli::GlobalOptions& g
   return OptionResult::Handled;
 }
 
-constexpr std::array<HandlerFn, 9> kGlobalHandlers{handle_json,   handle_threads,    handle_file,
-                                                   handle_hash,   handle_stop_after, handle_stats,
-                                                   handle_bucket, handle_prom,       handle_mem_budget};
+inline auto handle_alloc(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--alloc=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--alloc="}.size());
+  if (val == "heap") {
+    g.alloc = probkit::Backing::heap;
+  } else if (val == "lazy") {
+    g.alloc = probkit::Backing::lazy;
+  } else if (val == "thp") {
+    g.alloc = probkit::Backing::thp;
+  } else if (val == "hugetlb") {
+    g.alloc = probkit::Backing::hugetlb;
+  } else {
+    std::fputs("error: invalid --alloc value (expected heap|lazy|thp|hugetlb)\n", stderr);
+    return OptionResult::Error;
+  }
+  return OptionResult::Handled;
+}
+inline auto handle_prefault(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (a != "--prefault") {
+    return OptionResult::NotHandled;
+  }
+  g.prefault = true;
+  return OptionResult::Handled;
+}
+
+inline auto handle_wait(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--wait=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--wait="}.size());
+  if (!parse_wait_strategy(val, g.wait)) {
+    std::fputs("error: invalid --wait value (expected spin|yield|block)\n", stderr);
+    return OptionResult::Error;
+  }
+  return OptionResult::Handled;
+}
+
+inline auto handle_ring_capacity(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--ring-capacity=")) {
+    return OptionResult::NotHandled;
+  }
+  std::uint64_t v = 0;
+  auto val = a;
+  val.remove_prefix(std::string_view{"--ring-capacity="}.size());
+  constexpr std::uint64_t kMaxRingBatches = std::uint64_t{1} << 20U;
+  if (!parse_u64(val, v) || v == 0U || v > kMaxRingBatches) {
+    std::fputs("error: invalid --ring-capacity value (1..1048576)\n", stderr);
+    return OptionResult::Error;
+  }
+  g.ring_batches = static_cast<std::size_t>(v);
+  return OptionResult::Handled;
+}
+
+inline auto handle_cpu_affinity(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (!sv_starts_with(a, "--cpu-affinity=")) {
+    return OptionResult::NotHandled;
+  }
+  auto val = a;
+  val.remove_prefix(std::string_view{"--cpu-affinity="}.size());
+  if (!probkit::cli::util::parse_cpu_list(val, g.cpu_affinity)) {
+    std::fputs("error: invalid --cpu-affinity value (e.g. 0-3,8; CPUs 0..1023)\n", stderr);
+    return OptionResult::Error;
+  }
+  return OptionResult::Handled;
+}
+
+inline auto handle_numa(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
+  if (a != "--numa") {
+    return OptionResult::NotHandled;
+  }
+  g.numa = true;
+  return OptionResult::Handled;
+}
+
+constexpr std::array<HandlerFn, 21> kGlobalHandlers{
+    handle_json,  handle_threads,  handle_file,     handle_listen,        handle_io,
+    handle_field, handle_delim,    handle_json_key, handle_hash,          handle_stop_after,
+    handle_stats, handle_bucket,   handle_window,   handle_prom,          handle_mem_budget,
+    handle_alloc, handle_prefault, handle_wait,     handle_ring_capacity, handle_cpu_affinity,
+    handle_numa};
 
 inline auto process_global_option(std::string_view a, probkit::cli::GlobalOptions& g) -> OptionResult {
   if (a.empty() || a.front() != '-') {
@@ -207,6 +400,22 @@ inline auto safe_argv_at(char** argv, int argc, int index) -> char* {
       break;
     }
   }
+  if (!g.listen.empty() && !g.file_path.empty()) {
+    std::fputs("error: --listen and --file are mutually exclusive\n", stderr);
+    return ParseResult{.status = ExitCode::ArgumentError, /*next_index=*/.next_index = -1};
+  }
+  if (g.fields.field != 0U && !g.fields.json_needle.empty()) {
+    std::fputs("error: --field and --json-key are mutually exclusive\n", stderr);
+    return ParseResult{.status = ExitCode::ArgumentError, /*next_index=*/.next_index = -1};
+  }
+  if (g.fields.delim != '\t' && g.fields.field == 0U) {
+    std::fputs("error: --delim needs --field (the column to take)\n", stderr);
+    return ParseResult{.status = ExitCode::ArgumentError, /*next_index=*/.next_index = -1};
+  }
+  if (!g.window.empty() && g.bucket.empty()) {
+    std::fputs("error: --window needs --bucket (the reporting interval)\n", stderr);
+    return ParseResult{.status = ExitCode::ArgumentError, /*next_index=*/.next_index = -1};
+  }
   return ParseResult{.status = ExitCode::Success, .next_index = argi};
 }
 
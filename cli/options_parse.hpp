@@ -10,5 +10,7 @@ struct ParseResult {
 };
 
 [[nodiscard]] auto parse_global_options(int argc, char** argv, GlobalOptions& g) -> ParseResult;
+// Usage and the global options, for --help, a bare `probkit` and unknown subcommands
+void print_root_help();
 
 } // namespace probkit::cli
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "parse.hpp"
+
+namespace probkit::cli::util {
+
+// Largest CPU id --cpu-affinity accepts (the size of a default cpu_set_t)
+constexpr int kMaxCpu = 1023;
+
+// Parse a Linux cpulist ("0-3,8,10-11") into ascending, unique CPU ids
+inline auto parse_cpu_list(std::string_view s, std::vector<int>& out) -> bool {
+  out.clear();
+  while (!s.empty()) {
+    const auto comma = s.find(',');
+    std::string_view item = s.substr(0, comma);
+    s = comma == std::string_view::npos ? std::string_view{} : s.substr(comma + 1U);
+    const auto dash = item.find('-');
+    std::uint64_t lo = 0;
+    if (!parse_u64(item.substr(0, dash), lo)) {
+      return false;
+    }
+    std::uint64_t hi = lo;
+    if (dash != std::string_view::npos && !parse_u64(item.substr(dash + 1U), hi)) {
+      return false;
+    }
+    if (hi < lo || hi > static_cast<std::uint64_t>(kMaxCpu)) {
+      return false;
+    }
+    for (std::uint64_t c = lo; c <= hi; ++c) {
+      out.push_back(static_cast<int>(c));
+    }
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return !out.empty();
+}
+
+// CPUs this process may run on (every hardware thread where the mask is unavailable)
+inline auto allowed_cpus() -> std::vector<int> {
+  std::vector<int> cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int c = 0; c <= kMaxCpu; ++c) {
+      if (CPU_ISSET(static_cast<std::size_t>(c), &set)) {
+        cpus.push_back(c);
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    const int hw = static_cast<int>(std::thread::hardware_concurrency());
+    for (int c = 0; c < std::max(hw, 1); ++c) {
+      cpus.push_back(c);
+    }
+  }
+  return cpus;
+}
+
+// CPUs of each NUMA node, in node order, from /sys/devices/system/node; empty without NUMA topology
+inline auto numa_nodes() -> std::vector<std::vector<int>> {
+  std::vector<std::pair<std::uint64_t, std::vector<int>>> found;
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it{"/sys/devices/system/node", ec}, end; !ec && it != end;
+       it.increment(ec)) {
+    const std::string name = it->path().filename().string();
+    std::uint64_t id = 0;
+    if (name.size() <= 4U || name.compare(0, 4, "node") != 0 || !parse_u64(std::string_view{name}.substr(4), id)) {
+      continue;
+    }
+    std::ifstream in(it->path() / "cpulist");
+    std::string list;
+    std::vector<int> cpus;
+    if (std::getline(in, list) && parse_cpu_list(list, cpus)) {
+      found.emplace_back(id, std::move(cpus));
+    }
+  }
+  std::sort(found.begin(), found.end());
+  std::vector<std::vector<int>> nodes;
+  nodes.reserve(found.size());
+  for (auto& n : found) {
+    nodes.push_back(std::move(n.second));
+  }
+  return nodes;
+}
+
+// Restrict the calling thread to cpus; false where unsupported or refused
+inline auto pin_current_thread(const std::vector<int>& cpus) -> bool {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int c : cpus) {
+    CPU_SET(static_cast<std::size_t>(c), &set);
+  }
+  return !cpus.empty() && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+// Where the pipeline threads of one run go (--cpu-affinity, --numa). CPUs are grouped by NUMA node
+// with --numa (one group otherwise); worker w takes group w % groups, so workers alternate between
+// nodes. With an explicit CPU list every thread gets one CPU: the reader (and reducer) the first of
+// group 0, the workers the next ones of their group in turn. --numa alone pins to whole nodes and
+// leaves placement within a node to the scheduler.
+class placement {
+public:
+  placement() = default; // inactive: threads stay wherever the scheduler puts them
+
+  [[nodiscard]] static auto make(const std::vector<int>& cpus, bool numa) -> placement {
+    placement p;
+    if (cpus.empty() && !numa) {
+      return p;
+    }
+    const std::vector<int> allowed = allowed_cpus();
+    std::vector<int> pool;
+    if (cpus.empty()) {
+      pool = allowed;
+    } else {
+      std::set_intersection(cpus.begin(), cpus.end(), allowed.begin(), allowed.end(), std::back_inserter(pool));
+      if (pool.empty()) {
+        std::fputs("warning: no --cpu-affinity CPU is available to this process; threads stay unpinned\n", stderr);
+        return p;
+      }
+    }
+    if (numa) {
+      for (const auto& node : numa_nodes()) {
+        std::vector<int> group;
+        std::set_intersection(node.begin(), node.end(), pool.begin(), pool.end(), std::back_inserter(group));
+        if (!group.empty()) {
+          p.groups_.push_back(std::move(group));
+        }
+      }
+    }
+    if (p.groups_.empty()) {
+      p.groups_.push_back(pool);
+    }
+    p.single_cpu_ = !cpus.empty();
+    return p;
+  }
+
+  [[nodiscard]] auto active() const noexcept -> bool {
+    return !groups_.empty();
+  }
+
+  // CPUs for the reader and reducer threads
+  [[nodiscard]] auto reader_cpus() const -> std::vector<int> {
+    if (!active()) {
+      return {};
+    }
+    return single_cpu_ ? std::vector<int>{groups_[0][0]} : groups_[0];
+  }
+
+  [[nodiscard]] auto worker_cpus(std::size_t w) const -> std::vector<int> {
+    if (!active()) {
+      return {};
+    }
+    const std::size_t g = w % groups_.size();
+    const auto& group = groups_[g];
+    if (!single_cpu_) {
+      return group;
+    }
+    // Group 0 leads with the reader's CPU; workers there start after it when there is room
+    const std::size_t skip = (g == 0U && group.size() > 1U) ? 1U : 0U;
+    return {group[((w / groups_.size()) + skip) % group.size()]};
+  }
+
+  void pin_reader() const {
+    if (active()) {
+      (void)pin_current_thread(reader_cpus());
+    }
+  }
+
+  void pin_worker(std::size_t w) const {
+    if (active()) {
+      (void)pin_current_thread(worker_cpus(w));
+    }
+  }
+
+  // Run fn on a thread placed like worker w and return its result, so the memory fn allocates and
+  // first touches (the worker's ring and local sketch) comes from that worker's node; runs inline
+  // when inactive
+  template <class Fn> auto on_worker_node(std::size_t w, Fn&& fn) const -> std::invoke_result_t<Fn&> {
+    using R = std::invoke_result_t<Fn&>;
+    if (!active()) {
+      return fn();
+    }
+    if constexpr (std::is_void_v<R>) {
+      std::thread t([this, w, &fn]() -> void {
+        pin_worker(w);
+        fn();
+      });
+      t.join();
+    } else {
+      std::optional<R> out;
+      std::thread t([this, w, &fn, &out]() -> void {
+        pin_worker(w);
+        out.emplace(fn());
+      });
+      t.join();
+      return std::move(*out);
+    }
+  }
+
+private:
+  std::vector<std::vector<int>> groups_;
+  bool single_cpu_{false};
+};
+
+} // namespace probkit::cli::util
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace probkit::cli::util {
+
+// Epoch handshake for rotating time buckets without pausing ingest.
+// Each worker owns two sketches and writes to slot(epoch). At a bucket boundary the reducer calls
+// advance(); every worker notices at its next batch boundary, switches to the other slot and
+// acknowledges. Once wait_for_acks() returns, no worker touches the retired slot any more, so the
+// reducer can merge and reset it while ingest continues on the fresh one. The reset happens before
+// the following advance(), so a slot is always empty when workers flip back to it.
+class bucket_epoch {
+public:
+  explicit bucket_epoch(std::size_t workers) : acks_(workers) {}
+
+  static constexpr auto slot(std::uint32_t epoch) noexcept -> std::size_t {
+    return epoch & 1U;
+  }
+
+  // Worker side: call between batches; returns true (and updates seen) when the epoch moved and
+  // the worker must switch to slot(seen). The acknowledgement is published here, so callers have
+  // to make the switch before touching either sketch again.
+  [[nodiscard]] auto observe(std::size_t worker, std::uint32_t& seen) noexcept -> bool {
+    const std::uint32_t e = epoch_.load(std::memory_order_acquire);
+    if (e == seen) {
+      return false;
+    }
+    seen = e;
+    acks_[worker].epoch.store(e, std::memory_order_release);
+    acks_[worker].epoch.notify_one();
+    return true;
+  }
+
+  // Worker side: the worker has stopped and will never write again
+  void retire(std::size_t worker) noexcept {
+    acks_[worker].epoch.store(kRetired, std::memory_order_release);
+    acks_[worker].epoch.notify_one();
+  }
+
+  // Reducer side: start a new bucket; returns the new epoch
+  auto advance() noexcept -> std::uint32_t {
+    return epoch_.fetch_add(1U, std::memory_order_acq_rel) + 1U;
+  }
+  [[nodiscard]] auto current() const noexcept -> std::uint32_t {
+    return epoch_.load(std::memory_order_acquire);
+  }
+
+  // Reducer side: block until every worker has switched to epoch e (or retired)
+  void wait_for_acks(std::uint32_t e) const noexcept {
+    for (const auto& a : acks_) {
+      for (std::uint32_t v = a.epoch.load(std::memory_order_acquire); v != e && v != kRetired;
+           v = a.epoch.load(std::memory_order_acquire)) {
+        a.epoch.wait(v, std::memory_order_acquire);
+      }
+    }
+  }
+
+private:
+  static constexpr std::uint32_t kRetired = std::numeric_limits<std::uint32_t>::max();
+  static constexpr std::size_t kCacheLine = 64;
+
+  struct alignas(kCacheLine) ack_slot {
+    std::atomic<std::uint32_t> epoch{0};
+  };
+
+  alignas(kCacheLine) std::atomic<std::uint32_t> epoch_{0};
+  std::vector<ack_slot> acks_;
+};
+
+} // namespace probkit::cli::util
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace probkit::cli::util {
+
+// Which part of an input line is the sketch key (--delim, --field, --json-key); the whole line by default
+struct field_spec {
+  char delim{'\t'};
+  std::size_t field{0};    // 1-based column split on delim; 0 => not splitting
+  std::string json_needle; // "\"<key>\"" for --json-key; empty => not a JSON lookup
+
+  [[nodiscard]] auto active() const noexcept -> bool {
+    return field != 0U || !json_needle.empty();
+  }
+};
+
+// Position of the count-th (count >= 1) occurrence of d in s, or npos. Whole 16-byte chunks holding
+// fewer hits than still needed are skipped with one popcount on SSE2 targets.
+inline auto find_nth(std::string_view s, char d, std::size_t count) noexcept -> std::size_t {
+  std::size_t i = 0;
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+#if defined(__SSE2__)
+  const __m128i dv = _mm_set1_epi8(d);
+  for (; i + 16U <= s.size(); i += 16U) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): unaligned SSE2 load
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + i));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, dv)));
+    const auto hits = static_cast<std::size_t>(std::popcount(mask));
+    if (hits < count) {
+      count -= hits;
+      continue;
+    }
+    for (; count > 1U; --count) {
+      mask &= mask - 1U;
+    }
+    return i + static_cast<std::size_t>(std::countr_zero(mask));
+  }
+#endif
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (; i < s.size(); ++i) {
+    if (s[i] == d && --count == 0U) {
+      return i;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Column n (1-based) of line split on d, with no quoting rules (a CSV field holding d is split too)
+inline auto split_field(std::string_view line, char d, std::size_t n, std::string_view& out) noexcept -> bool {
+  std::size_t begin = 0;
+  if (n > 1U) {
+    const std::size_t before = find_nth(line, d, n - 1U);
+    if (before == std::string_view::npos) {
+      return false;
+    }
+    begin = before + 1U;
+  }
+  const std::string_view rest = line.substr(begin);
+  out = rest.substr(0, find_nth(rest, d, 1U));
+  return true;
+}
+
+// Value of the member named by needle (its quoted name) in a JSON-lines record, found by scanning for
+// the name followed by a colon rather than parsing, so a nested member of that name matches too. String
+// values come back without their quotes and with escapes undecoded; numbers, true/false and null as
+// written. Object and array values are not keys.
+inline auto json_member(std::string_view line, std::string_view needle, std::string_view& out) noexcept -> bool {
+  const auto skip_ws = [line](std::size_t i) -> std::size_t {
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) {
+      ++i;
+    }
+    return i;
+  };
+  for (std::size_t pos = line.find(needle); pos != std::string_view::npos; pos = line.find(needle, pos + 1U)) {
+    if (pos > 0U && line[pos - 1U] == '\\') {
+      continue; // an escaped quote inside some string
+    }
+    std::size_t i = skip_ws(pos + needle.size());
+    if (i >= line.size() || line[i] != ':') {
+      continue; // a string value equal to the name
+    }
+    i = skip_ws(i + 1U);
+    if (i >= line.size() || line[i] == '{' || line[i] == '[') {
+      return false;
+    }
+    if (line[i] == '"') {
+      for (std::size_t q = line.find('"', i + 1U); q != std::string_view::npos; q = line.find('"', q + 1U)) {
+        std::size_t slashes = 0;
+        while (line[q - 1U - slashes] == '\\') {
+          ++slashes;
+        }
+        if (slashes % 2U == 0U) {
+          out = line.substr(i + 1U, q - i - 1U);
+          return true;
+        }
+      }
+      return false; // unterminated string
+    }
+    std::size_t end = i;
+    while (end < line.size() && line[end] != ',' && line[end] != '}' && line[end] != ']' && line[end] != ' ' &&
+           line[end] != '\t' && line[end] != '\r') {
+      ++end;
+    }
+    out = line.substr(i, end - i);
+    return end != i;
+  }
+  return false;
+}
+
+// The key f selects from line, as a view into it; false when the line lacks that field (it is skipped)
+inline auto extract_key(const field_spec& f, std::string_view line, std::string_view& key) noexcept -> bool {
+  if (!f.json_needle.empty()) {
+    return json_member(line, f.json_needle, key);
+  }
+  if (f.field != 0U) {
+    return split_field(line, f.delim, f.field, key);
+  }
+  key = line;
+  return true;
+}
+
+} // namespace probkit::cli::util
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+#include "probkit/bloom.hpp"
+#include "probkit/cms.hpp"
+#include "probkit/expected.hpp"
+#include "probkit/hll.hpp"
+
+namespace probkit::cli::util {
+
+// Hot-path update calls picked once per run: the compile-time specialisation whose geometry matches
+// the sketch (the common --precision, --fp and --delta choices), else the runtime member. Every
+// sketch of one run shares its geometry, so worker locals and bucket spares reuse the same pick.
+using hll_add_fn = result<void> (*)(hll::sketch&, std::span<const std::string_view>) noexcept;
+using cms_inc_fn = result<void> (*)(cms::sketch&, std::span<const std::string_view>, std::uint64_t) noexcept;
+
+struct bloom_ops {
+  result<bool> (*might_contain)(const bloom::filter&, std::string_view) noexcept;
+  result<void> (*add)(bloom::filter&, std::string_view) noexcept;
+};
+
+inline auto hll_adder(const hll::sketch& s) noexcept -> hll_add_fn {
+  if (hll::fixed_sketch<14>::fits(s)) {
+    return &hll::fixed_sketch<14>::add_batch;
+  }
+  if (hll::fixed_sketch<12>::fits(s)) {
+    return &hll::fixed_sketch<12>::add_batch;
+  }
+  if (hll::fixed_sketch<16>::fits(s)) {
+    return &hll::fixed_sketch<16>::add_batch;
+  }
+  return [](hll::sketch& sk, std::span<const std::string_view> xs) noexcept -> result<void> {
+    return sk.add_batch(xs);
+  };
+}
+
+// Depths 5, 7 and 10 are --delta 1e-2, 1e-3 and 1e-4 (the default)
+inline auto cms_incrementer(const cms::sketch& s) noexcept -> cms_inc_fn {
+  if (cms::fixed_sketch<10>::fits(s)) {
+    return &cms::fixed_sketch<10>::inc_batch;
+  }
+  if (cms::fixed_sketch<5>::fits(s)) {
+    return &cms::fixed_sketch<5>::inc_batch;
+  }
+  if (cms::fixed_sketch<7>::fits(s)) {
+    return &cms::fixed_sketch<7>::inc_batch;
+  }
+  return [](cms::sketch& sk, std::span<const std::string_view> xs, std::uint64_t c) noexcept -> result<void> {
+    return sk.inc_batch(xs, c);
+  };
+}
+
+// k = 7 is --mem-budget and --fp 1e-2; k = 10 is --fp 1e-3
+inline auto bloom_ops_for(const bloom::filter& f) noexcept -> bloom_ops {
+  if (bloom::fixed_filter<7>::fits(f)) {
+    return {&bloom::fixed_filter<7>::might_contain, &bloom::fixed_filter<7>::add};
+  }
+  if (bloom::fixed_filter<10>::fits(f)) {
+    return {&bloom::fixed_filter<10>::might_contain, &bloom::fixed_filter<10>::add};
+  }
+  return {[](const bloom::filter& flt, std::string_view x) noexcept -> result<bool> { return flt.might_contain(x); },
+          [](bloom::filter& flt, std::string_view x) noexcept -> result<void> { return flt.add(x); }};
+}
+
+} // namespace probkit::cli::util
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && __has_include(<sys/syscall.h>) && __has_include(<sys/mman.h>)
+#define PROBKIT_HAS_IO_URING 1
+#include <cerrno>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+#ifndef PROBKIT_HAS_IO_URING
+#define PROBKIT_HAS_IO_URING 0
+#endif
+
+namespace probkit::cli::util {
+
+// Minimal io_uring ring for the input reader, on raw syscalls (no liburing): reads are queued with
+// submit_read() and reaped in completion order with wait(). This thread is the only submitter and
+// the only reaper. init() fails where io_uring is missing or refused (old kernels, seccomp filters);
+// callers then fall back to read(2).
+class io_ring {
+public:
+  io_ring() = default;
+  io_ring(const io_ring&) = delete;
+  auto operator=(const io_ring&) -> io_ring& = delete;
+  io_ring(io_ring&&) = delete;
+  auto operator=(io_ring&&) -> io_ring& = delete;
+  ~io_ring() {
+    close();
+  }
+
+  [[nodiscard]] auto init(unsigned entries) noexcept -> bool {
+#if PROBKIT_HAS_IO_URING
+    close();
+    io_uring_params p{};
+    const long fd = ::syscall(__NR_io_uring_setup, entries, &p); // NOLINT(cppcoreguidelines-pro-type-vararg)
+    if (fd < 0) {
+      return false;
+    }
+    fd_ = static_cast<int>(fd);
+    sq_bytes_ = p.sq_off.array + (p.sq_entries * sizeof(std::uint32_t));
+    cq_bytes_ = p.cq_off.cqes + (p.cq_entries * sizeof(io_uring_cqe));
+    const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0U;
+    if (single) {
+      sq_bytes_ = cq_bytes_ = std::max(sq_bytes_, cq_bytes_);
+    }
+    sq_ = map(sq_bytes_, IORING_OFF_SQ_RING);
+    cq_ = single ? sq_ : map(cq_bytes_, IORING_OFF_CQ_RING);
+    sqes_bytes_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = map(sqes_bytes_, IORING_OFF_SQES);
+    if (sq_ == nullptr || cq_ == nullptr || sqes == nullptr) {
+      if (sqes != nullptr) {
+        (void)::munmap(sqes, sqes_bytes_);
+      }
+      close();
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+    auto* sq = static_cast<char*>(sq_);
+    auto* cq = static_cast<char*>(cq_);
+    sq_tail_ = reinterpret_cast<std::uint32_t*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<const std::uint32_t*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<std::uint32_t*>(sq + p.sq_off.array);
+    cq_head_ = reinterpret_cast<std::uint32_t*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<std::uint32_t*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<const std::uint32_t*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+    return true;
+#else
+    (void)entries;
+    return false;
+#endif
+  }
+
+  [[nodiscard]] auto active() const noexcept -> bool {
+    return fd_ >= 0;
+  }
+
+  // Queue read(fd, buf, len) at offset off (UINT64_MAX: the file's current position, for pipes and
+  // sockets); its completion carries user
+  [[nodiscard]] auto submit_read(int fd, void* buf, std::uint32_t len, std::uint64_t off, std::uint64_t user) noexcept
+      -> bool {
+#if PROBKIT_HAS_IO_URING
+    io_uring_sqe& sqe = next_sqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(buf); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    sqe.len = len;
+    sqe.off = off;
+    sqe.user_data = user;
+    return submit();
+#else
+    (void)fd, (void)buf, (void)len, (void)off, (void)user;
+    return false;
+#endif
+  }
+
+  // Ask the kernel to cancel the read submitted with user; it still completes (with -ECANCELED)
+  [[nodiscard]] auto cancel(std::uint64_t user) noexcept -> bool {
+#if PROBKIT_HAS_IO_URING
+    io_uring_sqe& sqe = next_sqe();
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = user;
+    sqe.user_data = kCancelTag;
+    return submit();
+#else
+    (void)user;
+    return false;
+#endif
+  }
+
+  // Block for the next completion of a read (cancel requests' own completions are skipped); false
+  // when the ring fails
+  [[nodiscard]] auto wait(std::uint64_t& user, int& res) noexcept -> bool {
+#if PROBKIT_HAS_IO_URING
+    for (;;) {
+      const std::uint32_t head = *cq_head_;
+      if (head != std::atomic_ref<std::uint32_t>(*cq_tail_).load(std::memory_order_acquire)) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_]; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        user = cqe.user_data;
+        res = cqe.res;
+        std::atomic_ref<std::uint32_t>(*cq_head_).store(head + 1U, std::memory_order_release);
+        if (user != kCancelTag) {
+          return true;
+        }
+        continue;
+      }
+      if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        return false;
+      }
+    }
+#else
+    (void)user, (void)res;
+    return false;
+#endif
+  }
+
+  void close() noexcept {
+#if PROBKIT_HAS_IO_URING
+    if (sqes_ != nullptr) {
+      (void)::munmap(sqes_, sqes_bytes_);
+    }
+    if (cq_ != nullptr && cq_ != sq_) {
+      (void)::munmap(cq_, cq_bytes_);
+    }
+    if (sq_ != nullptr) {
+      (void)::munmap(sq_, sq_bytes_);
+    }
+    sqes_ = nullptr;
+    cq_ = sq_ = nullptr;
+    if (fd_ >= 0) {
+      (void)::close(fd_);
+    }
+#endif
+    fd_ = -1;
+  }
+
+private:
+#if PROBKIT_HAS_IO_URING
+  static constexpr std::uint64_t kCancelTag = UINT64_MAX;
+
+  [[nodiscard]] auto map(std::size_t bytes, std::int64_t offset) const noexcept -> void* {
+    void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return p == MAP_FAILED ? nullptr : p; // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  }
+
+  [[nodiscard]] auto enter(unsigned to_submit, unsigned min_complete, unsigned flags) const noexcept -> long {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    return ::syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0);
+  }
+
+  // The submission slot after the tail, zeroed; submit() publishes it
+  [[nodiscard]] auto next_sqe() noexcept -> io_uring_sqe& {
+    const std::uint32_t idx = *sq_tail_ & sq_mask_;
+    io_uring_sqe& sqe = sqes_[idx]; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    std::memset(&sqe, 0, sizeof(sqe));
+    sq_array_[idx] = idx; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return sqe;
+  }
+
+  [[nodiscard]] auto submit() noexcept -> bool {
+    std::atomic_ref<std::uint32_t>(*sq_tail_).store(*sq_tail_ + 1U, std::memory_order_release);
+    for (;;) {
+      if (enter(1, 0, 0) >= 0) {
+        return true;
+      }
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  void* sq_{nullptr};
+  void* cq_{nullptr};
+  io_uring_sqe* sqes_{nullptr};
+  io_uring_cqe* cqes_{nullptr};
+  std::size_t sq_bytes_{0};
+  std::size_t cq_bytes_{0};
+  std::size_t sqes_bytes_{0};
+  std::uint32_t* sq_tail_{nullptr};
+  std::uint32_t* sq_array_{nullptr};
+  std::uint32_t* cq_head_{nullptr};
+  std::uint32_t* cq_tail_{nullptr};
+  std::uint32_t sq_mask_{0};
+  std::uint32_t cq_mask_{0};
+#endif
+  int fd_{-1};
+};
+
+} // namespace probkit::cli::util
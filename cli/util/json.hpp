@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string_view>
+
+namespace probkit::cli::util {
+
+// Minimal JSON string escaper for keys in --topk output
+inline void json_escape_and_print(FILE* out, std::string_view s) {
+  std::fputc('"', out);
+  for (const char c : s) {
+    const auto ch = static_cast<unsigned char>(c);
+    switch (ch) {
+    case '\\':
+      std::fputs("\\\\", out);
+      break;
+    case '"':
+      std::fputs("\\\"", out);
+      break;
+    case '\b':
+      std::fputs("\\b", out);
+      break;
+    case '\f':
+      std::fputs("\\f", out);
+      break;
+    case '\n':
+      std::fputs("\\n", out);
+      break;
+    case '\r':
+      std::fputs("\\r", out);
+      break;
+    case '\t':
+      std::fputs("\\t", out);
+      break;
+    default:
+      if (ch < 0x20) {
+        std::fprintf(out, "\\u%04x", ch);
+      } else {
+        std::fputc(ch, out);
+      }
+    }
+  }
+  std::fputc('"', out);
+}
+
+// [{"key":..,"est":..},...] for cms::Pair-like items
+template <class Items> inline void print_topk_array(FILE* out, const Items& items) {
+  std::fputc('[', out);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    const auto& it = items[i];
+    if (i != 0U) {
+      std::fputc(',', out);
+    }
+    std::fputs(R"({"key":)", out);
+    json_escape_and_print(out, it.key);
+    std::fprintf(out, R"(,"est":%llu})", static_cast<unsigned long long>(it.est));
+  }
+  std::fputc(']', out);
+}
+
+} // namespace probkit::cli::util
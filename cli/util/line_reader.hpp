@@ -0,0 +1,507 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<unistd.h>) && __has_include(<fcntl.h>)
+#define PROBKIT_HAS_POSIX_READ 1
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PROBKIT_HAS_POSIX_READ 0
+#endif
+#else
+#define PROBKIT_HAS_POSIX_READ 0
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "fields.hpp"
+#include "io_ring.hpp"
+#include "net_input.hpp"
+
+namespace probkit::cli::util {
+
+// How the reader pulls bytes: blocking read(2) per block, or io_uring with reads queued ahead
+enum class input_io : std::uint8_t { read, uring };
+
+inline auto parse_input_io(std::string_view s, input_io& out) -> bool {
+  if (s == "read") {
+    out = input_io::read;
+    return true;
+  }
+  if (s == "uring") {
+    out = input_io::uring;
+    return true;
+  }
+  return false;
+}
+
+// Where a line_reader takes its input from (--file, --listen, --io) and which part of a line is the key
+struct input_spec {
+  std::string path;   // empty or "-" => stdin
+  std::string listen; // tcp:// or udp:// address (see parse_listen); takes precedence over path
+  input_io io{input_io::read};
+  field_spec fields{};
+};
+
+// Calls on_newline(offset) for every '\n' in p[0, n), in order; 16 bytes per compare on SSE2 targets
+template <class Fn> inline void for_each_newline(const char* p, std::size_t n, Fn&& on_newline) {
+  std::size_t i = 0;
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+#if defined(__SSE2__)
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; i + 16U <= n; i += 16U) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): unaligned SSE2 load
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    while (mask != 0U) {
+      on_newline(i + static_cast<std::size_t>(std::countr_zero(mask)));
+      mask &= mask - 1U;
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    if (p[i] == '\n') {
+      on_newline(i);
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+// One read of input: the bytes plus a view of every complete line in them (newline stripped), or of
+// each line's key field when the reader was opened with an active field_spec
+struct line_block {
+  std::unique_ptr<char[]> bytes; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+  std::vector<std::string_view> lines;
+};
+
+// A worker's share of a block. owner keeps the viewed bytes alive (the block itself, or a structure
+// that holds it), so a block is freed once every batch referencing it has been dropped.
+struct line_batch {
+  std::shared_ptr<const void> owner;
+  std::span<const std::string_view> lines;
+};
+
+// Block-oriented line splitter replacing per-line std::getline: reads large blocks straight from
+// the file descriptor, scans them for newlines, and carries a trailing partial line into the next
+// block. Line semantics match std::getline (a final unterminated line is still returned).
+// With input_io::uring the next blocks are read while the current one is processed: up to
+// kReadDepth reads in flight at explicit offsets for a regular file, one for a pipe or socket. Each
+// read lands in the buffer of the block it becomes, behind kReadHeadroom bytes that take the
+// carried partial line, so the bytes are not copied again. UDP input packs datagrams with recvmmsg
+// and always uses the read path.
+class line_reader {
+public:
+  static constexpr std::size_t kDefaultBlockBytes = std::size_t{1} << 20;
+
+  explicit line_reader(std::size_t block_bytes = kDefaultBlockBytes) noexcept
+      : block_bytes_(block_bytes < 4096U ? 4096U : block_bytes) {}
+  line_reader(const line_reader&) = delete;
+  auto operator=(const line_reader&) -> line_reader& = delete;
+  line_reader(line_reader&&) = delete;
+  auto operator=(line_reader&&) -> line_reader& = delete;
+  ~line_reader() {
+    close();
+  }
+
+  [[nodiscard]] auto open(const input_spec& spec) -> bool {
+    fields_ = spec.fields;
+    if (spec.listen.empty()) {
+      if (!open(spec.path)) {
+        return false;
+      }
+    } else {
+#if PROBKIT_HAS_POSIX_READ
+      close();
+      listen_addr addr;
+      if (!parse_listen(spec.listen, addr)) {
+        std::fputs("error: invalid --listen address\n", stderr);
+        return false;
+      }
+      fd_ = open_listen(addr);
+      owns_ = fd_ >= 0;
+      datagrams_ = addr.udp;
+      if (fd_ < 0) {
+        return false;
+      }
+#else
+      std::fputs("error: --listen is not supported on this platform\n", stderr);
+      return false;
+#endif
+    }
+    if (spec.io == input_io::uring && !datagrams_ && !start_read_ahead()) {
+      std::fputs("warning: io_uring is unavailable; reading with read(2)\n", stderr);
+    }
+    return true;
+  }
+
+  // Empty path or "-" reads stdin
+  [[nodiscard]] auto open(const std::string& path) noexcept -> bool {
+    close();
+#if PROBKIT_HAS_POSIX_READ
+    if (path.empty() || path == "-") {
+      fd_ = STDIN_FILENO;
+      return true;
+    }
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(cppcoreguidelines-pro-type-vararg)
+    owns_ = fd_ >= 0;
+    return fd_ >= 0;
+#else
+    if (path.empty() || path == "-") {
+      file_ = stdin;
+      return true;
+    }
+    file_ = std::fopen(path.c_str(), "rb");
+    owns_ = file_ != nullptr;
+    return file_ != nullptr;
+#endif
+  }
+
+  // Stop after this many lines in total (0 = unlimited), like --stop-after
+  void set_line_limit(std::uint64_t n) noexcept {
+    limit_ = n;
+  }
+  [[nodiscard]] auto failed() const noexcept -> bool {
+    return failed_;
+  }
+  [[nodiscard]] auto lines_read() const noexcept -> std::uint64_t {
+    return lines_read_;
+  }
+
+  // Next block holding at least one line, or nullptr at end of input or on a read error
+  [[nodiscard]] auto next() -> std::shared_ptr<line_block> {
+    if (ring_.active()) {
+      return next_read_ahead();
+    }
+    while (!eof_ && !limit_reached()) {
+      auto blk = std::make_shared<line_block>();
+      const std::size_t cap = carry_.size() >= block_bytes_ / 2U ? carry_.size() * 2U : block_bytes_;
+      blk->bytes.reset(new char[cap]); // NOLINT(cppcoreguidelines-owning-memory): uninitialised on purpose
+      char* buf = blk->bytes.get();
+      std::memcpy(buf, carry_.data(), carry_.size());
+      std::size_t filled = carry_.size();
+      std::size_t scanned = filled; // the carried bytes hold no newline
+      std::size_t line_start = 0;
+      bool have_line = false;
+      carry_.clear();
+      // Keep reading only until the block ends a line, so a slow pipe still yields blocks promptly
+      while (filled < cap && !have_line) {
+        const std::size_t got = read_some(buf + filled, cap - filled); // NOLINT(*-pointer-arithmetic)
+        if (got == 0U) {
+          eof_ = true;
+          break;
+        }
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        for_each_newline(buf + scanned, filled + got - scanned, [&](std::size_t off) {
+          const std::size_t end = scanned + off;
+          emit(*blk, std::string_view(buf + line_start, end - line_start)); // NOLINT(*-pointer-arithmetic)
+          line_start = end + 1U;
+          have_line = true;
+        });
+        filled += got;
+        scanned = filled;
+      }
+      if (eof_ && line_start < filled) {
+        emit(*blk, std::string_view(buf + line_start, filled - line_start)); // NOLINT(*-pointer-arithmetic)
+        line_start = filled;
+      }
+      if (!limit_reached()) {
+        carry_.assign(buf + line_start, filled - line_start); // NOLINT(*-pointer-arithmetic)
+      }
+      if (!blk->lines.empty()) {
+        return blk;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  static constexpr std::size_t kReadDepth = 4;
+  static constexpr std::size_t kReadHeadroom = std::size_t{64} << 10;
+
+  // A queued io_uring read; buf is kReadHeadroom bytes of room for the carried partial line, then
+  // the read target
+  struct pending_read {
+    std::unique_ptr<char[]> buf; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+    std::uint64_t offset{0};
+    std::uint32_t len{0};
+    int res{0};
+    bool done{false};
+  };
+
+  [[nodiscard]] auto start_read_ahead() -> bool {
+#if PROBKIT_HAS_POSIX_READ
+    struct stat st {};
+    if (::fstat(fd_, &st) == 0 && S_ISREG(st.st_mode)) {
+      const off_t pos = ::lseek(fd_, 0, SEEK_CUR);
+      seekable_ = pos >= 0;
+      next_offset_ = seekable_ ? static_cast<std::uint64_t>(pos) : 0U;
+      file_size_ = static_cast<std::uint64_t>(st.st_size);
+    }
+    // Room for every read plus a cancel request for each
+    if (!ring_.init(static_cast<unsigned>(2U * kReadDepth))) {
+      return false;
+    }
+    queue_reads();
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Keep the read-ahead queue full: kReadDepth reads for a regular file (up to its size at open),
+  // one at the current position otherwise
+  void queue_reads() {
+    const std::size_t depth = seekable_ ? kReadDepth : 1U;
+    const auto len = static_cast<std::uint32_t>(std::min<std::size_t>(block_bytes_, std::size_t{1} << 30U));
+    while (!read_ahead_end_ && reads_.size() < depth) {
+      if (seekable_ && next_offset_ >= file_size_) {
+        read_ahead_end_ = true;
+        break;
+      }
+      pending_read r;
+      r.buf.reset(new char[kReadHeadroom + len]); // NOLINT(cppcoreguidelines-owning-memory)
+      r.len = len;
+      r.offset = seekable_ ? next_offset_ : UINT64_MAX;
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      if (!ring_.submit_read(fd_, r.buf.get() + kReadHeadroom, len, r.offset, first_id_ + reads_.size())) {
+        failed_ = true;
+        read_ahead_end_ = true;
+        break;
+      }
+      next_offset_ += len;
+      reads_.push_back(std::move(r));
+    }
+  }
+
+  // The oldest queued read once it completes; false at end of input or on an error
+  [[nodiscard]] auto take_read(pending_read& out) -> bool {
+    if (reads_.empty()) {
+      return false;
+    }
+    while (!reads_.front().done) {
+      std::uint64_t id = 0;
+      int res = 0;
+      if (!ring_.wait(id, res)) {
+        failed_ = true;
+        return false;
+      }
+      if (id >= first_id_ && id - first_id_ < reads_.size()) {
+        pending_read& r = reads_[static_cast<std::size_t>(id - first_id_)];
+        r.res = res;
+        r.done = true;
+      }
+    }
+    out = std::move(reads_.front());
+    reads_.pop_front();
+    ++first_id_;
+    if (out.res < 0) {
+      failed_ = true;
+      read_ahead_end_ = true;
+      return false;
+    }
+#if PROBKIT_HAS_POSIX_READ
+    // A short read inside a regular file would leave a gap before the reads queued after it
+    while (seekable_ && out.res > 0 && static_cast<std::uint32_t>(out.res) < out.len) {
+      const auto have = static_cast<std::size_t>(out.res);
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      const ssize_t r = ::pread(fd_, out.buf.get() + kReadHeadroom + have, out.len - have,
+                                static_cast<off_t>(out.offset + have));
+      if (r > 0) {
+        out.res += static_cast<int>(r);
+      } else if (r == 0 || errno != EINTR) {
+        break;
+      }
+    }
+#endif
+    if (out.res == 0) {
+      read_ahead_end_ = true;
+    }
+    queue_reads();
+    return true;
+  }
+
+  [[nodiscard]] auto next_read_ahead() -> std::shared_ptr<line_block> {
+    while (!eof_ && !limit_reached()) {
+      pending_read r;
+      const bool have_read = take_read(r);
+      const std::size_t got = have_read ? static_cast<std::size_t>(r.res) : 0U;
+      eof_ = got == 0U;
+      const std::size_t carried = carry_.size();
+      auto blk = std::make_shared<line_block>();
+      char* buf = nullptr;
+      if (have_read && carried <= kReadHeadroom) {
+        blk->bytes = std::move(r.buf);
+        buf = blk->bytes.get() + (kReadHeadroom - carried); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      } else {
+        // A partial line longer than the headroom (or the last one at end of input) gets its own buffer
+        blk->bytes.reset(new char[carried + got]); // NOLINT(cppcoreguidelines-owning-memory)
+        buf = blk->bytes.get();
+        if (got != 0U) {
+          std::memcpy(buf + carried, r.buf.get() + kReadHeadroom, got); // NOLINT(*-pointer-arithmetic)
+        }
+      }
+      std::memcpy(buf, carry_.data(), carried);
+      carry_.clear();
+      const std::size_t filled = carried + got;
+      std::size_t line_start = 0;
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      for_each_newline(buf + carried, got, [&](std::size_t off) {
+        const std::size_t end = carried + off;
+        emit(*blk, std::string_view(buf + line_start, end - line_start)); // NOLINT(*-pointer-arithmetic)
+        line_start = end + 1U;
+      });
+      if (eof_ && line_start < filled) {
+        emit(*blk, std::string_view(buf + line_start, filled - line_start)); // NOLINT(*-pointer-arithmetic)
+        line_start = filled;
+      }
+      if (!limit_reached()) {
+        carry_.assign(buf + line_start, filled - line_start); // NOLINT(*-pointer-arithmetic)
+      }
+      if (!blk->lines.empty()) {
+        return blk;
+      }
+    }
+    return nullptr;
+  }
+
+  // Cancel the reads still in flight and wait for them: the kernel may write their buffers until then
+  void stop_read_ahead() noexcept {
+    if (!ring_.active()) {
+      return;
+    }
+    std::size_t outstanding = 0;
+    for (std::size_t i = 0; i < reads_.size(); ++i) {
+      if (!reads_[i].done) {
+        (void)ring_.cancel(first_id_ + i);
+        ++outstanding;
+      }
+    }
+    for (; outstanding != 0U; --outstanding) {
+      std::uint64_t id = 0;
+      int res = 0;
+      if (!ring_.wait(id, res)) {
+        // Never free a buffer the kernel may still fill
+        for (auto& r : reads_) {
+          (void)r.buf.release();
+        }
+        break;
+      }
+    }
+    reads_.clear();
+    ring_.close();
+  }
+
+  [[nodiscard]] auto limit_reached() const noexcept -> bool {
+    return limit_ != 0U && lines_read_ >= limit_;
+  }
+
+  // Lines without the selected field still count towards the line limit
+  void emit(line_block& blk, std::string_view line) {
+    if (limit_reached()) {
+      return;
+    }
+    ++lines_read_;
+    if (std::string_view key; extract_key(fields_, line, key)) {
+      blk.lines.push_back(key);
+    }
+  }
+
+  [[nodiscard]] auto read_some(char* dst, std::size_t n) noexcept -> std::size_t {
+#if PROBKIT_HAS_POSIX_READ
+    if (datagrams_) {
+      if (datagrams_end_) {
+        return 0;
+      }
+      const long r = recv_datagrams(fd_, dst, n, datagrams_end_);
+      if (r < 0) {
+        failed_ = true;
+        return 0;
+      }
+      return static_cast<std::size_t>(r);
+    }
+    for (;;) {
+      const ssize_t r = ::read(fd_, dst, n);
+      if (r >= 0) {
+        return static_cast<std::size_t>(r);
+      }
+      if (errno != EINTR) {
+        failed_ = true;
+        return 0;
+      }
+    }
+#else
+    const std::size_t r = std::fread(dst, 1, n, file_);
+    if (r == 0U && std::ferror(file_) != 0) {
+      failed_ = true;
+    }
+    return r;
+#endif
+  }
+
+  void close() noexcept {
+    stop_read_ahead();
+#if PROBKIT_HAS_POSIX_READ
+    if (owns_ && fd_ >= 0) {
+      (void)::close(fd_);
+    }
+    fd_ = -1;
+#else
+    if (owns_ && file_ != nullptr) {
+      (void)std::fclose(file_);
+    }
+    file_ = nullptr;
+#endif
+    owns_ = false;
+  }
+
+  std::size_t block_bytes_;
+#if PROBKIT_HAS_POSIX_READ
+  int fd_{-1};
+#else
+  std::FILE* file_{nullptr};
+#endif
+  bool owns_{false};
+  bool eof_{false};
+  bool failed_{false};
+  std::uint64_t limit_{0};
+  std::uint64_t lines_read_{0};
+  std::string carry_; // partial line left over from the previous block
+  field_spec fields_;
+  bool datagrams_{false};     // UDP: each read_some() packs a recvmmsg batch
+  bool datagrams_end_{false}; // an empty datagram ended the stream
+  // input_io::uring
+  io_ring ring_;
+  std::deque<pending_read> reads_; // oldest first; reads_[i] completes with user data first_id_ + i
+  std::uint64_t first_id_{0};
+  std::uint64_t next_offset_{0};
+  std::uint64_t file_size_{0};
+  bool seekable_{false};
+  bool read_ahead_end_{false}; // nothing more to queue
+};
+
+// Contiguous share [w * n / workers, (w + 1) * n / workers) of a block's lines for worker w
+inline auto slice_for_worker(const std::shared_ptr<const line_block>& blk, std::size_t w, std::size_t workers)
+    -> line_batch {
+  const std::size_t n = blk->lines.size();
+  const std::size_t first = w * n / workers;
+  const std::size_t last = (w + 1U) * n / workers;
+  return line_batch{.owner = blk, .lines = std::span<const std::string_view>(blk->lines).subspan(first, last - first)};
+}
+
+} // namespace probkit::cli::util
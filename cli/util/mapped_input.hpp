@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "line_reader.hpp"
+
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>) && __has_include(<sys/stat.h>) && __has_include(<fcntl.h>) &&                       \
+    __has_include(<unistd.h>)
+#define PROBKIT_HAS_MAPPED_INPUT 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PROBKIT_HAS_MAPPED_INPUT 0
+#endif
+#else
+#define PROBKIT_HAS_MAPPED_INPUT 0
+#endif
+
+namespace probkit::cli::util {
+
+// Read-only mapping of a regular input file. open() fails for stdin, pipes, empty files and
+// platforms without mmap; callers then fall back to the streaming line_reader pipeline.
+class mapped_input {
+public:
+  mapped_input() = default;
+  mapped_input(const mapped_input&) = delete;
+  auto operator=(const mapped_input&) -> mapped_input& = delete;
+  mapped_input(mapped_input&&) = delete;
+  auto operator=(mapped_input&&) -> mapped_input& = delete;
+  ~mapped_input() {
+#if PROBKIT_HAS_MAPPED_INPUT
+    if (addr_ != nullptr) {
+      (void)::munmap(addr_, size_);
+    }
+#endif
+  }
+
+  [[nodiscard]] auto open(const std::string& path) noexcept -> bool {
+#if PROBKIT_HAS_MAPPED_INPUT
+    if (path.empty() || path == "-" || addr_ != nullptr) {
+      return false;
+    }
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(cppcoreguidelines-pro-type-vararg)
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+      (void)::close(fd);
+      return false;
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)::close(fd); // the mapping keeps the file referenced
+    if (addr == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      return false;
+    }
+    (void)::madvise(addr, size, MADV_SEQUENTIAL); // each range is scanned front to back
+    addr_ = addr;
+    size_ = size;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+  }
+
+  [[nodiscard]] auto bytes() const noexcept -> std::string_view {
+    return {static_cast<const char*>(addr_), size_};
+  }
+
+private:
+  void* addr_{nullptr};
+  std::size_t size_{0};
+};
+
+// Split data into up to n ranges of roughly equal size, each ending just after a newline (or at the
+// end of data), so no line straddles two ranges
+inline auto split_at_newlines(std::string_view data, std::size_t n) -> std::vector<std::string_view> {
+  std::vector<std::string_view> out;
+  std::size_t begin = 0;
+  for (std::size_t i = 1; i <= n && begin < data.size(); ++i) {
+    std::size_t end = data.size();
+    if (i < n) {
+      const std::size_t target = std::max(begin, (data.size() / n) * i);
+      const std::size_t nl = data.find('\n', target);
+      end = nl == std::string_view::npos ? data.size() : nl + 1U;
+    }
+    out.push_back(data.substr(begin, end - begin));
+    begin = end;
+  }
+  return out;
+}
+
+// Calls fn(lines) with consecutive batches of the lines in range (getline semantics: newline
+// stripped, a final unterminated line included), or of their keys per fields
+template <class Fn> inline void for_each_line_batch(std::string_view range, const field_spec& fields, Fn&& fn) {
+  constexpr std::size_t kBatch = 256;
+  std::array<std::string_view, kBatch> batch{};
+  std::size_t count = 0;
+  std::size_t line_start = 0;
+  const auto push = [&](std::string_view line) {
+    if (!extract_key(fields, line, batch[count])) {
+      return;
+    }
+    ++count;
+    if (count == kBatch) {
+      fn(std::span<const std::string_view>(batch.data(), count));
+      count = 0;
+    }
+  };
+  for_each_newline(range.data(), range.size(), [&](std::size_t off) {
+    push(range.substr(line_start, off - line_start));
+    line_start = off + 1U;
+  });
+  if (line_start < range.size()) {
+    push(range.substr(line_start));
+  }
+  if (count != 0U) {
+    fn(std::span<const std::string_view>(batch.data(), count));
+  }
+}
+
+// Scan data on `workers` threads, one newline-aligned range each; fn(worker, lines) is called from
+// worker threads with disjoint worker indices, so per-worker state needs no synchronisation. Lines are
+// cut down to their keys per fields on those threads. on_start(worker) runs first on each (e.g. to pin it).
+template <class Fn, class Start>
+inline void parallel_for_lines(std::string_view data, std::size_t workers, const field_spec& fields, Fn&& fn,
+                               Start&& on_start) {
+  const auto ranges = split_at_newlines(data, workers == 0U ? 1U : workers);
+  std::vector<std::thread> threads;
+  threads.reserve(ranges.size());
+  for (std::size_t w = 1; w < ranges.size(); ++w) {
+    threads.emplace_back([&fn, &on_start, &ranges, &fields, w]() -> void {
+      on_start(w);
+      for_each_line_batch(ranges[w], fields, [&](std::span<const std::string_view> lines) { fn(w, lines); });
+    });
+  }
+  if (!ranges.empty()) { // the calling thread takes the first range
+    on_start(std::size_t{0});
+    for_each_line_batch(ranges[0], fields,
+                        [&](std::span<const std::string_view> lines) { fn(std::size_t{0}, lines); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+template <class Fn>
+inline void parallel_for_lines(std::string_view data, std::size_t workers, const field_spec& fields, Fn&& fn) {
+  parallel_for_lines(data, workers, fields, std::forward<Fn>(fn), [](std::size_t) -> void {});
+}
+
+} // namespace probkit::cli::util
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace probkit::cli::util {
+
+// Pipeline counters behind --stats and --prom. Every thread on the hot path owns one cache line of
+// counters and bumps it with a relaxed load/store pair (single writer, so no locked read-modify-write);
+// nothing is summed until a scrape.
+struct alignas(64) thread_counters {
+  std::atomic<std::uint64_t> lines{0};
+  std::atomic<std::uint64_t> bytes{0};      // bytes spanned by those lines, separators included
+  std::atomic<std::uint64_t> ring_full{0};  // pushes that found a worker ring full
+  std::atomic<std::uint64_t> idle_waits{0}; // pops that found the ring empty and backed off
+};
+
+inline void bump(std::atomic<std::uint64_t>& c, std::uint64_t n = 1) noexcept {
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// The helpers below take the owning thread's counters, or null when metrics are off.
+// Lines of one block (or one mapped range) are contiguous, so their byte count is one subtraction.
+inline void count_lines(thread_counters* c, std::span<const std::string_view> lines) noexcept {
+  if (c == nullptr || lines.empty()) {
+    return;
+  }
+  bump(c->lines, lines.size());
+  const std::string_view last = lines.back();
+  bump(c->bytes, static_cast<std::uint64_t>(last.data() + last.size() - lines.front().data()) + 1U);
+}
+
+inline void count_stall(thread_counters* c, bool stalled) noexcept {
+  if (c != nullptr && stalled) {
+    bump(c->ring_full);
+  }
+}
+
+inline void count_idle(thread_counters* c) noexcept {
+  if (c != nullptr) {
+    bump(c->idle_waits);
+  }
+}
+
+class pipeline_metrics {
+public:
+  // One slot per worker plus one for the reader (or the single thread doing all the work)
+  explicit pipeline_metrics(std::size_t workers) : slots_(workers + 1U) {}
+
+  [[nodiscard]] auto worker(std::size_t w) noexcept -> thread_counters* {
+    return &slots_[w];
+  }
+  [[nodiscard]] auto reader() noexcept -> thread_counters* {
+    return &slots_.back();
+  }
+
+  // Off the hot path: worker-sketch merges and bucket rotations, and the sketch footprint
+  void add_merge(std::chrono::steady_clock::duration d) noexcept {
+    merges_.fetch_add(1U, std::memory_order_relaxed);
+    merge_ns_.fetch_add(static_cast<std::uint64_t>(std::chrono::nanoseconds(d).count()), std::memory_order_relaxed);
+  }
+  void set_sketch_bytes(std::uint64_t bytes) noexcept {
+    sketch_bytes_.store(bytes, std::memory_order_relaxed);
+  }
+
+  struct totals {
+    std::uint64_t lines{0};
+    std::uint64_t bytes{0};
+    std::uint64_t ring_full{0};
+    std::uint64_t idle_waits{0};
+    std::uint64_t merges{0};
+    std::uint64_t merge_ns{0};
+    std::uint64_t sketch_bytes{0};
+    std::size_t workers{0};
+  };
+
+  [[nodiscard]] auto scrape() const noexcept -> totals {
+    totals t{};
+    for (const auto& s : slots_) {
+      t.lines += s.lines.load(std::memory_order_relaxed);
+      t.bytes += s.bytes.load(std::memory_order_relaxed);
+      t.ring_full += s.ring_full.load(std::memory_order_relaxed);
+      t.idle_waits += s.idle_waits.load(std::memory_order_relaxed);
+    }
+    t.merges = merges_.load(std::memory_order_relaxed);
+    t.merge_ns = merge_ns_.load(std::memory_order_relaxed);
+    t.sketch_bytes = sketch_bytes_.load(std::memory_order_relaxed);
+    t.workers = slots_.size() - 1U;
+    return t;
+  }
+
+private:
+  std::vector<thread_counters> slots_;
+  std::atomic<std::uint64_t> merges_{0};
+  std::atomic<std::uint64_t> merge_ns_{0};
+  std::atomic<std::uint64_t> sketch_bytes_{0};
+};
+
+// Null-tolerant slot lookups for call sites that run with and without metrics
+inline auto reader_counters(pipeline_metrics* m) noexcept -> thread_counters* {
+  return m != nullptr ? m->reader() : nullptr;
+}
+inline auto worker_counters(pipeline_metrics* m, std::size_t w) noexcept -> thread_counters* {
+  return m != nullptr ? m->worker(w) : nullptr;
+}
+
+// Run fn and, with metrics on, record it as one merge
+template <class Fn> inline void timed_merge(pipeline_metrics* m, Fn&& fn) {
+  const auto t0 = std::chrono::steady_clock::now();
+  std::forward<Fn>(fn)();
+  if (m != nullptr) {
+    m->add_merge(std::chrono::steady_clock::now() - t0);
+  }
+}
+
+// Prometheus text exposition of one scrape, every series labelled with the subcommand
+inline auto render_prom(const pipeline_metrics::totals& t, std::string_view command) -> std::string {
+  std::string out;
+  const std::string label = "{command=\"" + std::string(command) + "\"} ";
+  const auto series = [&](const char* name, const char* type, const char* help, const std::string& value) -> void {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    out.append(name).append(label).append(value).append("\n");
+  };
+  series("probkit_lines_in_total", "counter", "Input lines taken in.", std::to_string(t.lines));
+  series("probkit_bytes_in_total", "counter", "Input bytes taken in, line separators included.",
+         std::to_string(t.bytes));
+  series("probkit_ring_full_stalls_total", "counter", "Reader pushes that found a worker ring full.",
+         std::to_string(t.ring_full));
+  series("probkit_worker_idle_waits_total", "counter", "Worker pops that found their ring empty and waited.",
+         std::to_string(t.idle_waits));
+  series("probkit_merges_total", "counter", "Worker sketch merges and bucket rotations.", std::to_string(t.merges));
+  std::array<char, 32> secs{};
+  std::snprintf(secs.data(), secs.size(), "%.9f", static_cast<double>(t.merge_ns) * 1e-9);
+  series("probkit_merge_seconds_total", "counter", "Time spent in merges and bucket rotations.", secs.data());
+  series("probkit_sketch_bytes", "gauge", "Memory held by the sketches or filters.", std::to_string(t.sketch_bytes));
+  series("probkit_workers", "gauge", "Worker threads.", std::to_string(t.workers));
+  return out;
+}
+
+// Replace path with text atomically: write a sibling temporary file, then rename it over path, so a
+// textfile collector never reads a partial file
+inline auto write_textfile(const std::string& path, std::string_view text) -> bool {
+  const std::string tmp = path + ".tmp";
+  std::FILE* f = std::fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  const bool wrote = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+  if (std::fclose(f) != 0 || !wrote) {
+    (void)std::remove(tmp.c_str());
+    return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+struct report_options {
+  std::string_view command;
+  bool stats{false}; // processed=<lines> on stderr every interval
+  bool prom{false};
+  std::string prom_path; // rewritten every interval and at the end; empty => stdout, once at the end
+  unsigned interval_seconds{5};
+};
+
+// Owns the periodic stats/metrics thread of one subcommand run. finish() (or the destructor) stops
+// it and writes the final exposition; declared right after its pipeline_metrics, it outlives the
+// command's final merge and output.
+class metrics_reporter {
+public:
+  metrics_reporter(pipeline_metrics& m, report_options o) : m_(m), o_(std::move(o)) {
+    if (o_.stats || (o_.prom && !o_.prom_path.empty())) {
+      thread_ = std::thread([this]() -> void { run(); });
+    }
+  }
+  metrics_reporter(const metrics_reporter&) = delete;
+  auto operator=(const metrics_reporter&) -> metrics_reporter& = delete;
+  metrics_reporter(metrics_reporter&&) = delete;
+  auto operator=(metrics_reporter&&) -> metrics_reporter& = delete;
+  ~metrics_reporter() {
+    finish();
+  }
+
+  // Whether anything reads the counters; call sites pass null metrics otherwise
+  [[nodiscard]] auto active() const noexcept -> bool {
+    return o_.stats || o_.prom;
+  }
+
+  void finish() {
+    if (finished_) {
+      return;
+    }
+    finished_ = true;
+    if (thread_.joinable()) {
+      {
+        const std::scoped_lock lk(mu_);
+        stop_ = true;
+      }
+      cv_.notify_one();
+      thread_.join();
+    }
+    if (o_.prom) {
+      emit_prom();
+    }
+  }
+
+private:
+  void run() {
+    const auto interval = std::chrono::seconds(o_.interval_seconds == 0U ? 1U : o_.interval_seconds);
+    std::unique_lock lk(mu_);
+    while (!cv_.wait_for(lk, interval, [this]() -> bool { return stop_; })) {
+      if (o_.stats) {
+        std::fprintf(stderr, "processed=%llu\n", static_cast<unsigned long long>(m_.scrape().lines));
+      }
+      if (o_.prom && !o_.prom_path.empty()) {
+        emit_prom();
+      }
+    }
+  }
+
+  void emit_prom() const {
+    const std::string text = render_prom(m_.scrape(), o_.command);
+    if (o_.prom_path.empty()) {
+      std::fwrite(text.data(), 1, text.size(), stdout);
+    } else if (!write_textfile(o_.prom_path, text)) {
+      std::fprintf(stderr, "error: failed to write --prom file %s\n", o_.prom_path.c_str());
+    }
+  }
+
+  pipeline_metrics& m_;
+  report_options o_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_{false};
+  bool finished_{false};
+  std::thread thread_;
+};
+
+} // namespace probkit::cli::util
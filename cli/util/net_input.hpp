@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/socket.h>) && __has_include(<netdb.h>)
+#define PROBKIT_HAS_NET_INPUT 1
+#include <cerrno>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#endif
+#ifndef PROBKIT_HAS_NET_INPUT
+#define PROBKIT_HAS_NET_INPUT 0
+#endif
+
+#include "parse.hpp"
+
+namespace probkit::cli::util {
+
+// --listen=tcp://[host]:port | udp://[host]:port; an empty host binds every interface and an IPv6
+// host goes in brackets (udp://[::1]:5140)
+struct listen_addr {
+  bool udp{false};
+  std::string host;
+  std::string port;
+};
+
+inline auto parse_listen(std::string_view s, listen_addr& out) -> bool {
+  constexpr std::string_view kTcp = "tcp://";
+  constexpr std::string_view kUdp = "udp://";
+  if (s.substr(0, kTcp.size()) == kTcp) {
+    out.udp = false;
+  } else if (s.substr(0, kUdp.size()) == kUdp) {
+    out.udp = true;
+  } else {
+    return false;
+  }
+  s.remove_prefix(kTcp.size());
+  std::string_view host;
+  if (!s.empty() && s.front() == '[') {
+    const auto close = s.find(']');
+    if (close == std::string_view::npos) {
+      return false;
+    }
+    host = s.substr(1, close - 1U);
+    s.remove_prefix(close + 1U);
+  } else {
+    host = s.substr(0, s.rfind(':') == std::string_view::npos ? s.size() : s.rfind(':'));
+    s.remove_prefix(host.size());
+  }
+  std::uint64_t port = 0;
+  if (s.size() < 2U || s.front() != ':' || !parse_u64(s.substr(1), port) || port == 0U || port > 65535U) {
+    return false;
+  }
+  out.host = std::string(host);
+  out.port = std::string(s.substr(1));
+  return true;
+}
+
+// TCP: listen, take one connection and return it (the stream ends when the sender closes); UDP:
+// return the bound socket. -1 on failure, with the reason on stderr.
+inline auto open_listen(const listen_addr& a) -> int {
+#if PROBKIT_HAS_NET_INPUT
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = a.udp ? SOCK_DGRAM : SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo* res = nullptr;
+  if (const int rc = ::getaddrinfo(a.host.empty() ? nullptr : a.host.c_str(), a.port.c_str(), &hints, &res);
+      rc != 0) {
+    std::fprintf(stderr, "error: --listen: %s\n", ::gai_strerror(rc));
+    return -1;
+  }
+  int fd = -1;
+  int err = 0;
+  for (const addrinfo* ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+    fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) {
+      err = errno;
+      continue;
+    }
+    const int one = 1;
+    (void)::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || (!a.udp && ::listen(fd, 1) != 0)) {
+      err = errno;
+      (void)::close(fd);
+      fd = -1;
+    }
+  }
+  ::freeaddrinfo(res);
+  if (fd < 0) {
+    std::fprintf(stderr, "error: --listen: %s\n", std::strerror(err));
+    return -1;
+  }
+  if (a.udp) {
+    return fd;
+  }
+  int conn = -1;
+  do {
+    conn = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+  } while (conn < 0 && errno == EINTR);
+  if (conn < 0) {
+    std::fprintf(stderr, "error: --listen: accept: %s\n", std::strerror(errno));
+  }
+  (void)::close(fd);
+  return conn;
+#else
+  (void)a;
+  std::fputs("error: --listen is not supported on this platform\n", stderr);
+  return -1;
+#endif
+}
+
+// Receive up to a batch of datagrams with one recvmmsg straight into dst[0, n) and pack them as
+// lines: each datagram is one or more lines, and a missing final newline is added. An empty
+// datagram marks the end of the stream (end = true; datagrams before it are still returned).
+// Returns the bytes packed, or -1 on a receive error.
+inline auto recv_datagrams(int fd, char* dst, std::size_t n, bool& end) -> long {
+#if PROBKIT_HAS_NET_INPUT
+  constexpr std::size_t kSlot = 65536; // the largest UDP payload, plus room for the added newline
+  constexpr std::size_t kBatch = 64;
+  const std::size_t slots = std::clamp<std::size_t>(n / kSlot, 1U, kBatch);
+  const std::size_t slot = slots == 1U ? n : kSlot;
+  std::array<iovec, kBatch> iov{};
+  std::array<mmsghdr, kBatch> msgs{};
+  for (std::size_t i = 0; i < slots; ++i) {
+    iov[i] = iovec{.iov_base = dst + (i * slot), .iov_len = slot - 1U}; // NOLINT(*-pointer-arithmetic)
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int got = -1;
+  do {
+    got = ::recvmmsg(fd, msgs.data(), static_cast<unsigned>(slots), MSG_WAITFORONE, nullptr);
+  } while (got < 0 && errno == EINTR);
+  if (got < 0) {
+    return -1;
+  }
+  // Slide each datagram down to the end of the previous one; slot 0 is already in place
+  std::size_t w = 0;
+  for (std::size_t i = 0; i < static_cast<std::size_t>(got); ++i) {
+    const std::size_t len = msgs[i].msg_len;
+    if (len == 0U) {
+      end = true;
+      break;
+    }
+    std::memmove(dst + w, dst + (i * slot), len); // NOLINT(*-pointer-arithmetic)
+    w += len;
+    if (dst[w - 1U] != '\n') { // NOLINT(*-pointer-arithmetic)
+      dst[w++] = '\n';         // NOLINT(*-pointer-arithmetic)
+    }
+  }
+  return static_cast<long>(w);
+#else
+  (void)fd, (void)dst, (void)n, (void)end;
+  return -1;
+#endif
+}
+
+} // namespace probkit::cli::util
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+
+#include "probkit/cms.hpp"
+#include "probkit/error.hpp"
+#include "probkit/expected.hpp"
+
+namespace probkit::cli::util {
+
+// Raised by any thread whose cms update or merge clamped a counter (errc::overflow: the update was
+// still applied, at the cell maximum), so the command can warn once after the run instead of printing
+// clamped estimates as if they were counts
+class saturation_flag {
+public:
+  void note(const result<void>& r) noexcept {
+    if (!r.has_value() && r.error().code == make_error_code(errc::overflow)) {
+      hit_.store(true, std::memory_order_relaxed);
+    }
+  }
+  [[nodiscard]] auto hit() const noexcept -> bool {
+    return hit_.load(std::memory_order_relaxed);
+  }
+  void warn_if_hit(cms::CounterWidth w) const {
+    if (!hit()) {
+      return;
+    }
+    const char* max = w == cms::CounterWidth::u16 ? "65535" : w == cms::CounterWidth::u32 ? "4294967295" : "2^64-1";
+    std::fprintf(stderr, "warning: cms counters saturated at %s; estimates at that value are lower bounds\n", max);
+  }
+
+private:
+  std::atomic<bool> hit_{false};
+};
+
+} // namespace probkit::cli::util
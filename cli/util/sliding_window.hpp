@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace probkit::cli::util {
+
+// Buckets a --window covers at the given --bucket length, rounded up; 0 without a window
+inline auto window_buckets(std::chrono::nanoseconds bucket, std::chrono::nanoseconds window) noexcept -> std::size_t {
+  if (window.count() <= 0 || bucket.count() <= 0) {
+    return 0;
+  }
+  return static_cast<std::size_t>((window.count() + bucket.count() - 1) / bucket.count());
+}
+
+// Merge of the last span buckets of a rotating stream (the union for hll, the sum for cms), kept as
+// two stacks so a tick costs O(1) merges amortised instead of re-merging the whole window:
+//   back_  buckets pushed since the last flip, oldest first, with agg_ their running merge;
+//   front_ older buckets, newest at the bottom; every entry already holds the merge of itself and
+//          all entries below it, so the top one is the merge of the whole front.
+// Evicting pops the top of front_; when front_ runs dry, back_ is flipped onto it newest first, each
+// bucket merged with the entry below it (span - 1 merges once every span ticks). query() merges the
+// front top with agg_. Buckets are moved in, never copied: at most span + 2 sketches are held.
+// make() returns a fresh empty sketch (std::optional, nullopt on failure) with the buckets' config.
+template <class Make> class sliding_window {
+public:
+  using sketch_type = typename std::invoke_result_t<Make&>::value_type;
+
+  sliding_window(std::size_t span, Make make) : span_(span), make_(std::move(make)) {}
+
+  [[nodiscard]] auto span() const noexcept -> std::size_t {
+    return span_;
+  }
+  // Buckets currently held, at most span()
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return front_.size() + back_.size();
+  }
+
+  // Add a finished bucket and drop the oldest one beyond span(); false when no empty sketch could be
+  // made for the running merge (the bucket is then dropped)
+  [[nodiscard]] auto push(sketch_type&& bucket) -> bool {
+    if (!agg_) {
+      agg_ = make_();
+      if (!agg_) {
+        return false;
+      }
+    }
+    (void)agg_->merge(bucket); // a saturating cms merge still completes
+    back_.push_back(std::move(bucket));
+    if (size() > span_) {
+      if (front_.empty()) {
+        flip();
+      }
+      front_.pop_back();
+    }
+    return true;
+  }
+
+  // Merge of every held bucket, as a new sketch
+  [[nodiscard]] auto query() -> std::optional<sketch_type> {
+    std::optional<sketch_type> out = make_();
+    if (!out) {
+      return out;
+    }
+    if (!front_.empty()) {
+      (void)out->merge(front_.back());
+    }
+    if (agg_) {
+      (void)out->merge(*agg_);
+    }
+    return out;
+  }
+
+private:
+  void flip() {
+    for (std::size_t i = back_.size(); i-- > 0U;) {
+      if (!front_.empty()) {
+        (void)back_[i].merge(front_.back());
+      }
+      front_.push_back(std::move(back_[i]));
+    }
+    back_.clear();
+    agg_.reset();
+  }
+
+  std::size_t span_;
+  Make make_;
+  std::vector<sketch_type> front_;
+  std::vector<sketch_type> back_;
+  std::optional<sketch_type> agg_;
+};
+
+} // namespace probkit::cli::util
@@ -1,42 +1,53 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <span>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "wait.hpp"
+
 namespace probkit::cli::util {
 
 // Minimal single-producer single-consumer ring buffer.
 // T should be movable and reasonably small.
+// Capacity is rounded up to a power of two so slots are found with a mask. head_ and tail_ are
+// free-running counters on separate cache lines, and each side caches the other side's counter,
+// touching the shared line only when the cached view says the ring is full (or empty).
+// The *_wait operations add blocking on top: a side that runs out of items (or room) backs off
+// per its wait_strategy and, for block, parks on a futex-backed std::atomic::wait. The other side
+// pays for a notify only while a parked flag is set, so the fast path stays free of syscalls.
 template <typename T> class spsc_ring {
 public:
-  explicit spsc_ring(std::size_t capacity) : capacity_(capacity < 2 ? 2 : capacity), data_(capacity_) {}
+  explicit spsc_ring(std::size_t capacity)
+      : capacity_(std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity)), mask_(capacity_ - 1U), data_(capacity_) {}
 
   static_assert(std::is_move_constructible_v<T>, "spsc_ring requires T to be move-constructible");
 
   // Copy-push (kept for API compatibility)
   [[nodiscard]] auto push(const T& value) noexcept -> bool {
     const std::size_t head = head_.load(std::memory_order_relaxed);
-    const std::size_t next = (head + 1) % capacity_;
-    if (next == tail_.load(std::memory_order_acquire)) {
+    if (!producer_has_room(head, 1U)) {
       return false; // full
     }
-    data_[head] = value;
-    head_.store(next, std::memory_order_release);
+    data_[head & mask_] = value;
+    head_.store(head + 1U, std::memory_order_release);
     return true;
   }
 
   // Move-push to avoid extra string allocations/copies on hot path
   [[nodiscard]] auto push(T&& value) noexcept -> bool {
     const std::size_t head = head_.load(std::memory_order_relaxed);
-    const std::size_t next = (head + 1) % capacity_;
-    if (next == tail_.load(std::memory_order_acquire)) {
+    if (!producer_has_room(head, 1U)) {
       return false; // full
     }
-    data_[head] = std::move(value);
-    head_.store(next, std::memory_order_release);
+    data_[head & mask_] = std::move(value);
+    head_.store(head + 1U, std::memory_order_release);
     return true;
   }
 
@@ -44,25 +55,106 @@ public:
   // Important: Passing std::move(x) here is safe in a retry loop; x is consumed only on success.
   template <class... Args> [[nodiscard]] auto try_emplace(Args&&... args) noexcept -> bool {
     const std::size_t head = head_.load(std::memory_order_relaxed);
-    const std::size_t next = (head + 1) % capacity_;
-    if (next == tail_.load(std::memory_order_acquire)) {
+    if (!producer_has_room(head, 1U)) {
       return false; // full
     }
-    data_[head] = T{std::forward<Args>(args)...};
-    head_.store(next, std::memory_order_release);
+    data_[head & mask_] = T{std::forward<Args>(args)...};
+    head_.store(head + 1U, std::memory_order_release);
     return true;
   }
 
+  // Move as many leading items as fit, published with one release store; returns how many were
+  // consumed (the rest are left untouched for a retry)
+  [[nodiscard]] auto try_push_n(std::span<T> items) noexcept -> std::size_t {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    (void)producer_has_room(head, items.size()); // refreshes the cached tail when short of room
+    const std::size_t n = std::min(items.size(), capacity_ - (head - cached_tail_));
+    if (n == 0U) {
+      return 0;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      data_[(head + i) & mask_] = std::move(items[i]);
+    }
+    head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
   [[nodiscard]] auto pop(T& out) noexcept -> bool {
     const std::size_t tail = tail_.load(std::memory_order_relaxed);
-    if (tail == head_.load(std::memory_order_acquire)) {
+    if (consumer_available(tail) == 0U) {
       return false; // empty
     }
-    out = std::move(data_[tail]);
-    tail_.store((tail + 1) % capacity_, std::memory_order_release);
+    out = std::move(data_[tail & mask_]);
+    tail_.store(tail + 1U, std::memory_order_release);
     return true;
   }
 
+  // Move up to out.size() items into out with one acquire/release pair; returns how many
+  [[nodiscard]] auto pop_n(std::span<T> out) noexcept -> std::size_t {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t n = std::min(out.size(), consumer_available(tail));
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = std::move(data_[(tail + i) & mask_]);
+    }
+    if (n != 0U) {
+      tail_.store(tail + n, std::memory_order_release);
+    }
+    return n;
+  }
+
+  // Push, waiting for room as ws dictates; wakes a parked consumer. Returns true when the first
+  // attempt found the ring full (a producer stall)
+  auto push_wait(T&& value, wait_strategy ws) noexcept -> bool {
+    backoff idle{ws};
+    bool stalled = false;
+    while (!push(std::move(value))) {
+      stalled = true;
+      if (!idle.pause()) {
+        park(producer_seq_, producer_parked_, [this]() noexcept -> bool {
+          return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed) >= capacity_;
+        });
+      }
+    }
+    notify(consumer_seq_, consumer_parked_);
+    return stalled;
+  }
+
+  // pop_n, backing off (or parking) once when the ring is empty. Returns 0 when nothing arrived in
+  // that wait, after close(), or after wake_consumer(), so the caller can re-check its own flags.
+  [[nodiscard]] auto pop_n_wait(std::span<T> out, backoff& idle) noexcept -> std::size_t {
+    std::size_t n = pop_n(out);
+    if (n == 0U && !closed()) {
+      if (!idle.pause()) {
+        park(consumer_seq_, consumer_parked_, [this]() noexcept -> bool {
+          return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_relaxed) && !closed() &&
+                 !kicked_.exchange(false, std::memory_order_acq_rel);
+        });
+      }
+      n = pop_n(out);
+    }
+    if (n != 0U) {
+      idle.reset();
+      notify(producer_seq_, producer_parked_);
+    }
+    return n;
+  }
+
+  // Producer is done: no further pushes; a parked consumer wakes and drains what is left
+  void close() noexcept {
+    closed_.store(true, std::memory_order_release);
+    wake_consumer();
+  }
+  [[nodiscard]] auto closed() const noexcept -> bool {
+    return closed_.load(std::memory_order_acquire);
+  }
+
+  // Unconditionally wake the consumer (e.g. so it notices a pause request); pop_n_wait returns 0
+  void wake_consumer() noexcept {
+    kicked_.store(true, std::memory_order_release);
+    consumer_seq_.fetch_add(1U, std::memory_order_release);
+    consumer_seq_.notify_all();
+  }
+
   [[nodiscard]] auto empty() const noexcept -> bool {
     return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
   }
@@ -72,16 +164,70 @@ public:
     return capacity_;
   }
   auto approx_size() const noexcept -> std::size_t {
-    const auto h = head_.load(std::memory_order_acquire);
     const auto t = tail_.load(std::memory_order_acquire);
-    return (h >= t) ? (h - t) : (capacity_ - t + h);
+    const auto h = head_.load(std::memory_order_acquire);
+    return h - t;
   }
 
 private:
+  static constexpr std::size_t kCacheLine = 64;
+
+  // Producer side: refresh the cached tail only when the cached view lacks room for n items
+  auto producer_has_room(std::size_t head, std::size_t n) noexcept -> bool {
+    if (capacity_ - (head - cached_tail_) >= n) {
+      return true;
+    }
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    return capacity_ - (head - cached_tail_) >= n;
+  }
+
+  // Consumer side: items ready at tail, refreshing the cached head only when it shows none
+  auto consumer_available(std::size_t tail) noexcept -> std::size_t {
+    if (cached_head_ == tail) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    return cached_head_ - tail;
+  }
+
+  // Park until notified, unless still_waiting() turns false after the parked flag is published.
+  // The seq_cst fences here and in notify() order "set flag, re-check ring" against "update ring,
+  // check flag", so at least one side sees the other and a wake-up cannot be lost.
+  template <class Pred>
+  void park(std::atomic<std::uint32_t>& seq, std::atomic<bool>& parked, Pred still_waiting) noexcept {
+    const std::uint32_t s = seq.load(std::memory_order_acquire);
+    parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (still_waiting()) {
+      seq.wait(s, std::memory_order_acquire);
+    }
+    parked.store(false, std::memory_order_relaxed);
+  }
+
+  static void notify(std::atomic<std::uint32_t>& seq, std::atomic<bool>& parked) noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed)) {
+      seq.fetch_add(1U, std::memory_order_release);
+      seq.notify_one();
+    }
+  }
+
+  // Read-only after construction, shared by both sides
   std::size_t capacity_;
+  std::size_t mask_;
   std::vector<T> data_;
-  std::atomic<std::size_t> head_{0};
-  std::atomic<std::size_t> tail_{0};
+  // Written by the producer
+  alignas(kCacheLine) std::atomic<std::size_t> head_{0};
+  std::size_t cached_tail_{0};
+  // Written by the consumer
+  alignas(kCacheLine) std::atomic<std::size_t> tail_{0};
+  std::size_t cached_head_{0};
+  // Parking state, touched only on the slow path
+  alignas(kCacheLine) std::atomic<std::uint32_t> consumer_seq_{0};
+  std::atomic<std::uint32_t> producer_seq_{0};
+  std::atomic<bool> consumer_parked_{false};
+  std::atomic<bool> producer_parked_{false};
+  std::atomic<bool> closed_{false};
+  std::atomic<bool> kicked_{false};
 };
 
 } // namespace probkit::cli::util
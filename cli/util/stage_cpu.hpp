@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+namespace probkit::cli::util {
+
+// Optional per-stage CPU accounting for the ring pipelines (filled in for the pipeline benchmark;
+// the CLI itself leaves GlobalOptions::stage_cpu null). Each reader and worker thread adds its own
+// thread CPU time to its stage when it exits.
+struct stage_cpu {
+  std::atomic<std::uint64_t> reader_ns{0};
+  std::atomic<std::uint64_t> worker_ns{0}; // summed over workers
+};
+
+inline auto thread_cpu_ns() noexcept -> std::uint64_t {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  timespec ts{};
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return (static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ULL) + static_cast<std::uint64_t>(ts.tv_nsec);
+  }
+#endif
+  return 0;
+}
+
+// Add the calling thread's CPU time since since_ns (a thread_cpu_ns() reading; 0 = thread start)
+// to one stage of sink; no-ops for a null sink
+inline void charge_reader(stage_cpu* sink, std::uint64_t since_ns = 0) noexcept {
+  if (sink != nullptr) {
+    sink->reader_ns.fetch_add(thread_cpu_ns() - since_ns, std::memory_order_relaxed);
+  }
+}
+
+inline void charge_worker(stage_cpu* sink) noexcept {
+  if (sink != nullptr) {
+    sink->worker_ns.fetch_add(thread_cpu_ns(), std::memory_order_relaxed);
+  }
+}
+
+} // namespace probkit::cli::util
@@ -1,11 +1,26 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <thread>
 namespace probkit::cli::util {
-inline auto decide_num_workers(int requested) -> int {
+// Explicit --threads wins, then one worker per --cpu-affinity CPU, then one per hardware thread
+inline auto decide_num_workers(int requested, std::size_t pinned_cpus = 0) -> int {
   if (requested > 0) {
     return requested;
   }
+  if (pinned_cpus > 0U) {
+    return static_cast<int>(pinned_cpus);
+  }
   const int hw = static_cast<int>(std::thread::hardware_concurrency());
   return (hw > 0) ? hw : 1;
 }
+
+// Per-worker sketches cost workers * sketch_bytes; once that exceeds a non-zero --mem-budget the
+// pipelines share one concurrently updated sketch instead (one copy, no final merge)
+inline auto prefer_shared_sketch(std::uint64_t mem_budget, int workers, std::uint64_t sketch_bytes) -> bool {
+  if (mem_budget == 0U || workers <= 1) {
+    return false;
+  }
+  return static_cast<std::uint64_t>(workers) * sketch_bytes > mem_budget;
+}
 } // namespace probkit::cli::util
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+
+namespace probkit::cli::util {
+
+// How pipeline threads wait for ring space, ring items, or a pause to end.
+//   spin:  busy-wait with a CPU relax hint; lowest wake-up latency, burns a core per waiter
+//   yield: yield, then 50us sleeps (the historical behaviour)
+//   block: spin briefly, then park in std::atomic::wait (a futex on Linux) until notified
+enum class wait_strategy : std::uint8_t { spin, yield, block };
+
+inline auto parse_wait_strategy(std::string_view s, wait_strategy& out) noexcept -> bool {
+  if (s == "spin") {
+    out = wait_strategy::spin;
+  } else if (s == "yield") {
+    out = wait_strategy::yield;
+  } else if (s == "block") {
+    out = wait_strategy::block;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+// One waiter's escalation state; reset() after making progress
+class backoff {
+public:
+  static constexpr unsigned kSpins = 128; // relax hints before yielding (block) or sleeping (yield)
+  static constexpr unsigned kYields = 16;
+
+  explicit backoff(wait_strategy ws) noexcept : ws_(ws) {}
+
+  void reset() noexcept {
+    step_ = 0;
+  }
+
+  // Wait one step; returns false once a block waiter should park instead
+  [[nodiscard]] auto pause() noexcept -> bool {
+    switch (ws_) {
+    case wait_strategy::spin:
+      cpu_relax();
+      return true;
+    case wait_strategy::yield:
+      if (step_ < kYields) {
+        ++step_;
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+      return true;
+    case wait_strategy::block:
+      if (step_ < kSpins) {
+        ++step_;
+        cpu_relax();
+        return true;
+      }
+      if (step_ < kSpins + kYields) {
+        ++step_;
+        std::this_thread::yield();
+        return true;
+      }
+      return false;
+    }
+    return false;
+  }
+
+private:
+  wait_strategy ws_;
+  unsigned step_{0};
+};
+
+} // namespace probkit::cli::util
@@ -2,19 +2,46 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include "probkit/detail/buffer.hpp"
 #include "probkit/expected.hpp"
 #include "probkit/hash.hpp"
+#include "probkit/memory.hpp"
+#include "probkit/serialize.hpp"
+
+namespace probkit::serialize::detail {
+struct image;
+} // namespace probkit::serialize::detail
 
 namespace probkit::bloom {
 
+// standard: k probes anywhere in the bit array. blocked: one hash picks a 512-bit (cache-line) block and all
+// k probes land inside it, so a lookup costs one cache miss at the price of a slightly higher FP rate.
+enum class Layout : std::uint8_t { standard, blocked };
+
+// Where the double-hashing step h2 comes from. independent: a second hash64 with a salted seed.
+// derived: a mix of the first hash, so a key costs one hash64 and the *_hashed calls can take a
+// hash computed once for several sketches.
+enum class ProbeHash : std::uint8_t { independent, derived };
+
 struct Config {
   double fp = 0.01;
-  std::size_t mem_budget_bytes{};
+  std::size_t mem_budget_bytes{};    // > 0: size by memory (k = 7) instead of fp
+  std::size_t capacity_hint{100000}; // expected keys when sizing by fp
+  Layout layout{Layout::standard};
+  hashing::IndexMap index_map{hashing::IndexMap::modulo}; // pow2 rounds the bit/block count to a power of two
+  // > 1: split the same total size into that many equal, cache-line aligned partitions (see filter::partition_of)
+  std::size_t partitions{1};
+  ProbeHash probe_hash{ProbeHash::independent};
+  AllocPolicy alloc{}; // backing of the bit array
 };
 
+template <std::uint8_t K> class fixed_filter;
+
 class filter {
 public:
   filter() = default;
@@ -23,14 +50,44 @@ public:
   filter(const filter&) = delete;
   auto operator=(const filter&) -> filter& = delete;
 
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}) -> result<filter>;
   [[nodiscard]] static auto make_by_fp(double p, hashing::HashConfig h = {}) -> result<filter>;
   [[nodiscard]] static auto make_by_fp(double p, hashing::HashConfig h, std::size_t capacity_hint) -> result<filter>;
-  [[nodiscard]] static auto make_by_mem(std::size_t bytes, hashing::HashConfig h = {}) -> result<filter>;
+  [[nodiscard]] static auto make_by_mem(std::size_t bytes, hashing::HashConfig h = {}, AllocPolicy alloc = {})
+      -> result<filter>;
+  // Blocked layout; sized for the target FP rate including the block-load penalty
+  [[nodiscard]] static auto make_blocked_by_fp(double p, hashing::HashConfig h = {}) -> result<filter>;
+  [[nodiscard]] static auto make_blocked_by_fp(double p, hashing::HashConfig h, std::size_t capacity_hint)
+      -> result<filter>;
+  [[nodiscard]] static auto make_blocked_by_mem(std::size_t bytes, hashing::HashConfig h = {}, AllocPolicy alloc = {})
+      -> result<filter>;
 
   [[nodiscard]] auto add(std::string_view x) noexcept -> result<void>;
+  // Same as add() per key; both probe hashes are computed chunk-wise through hashing::hash64_batch
+  [[nodiscard]] auto add_batch(std::span<const std::string_view> xs) noexcept -> result<void>;
   // May return false positives; must not return false negatives if constructed successfully
   [[nodiscard]] auto might_contain(std::string_view x) const noexcept -> result<bool>;
   [[nodiscard]] auto merge(const filter& other) noexcept -> result<void>;
+  // ProbeHash::derived only (not_supported otherwise): the same as add(x) and might_contain(x) for
+  // h == hashing::hash64(x, hash_config())
+  [[nodiscard]] auto add_hashed(std::uint64_t h) noexcept -> result<void>;
+  [[nodiscard]] auto might_contain_hashed(std::uint64_t h) const noexcept -> result<bool>;
+
+  // Partition of the bit array that holds all of x's probes (0 for an unpartitioned filter). Keys of
+  // different partitions touch disjoint cache lines, so add() and might_contain() may run concurrently
+  // as long as each partition is used by one thread at a time.
+  [[nodiscard]] auto partition_of(std::string_view x) const noexcept -> std::size_t {
+    return partition_of_hash(hashing::hash64(x, hash_cfg_));
+  }
+  [[nodiscard]] auto partition_of_hashed(std::uint64_t h) const noexcept -> std::size_t {
+    return partition_of_hash(h);
+  }
+
+  // Versioned binary image (see probkit/serialize.hpp); load() can map the bit array in place
+  [[nodiscard]] auto save(const std::string& path) const -> result<void>;
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte>;
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<filter>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<filter>;
 
   [[nodiscard]] auto bit_size() const noexcept -> std::size_t {
     return m_bits_;
@@ -38,28 +95,57 @@ public:
   [[nodiscard]] auto k() const noexcept -> std::uint8_t {
     return k_;
   }
+  [[nodiscard]] auto layout() const noexcept -> Layout {
+    return layout_;
+  }
+  [[nodiscard]] auto index_map() const noexcept -> hashing::IndexMap {
+    return index_map_;
+  }
+  [[nodiscard]] auto probe_hash() const noexcept -> ProbeHash {
+    return probe_hash_;
+  }
+  [[nodiscard]] auto partitions() const noexcept -> std::size_t {
+    return partitions_;
+  }
   [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
     return (m_bits_ + 7U) / 8U;
   }
+  // False for filters loaded with LoadMode::map_read_only
+  [[nodiscard]] auto writable() const noexcept -> bool {
+    return bits_.writable();
+  }
   [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
     return hash_cfg_;
   }
   [[nodiscard]] auto same_params(const filter& other) const noexcept -> bool {
-    return m_bits_ == other.m_bits_ && k_ == other.k_ && hash_cfg_.kind == other.hash_cfg_.kind &&
-           hash_cfg_.seed == other.hash_cfg_.seed && hash_cfg_.thread_salt == other.hash_cfg_.thread_salt;
+    return m_bits_ == other.m_bits_ && partitions_ == other.partitions_ && k_ == other.k_ && layout_ == other.layout_ &&
+           index_map_ == other.index_map_ && probe_hash_ == other.probe_hash_ &&
+           hash_cfg_.kind == other.hash_cfg_.kind && hash_cfg_.seed == other.hash_cfg_.seed &&
+           hash_cfg_.thread_salt == other.hash_cfg_.thread_salt;
   }
 
 private:
+  template <std::uint8_t K> friend class fixed_filter;
+
   static constexpr std::uint8_t kDefaultK = 7;
   static constexpr std::uint64_t kSalt2 = 0x9E3779B97F4A7C15ULL;
+  static constexpr std::size_t kBlockWords = 8; // 512-bit block == one 64-byte cache line
+
+  using word_buffer = probkit::detail::buffer<std::uint64_t>; // 64-byte aligned when owned
 
-  struct layout {
+  struct geometry {
     std::size_t bit_count{};
     std::uint8_t k{};
+    Layout layout{Layout::standard};
+    hashing::IndexMap index_map{hashing::IndexMap::modulo};
+    std::size_t partitions{1};
+    ProbeHash probe_hash{ProbeHash::independent};
   };
 
-  filter(std::vector<std::uint64_t>&& words, layout s, hashing::HashConfig cfg) noexcept
-      : bits_(std::move(words)), m_bits_(s.bit_count), k_(s.k), hash_cfg_(cfg) {}
+  filter(word_buffer&& words, geometry s, hashing::HashConfig cfg) noexcept
+      : bits_(std::move(words)), m_bits_(s.bit_count), part_bits_(s.bit_count / s.partitions),
+        partitions_(s.partitions), k_(s.k), layout_(s.layout), index_map_(s.index_map), probe_hash_(s.probe_hash),
+        hash_cfg_(cfg) {}
 
   static auto index_word(std::size_t bit) noexcept -> std::size_t {
     return bit >> 6;
@@ -67,18 +153,130 @@ private:
   static auto index_mask(std::size_t bit) noexcept -> std::uint64_t {
     return 1ULL << (bit & 63U);
   }
-  [[nodiscard]] auto mod_bit(std::uint64_t v) const noexcept -> std::size_t {
-    return static_cast<std::size_t>(v % static_cast<std::uint64_t>(m_bits_));
+  // Bit (standard) or block (blocked) inside one partition
+  [[nodiscard]] auto bit_of(std::uint64_t v) const noexcept -> std::size_t {
+    return static_cast<std::size_t>(hashing::map_index(v, static_cast<std::uint64_t>(part_bits_), index_map_));
+  }
+
+  [[nodiscard]] auto block_of(std::uint64_t h1) const noexcept -> std::size_t {
+    const auto blocks = static_cast<std::uint64_t>(part_bits_ / (kBlockWords * 64U));
+    return static_cast<std::size_t>(hashing::map_index(h1, blocks, index_map_));
+  }
+
+  // The partition comes from the top bits of a multiplicative remix of h1, so it stays independent of
+  // the in-partition position bit_of/block_of take from h1 itself
+  [[nodiscard]] auto partition_of_hash(std::uint64_t h1) const noexcept -> std::size_t {
+    return static_cast<std::size_t>(
+        hashing::map_index(h1 * kSalt2, static_cast<std::uint64_t>(partitions_), hashing::IndexMap::fastrange));
+  }
+  [[nodiscard]] auto partition_word(std::uint64_t h1) const noexcept -> std::size_t {
+    return partition_of_hash(h1) * (part_bits_ / 64U);
   }
 
   [[nodiscard]] auto second_seed() const noexcept -> std::uint64_t {
     return hash_cfg_.seed ^ kSalt2;
   }
+  // Odd double-hashing step of x, whose first hash is h1 (see ProbeHash)
+  [[nodiscard]] auto second_hash(std::string_view x, std::uint64_t h1) const noexcept -> std::uint64_t;
 
-  std::vector<std::uint64_t> bits_;
+  [[nodiscard]] static auto from_image(serialize::detail::image&& img) -> result<filter>;
+
+  // K > 0 fixes the probe count at compile time (it must equal k_); K == 0 loops over k_
+  template <std::uint8_t K> void set_bits(std::uint64_t h1, std::uint64_t h2) noexcept;
+  template <std::uint8_t K> [[nodiscard]] auto test_bits(std::uint64_t h1, std::uint64_t h2) const noexcept -> bool;
+  template <std::uint8_t K> void add_key(std::string_view x) noexcept;
+  template <std::uint8_t K> void add_keys(std::span<const std::string_view> xs) noexcept;
+  template <std::uint8_t K> [[nodiscard]] auto contains_key(std::string_view x) const noexcept -> bool;
+
+  word_buffer bits_;
   std::size_t m_bits_{};
+  std::size_t part_bits_{}; // m_bits_ / partitions_
+  std::size_t partitions_{1};
   std::uint8_t k_{};
+  Layout layout_{Layout::standard};
+  hashing::IndexMap index_map_{hashing::IndexMap::modulo};
+  ProbeHash probe_hash_{ProbeHash::independent};
   hashing::HashConfig hash_cfg_{};
 };
 
+// A filter with compile-time probe count K: the probe loops unroll. Sizing, layout, partitions and
+// the image format are those of filter, which it holds; wrap() and release() convert either way without
+// copying, and merge() accepts either. Instantiated for K in [3, 12].
+template <std::uint8_t K> class fixed_filter {
+public:
+  static_assert(K >= 3U && K <= 12U, "bloom::fixed_filter is instantiated for k in 3..12");
+  static constexpr std::uint8_t kProbes = K;
+
+  fixed_filter() = default;
+  fixed_filter(fixed_filter&&) noexcept = default;
+  auto operator=(fixed_filter&&) noexcept -> fixed_filter& = default;
+  fixed_filter(const fixed_filter&) = delete;
+  auto operator=(const fixed_filter&) -> fixed_filter& = delete;
+
+  // Sized like filter::make; invalid_argument when that sizing picks a k other than K
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}) -> result<fixed_filter>;
+  // Takes over f; fails with invalid_argument unless fits(f)
+  [[nodiscard]] static auto wrap(filter&& f) -> result<fixed_filter>;
+  [[nodiscard]] static auto fits(const filter& f) noexcept -> bool {
+    return f.k() == K;
+  }
+  // The specialised operations applied to a runtime filter; invalid_argument unless fits(f)
+  [[nodiscard]] static auto add(filter& f, std::string_view x) noexcept -> result<void>;
+  [[nodiscard]] static auto add_batch(filter& f, std::span<const std::string_view> xs) noexcept -> result<void>;
+  [[nodiscard]] static auto might_contain(const filter& f, std::string_view x) noexcept -> result<bool>;
+
+  [[nodiscard]] auto add(std::string_view x) noexcept -> result<void> {
+    return add(base_, x);
+  }
+  [[nodiscard]] auto add_batch(std::span<const std::string_view> xs) noexcept -> result<void> {
+    return add_batch(base_, xs);
+  }
+  [[nodiscard]] auto might_contain(std::string_view x) const noexcept -> result<bool> {
+    return might_contain(base_, x);
+  }
+  [[nodiscard]] auto merge(const filter& other) noexcept -> result<void> {
+    return base_.merge(other);
+  }
+  [[nodiscard]] auto merge(const fixed_filter& other) noexcept -> result<void> {
+    return base_.merge(other.base_);
+  }
+
+  [[nodiscard]] auto save(const std::string& path) const -> result<void> {
+    return base_.save(path);
+  }
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte> {
+    return base_.to_bytes();
+  }
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<fixed_filter>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<fixed_filter>;
+
+  [[nodiscard]] auto base() const noexcept -> const filter& {
+    return base_;
+  }
+  // The underlying runtime filter, without a copy; leaves *this empty
+  [[nodiscard]] auto release() && noexcept -> filter {
+    return std::move(base_);
+  }
+  [[nodiscard]] static constexpr auto k() noexcept -> std::uint8_t {
+    return K;
+  }
+  [[nodiscard]] auto bit_size() const noexcept -> std::size_t {
+    return base_.bit_size();
+  }
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return base_.byte_size();
+  }
+  [[nodiscard]] auto partition_of(std::string_view x) const noexcept -> std::size_t {
+    return base_.partition_of(x);
+  }
+  [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
+    return base_.hash_config();
+  }
+
+private:
+  explicit fixed_filter(filter&& base) noexcept : base_(std::move(base)) {}
+
+  filter base_;
+};
+
 } // namespace probkit::bloom
@@ -2,19 +2,52 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "probkit/detail/buffer.hpp"
+#include "probkit/detail/key_arena.hpp"
 #include "probkit/expected.hpp"
 #include "probkit/hash.hpp"
+#include "probkit/memory.hpp"
+#include "probkit/serialize.hpp"
+
+namespace probkit::serialize::detail {
+struct image;
+} // namespace probkit::serialize::detail
 
 namespace probkit::cms {
 
+// independent: one full hash64 per row with a row-salted seed.
+// double_hash: one hash64 per key; row r uses h1 + r * h2 (Kirsch-Mitzenmacher), h2 derived from h1.
+enum class RowHash : std::uint8_t { independent, double_hash };
+
+// Counter cell size in bytes. Narrower cells shrink the table and its cache footprint; counters
+// saturate at the cell maximum and the update that hit it reports errc::overflow.
+enum class CounterWidth : std::uint8_t { u16 = 2, u32 = 4, u64 = 8 };
+
+// standard: add c to the key's counter in every row.
+// conservative: raise the key's counters only up to (current estimate + c). Never underestimates
+// and overestimates less than standard, so a narrower table holds the same error in practice.
+enum class UpdateRule : std::uint8_t { standard, conservative };
+
+// Largest Config::topk sketch::make() accepts (errc::invalid_argument above it); the tracked keys,
+// four per top-k slot, stay far inside the candidate key ids
+inline constexpr std::size_t kMaxTopk = std::size_t{1} << 20;
+
 struct Config {
   double eps = 1e-3;
   double delta = 1e-4;
-  std::size_t topk = 0; // optional, used for sizing candidate structure
+  std::size_t topk = 0; // > 0 enables heavy-hitter tracking of topk * kCandidateFactor keys, up to kMaxTopk
+  hashing::IndexMap index_map{hashing::IndexMap::modulo}; // pow2 rounds width up to a power of two
+  RowHash row_hash{RowHash::independent};
+  CounterWidth counter_width{CounterWidth::u64};
+  UpdateRule update{UpdateRule::standard};
+  AllocPolicy alloc{}; // backing of the counter table
 };
 
 struct Pair {
@@ -22,6 +55,15 @@ struct Pair {
   std::uint64_t est{};
 };
 
+// Pair whose key views the sketch's candidate storage; see sketch::topk(k, out)
+struct PairView {
+  std::string_view key;
+  std::uint64_t est{};
+};
+
+class concurrent_sketch;
+template <std::size_t Depth> class fixed_sketch;
+
 class sketch {
 public:
   sketch() = default;
@@ -30,39 +72,322 @@ public:
   sketch(const sketch&) = delete;
   auto operator=(const sketch&) -> sketch& = delete;
 
-  [[nodiscard]] static auto make_by_eps_delta(double eps, double delta, hashing::HashConfig h = {}) -> result<sketch>;
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}) -> result<sketch>;
+  [[nodiscard]] static auto make_by_eps_delta(double eps, double delta, hashing::HashConfig h = {},
+                                              AllocPolicy alloc = {}) -> result<sketch>;
 
   [[nodiscard]] auto inc(std::string_view x, std::uint64_t c = 1) noexcept -> result<void>;
+  // Adds c to every key in xs; rows are hashed chunk-wise through hashing::hash64_batch.
+  // Both report errc::overflow once a counter saturates; the remaining updates are still applied.
+  [[nodiscard]] auto inc_batch(std::span<const std::string_view> xs, std::uint64_t c = 1) noexcept -> result<void>;
+  // inc_batch(xs, c) with hs[i] == hashing::hash64(xs[i], hash_config()) computed by the caller; the
+  // keys still feed the heavy-hitter candidates. RowHash::double_hash only (not_supported otherwise).
+  [[nodiscard]] auto inc_hashed_batch(std::span<const std::string_view> xs, std::span<const std::uint64_t> hs,
+                                      std::uint64_t c = 1) noexcept -> result<void>;
   [[nodiscard]] auto estimate(std::string_view x) const noexcept -> result<std::uint64_t>;
+  // Up to k tracked keys by descending current estimate; requires Config::topk > 0
   [[nodiscard]] auto topk(std::size_t k) const -> result<std::vector<Pair>>;
+  // The same into out (cleared, its capacity reused) without copying keys: the views stay valid until
+  // the next update, merge or reset() of this sketch
+  [[nodiscard]] auto topk(std::size_t k, std::vector<PairView>& out) const -> result<void>;
+  // Zero the counters and drop the candidates, keeping every allocation (for reuse across time buckets)
+  [[nodiscard]] auto reset() noexcept -> result<void>;
+  // Adds counters (saturating, see CounterWidth); tracked candidates of both sides are re-estimated
+  // against the merged table. Update rules may differ: sums of either kind never underestimate.
   [[nodiscard]] auto merge(const sketch& other) noexcept -> result<void>;
 
+  // Versioned binary image (see probkit/serialize.hpp); load() can map the counter table in place.
+  // Heavy-hitter candidates travel in the image's extra section and are always copied.
+  [[nodiscard]] auto save(const std::string& path) const -> result<void>;
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte>;
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<sketch>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<sketch>;
+
   [[nodiscard]] auto dims() const noexcept -> std::pair<std::size_t, std::size_t> {
     return {depth_, width_};
   }
+  [[nodiscard]] auto index_map() const noexcept -> hashing::IndexMap {
+    return index_map_;
+  }
+  [[nodiscard]] auto row_hash() const noexcept -> RowHash {
+    return row_hash_;
+  }
+  [[nodiscard]] auto counter_width() const noexcept -> CounterWidth {
+    return counter_width_;
+  }
+  [[nodiscard]] auto update_rule() const noexcept -> UpdateRule {
+    return update_;
+  }
+  // Counter table size
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return table_.size();
+  }
   [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
     return hash_cfg_;
   }
+  [[nodiscard]] auto candidate_capacity() const noexcept -> std::size_t {
+    return cand_cap_;
+  }
+  // False for sketches loaded with LoadMode::map_read_only
+  [[nodiscard]] auto writable() const noexcept -> bool {
+    return table_.writable();
+  }
   [[nodiscard]] auto same_params(const sketch& other) const noexcept -> bool {
-    return depth_ == other.depth_ && width_ == other.width_ && hash_cfg_.kind == other.hash_cfg_.kind &&
-           hash_cfg_.seed == other.hash_cfg_.seed && hash_cfg_.thread_salt == other.hash_cfg_.thread_salt;
+    return depth_ == other.depth_ && width_ == other.width_ && index_map_ == other.index_map_ &&
+           row_hash_ == other.row_hash_ && counter_width_ == other.counter_width_ &&
+           hash_cfg_.kind == other.hash_cfg_.kind && hash_cfg_.seed == other.hash_cfg_.seed &&
+           hash_cfg_.thread_salt == other.hash_cfg_.thread_salt;
   }
 
 private:
-  // Order parameters to avoid adjacent easily-swappable size_t parameters
-  explicit sketch(std::size_t d, hashing::HashConfig cfg, std::size_t w, std::vector<std::uint64_t>&& counters,
-                  std::vector<std::string>&& keys, std::vector<std::uint64_t>&& ests) noexcept
-      : depth_(d), width_(w), hash_cfg_(cfg), table_(std::move(counters)), cand_keys_(std::move(keys)),
-        cand_ests_(std::move(ests)) {}
+  friend class concurrent_sketch;
+  template <std::size_t Depth> friend class fixed_sketch;
+
+  static constexpr std::size_t kCandidateFactor = 4; // tracked keys per requested top-k slot
+  // Largest candidate capacity make() produces and from_image() accepts
+  static constexpr std::size_t kMaxCandidates = kMaxTopk * kCandidateFactor;
+  static_assert(kMaxCandidates < probkit::detail::key_arena::npos, "candidate ids must fit key_arena::id");
+
+  struct geometry {
+    std::size_t depth{};
+    std::size_t width{};
+    hashing::IndexMap index_map{hashing::IndexMap::modulo};
+    RowHash row_hash{RowHash::independent};
+    CounterWidth counter_width{CounterWidth::u64};
+    UpdateRule update{UpdateRule::standard};
+  };
+
+  // Min-heap entry; key is the candidate's id in cand_keys_, whose value is its heap slot
+  struct candidate {
+    std::uint64_t est{};
+    probkit::detail::key_arena::id key{};
+  };
+
+  explicit sketch(geometry g, hashing::HashConfig cfg, probkit::detail::buffer<std::byte>&& counters,
+                  std::size_t cand_cap) noexcept
+      : depth_(g.depth), width_(g.width), index_map_(g.index_map), row_hash_(g.row_hash),
+        counter_width_(g.counter_width), update_(g.update), hash_cfg_(cfg), table_(std::move(counters)),
+        cand_cap_(cand_cap), cand_keys_(cand_cap) {}
+
+  [[nodiscard]] auto geo() const noexcept -> geometry {
+    return geometry{.depth = depth_,
+                    .width = width_,
+                    .index_map = index_map_,
+                    .row_hash = row_hash_,
+                    .counter_width = counter_width_,
+                    .update = update_};
+  }
+
+  // double_hash column in row r for key hash h1 and its derived step
+  [[nodiscard]] auto row_col(std::uint64_t h1, std::uint64_t step, std::size_t r) const noexcept -> std::size_t {
+    return col_of(h1 + (static_cast<std::uint64_t>(r) * step));
+  }
+
+  [[nodiscard]] auto col_of(std::uint64_t h) const noexcept -> std::size_t {
+    return static_cast<std::size_t>(hashing::map_index(h, static_cast<std::uint64_t>(width_), index_map_));
+  }
+
+  // The table viewed as cells of the configured width (Cell must match counter_width_)
+  template <class Cell> [[nodiscard]] auto cells() noexcept -> Cell*;
+  template <class Cell> [[nodiscard]] auto cells() const noexcept -> const Cell*;
+  // Calls fn(cell index) for x's counter in every row. Depth > 0 (here and below) fixes the row
+  // count at compile time and must equal depth_; Depth == 0 loops over depth_.
+  template <std::size_t Depth = 0, class Fn> void for_each_cell(std::string_view x, Fn&& fn) const;
+  // The public update and query calls for a compile-time or runtime depth
+  template <std::size_t Depth>
+  [[nodiscard]] auto inc_with(std::string_view x, std::uint64_t c) noexcept -> result<void>;
+  // hs: caller-computed double_hash key hashes aligned with xs, or null to hash here
+  template <std::size_t Depth>
+  [[nodiscard]] auto inc_batch_with(std::span<const std::string_view> xs, std::uint64_t c,
+                                    const std::uint64_t* hs = nullptr) noexcept -> result<void>;
+  template <std::size_t Depth> [[nodiscard]] auto estimate_with(std::string_view x) const noexcept -> std::uint64_t;
+  // Width-specific bodies behind those; true when a counter saturated
+  template <class Cell, std::size_t Depth = 0>
+  [[nodiscard]] auto inc_as(std::string_view x, std::uint64_t c) noexcept -> bool;
+  template <class Cell, std::size_t Depth = 0>
+  [[nodiscard]] auto inc_batch_as(std::span<const std::string_view> xs, std::uint64_t c,
+                                  const std::uint64_t* pre) noexcept -> bool;
+  template <class Cell, std::size_t Depth = 0>
+  [[nodiscard]] auto estimate_as(std::string_view x) const noexcept -> std::uint64_t;
+  template <class Cell> [[nodiscard]] auto merge_as(const sketch& other) noexcept -> bool;
+
+  [[nodiscard]] static auto from_image(serialize::detail::image&& img) -> result<sketch>;
+  [[nodiscard]] auto candidate_bytes() const -> std::vector<std::byte>;
+  // Union of both candidate sets, re-estimated against the (already merged) table
+  void merge_candidates(const sketch& other);
+  // Keep the cand_cap_ keys of pool with the largest estimates against this table
+  void rebuild_candidates(std::vector<Pair>&& pool);
+  // Append a candidate not yet tracked, leaving the heap order to the caller
+  void push_candidate(std::string_view x, std::uint64_t est);
+
+  // SpaceSaving-style admission: O(1) reject below the heap minimum, O(log n) update otherwise
+  void offer(std::string_view x, std::uint64_t est);
+  void sift_down(std::size_t i) noexcept;
+  void sift_up(std::size_t i) noexcept;
 
   std::size_t depth_{};
   std::size_t width_{};
+  hashing::IndexMap index_map_{hashing::IndexMap::modulo};
+  RowHash row_hash_{RowHash::independent};
+  CounterWidth counter_width_{CounterWidth::u64};
+  UpdateRule update_{UpdateRule::standard};
   hashing::HashConfig hash_cfg_{};
-  std::vector<std::uint64_t> table_; // size depth_*width_
+  probkit::detail::buffer<std::byte> table_; // depth_*width_ cells of counter_width_ bytes
+  std::vector<std::size_t> cu_cells_;        // conservative inc_batch: cell indices of one chunk, row-major
+
+  // Heavy-hitter candidates: min-heap on est, keys interned in cand_keys_ (slab-backed, so candidate
+  // churn does not allocate)
+  std::size_t cand_cap_{};
+  std::vector<candidate> cand_heap_;
+  probkit::detail::key_arena cand_keys_;
+};
+
+// One counter table shared by many writer threads, replacing per-thread sketches and the final
+// merge: counters take relaxed atomic (saturating) adds. UpdateRule::conservative is not supported,
+// as its read-min-then-raise step cannot be made atomic across rows. Heavy-hitter candidates live in `shards`
+// separately locked trackers; writers name a shard (their worker index, say) so that locking stays
+// uncontended, and release()/snapshot() re-estimate the union against the final table.
+class concurrent_sketch {
+public:
+  concurrent_sketch() = default;
+  concurrent_sketch(concurrent_sketch&&) noexcept = default;
+  auto operator=(concurrent_sketch&&) noexcept -> concurrent_sketch& = default;
+  concurrent_sketch(const concurrent_sketch&) = delete;
+  auto operator=(const concurrent_sketch&) -> concurrent_sketch& = delete;
+  ~concurrent_sketch() = default;
+
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}, std::size_t shards = 1)
+      -> result<concurrent_sketch>;
+
+  // Safe to call from many threads at once; shard % shards picks the candidate tracker
+  [[nodiscard]] auto inc(std::string_view x, std::uint64_t c = 1, std::size_t shard = 0) noexcept -> result<void>;
+  [[nodiscard]] auto inc_batch(std::span<const std::string_view> xs, std::uint64_t c = 1,
+                               std::size_t shard = 0) noexcept -> result<void>;
+  // May run alongside writers; sees every increment that happened before the call
+  [[nodiscard]] auto estimate(std::string_view x) const noexcept -> result<std::uint64_t>;
+
+  // Plain copy of the current counters and candidates
+  [[nodiscard]] auto snapshot() const -> result<sketch>;
+  // Once writers are done: the underlying sketch with merged candidates, without copying the table
+  [[nodiscard]] auto release() && -> sketch;
+
+  [[nodiscard]] auto dims() const noexcept -> std::pair<std::size_t, std::size_t> {
+    return base_.dims();
+  }
+  [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
+    return base_.hash_config();
+  }
+  [[nodiscard]] auto candidate_capacity() const noexcept -> std::size_t {
+    return base_.candidate_capacity();
+  }
+
+private:
+  static constexpr std::size_t kCacheLine = 64;
+
+  // Candidate-only sketch (empty table) behind its own lock
+  struct alignas(kCacheLine) tracker {
+    std::mutex mu;
+    sketch cands;
+  };
+
+  explicit concurrent_sketch(sketch&& base, std::unique_ptr<tracker[]> trackers, std::size_t count) noexcept
+      : base_(std::move(base)), trackers_(std::move(trackers)), tracker_count_(count) {}
+
+  template <class Cell>
+  [[nodiscard]] auto add_cell(std::size_t idx, std::uint64_t c, bool& saturated) noexcept -> std::uint64_t;
+  template <class Cell> [[nodiscard]] auto load_cell(std::size_t idx) const noexcept -> std::uint64_t;
+  template <class Cell>
+  [[nodiscard]] auto inc_batch_as(std::span<const std::string_view> xs, std::uint64_t c, std::size_t shard) noexcept
+      -> bool;
+  template <class Cell> [[nodiscard]] auto estimate_as(std::string_view x) const noexcept -> std::uint64_t;
+  void offer(std::size_t shard, std::span<const std::string_view> xs, std::span<const std::uint64_t> ests);
+  [[nodiscard]] auto candidate_pool() const -> std::vector<Pair>;
+
+  sketch base_;
+  std::unique_ptr<tracker[]> trackers_; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+  std::size_t tracker_count_{0};
+};
+
+// A sketch with compile-time depth: the per-row loops of inc(), inc_batch() and estimate() unroll.
+// Width, counter cells, update rule, heavy hitters and the image format are those of sketch, which
+// it holds; wrap() and release() convert either way without copying, and merge() accepts either.
+// Instantiated for Depth in [3, 10] (delta from about 5e-2 down to 5e-5).
+template <std::size_t Depth> class fixed_sketch {
+public:
+  static_assert(Depth >= 3U && Depth <= 10U, "cms::fixed_sketch is instantiated for depths 3..10");
+  static constexpr std::size_t kDepth = Depth;
+
+  fixed_sketch() = default;
+  fixed_sketch(fixed_sketch&&) noexcept = default;
+  auto operator=(fixed_sketch&&) noexcept -> fixed_sketch& = default;
+  fixed_sketch(const fixed_sketch&) = delete;
+  auto operator=(const fixed_sketch&) -> fixed_sketch& = delete;
+
+  // Sized like sketch::make; invalid_argument when delta gives a depth other than Depth
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}) -> result<fixed_sketch>;
+  // Takes over s; fails with invalid_argument unless fits(s)
+  [[nodiscard]] static auto wrap(sketch&& s) -> result<fixed_sketch>;
+  [[nodiscard]] static auto fits(const sketch& s) noexcept -> bool {
+    return s.dims().first == Depth;
+  }
+  // The specialised operations applied to a runtime sketch; invalid_argument unless fits(s)
+  [[nodiscard]] static auto inc(sketch& s, std::string_view x, std::uint64_t c = 1) noexcept -> result<void>;
+  [[nodiscard]] static auto inc_batch(sketch& s, std::span<const std::string_view> xs, std::uint64_t c = 1) noexcept
+      -> result<void>;
+  [[nodiscard]] static auto estimate(const sketch& s, std::string_view x) noexcept -> result<std::uint64_t>;
+
+  [[nodiscard]] auto inc(std::string_view x, std::uint64_t c = 1) noexcept -> result<void> {
+    return inc(base_, x, c);
+  }
+  [[nodiscard]] auto inc_batch(std::span<const std::string_view> xs, std::uint64_t c = 1) noexcept -> result<void> {
+    return inc_batch(base_, xs, c);
+  }
+  [[nodiscard]] auto estimate(std::string_view x) const noexcept -> result<std::uint64_t> {
+    return estimate(base_, x);
+  }
+  [[nodiscard]] auto topk(std::size_t k) const -> result<std::vector<Pair>> {
+    return base_.topk(k);
+  }
+  [[nodiscard]] auto merge(const sketch& other) noexcept -> result<void> {
+    return base_.merge(other);
+  }
+  [[nodiscard]] auto merge(const fixed_sketch& other) noexcept -> result<void> {
+    return base_.merge(other.base_);
+  }
+
+  [[nodiscard]] auto save(const std::string& path) const -> result<void> {
+    return base_.save(path);
+  }
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte> {
+    return base_.to_bytes();
+  }
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<fixed_sketch>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<fixed_sketch>;
+
+  [[nodiscard]] auto base() const noexcept -> const sketch& {
+    return base_;
+  }
+  // The underlying runtime sketch, without a copy; leaves *this empty
+  [[nodiscard]] auto release() && noexcept -> sketch {
+    return std::move(base_);
+  }
+  [[nodiscard]] auto dims() const noexcept -> std::pair<std::size_t, std::size_t> {
+    return base_.dims();
+  }
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return base_.byte_size();
+  }
+  [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
+    return base_.hash_config();
+  }
+  [[nodiscard]] auto candidate_capacity() const noexcept -> std::size_t {
+    return base_.candidate_capacity();
+  }
+
+private:
+  explicit fixed_sketch(sketch&& base) noexcept : base_(std::move(base)) {}
 
-  // Optional candidate tracking for Top-K (simple reservoir with over-provision factor)
-  std::vector<std::string> cand_keys_;
-  std::vector<std::uint64_t> cand_ests_;
+  sketch base_;
 };
 
 } // namespace probkit::cms
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+namespace probkit::detail {
+
+// Minimal allocator returning Align-byte aligned storage (e.g. cache-line aligned filter blocks).
+template <class T, std::size_t Align> struct aligned_allocator {
+  using value_type = T;
+  static_assert(Align >= alignof(T) && (Align & (Align - 1U)) == 0U, "Align must be a power of two >= alignof(T)");
+
+  template <class U> struct rebind {
+    using other = aligned_allocator<U, Align>;
+  };
+
+  aligned_allocator() noexcept = default;
+  template <class U> explicit aligned_allocator(const aligned_allocator<U, Align>& /*unused*/) noexcept {}
+
+  [[nodiscard]] auto allocate(std::size_t n) -> T* {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{Align}));
+  }
+  void deallocate(T* p, std::size_t /*n*/) noexcept {
+    ::operator delete(p, std::align_val_t{Align});
+  }
+
+  friend auto operator==(const aligned_allocator& /*lhs*/, const aligned_allocator& /*rhs*/) noexcept -> bool {
+    return true;
+  }
+};
+
+} // namespace probkit::detail
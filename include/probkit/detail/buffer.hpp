@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "probkit/detail/aligned_allocator.hpp"
+
+namespace probkit::detail {
+
+// Contiguous sketch storage: either an owned, zero-initialised, cache-line aligned heap block, or a
+// view into a region owned elsewhere (e.g. a mapped file), kept alive by a type-erased owner.
+template <class T> class buffer {
+public:
+  static constexpr std::size_t kAlign = 64;
+
+  buffer() = default;
+  explicit buffer(std::size_t n) : owned_(n, T{}), data_(owned_.data()), size_(n) {}
+
+  buffer(buffer&& other) noexcept
+      : owned_(std::move(other.owned_)), owner_(std::move(other.owner_)), data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)), writable_(std::exchange(other.writable_, true)) {}
+  auto operator=(buffer&& other) noexcept -> buffer& {
+    if (this != &other) {
+      owned_ = std::move(other.owned_);
+      owner_ = std::move(other.owner_);
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+      writable_ = std::exchange(other.writable_, true);
+    }
+    return *this;
+  }
+  buffer(const buffer&) = delete;
+  auto operator=(const buffer&) -> buffer& = delete;
+  ~buffer() = default;
+
+  // View n elements at p inside a region kept alive by owner; writable == false for read-only mappings
+  [[nodiscard]] static auto adopt(std::shared_ptr<void> owner, T* p, std::size_t n, bool writable) noexcept -> buffer {
+    buffer b;
+    b.owner_ = std::move(owner);
+    b.data_ = p;
+    b.size_ = n;
+    b.writable_ = writable;
+    return b;
+  }
+
+  // Replace the contents with n copies of v in owned storage (drops any adopted region)
+  void assign(std::size_t n, const T& v) {
+    owner_.reset();
+    owned_.assign(n, v);
+    data_ = owned_.data();
+    size_ = n;
+    writable_ = true;
+  }
+
+  [[nodiscard]] auto data() noexcept -> T* {
+    return data_;
+  }
+  [[nodiscard]] auto data() const noexcept -> const T* {
+    return data_;
+  }
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return size_;
+  }
+  [[nodiscard]] auto empty() const noexcept -> bool {
+    return size_ == 0U;
+  }
+  [[nodiscard]] auto writable() const noexcept -> bool {
+    return writable_;
+  }
+  // True when the elements live in an adopted region rather than owned heap storage
+  [[nodiscard]] auto adopted() const noexcept -> bool {
+    return owner_ != nullptr;
+  }
+
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  [[nodiscard]] auto operator[](std::size_t i) noexcept -> T& {
+    return data_[i];
+  }
+  [[nodiscard]] auto operator[](std::size_t i) const noexcept -> const T& {
+    return data_[i];
+  }
+  [[nodiscard]] auto begin() noexcept -> T* {
+    return data_;
+  }
+  [[nodiscard]] auto end() noexcept -> T* {
+    return data_ + size_;
+  }
+  [[nodiscard]] auto begin() const noexcept -> const T* {
+    return data_;
+  }
+  [[nodiscard]] auto end() const noexcept -> const T* {
+    return data_ + size_;
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+private:
+  std::vector<T, aligned_allocator<T, kAlign>> owned_;
+  std::shared_ptr<void> owner_;
+  T* data_{nullptr};
+  std::size_t size_{0};
+  bool writable_{true};
+};
+
+} // namespace probkit::detail
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace probkit::detail {
+
+// Interned keys of a small, churning set (the cms heavy-hitter candidates): key bytes share one slab
+// and a linear-probing table finds them, each key carrying a caller value (its heap slot, say). Up to
+// max_keys keys (below npos) are held; the table, entries and slab grow geometrically with the keys
+// actually inserted, so once the set reaches its working size inserting, finding and erasing keys do
+// not allocate unless live keys outgrow the slab. Erased keys leave holes that are squeezed out into a
+// spare slab when an insert does not fit. Ids stay stable until their key is erased; views from key()
+// until the next insert() or clear().
+class key_arena {
+public:
+  using id = std::uint32_t;
+  static constexpr id npos = UINT32_MAX;
+
+  key_arena() = default;
+  explicit key_arena(std::size_t max_keys) noexcept : max_keys_(max_keys) {}
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return count_;
+  }
+  [[nodiscard]] auto max_keys() const noexcept -> std::size_t {
+    return max_keys_;
+  }
+  [[nodiscard]] auto key(id i) const noexcept -> std::string_view {
+    const entry& e = entries_[i];
+    return {slab_.data() + e.off, e.len}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+  [[nodiscard]] auto value(id i) noexcept -> std::size_t& {
+    return entries_[i].value;
+  }
+  [[nodiscard]] auto value(id i) const noexcept -> std::size_t {
+    return entries_[i].value;
+  }
+
+  [[nodiscard]] auto find(std::string_view k) const noexcept -> id {
+    if (count_ == 0U) {
+      return npos;
+    }
+    const std::size_t h = hash(k);
+    for (std::size_t s = h & mask_;; s = (s + 1U) & mask_) {
+      const id i = slots_[s];
+      if (i == npos) {
+        return npos;
+      }
+      if (entries_[i].hash == h && key(i) == k) {
+        return i;
+      }
+    }
+  }
+
+  // Add k (not already present, size() < max_keys) with value v
+  auto insert(std::string_view k, std::size_t v) -> id {
+    // At most half the table in use keeps probe runs short
+    if ((count_ + 1U) * 2U > slots_.size()) {
+      grow_slots();
+    }
+    if (used_ + k.size() > slab_.size()) {
+      compact(k.size());
+    }
+    id i = static_cast<id>(entries_.size());
+    if (free_.empty()) {
+      entries_.emplace_back();
+    } else {
+      i = free_.back();
+      free_.pop_back();
+    }
+    if (!k.empty()) {
+      std::memcpy(slab_.data() + used_, k.data(), k.size()); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    }
+    entries_[i] = entry{.hash = hash(k), .off = used_, .len = k.size(), .value = v};
+    used_ += k.size();
+    live_ += k.size();
+    place(i);
+    ++count_;
+    return i;
+  }
+
+  // Drop a held key; its bytes stay in the slab until the next compaction
+  void erase(id i) noexcept {
+    std::size_t s = entries_[i].hash & mask_;
+    while (slots_[s] != i) {
+      s = (s + 1U) & mask_;
+    }
+    // Backward-shift deletion: pull later keys of the probe run into the hole, so no tombstones build up
+    for (std::size_t j = (s + 1U) & mask_; slots_[j] != npos; j = (j + 1U) & mask_) {
+      const std::size_t home = entries_[slots_[j]].hash & mask_;
+      if (((j - home) & mask_) >= ((j - s) & mask_)) {
+        slots_[s] = slots_[j];
+        s = j;
+      }
+    }
+    slots_[s] = npos;
+    live_ -= entries_[i].len;
+    free_.push_back(i);
+    --count_;
+  }
+
+  // Drop every key, keeping the storage
+  void clear() noexcept {
+    if (slots_.empty()) {
+      return;
+    }
+    std::fill(slots_.begin(), slots_.end(), npos);
+    entries_.clear();
+    free_.clear();
+    used_ = live_ = count_ = 0;
+  }
+
+private:
+  static constexpr std::size_t kKeyBytesHint = 32; // initial slab bytes
+  static constexpr std::size_t kMinSlots = 16;
+
+  struct entry {
+    std::size_t hash{};
+    std::size_t off{};
+    std::size_t len{};
+    std::size_t value{};
+  };
+
+  [[nodiscard]] static auto hash(std::string_view k) noexcept -> std::size_t {
+    return std::hash<std::string_view>{}(k);
+  }
+
+  void place(id i) noexcept {
+    std::size_t s = entries_[i].hash & mask_;
+    while (slots_[s] != npos) {
+      s = (s + 1U) & mask_;
+    }
+    slots_[s] = i;
+  }
+
+  // Double the probe table and re-place the held keys
+  void grow_slots() {
+    std::vector<id> old(std::max(slots_.size() * 2U, kMinSlots), npos);
+    old.swap(slots_);
+    mask_ = slots_.size() - 1U;
+    for (const id i : old) {
+      if (i != npos) {
+        place(i);
+      }
+    }
+  }
+
+  // Copy live keys to the front of the spare slab, growing both when they and extra bytes do not fit
+  void compact(std::size_t extra) {
+    std::size_t cap = std::max<std::size_t>(slab_.size(), kKeyBytesHint);
+    while (cap < live_ + extra) {
+      cap *= 2U;
+    }
+    spare_.resize(cap);
+    std::size_t w = 0;
+    for (const id i : slots_) {
+      if (i == npos) {
+        continue;
+      }
+      entry& e = entries_[i];
+      if (e.len != 0U) {
+        std::memcpy(spare_.data() + w, slab_.data() + e.off, e.len); // NOLINT(*-pointer-arithmetic)
+      }
+      e.off = w;
+      w += e.len;
+    }
+    slab_.swap(spare_);
+    used_ = w;
+  }
+
+  std::size_t max_keys_{};
+  std::size_t mask_{};
+  std::size_t used_{};  // slab bytes written since the last compaction
+  std::size_t live_{};  // bytes of held keys
+  std::size_t count_{}; // held keys
+  std::vector<id> slots_;
+  std::vector<entry> entries_;
+  std::vector<id> free_;
+  std::vector<char> slab_;
+  std::vector<char> spare_;
+};
+
+} // namespace probkit::detail
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "probkit/detail/buffer.hpp"
+#include "probkit/expected.hpp"
+#include "probkit/hash.hpp"
+#include "probkit/serialize.hpp"
+
+namespace probkit::serialize::detail {
+struct image;
+} // namespace probkit::serialize::detail
+
+namespace probkit::fuse {
+
+// Bits per fingerprint. f8: about 9 bits/key at an FP rate of 2^-8 (0.39%); f16: about 18 bits/key at
+// 2^-16 (0.0015%), still fewer bits than a bloom::filter at 0.1% takes.
+enum class Fingerprint : std::uint8_t { f8 = 8, f16 = 16 };
+
+struct Config {
+  Fingerprint fingerprint{Fingerprint::f8};
+  // > 1: split the keys by hash into that many independently built filters (see filter::partition_of),
+  // which build() constructs in parallel. Each query still reads three fingerprints of one partition.
+  std::size_t partitions{1};
+  unsigned build_threads{1}; // partitions built concurrently
+};
+
+// Static membership set (a 3-wise binary fuse filter, Graf & Lemire 2022): built once from the full
+// key set and then only queried. A query costs one hash and three fingerprint reads, against k bit
+// probes for a bloom::filter, and no false negatives for the keys it was built from. It cannot take
+// keys after build() or be merged.
+class filter {
+public:
+  filter() = default;
+  filter(filter&&) noexcept = default;
+  auto operator=(filter&&) noexcept -> filter& = default;
+  filter(const filter&) = delete;
+  auto operator=(const filter&) -> filter& = delete;
+
+  // Duplicate keys are dropped before the table is sized, so repeats cost build time but no space.
+  // internal_error only if construction keeps failing (not seen in practice).
+  [[nodiscard]] static auto build(std::span<const std::string_view> keys, const Config& c = {},
+                                  hashing::HashConfig h = {}) -> result<filter>;
+  // The same filter from hashes[i] == hashing::hash64(keys[i], h), for callers that hash keys as they
+  // read them
+  [[nodiscard]] static auto build_hashed(std::span<const std::uint64_t> hashes, const Config& c = {},
+                                         hashing::HashConfig h = {}) -> result<filter>;
+
+  [[nodiscard]] auto might_contain(std::string_view x) const noexcept -> result<bool> {
+    return contains_hash(hashing::hash64(x, hash_cfg_));
+  }
+  [[nodiscard]] auto might_contain_hashed(std::uint64_t h) const noexcept -> result<bool> {
+    return contains_hash(h);
+  }
+  // out[i] = might_contain(xs[i]); keys are hashed chunk-wise through hashing::hash64_batch and the
+  // fingerprints of a few keys are prefetched before any is tested, which pays off once the table is
+  // larger than the cache. invalid_argument when out is shorter than xs.
+  [[nodiscard]] auto might_contain_batch(std::span<const std::string_view> xs, std::span<bool> out) const noexcept
+      -> result<void>;
+
+  // Partition whose fingerprints x is checked against (0 for an unpartitioned filter)
+  [[nodiscard]] auto partition_of(std::string_view x) const noexcept -> std::size_t {
+    return partition_of_hash(hashing::hash64(x, hash_cfg_));
+  }
+
+  // Versioned binary image (see probkit/serialize.hpp); load() can map the fingerprints in place
+  [[nodiscard]] auto save(const std::string& path) const -> result<void>;
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte>;
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<filter>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<filter>;
+
+  // Distinct keys held
+  [[nodiscard]] auto size() const noexcept -> std::uint64_t {
+    return keys_;
+  }
+  [[nodiscard]] auto fingerprint() const noexcept -> Fingerprint {
+    return fingerprint_;
+  }
+  [[nodiscard]] auto partitions() const noexcept -> std::size_t {
+    return parts_.size();
+  }
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return table_.size();
+  }
+  [[nodiscard]] auto bits_per_key() const noexcept -> double {
+    return keys_ == 0U ? 0.0 : 8.0 * static_cast<double>(table_.size()) / static_cast<double>(keys_);
+  }
+  [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
+    return hash_cfg_;
+  }
+
+private:
+  static constexpr std::uint64_t kSalt = 0x9E3779B97F4A7C15ULL;
+
+  // One independently built filter: fingerprints [offset, offset + cells) of the table
+  struct partition {
+    std::uint64_t seed{};
+    std::uint64_t segment_length{}; // power of two
+    std::uint64_t segment_count_length{};
+    std::uint64_t offset{};
+    std::uint64_t cells{}; // segment_count_length + 2 * segment_length
+    std::uint64_t keys{};
+  };
+
+  filter(probkit::detail::buffer<std::uint8_t>&& table, std::vector<partition>&& parts, Fingerprint fp,
+         std::uint64_t keys, hashing::HashConfig cfg) noexcept
+      : table_(std::move(table)), parts_(std::move(parts)), keys_(keys), fingerprint_(fp), hash_cfg_(cfg) {}
+
+  // Same remix as bloom::filter partitions, so a partition never depends on the positions it selects
+  [[nodiscard]] auto partition_of_hash(std::uint64_t h) const noexcept -> std::size_t {
+    if (parts_.size() <= 1U) {
+      return 0;
+    }
+    const auto n = static_cast<std::uint64_t>(parts_.size());
+    return static_cast<std::size_t>(hashing::map_index(h * kSalt, n, hashing::IndexMap::fastrange));
+  }
+  [[nodiscard]] auto contains_hash(std::uint64_t h) const noexcept -> bool;
+
+  [[nodiscard]] auto image_extra() const -> std::vector<std::byte>;
+  [[nodiscard]] static auto from_image(serialize::detail::image&& img) -> result<filter>;
+
+  probkit::detail::buffer<std::uint8_t> table_; // fingerprints of every partition, little-endian
+  std::vector<partition> parts_;
+  std::uint64_t keys_{};
+  Fingerprint fingerprint_{Fingerprint::f8};
+  hashing::HashConfig hash_cfg_{};
+};
+
+} // namespace probkit::fuse
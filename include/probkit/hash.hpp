@@ -1,11 +1,25 @@
 #pragma once
 
 #include <cstdint>
+#include <span>
 #include <string_view>
 
 namespace probkit::hashing {
 
-enum class HashKind : std::uint8_t { wyhash, xxhash };
+// Key hash. Values are stored in sketch images, so new kinds are only ever appended.
+//   wyhash  default
+//   xxhash  XXH64
+//   xxh3    XXH3-64 (xxHash 0.8); independent multiplies, about twice wyhash's speed on 64-256 byte keys
+//   aes     AES rounds: AES-NI on x86-64 when the CPU has it (checked at runtime), the ARMv8 crypto
+//           extension when compiled for it, else a bit-identical software round that is much slower.
+//           With the instructions, the fastest kind on keys up to a few hundred bytes.
+enum class HashKind : std::uint8_t { wyhash, xxhash, xxh3, aes };
+
+// How a 64-bit hash is reduced to an index in [0, n):
+//   modulo    h % n (any n; one hardware division per probe)
+//   pow2      h & (n - 1) (sketch sizes are rounded to a power of two at construction)
+//   fastrange (h * n) >> 64 (Lemire's multiply-shift; any n, uses the high bits of h)
+enum class IndexMap : std::uint8_t { modulo, pow2, fastrange };
 
 struct HashConfig {
   HashKind kind{HashKind::wyhash};
@@ -14,8 +28,22 @@ struct HashConfig {
 };
 
 [[nodiscard]] auto hash64(std::string_view input, const HashConfig& cfg) noexcept -> std::uint64_t;
+// Hashes keys[i] into out[i] for every i < min(keys.size(), out.size()); bit-identical to hash64().
+void hash64_batch(std::span<const std::string_view> keys, const HashConfig& cfg, std::span<std::uint64_t> out) noexcept;
 [[nodiscard]] auto derive_thread_salt(std::uint64_t base, std::uint64_t thread_index) noexcept -> std::uint64_t;
 
+[[nodiscard]] constexpr auto map_index(std::uint64_t h, std::uint64_t n, IndexMap m) noexcept -> std::uint64_t {
+  switch (m) {
+  case IndexMap::pow2:
+    return h & (n - 1U);
+  case IndexMap::fastrange:
+    return static_cast<std::uint64_t>((static_cast<__uint128_t>(h) * static_cast<__uint128_t>(n)) >> 64U);
+  case IndexMap::modulo:
+    break;
+  }
+  return h % n;
+}
+
 // ------------------------------------------------------------------
 // Helpers for converting HashKind <-> string (shared by CLI/tests)
 // ------------------------------------------------------------------
@@ -25,11 +53,15 @@ struct HashConfig {
     return std::string_view{"wyhash"};
   case HashKind::xxhash:
     return std::string_view{"xxhash"};
+  case HashKind::xxh3:
+    return std::string_view{"xxh3"};
+  case HashKind::aes:
+    return std::string_view{"aes"};
   }
   return std::string_view{"wyhash"};
 }
 
-// Accepts: "wyhash", "xxhash", and the common shorthand "xxh"
+// Accepts: "wyhash", "xxhash" (and the common shorthand "xxh"), "xxh3", "aes"
 constexpr auto parse_hash_kind(std::string_view s, HashKind& out) noexcept -> bool {
   if (s == std::string_view{"wyhash"}) {
     out = HashKind::wyhash;
@@ -39,6 +71,43 @@ constexpr auto parse_hash_kind(std::string_view s, HashKind& out) noexcept -> bo
     out = HashKind::xxhash;
     return true;
   }
+  if (s == std::string_view{"xxh3"}) {
+    out = HashKind::xxh3;
+    return true;
+  }
+  if (s == std::string_view{"aes"}) {
+    out = HashKind::aes;
+    return true;
+  }
+  return false;
+}
+
+[[nodiscard]] constexpr auto to_string(IndexMap m) noexcept -> std::string_view {
+  switch (m) {
+  case IndexMap::modulo:
+    return std::string_view{"modulo"};
+  case IndexMap::pow2:
+    return std::string_view{"pow2"};
+  case IndexMap::fastrange:
+    return std::string_view{"fastrange"};
+  }
+  return std::string_view{"modulo"};
+}
+
+// Accepts: "modulo", "pow2", "fastrange"
+constexpr auto parse_index_map(std::string_view s, IndexMap& out) noexcept -> bool {
+  if (s == std::string_view{"modulo"}) {
+    out = IndexMap::modulo;
+    return true;
+  }
+  if (s == std::string_view{"pow2"}) {
+    out = IndexMap::pow2;
+    return true;
+  }
+  if (s == std::string_view{"fastrange"}) {
+    out = IndexMap::fastrange;
+    return true;
+  }
   return false;
 }
 
@@ -2,18 +2,40 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include "probkit/detail/buffer.hpp"
 #include "probkit/expected.hpp"
 #include "probkit/hash.hpp"
+#include "probkit/serialize.hpp"
+
+namespace probkit::serialize::detail {
+struct image;
+} // namespace probkit::serialize::detail
 
 namespace probkit::hll {
 
+// Register layout once the sketch is dense. dense: one byte per register. packed: 6 bits per
+// register, which always suffices because ranks never exceed 64 - p + 1.
+enum class Encoding : std::uint8_t { dense, packed };
+
 struct Config {
   std::uint8_t precision = 14; // m = 1 << p
+  Encoding encoding{Encoding::dense};
+  // Start as a sorted list of (index, rank) pairs and switch to `encoding` once the list would
+  // outgrow it; empty and low-cardinality sketches then cost a few bytes instead of m
+  bool sparse{false};
+  // Keep a per-rank register histogram up to date as registers rise, making estimate() O(1) in m
+  // (256 bytes extra; merge() rebuilds it in one pass)
+  bool track_estimate{false};
 };
 
+class concurrent_sketch;
+template <std::uint8_t P> class fixed_sketch;
+
 class sketch {
 public:
   sketch() = default;
@@ -22,33 +44,236 @@ public:
   sketch(const sketch&) = delete;
   auto operator=(const sketch&) -> sketch& = delete;
 
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}) -> result<sketch>;
   [[nodiscard]] static auto make_by_precision(std::uint8_t p, hashing::HashConfig h = {}) -> result<sketch>;
+  // Register bytes of a sketch made from c once it is dense (a sparse sketch grows up to this)
+  [[nodiscard]] static auto dense_byte_size(const Config& c) noexcept -> std::size_t;
 
   [[nodiscard]] auto add(std::string_view x) noexcept -> result<void>;
+  // Same as add() per key; hashes keys in chunks through hashing::hash64_batch
+  [[nodiscard]] auto add_batch(std::span<const std::string_view> xs) noexcept -> result<void>;
+  // Same as add(x) for h == hashing::hash64(x, hash_config()), so one hash per key can feed several sketches
+  [[nodiscard]] auto add_hashed(std::uint64_t h) noexcept -> result<void>;
+  [[nodiscard]] auto add_hashed_batch(std::span<const std::uint64_t> hs) noexcept -> result<void>;
   [[nodiscard]] auto estimate() const noexcept -> result<double>;
+  // Works across encodings; a sparse sketch converts to its dense form when the union outgrows it
   [[nodiscard]] auto merge(const sketch& other) noexcept -> result<void>;
 
+  // Versioned binary image (see probkit/serialize.hpp); load() maps dense/packed registers in place,
+  // while a sparse list is always copied
+  [[nodiscard]] auto save(const std::string& path) const -> result<void>;
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte>;
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<sketch>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<sketch>;
+
   [[nodiscard]] auto precision() const noexcept -> std::uint8_t {
     return p_;
   }
   [[nodiscard]] auto m() const noexcept -> std::size_t {
     return static_cast<std::size_t>(1ULL << p_);
   }
+  [[nodiscard]] auto encoding() const noexcept -> Encoding {
+    return encoding_;
+  }
+  [[nodiscard]] auto is_sparse() const noexcept -> bool {
+    return sparse_;
+  }
+  [[nodiscard]] auto tracks_estimate() const noexcept -> bool {
+    return !rank_hist_.empty();
+  }
+  // Bytes of register storage currently in use (sparse list and pending entries, or dense registers)
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return sparse_ ? (sparse_list_.size() + sparse_buf_.size()) * sizeof(std::uint32_t) : registers_.size();
+  }
   [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
     return hash_cfg_;
   }
+  // False for sketches loaded with LoadMode::map_read_only
+  [[nodiscard]] auto writable() const noexcept -> bool {
+    return registers_.writable();
+  }
+  // Encodings are interchangeable and deliberately not compared
   [[nodiscard]] auto same_params(const sketch& other) const noexcept -> bool {
     return p_ == other.p_ && hash_cfg_.kind == other.hash_cfg_.kind && hash_cfg_.seed == other.hash_cfg_.seed &&
            hash_cfg_.thread_salt == other.hash_cfg_.thread_salt;
   }
 
 private:
-  explicit sketch(std::uint8_t p, hashing::HashConfig cfg, std::vector<std::uint8_t>&& regs) noexcept
-      : p_(p), hash_cfg_(cfg), registers_(std::move(regs)) {}
+  friend class concurrent_sketch;
+  template <std::uint8_t P> friend class fixed_sketch;
+
+  static constexpr std::size_t kRanks = 64; // register values are < 64 for every supported p
+
+  explicit sketch(std::uint8_t p, hashing::HashConfig cfg, Encoding enc, bool sparse,
+                  probkit::detail::buffer<std::uint8_t>&& regs, std::vector<std::uint32_t>&& hist) noexcept
+      : p_(p), encoding_(enc), sparse_(sparse), hash_cfg_(cfg), registers_(std::move(regs)),
+        rank_hist_(std::move(hist)) {}
+
+  [[nodiscard]] static auto from_image(serialize::detail::image&& img) -> result<sketch>;
+  // scratch holds the sorted sparse list when entries are pending
+  [[nodiscard]] auto payload_bytes(std::vector<std::uint32_t>& scratch) const -> std::span<const std::byte>;
+
+  void add_hash(std::uint64_t h) noexcept;
+  // Dense, untracked registers only; the compile-time precision folds m and the shifts into constants
+  template <std::uint8_t P> void add_dense_batch(std::span<const std::string_view> xs) noexcept;
+  void add_sparse(std::uint32_t idx, std::uint8_t r) noexcept;
+  // Sort the pending entries into the sparse list, going dense once it is nearly full (sparse_full)
+  void flush_sparse() noexcept;
+  // The sparse list with pending entries folded in: sparse_list_ itself, or a merged copy in scratch
+  [[nodiscard]] auto sparse_entries(std::vector<std::uint32_t>& scratch) const -> std::span<const std::uint32_t>;
+  void to_dense() noexcept;
+  [[nodiscard]] auto get_reg(std::size_t i) const noexcept -> std::uint8_t;
+  void put_reg(std::size_t i, std::uint8_t v) noexcept;
+  void raise_reg(std::size_t i, std::uint8_t r) noexcept;
+  void rebuild_histogram() noexcept;
+  [[nodiscard]] auto sparse_limit() const noexcept -> std::size_t;
+  [[nodiscard]] auto sparse_buffer_limit() const noexcept -> std::size_t;
+  // A sorted list of n entries plus a full pending buffer would outgrow the dense registers
+  [[nodiscard]] auto sparse_full(std::size_t n) const noexcept -> bool {
+    return n + sparse_buffer_limit() > sparse_limit();
+  }
+  void fill_histogram(std::span<std::uint32_t, kRanks> hist) const noexcept;
+  void note_rise(std::uint8_t from, std::uint8_t to) noexcept {
+    if (!rank_hist_.empty()) {
+      --rank_hist_[from];
+      ++rank_hist_[to];
+    }
+  }
 
   std::uint8_t p_{14};
+  Encoding encoding_{Encoding::dense};
+  bool sparse_{false};
   hashing::HashConfig hash_cfg_{};
-  std::vector<std::uint8_t> registers_; // rank values per register
+  // dense: rank per register; packed: 6-bit ranks, little-endian bit order
+  probkit::detail::buffer<std::uint8_t> registers_;
+  std::vector<std::uint32_t> sparse_list_; // sparse: (index << 6) | rank, sorted by index
+  std::vector<std::uint32_t> sparse_buf_;  // sparse: entries added since the last flush, unsorted
+  std::vector<std::uint32_t> rank_hist_;   // track_estimate: register count per rank value, else empty
+};
+
+// One dense sketch shared by any number of writer threads, replacing per-thread sketches and the
+// final merge. Registers rise through an atomic fetch-max (a relaxed CAS loop that skips the write
+// once the register is high enough, so hot registers stay shared in cache). Always uses the dense
+// encoding without sparse mode or estimate tracking, whatever the Config asks for.
+class concurrent_sketch {
+public:
+  concurrent_sketch() = default;
+  concurrent_sketch(concurrent_sketch&&) noexcept = default;
+  auto operator=(concurrent_sketch&&) noexcept -> concurrent_sketch& = default;
+  concurrent_sketch(const concurrent_sketch&) = delete;
+  auto operator=(const concurrent_sketch&) -> concurrent_sketch& = delete;
+
+  [[nodiscard]] static auto make(const Config& c, hashing::HashConfig h = {}) -> result<concurrent_sketch>;
+
+  // Safe to call from many threads at once
+  [[nodiscard]] auto add(std::string_view x) noexcept -> result<void>;
+  [[nodiscard]] auto add_batch(std::span<const std::string_view> xs) noexcept -> result<void>;
+  // May run alongside writers; sees every add that happened before the call
+  [[nodiscard]] auto estimate() const noexcept -> result<double>;
+
+  // Plain copy of the current registers
+  [[nodiscard]] auto snapshot() const -> result<sketch>;
+  // Once writers are done: the underlying sketch, without a copy; leaves *this empty
+  [[nodiscard]] auto release() && noexcept -> sketch {
+    return std::move(base_);
+  }
+
+  [[nodiscard]] auto precision() const noexcept -> std::uint8_t {
+    return base_.precision();
+  }
+  [[nodiscard]] auto m() const noexcept -> std::size_t {
+    return base_.m();
+  }
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return base_.byte_size();
+  }
+  [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
+    return base_.hash_config();
+  }
+
+private:
+  explicit concurrent_sketch(sketch&& base) noexcept : base_(std::move(base)) {}
+
+  void add_hash(std::uint64_t h) noexcept;
+  [[nodiscard]] auto load_reg(std::size_t i) const noexcept -> std::uint8_t;
+
+  sketch base_;
+};
+
+// A sketch with compile-time precision P: add() and add_batch() fold m = 2^P and the index/rank
+// shifts into constants. Holds a plain dense sketch (no sparse mode, packing or estimate tracking),
+// so images, merge() and estimates are those of the equivalent runtime sketch; wrap() and release()
+// convert either way without copying. Instantiated for P in [10, 18].
+template <std::uint8_t P> class fixed_sketch {
+public:
+  static_assert(P >= 10U && P <= 18U, "hll::fixed_sketch is instantiated for precisions 10..18");
+  static constexpr std::uint8_t kPrecision = P;
+
+  fixed_sketch() = default;
+  fixed_sketch(fixed_sketch&&) noexcept = default;
+  auto operator=(fixed_sketch&&) noexcept -> fixed_sketch& = default;
+  fixed_sketch(const fixed_sketch&) = delete;
+  auto operator=(const fixed_sketch&) -> fixed_sketch& = delete;
+
+  [[nodiscard]] static auto make(hashing::HashConfig h = {}) -> result<fixed_sketch>;
+  // Takes over s; fails with invalid_argument unless fits(s)
+  [[nodiscard]] static auto wrap(sketch&& s) -> result<fixed_sketch>;
+  // Whether s has precision P and plain dense registers
+  [[nodiscard]] static auto fits(const sketch& s) noexcept -> bool {
+    return s.precision() == P && s.encoding() == Encoding::dense && !s.is_sparse() && !s.tracks_estimate();
+  }
+  // The specialised update applied to a runtime sketch; invalid_argument unless fits(s)
+  [[nodiscard]] static auto add_batch(sketch& s, std::span<const std::string_view> xs) noexcept -> result<void>;
+
+  [[nodiscard]] auto add(std::string_view x) noexcept -> result<void> {
+    return add_batch(base_, std::span<const std::string_view>(&x, 1));
+  }
+  [[nodiscard]] auto add_batch(std::span<const std::string_view> xs) noexcept -> result<void> {
+    return add_batch(base_, xs);
+  }
+  [[nodiscard]] auto estimate() const noexcept -> result<double> {
+    return base_.estimate();
+  }
+  [[nodiscard]] auto merge(const sketch& other) noexcept -> result<void> {
+    return base_.merge(other);
+  }
+  [[nodiscard]] auto merge(const fixed_sketch& other) noexcept -> result<void> {
+    return base_.merge(other.base_);
+  }
+
+  [[nodiscard]] auto save(const std::string& path) const -> result<void> {
+    return base_.save(path);
+  }
+  [[nodiscard]] auto to_bytes() const -> std::vector<std::byte> {
+    return base_.to_bytes();
+  }
+  [[nodiscard]] static auto load(const std::string& path, serialize::LoadOptions opt = {}) -> result<fixed_sketch>;
+  [[nodiscard]] static auto from_bytes(std::span<const std::byte> bytes) -> result<fixed_sketch>;
+
+  [[nodiscard]] auto base() const noexcept -> const sketch& {
+    return base_;
+  }
+  // The underlying runtime sketch, without a copy; leaves *this empty
+  [[nodiscard]] auto release() && noexcept -> sketch {
+    return std::move(base_);
+  }
+  [[nodiscard]] static constexpr auto precision() noexcept -> std::uint8_t {
+    return P;
+  }
+  [[nodiscard]] static constexpr auto m() noexcept -> std::size_t {
+    return std::size_t{1} << P;
+  }
+  [[nodiscard]] auto byte_size() const noexcept -> std::size_t {
+    return base_.byte_size();
+  }
+  [[nodiscard]] auto hash_config() const noexcept -> hashing::HashConfig {
+    return base_.hash_config();
+  }
+
+private:
+  explicit fixed_sketch(sketch&& base) noexcept : base_(std::move(base)) {}
+
+  sketch base_;
 };
 
 } // namespace probkit::hll
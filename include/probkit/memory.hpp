@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+namespace probkit {
+
+// Storage behind the large sketch tables (cms counters, bloom bits). heap zero-fills a cache-line aligned
+// block up front. The mapped kinds take anonymous memory that the kernel zeroes page by page on first
+// touch, so making a multi-GB sketch costs no memset and pages never written cost no RAM.
+enum class Backing : std::uint8_t {
+  heap,
+  lazy,    // anonymous mmap of base pages
+  thp,     // lazy, 2 MiB aligned and madvise(MADV_HUGEPAGE): transparent huge pages where the kernel allows
+  hugetlb, // MAP_HUGETLB from the reserved pool (vm.nr_hugepages); errc::out_of_memory when it runs dry
+};
+
+struct AllocPolicy {
+  Backing backing{Backing::heap};
+  // > 0: fault every page in when the sketch is made, split across this many threads, so that the first
+  // updates do not pay for page faults (mapped backings; heap storage is touched by its zero fill anyway)
+  unsigned prefault_threads{0};
+};
+
+} // namespace probkit
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "probkit/expected.hpp"
+
+namespace probkit::serialize {
+
+// On-disk sketch image (all integers little-endian):
+//   [128-byte header: magic, version, sketch kind, HashConfig, geometry, section sizes, checksums]
+//   [payload: counters/bits/registers exactly as held in memory, starting 128 bytes in]
+//   [extra: small variable-length state, e.g. cms heavy-hitter candidates]
+// The payload offset keeps the 64-byte alignment of a page-aligned mapping, so a mapped image is
+// used in place without copying.
+inline constexpr std::uint16_t kFormatVersion = 1;
+
+enum class LoadMode : std::uint8_t {
+  copy,              // read the file into owned memory
+  map_read_only,     // map the file; in-place, updates and merges into the sketch fail with not_supported
+  map_copy_on_write, // map the file privately; updates touch only this process's pages
+};
+
+struct LoadOptions {
+  LoadMode mode{LoadMode::copy};
+  // Verify the body checksum (reads every page; turn off for trusted files to make large mappings O(1) to open)
+  bool verify_checksum{true};
+};
+
+// The sketch an image holds (header byte 10)
+enum class SketchKind : std::uint8_t { bloom = 1, cms = 2, hll = 3, fuse = 4 };
+
+// Read only the header of the image at path and report which sketch it holds, so a caller handed
+// arbitrary images can pick the matching load(). The body is neither read nor checked.
+[[nodiscard]] auto sketch_kind(const std::string& path) -> result<SketchKind>;
+
+} // namespace probkit::serialize
@@ -1,4 +1,9 @@
 #include "probkit/bloom.hpp"
+#include "format.hpp"
+#include "memory.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
 #include <cstring>
 #if __has_include(<numbers>)
@@ -6,10 +11,18 @@
 #endif
 #include <vector>
 
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define PROBKIT_BLOOM_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define PROBKIT_BLOOM_X86_SIMD 0
+#endif
+
 using probkit::errc;
 using probkit::make_error;
 using probkit::result;
 using probkit::hashing::hash64;
+using probkit::hashing::hash64_batch;
 using probkit::hashing::HashConfig;
 
 namespace probkit::bloom {
@@ -17,6 +30,7 @@ namespace probkit::bloom {
 namespace {
 constexpr std::size_t kMinBytes = 8;          // at least one 64-bit word
 constexpr std::size_t kCapacityHint = 100000; // default n for make_by_fp
+constexpr std::size_t kHashChunk = 256;       // keys hashed per hash64_batch call
 #if defined(__cpp_lib_math_constants) && (__cpp_lib_math_constants >= 201907L)
 constexpr double kLn2 = std::numbers::ln2; // prefer standard constant when available
 #else
@@ -24,23 +38,216 @@ constexpr double kLn2 = std::numbers::ln2; // prefer standard constant when avai
 constexpr double kLn2 = 0.693147180559945309;
 #endif
 
-inline auto round_up_bits_to_words(std::size_t bits) -> std::size_t {
-  return (bits + 63U) / 64U; // number of 64-bit words
+constexpr std::size_t kBlockBits = 512;     // blocked layout: one 64-byte cache line per key
+constexpr std::size_t kBlockBytes = kBlockBits / 8U;
+constexpr unsigned kBlockShift = 64U - 9U;  // top 9 bits select a bit inside the block
+constexpr double kBlockedMaxGrowth = 4.0;   // give up sizing beyond 4x the standard bits/key
+constexpr double kBlockedGrowthStep = 1.02; // bits/key search step
+
+inline auto clamp_k(double k_real) -> std::uint8_t {
+  return static_cast<std::uint8_t>(std::lround(std::max(1.0, std::min(32.0, k_real))));
+}
+
+// Expected FP rate of a blocked filter with c bits/key and k probes. Keys per block follow
+// Poisson(lambda = B / c); a block holding j keys behaves like a standard B-bit filter with j keys.
+inline auto blocked_fp(double bits_per_key, unsigned k) -> double {
+  const double lambda = static_cast<double>(kBlockBits) / bits_per_key;
+  const double miss_one = 1.0 - (1.0 / static_cast<double>(kBlockBits));
+  const auto j_max = static_cast<unsigned>(lambda + (10.0 * std::sqrt(lambda)) + 10.0);
+  double pmf = std::exp(-lambda);
+  double fp = 0.0;
+  for (unsigned j = 0; j <= j_max; ++j) {
+    if (j > 0U) {
+      pmf *= lambda / static_cast<double>(j);
+    }
+    const double fill = 1.0 - std::pow(miss_one, static_cast<double>(k) * static_cast<double>(j));
+    fp += pmf * std::pow(fill, static_cast<double>(k));
+  }
+  return fp;
+}
+
+struct blocked_sizing {
+  double bits_per_key{};
+  std::uint8_t k{};
+};
+
+// Smallest bits/key (and its best k) whose blocked FP rate meets p; starts at the standard optimum
+inline auto size_blocked(double p) -> blocked_sizing {
+  const double c_std = -std::log(p) / (kLn2 * kLn2);
+  blocked_sizing best{.bits_per_key = c_std * kBlockedMaxGrowth, .k = clamp_k(c_std * kLn2)};
+  for (double c = c_std; c <= c_std * kBlockedMaxGrowth; c *= kBlockedGrowthStep) {
+    const std::uint8_t k_mid = clamp_k(c * kLn2);
+    const unsigned k_lo = k_mid > 4U ? k_mid - 4U : 1U;
+    const unsigned k_hi = std::min(32U, k_mid + 4U);
+    for (unsigned k = k_lo; k <= k_hi; ++k) {
+      if (blocked_fp(c, k) <= p) {
+        return blocked_sizing{.bits_per_key = c, .k = static_cast<std::uint8_t>(k)};
+      }
+    }
+  }
+  return best;
+}
+
+// In-block probe positions: double hashing on h2 with a rotated odd step, top 9 bits of each step
+inline auto block_step(std::uint64_t h2) -> std::uint64_t {
+  return ((h2 << 32U) | (h2 >> 32U)) | 1ULL;
+}
+
+// ProbeHash::derived step: a murmur3 fmix64 of h1, odd so the probe sequence never stalls
+inline auto derived_step(std::uint64_t h1) noexcept -> std::uint64_t {
+  std::uint64_t z = h1 ^ 0xD6E8FEB86659FD93ULL;
+  z = (z ^ (z >> 33U)) * 0xFF51AFD7ED558CCDULL;
+  z = (z ^ (z >> 33U)) * 0xC4CEB9FE1A85EC53ULL;
+  return (z ^ (z >> 33U)) | 1ULL;
+}
+
+// Word (standard) or block (blocked) count for the requested geometry; pow2 keeps it a power of two
+inline auto fit_units(std::size_t units, bool round_down, hashing::IndexMap map) -> std::size_t {
+  units = std::max<std::size_t>(units, 1);
+  if (map != hashing::IndexMap::pow2) {
+    return units;
+  }
+  return round_down ? std::bit_floor(units) : std::bit_ceil(units);
+}
+
+// Units per partition when a total of units is split parts ways. Standard partitions come in whole
+// cache lines (kLineWords words) so neighbouring partitions never share one.
+constexpr std::size_t kLineWords = 8;
+inline auto partition_units(std::size_t units, std::size_t parts, bool round_down, bool blocked,
+                            hashing::IndexMap map) -> std::size_t {
+  if (parts == 1U) {
+    return fit_units(units, round_down, map);
+  }
+  const std::size_t align = blocked ? 1U : kLineWords;
+  std::size_t per = round_down ? units / parts : (units + parts - 1U) / parts;
+  per = round_down ? per / align * align : (per + align - 1U) / align * align;
+  return fit_units(std::max(per, align), round_down, map);
+}
+
+// Word-wise union: dst[i] |= src[i]
+inline void or_merge_scalar(std::uint64_t* dst, const std::uint64_t* src, std::size_t n) noexcept {
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] |= src[i];
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+#if PROBKIT_BLOOM_X86_SIMD
+// Same split as the hll register merge: SSE2 baseline, AVX2 compiled per function and picked at runtime
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+inline void or_merge_sse2(std::uint64_t* dst, const std::uint64_t* src, std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 2U <= n; i += 2U) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(a, b));
+  }
+  or_merge_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) void or_merge_avx2(std::uint64_t* dst, const std::uint64_t* src,
+                                                   std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 8U <= n; i += 8U) { // one cache line per step, two independent ORs
+    const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i + 4U));
+    const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 4U));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(a0, b0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 4U), _mm256_or_si256(a1, b1));
+  }
+  or_merge_scalar(dst + i, src + i, n - i);
+}
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+#endif
+
+inline void or_merge(std::uint64_t* dst, const std::uint64_t* src, std::size_t n) noexcept {
+#if PROBKIT_BLOOM_X86_SIMD
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+  if (has_avx2) {
+    or_merge_avx2(dst, src, n);
+    return;
+  }
+  or_merge_sse2(dst, src, n);
+#else
+  or_merge_scalar(dst, src, n);
+#endif
 }
 } // namespace
 
-auto filter::make_by_mem(std::size_t bytes, HashConfig h) -> result<filter> {
+auto filter::make(const Config& c, HashConfig h) -> result<filter> {
+  const bool blocked = c.layout == Layout::blocked;
+  const std::size_t unit_words = blocked ? kBlockWords : 1U;
+  const std::size_t parts = c.partitions;
+  if (parts == 0U) {
+    return result<filter>::from_error(make_error(errc::invalid_argument, "partitions must be > 0"));
+  }
+  if (c.probe_hash > ProbeHash::derived) {
+    return result<filter>::from_error(make_error(errc::invalid_argument, "unknown probe hash"));
+  }
+  std::size_t units = 0; // per partition
+  std::uint8_t k = kDefaultK;
+  if (c.mem_budget_bytes > 0U) {
+    if (c.mem_budget_bytes < (blocked ? kBlockBytes : kMinBytes)) {
+      return result<filter>::from_error(
+          make_error(errc::invalid_argument, blocked ? "mem too small for one block" : "mem too small"));
+    }
+    if (parts > 1U && c.mem_budget_bytes / parts < (blocked ? kBlockBytes : kLineWords * 8U)) {
+      return result<filter>::from_error(make_error(errc::invalid_argument, "mem too small for partitions"));
+    }
+    units = partition_units(c.mem_budget_bytes / (unit_words * 8U), parts, true, blocked, c.index_map);
+  } else {
+    if (!(c.fp > 0.0) || !(c.fp < 1.0)) {
+      return result<filter>::from_error(make_error(errc::invalid_argument, "fp out of range"));
+    }
+    const auto n = static_cast<double>(std::max<std::size_t>(c.capacity_hint, 1));
+    std::size_t m_bits = 0;
+    if (blocked) {
+      const blocked_sizing sz = size_blocked(c.fp);
+      k = sz.k;
+      m_bits = static_cast<std::size_t>(std::ceil(sz.bits_per_key * n));
+    } else {
+      k = clamp_k(-std::log(c.fp) / kLn2);
+      m_bits = static_cast<std::size_t>(std::ceil((-std::log(c.fp) / (kLn2 * kLn2)) * n));
+    }
+    const std::size_t unit_bits = unit_words * 64U;
+    units = partition_units((m_bits + unit_bits - 1U) / unit_bits, parts, false, blocked, c.index_map);
+  }
+  auto storage = probkit::detail::make_table<std::uint64_t>(units * unit_words * parts, c.alloc);
+  if (!storage) {
+    return result<filter>::from_error(storage.error());
+  }
+  const filter::geometry geo{.bit_count = units * unit_words * 64U * parts,
+                             .k = k,
+                             .layout = c.layout,
+                             .index_map = c.index_map,
+                             .partitions = parts,
+                             .probe_hash = c.probe_hash};
+  filter f{std::move(storage.value()), geo, h};
+  return f;
+}
+
+auto filter::make_by_mem(std::size_t bytes, HashConfig h, AllocPolicy alloc) -> result<filter> {
   if (bytes < kMinBytes) {
     return result<filter>::from_error(make_error(errc::invalid_argument, "mem too small"));
   }
-  const std::size_t words = bytes / 8U;
-  if (words == 0U) {
-    return result<filter>::from_error(make_error(errc::invalid_argument, "mem not aligned"));
+  return make(Config{.mem_budget_bytes = bytes, .alloc = alloc}, h);
+}
+
+auto filter::make_blocked_by_mem(std::size_t bytes, HashConfig h, AllocPolicy alloc) -> result<filter> {
+  if (bytes < kBlockBytes) {
+    return result<filter>::from_error(make_error(errc::invalid_argument, "mem too small for one block"));
   }
-  const std::size_t m_bits = words * 64U;
-  std::vector<std::uint64_t> storage(words, 0ULL);
-  filter f{std::move(storage), filter::layout{.bit_count = m_bits, .k = kDefaultK}, h};
-  return f;
+  return make(Config{.mem_budget_bytes = bytes, .layout = Layout::blocked, .alloc = alloc}, h);
+}
+
+auto filter::make_blocked_by_fp(double p, HashConfig h) -> result<filter> {
+  return make_blocked_by_fp(p, h, kCapacityHint);
+}
+
+auto filter::make_blocked_by_fp(double p, HashConfig h, std::size_t capacity_hint) -> result<filter> {
+  return make(Config{.fp = p, .capacity_hint = capacity_hint, .layout = Layout::blocked}, h);
 }
 
 auto filter::make_by_fp(double p, HashConfig h) -> result<filter> {
@@ -48,57 +255,296 @@ auto filter::make_by_fp(double p, HashConfig h) -> result<filter> {
 }
 
 auto filter::make_by_fp(double p, HashConfig h, std::size_t capacity_hint) -> result<filter> {
-  if (!(p > 0.0) || !(p < 1.0)) {
-    return result<filter>::from_error(make_error(errc::invalid_argument, "fp out of range"));
-  }
-  const double k_real = -std::log(p) / kLn2;
-  std::uint8_t k = static_cast<std::uint8_t>(std::lround(std::max(1.0, std::min(32.0, k_real))));
-  const double m_per_n = -std::log(p) / (kLn2 * kLn2);
-  const double m_bits_d = std::ceil(m_per_n * static_cast<double>(capacity_hint));
-  const auto m_bits = static_cast<std::size_t>(m_bits_d);
-  const std::size_t words = round_up_bits_to_words(m_bits);
-  std::vector<std::uint64_t> storage(words, 0ULL);
-  filter f{std::move(storage), filter::layout{.bit_count = words * 64U, .k = k}, h};
-  return f;
+  return make(Config{.fp = p, .capacity_hint = capacity_hint}, h);
 }
 
 auto filter::add(std::string_view x) noexcept -> result<void> {
+  if (!bits_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  add_key<0>(x);
+  return {};
+}
+
+auto filter::add_batch(std::span<const std::string_view> xs) noexcept -> result<void> {
+  if (!bits_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  add_keys<0>(xs);
+  return {};
+}
+
+auto filter::second_hash(std::string_view x, std::uint64_t h1) const noexcept -> std::uint64_t {
+  if (probe_hash_ == ProbeHash::derived) {
+    return derived_step(h1);
+  }
+  HashConfig cfg2 = hash_cfg_;
+  cfg2.seed = second_seed();
+  return hash64(x, cfg2) | 1ULL; // make it odd to reduce cycles
+}
+
+template <std::uint8_t K> void filter::add_key(std::string_view x) noexcept {
   // Double-hashing: h(i) = h1 + i*h2 (mod m)
   const std::uint64_t h1 = hash64(x, hash_cfg_);
+  set_bits<K>(h1, second_hash(x, h1));
+}
+
+template <std::uint8_t K> void filter::add_keys(std::span<const std::string_view> xs) noexcept {
   HashConfig cfg2 = hash_cfg_;
   cfg2.seed = second_seed();
-  const std::uint64_t h2 = hash64(x, cfg2) | 1ULL; // make it odd to reduce cycles
-  for (std::uint8_t i = 0; i < k_; ++i) {
-    const std::size_t bit = mod_bit(h1 + (static_cast<std::uint64_t>(i) * h2));
-    bits_[index_word(bit)] |= index_mask(bit);
+  const bool derived = probe_hash_ == ProbeHash::derived;
+  std::array<std::uint64_t, kHashChunk> h1s{};
+  std::array<std::uint64_t, kHashChunk> h2s{};
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    hash64_batch(chunk, hash_cfg_, h1s);
+    if (derived) {
+      for (std::size_t i = 0; i < chunk.size(); ++i) {
+        set_bits<K>(h1s[i], derived_step(h1s[i]));
+      }
+      continue;
+    }
+    hash64_batch(chunk, cfg2, h2s);
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+      set_bits<K>(h1s[i], h2s[i] | 1ULL);
+    }
   }
+}
+
+auto filter::add_hashed(std::uint64_t h) noexcept -> result<void> {
+  if (probe_hash_ != ProbeHash::derived) {
+    return result<void>::from_error(make_error(errc::not_supported, "hashed add needs ProbeHash::derived"));
+  }
+  if (!bits_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  set_bits<0>(h, derived_step(h));
   return {};
 }
 
-auto filter::might_contain(std::string_view x) const noexcept -> result<bool> {
-  const std::uint64_t h1 = hash64(x, hash_cfg_);
-  HashConfig cfg2 = hash_cfg_;
-  cfg2.seed = second_seed();
-  const std::uint64_t h2 = hash64(x, cfg2) | 1ULL;
-  for (std::uint8_t i = 0; i < k_; ++i) {
-    const std::size_t bit = mod_bit(h1 + (static_cast<std::uint64_t>(i) * h2));
-    if ((bits_[index_word(bit)] & index_mask(bit)) == 0ULL) {
+auto filter::might_contain_hashed(std::uint64_t h) const noexcept -> result<bool> {
+  if (probe_hash_ != ProbeHash::derived) {
+    return result<bool>::from_error(make_error(errc::not_supported, "hashed query needs ProbeHash::derived"));
+  }
+  return test_bits<0>(h, derived_step(h));
+}
+
+template <std::uint8_t K> void filter::set_bits(std::uint64_t h1, std::uint64_t h2) noexcept {
+  const std::uint8_t k = K != 0U ? K : k_;
+  const std::size_t part = partition_word(h1);
+  if (layout_ == Layout::blocked) {
+    const std::size_t base = part + (block_of(h1) * kBlockWords);
+    const std::uint64_t step = block_step(h2);
+    for (std::uint8_t i = 0; i < k; ++i) {
+      const auto pos = static_cast<std::size_t>((h2 + (static_cast<std::uint64_t>(i) * step)) >> kBlockShift);
+      bits_[base + index_word(pos)] |= index_mask(pos);
+    }
+    return;
+  }
+  for (std::uint8_t i = 0; i < k; ++i) {
+    const std::size_t bit = bit_of(h1 + (static_cast<std::uint64_t>(i) * h2));
+    bits_[part + index_word(bit)] |= index_mask(bit);
+  }
+}
+
+template <std::uint8_t K> auto filter::test_bits(std::uint64_t h1, std::uint64_t h2) const noexcept -> bool {
+  const std::uint8_t k = K != 0U ? K : k_;
+  const std::size_t part = partition_word(h1);
+  if (layout_ == Layout::blocked) {
+    const std::size_t base = part + (block_of(h1) * kBlockWords);
+    const std::uint64_t step = block_step(h2);
+    for (std::uint8_t i = 0; i < k; ++i) {
+      const auto pos = static_cast<std::size_t>((h2 + (static_cast<std::uint64_t>(i) * step)) >> kBlockShift);
+      if ((bits_[base + index_word(pos)] & index_mask(pos)) == 0ULL) {
+        return false;
+      }
+    }
+    return true;
+  }
+  for (std::uint8_t i = 0; i < k; ++i) {
+    const std::size_t bit = bit_of(h1 + (static_cast<std::uint64_t>(i) * h2));
+    if ((bits_[part + index_word(bit)] & index_mask(bit)) == 0ULL) {
       return false;
     }
   }
   return true;
 }
 
+auto filter::might_contain(std::string_view x) const noexcept -> result<bool> {
+  return contains_key<0>(x);
+}
+
+template <std::uint8_t K> auto filter::contains_key(std::string_view x) const noexcept -> bool {
+  const std::uint64_t h1 = hash64(x, hash_cfg_);
+  return test_bits<K>(h1, second_hash(x, h1));
+}
+
 auto filter::merge(const filter& other) noexcept -> result<void> {
-  const bool hash_same = (hash_cfg_.kind == other.hash_cfg_.kind) && (hash_cfg_.seed == other.hash_cfg_.seed) &&
-                         (hash_cfg_.thread_salt == other.hash_cfg_.thread_salt);
-  if (m_bits_ != other.m_bits_ || k_ != other.k_ || !hash_same) {
+  if (!same_params(other)) {
     return result<void>::from_error(make_error(errc::invalid_argument, "incompatible bloom merge"));
   }
-  for (std::size_t i = 0; i < bits_.size(); ++i) {
-    bits_[i] |= other.bits_[i];
+  if (!bits_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  or_merge(bits_.data(), other.bits_.data(), bits_.size());
+  return {};
+}
+
+namespace {
+using serialize::detail::header_fields;
+using serialize::detail::SketchKind;
+
+// Image params: [m_bits, k, layout, index_map, partitions, probe_hash]; partitions is 0 for
+// unpartitioned filters, which keeps their images identical to those written before partitioning existed
+enum : std::size_t { kParamBits, kParamK, kParamLayout, kParamIndexMap, kParamPartitions, kParamProbeHash };
+
+inline auto image_header(const filter& f) -> header_fields {
+  header_fields hdr{};
+  hdr.kind = SketchKind::bloom;
+  hdr.hash = f.hash_config();
+  hdr.params[kParamBits] = f.bit_size();
+  hdr.params[kParamK] = f.k();
+  hdr.params[kParamLayout] = static_cast<std::uint64_t>(f.layout());
+  hdr.params[kParamIndexMap] = static_cast<std::uint64_t>(f.index_map());
+  hdr.params[kParamPartitions] = f.partitions() > 1U ? f.partitions() : 0U;
+  hdr.params[kParamProbeHash] = static_cast<std::uint64_t>(f.probe_hash());
+  return hdr;
+}
+} // namespace
+
+auto filter::save(const std::string& path) const -> result<void> {
+  return serialize::detail::save_image(path, image_header(*this), std::as_bytes(std::span(bits_)), {});
+}
+
+auto filter::to_bytes() const -> std::vector<std::byte> {
+  return serialize::detail::image_bytes(image_header(*this), std::as_bytes(std::span(bits_)), {});
+}
+
+auto filter::load(const std::string& path, serialize::LoadOptions opt) -> result<filter> {
+  auto img = serialize::detail::load_image(path, opt, SketchKind::bloom);
+  if (!img) {
+    return result<filter>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto filter::from_bytes(std::span<const std::byte> bytes) -> result<filter> {
+  auto img = serialize::detail::parse_image(bytes, SketchKind::bloom);
+  if (!img) {
+    return result<filter>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto filter::from_image(serialize::detail::image&& img) -> result<filter> {
+  const auto& p = img.hdr.params;
+  const std::uint64_t m_bits = p[kParamBits];
+  const std::uint64_t parts = std::max<std::uint64_t>(p[kParamPartitions], 1U);
+  const std::uint64_t part_bits = m_bits / parts;
+  const bool shape_ok = m_bits > 0U && part_bits > 0U && m_bits % parts == 0U && part_bits % 64U == 0U &&
+                        img.hdr.payload_bytes == m_bits / 8U &&
+                        p[kParamK] >= 1U && p[kParamK] <= 32U &&
+                        p[kParamLayout] <= static_cast<std::uint64_t>(Layout::blocked) &&
+                        p[kParamIndexMap] <= static_cast<std::uint64_t>(hashing::IndexMap::fastrange) &&
+                        p[kParamProbeHash] <= static_cast<std::uint64_t>(ProbeHash::derived);
+  const auto layout = static_cast<Layout>(p[kParamLayout]);
+  const auto map = static_cast<hashing::IndexMap>(p[kParamIndexMap]);
+  const std::uint64_t units = layout == Layout::blocked ? part_bits / kBlockBits : part_bits / 64U;
+  if (!shape_ok || (layout == Layout::blocked && part_bits % kBlockBits != 0U) ||
+      (map == hashing::IndexMap::pow2 && !std::has_single_bit(units))) {
+    return result<filter>::from_error(make_error(errc::parse_error, "invalid bloom image"));
   }
+  const auto words = static_cast<std::size_t>(m_bits / 64U);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): payload is 64-byte aligned within the image
+  auto* data = reinterpret_cast<std::uint64_t*>(img.payload);
+  const filter::geometry geo{.bit_count = static_cast<std::size_t>(m_bits),
+                             .k = static_cast<std::uint8_t>(p[kParamK]),
+                             .layout = layout,
+                             .index_map = map,
+                             .partitions = static_cast<std::size_t>(parts),
+                             .probe_hash = static_cast<ProbeHash>(p[kParamProbeHash])};
+  filter f{word_buffer::adopt(std::move(img.owner), data, words, img.writable), geo, img.hdr.hash};
+  return f;
+}
+
+namespace {
+inline auto mismatch() -> probkit::error {
+  return make_error(errc::invalid_argument, "filter does not match fixed_filter");
+}
+} // namespace
+
+template <std::uint8_t K> auto fixed_filter<K>::make(const Config& c, HashConfig h) -> result<fixed_filter> {
+  auto f = filter::make(c, h);
+  if (!f) {
+    return result<fixed_filter>::from_error(f.error());
+  }
+  return wrap(std::move(f.value()));
+}
+
+template <std::uint8_t K> auto fixed_filter<K>::wrap(filter&& f) -> result<fixed_filter> {
+  if (!fits(f)) {
+    return result<fixed_filter>::from_error(mismatch());
+  }
+  return fixed_filter{std::move(f)};
+}
+
+template <std::uint8_t K> auto fixed_filter<K>::add(filter& f, std::string_view x) noexcept -> result<void> {
+  if (!fits(f)) {
+    return result<void>::from_error(mismatch());
+  }
+  if (!f.bits_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  f.add_key<K>(x);
   return {};
 }
 
+template <std::uint8_t K>
+auto fixed_filter<K>::add_batch(filter& f, std::span<const std::string_view> xs) noexcept -> result<void> {
+  if (!fits(f)) {
+    return result<void>::from_error(mismatch());
+  }
+  if (!f.bits_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  f.add_keys<K>(xs);
+  return {};
+}
+
+template <std::uint8_t K>
+auto fixed_filter<K>::might_contain(const filter& f, std::string_view x) noexcept -> result<bool> {
+  if (!fits(f)) {
+    return result<bool>::from_error(mismatch());
+  }
+  return f.contains_key<K>(x);
+}
+
+template <std::uint8_t K>
+auto fixed_filter<K>::load(const std::string& path, serialize::LoadOptions opt) -> result<fixed_filter> {
+  auto f = filter::load(path, opt);
+  if (!f) {
+    return result<fixed_filter>::from_error(f.error());
+  }
+  return wrap(std::move(f.value()));
+}
+
+template <std::uint8_t K> auto fixed_filter<K>::from_bytes(std::span<const std::byte> bytes) -> result<fixed_filter> {
+  auto f = filter::from_bytes(bytes);
+  if (!f) {
+    return result<fixed_filter>::from_error(f.error());
+  }
+  return wrap(std::move(f.value()));
+}
+
+template class fixed_filter<3>;
+template class fixed_filter<4>;
+template class fixed_filter<5>;
+template class fixed_filter<6>;
+template class fixed_filter<7>;
+template class fixed_filter<8>;
+template class fixed_filter<9>;
+template class fixed_filter<10>;
+template class fixed_filter<11>;
+template class fixed_filter<12>;
+
 } // namespace probkit::bloom
@@ -1,17 +1,38 @@
 #include "probkit/cms.hpp"
+#include "format.hpp"
+#include "memory.hpp"
 #include "probkit/error.hpp"
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define PROBKIT_CMS_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define PROBKIT_CMS_X86_SIMD 0
+#endif
 
 using probkit::errc;
 using probkit::make_error;
 using probkit::result;
 using probkit::hashing::hash64;
+using probkit::hashing::hash64_batch;
 using probkit::hashing::HashConfig;
 
 namespace probkit::cms {
 
 namespace {
+constexpr std::size_t kHashChunk = 256; // keys hashed per hash64_batch call
+constexpr std::uint64_t kRowSalt = 0x9E3779B97F4A7C15ULL;
+
 inline auto compute_dims(double eps, double delta) -> std::pair<std::size_t, std::size_t> {
   if (!(eps > 0.0) || !(eps < 1.0) || !(delta > 0.0) || !(delta < 1.0)) {
     return {0, 0};
@@ -24,67 +45,910 @@ inline auto compute_dims(double eps, double delta) -> std::pair<std::size_t, std
 }
 
 // Avoid easily swappable adjacent size_t parameters by returning the hash first
-inline auto hash_row(std::string_view x, const HashConfig& base, std::size_t row) -> std::uint64_t {
+inline auto row_config(const HashConfig& base, std::size_t row) -> HashConfig {
   HashConfig cfg = base;
-  cfg.seed ^= (0x9E3779B97F4A7C15ULL * static_cast<std::uint64_t>(row + 1));
-  return hash64(x, cfg);
+  cfg.seed ^= (kRowSalt * static_cast<std::uint64_t>(row + 1));
+  return cfg;
+}
+
+inline auto hash_row(std::string_view x, const HashConfig& base, std::size_t row) -> std::uint64_t {
+  return hash64(x, row_config(base, row));
+}
+
+// double_hash step: a murmur3 fmix64 of h1, kept odd so the row sequence never stalls
+inline auto row_step(std::uint64_t h1) -> std::uint64_t {
+  std::uint64_t z = h1 ^ kRowSalt;
+  z = (z ^ (z >> 33U)) * 0xFF51AFD7ED558CCDULL;
+  z = (z ^ (z >> 33U)) * 0xC4CEB9FE1A85EC53ULL;
+  return (z ^ (z >> 33U)) | 1ULL;
+}
+
+// double_hash key hashes of chunk (which starts at xs[off]): copied from the caller's pre when given
+inline void key_hashes(std::span<const std::string_view> chunk, const HashConfig& cfg, const std::uint64_t* pre,
+                       std::size_t off, std::span<std::uint64_t> out) noexcept {
+  if (pre != nullptr) {
+    std::copy_n(pre + off, chunk.size(), out.begin());
+  } else {
+    hash64_batch(chunk, cfg, out);
+  }
+}
+
+inline constexpr auto cell_bytes(CounterWidth w) noexcept -> std::size_t {
+  return static_cast<std::size_t>(w);
+}
+
+inline constexpr auto valid_width(std::uint64_t bytes) noexcept -> bool {
+  return bytes == cell_bytes(CounterWidth::u16) || bytes == cell_bytes(CounterWidth::u32) ||
+         bytes == cell_bytes(CounterWidth::u64);
+}
+
+// Runs f(Cell{}) with the counter type of width w, so one template body serves every width
+template <class F> inline auto with_cell_type(CounterWidth w, F&& f) -> decltype(auto) {
+  switch (w) {
+  case CounterWidth::u16:
+    return std::forward<F>(f)(std::uint16_t{});
+  case CounterWidth::u32:
+    return std::forward<F>(f)(std::uint32_t{});
+  case CounterWidth::u64:
+    break;
+  }
+  return std::forward<F>(f)(std::uint64_t{});
+}
+
+// cell + c, clamped at the cell maximum; clamping sets saturated
+template <class Cell> inline auto sat_add(Cell cell, std::uint64_t c, bool& saturated) noexcept -> Cell {
+  constexpr Cell kMax = std::numeric_limits<Cell>::max();
+  if (c > static_cast<std::uint64_t>(kMax - cell)) {
+    saturated = true;
+    return kMax;
+  }
+  return static_cast<Cell>(cell + c);
+}
+
+// Table merge: dst[i] = sat_add(dst[i], src[i]) over n cells, branch-free; true when any cell clamped
+template <class Cell> inline auto sat_merge_scalar(Cell* dst, const Cell* src, std::size_t n) noexcept -> bool {
+  constexpr Cell kMax = std::numeric_limits<Cell>::max();
+  bool saturated = false;
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto sum = static_cast<Cell>(dst[i] + src[i]);
+    const bool wrapped = sum < dst[i];
+    dst[i] = wrapped ? kMax : sum;
+    saturated |= wrapped;
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  return saturated;
+}
+
+#if PROBKIT_CMS_X86_SIMD
+// A lane overflowed where the wrapping sum differs from the clamped one; the clamped sum is the wrapping
+// sum with every overflowed lane forced to all ones. SSE2 has an unsigned saturating add for 16-bit
+// lanes only; AVX2 covers every width and is compiled per function and picked at runtime.
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+inline auto sat_merge_sse2(std::uint16_t* dst, const std::uint16_t* src, std::size_t n) noexcept -> bool {
+  __m128i wrapped = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 8U <= n; i += 8U) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    const __m128i sum = _mm_adds_epu16(a, b);
+    wrapped = _mm_or_si128(wrapped, _mm_xor_si128(sum, _mm_add_epi16(a, b)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sum);
+  }
+  const bool tail = sat_merge_scalar(dst + i, src + i, n - i);
+  return tail || _mm_movemask_epi8(_mm_cmpeq_epi8(wrapped, _mm_setzero_si128())) != 0xFFFF;
+}
+
+__attribute__((target("avx2"))) auto sat_merge_avx2(std::uint16_t* dst, const std::uint16_t* src,
+                                                    std::size_t n) noexcept -> bool {
+  __m256i wrapped = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 16U <= n; i += 16U) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i sum = _mm256_adds_epu16(a, b);
+    wrapped = _mm256_or_si256(wrapped, _mm256_xor_si256(sum, _mm256_add_epi16(a, b)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), sum);
+  }
+  const bool tail = sat_merge_scalar(dst + i, src + i, n - i);
+  return tail || _mm256_testz_si256(wrapped, wrapped) == 0;
+}
+
+__attribute__((target("avx2"))) auto sat_merge_avx2(std::uint32_t* dst, const std::uint32_t* src,
+                                                    std::size_t n) noexcept -> bool {
+  const __m256i ones = _mm256_set1_epi32(-1);
+  __m256i wrapped = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 8U <= n; i += 8U) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i sum = _mm256_add_epi32(a, b);
+    // no wrap <=> sum >= a <=> max(a, sum) == sum
+    const __m256i lost = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(a, sum), sum), ones);
+    wrapped = _mm256_or_si256(wrapped, lost);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(sum, lost));
+  }
+  const bool tail = sat_merge_scalar(dst + i, src + i, n - i);
+  return tail || _mm256_testz_si256(wrapped, wrapped) == 0;
+}
+
+__attribute__((target("avx2"))) auto sat_merge_avx2(std::uint64_t* dst, const std::uint64_t* src,
+                                                    std::size_t n) noexcept -> bool {
+  // AVX2 compares 64-bit lanes signed only; flipping the sign bits makes it an unsigned compare
+  const __m256i bias = _mm256_set1_epi64x(std::numeric_limits<std::int64_t>::min());
+  __m256i wrapped = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4U <= n; i += 4U) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i sum = _mm256_add_epi64(a, b);
+    const __m256i lost = _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias), _mm256_xor_si256(sum, bias));
+    wrapped = _mm256_or_si256(wrapped, lost);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(sum, lost));
+  }
+  const bool tail = sat_merge_scalar(dst + i, src + i, n - i);
+  return tail || _mm256_testz_si256(wrapped, wrapped) == 0;
+}
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+#endif
+
+template <class Cell> inline auto sat_merge(Cell* dst, const Cell* src, std::size_t n) noexcept -> bool {
+#if PROBKIT_CMS_X86_SIMD
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+  if (has_avx2) {
+    return sat_merge_avx2(dst, src, n);
+  }
+  if constexpr (std::is_same_v<Cell, std::uint16_t>) {
+    return sat_merge_sse2(dst, src, n);
+  }
+#endif
+  return sat_merge_scalar(dst, src, n);
 }
 } // namespace
 
-auto sketch::make_by_eps_delta(double eps, double delta, HashConfig h) -> result<sketch> {
-  auto [d, w] = compute_dims(eps, delta);
+auto sketch::make(const Config& c, HashConfig h) -> result<sketch> {
+  auto [d, w] = compute_dims(c.eps, c.delta);
   if (d == 0 || w == 0) {
     return result<sketch>::from_error(make_error(errc::invalid_argument, "eps/delta out of range"));
   }
-  std::vector<std::uint64_t> counters(d * w, 0ULL);
-  std::vector<std::string> keys;
-  std::vector<std::uint64_t> ests;
-  keys.reserve(0);
-  ests.reserve(0);
-  sketch s{d, h, w, std::move(counters), std::move(keys), std::move(ests)};
+  if (!valid_width(static_cast<std::uint64_t>(c.counter_width)) || c.update > UpdateRule::conservative) {
+    return result<sketch>::from_error(make_error(errc::invalid_argument, "unknown counter width or update rule"));
+  }
+  if (c.topk > kMaxTopk) {
+    return result<sketch>::from_error(make_error(errc::invalid_argument, "topk above kMaxTopk"));
+  }
+  if (c.index_map == hashing::IndexMap::pow2) {
+    w = std::bit_ceil(w);
+  }
+  auto counters = probkit::detail::make_table<std::byte>(d * w * cell_bytes(c.counter_width), c.alloc);
+  if (!counters) {
+    return result<sketch>::from_error(counters.error());
+  }
+  sketch s{geometry{.depth = d,
+                    .width = w,
+                    .index_map = c.index_map,
+                    .row_hash = c.row_hash,
+                    .counter_width = c.counter_width,
+                    .update = c.update},
+           h, std::move(counters.value()), c.topk * kCandidateFactor};
   return s;
 }
 
+auto sketch::make_by_eps_delta(double eps, double delta, HashConfig h, AllocPolicy alloc) -> result<sketch> {
+  return make(Config{.eps = eps, .delta = delta, .alloc = alloc}, h);
+}
+
+template <class Cell> auto sketch::cells() noexcept -> Cell* {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): the table is 64-byte aligned storage for Cells
+  return reinterpret_cast<Cell*>(table_.data());
+}
+
+template <class Cell> auto sketch::cells() const noexcept -> const Cell* {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return reinterpret_cast<const Cell*>(table_.data());
+}
+
+template <std::size_t Depth, class Fn> void sketch::for_each_cell(std::string_view x, Fn&& fn) const {
+  const std::size_t depth = Depth != 0U ? Depth : depth_;
+  if (row_hash_ == RowHash::double_hash) {
+    const std::uint64_t h1 = hash64(x, hash_cfg_);
+    const std::uint64_t step = row_step(h1);
+    for (std::size_t r = 0; r < depth; ++r) {
+      fn((r * width_) + row_col(h1, step, r));
+    }
+  } else {
+    for (std::size_t r = 0; r < depth; ++r) {
+      fn((r * width_) + col_of(hash_row(x, hash_cfg_, r)));
+    }
+  }
+}
+
+template <class Cell, std::size_t Depth> auto sketch::inc_as(std::string_view x, std::uint64_t c) noexcept -> bool {
+  Cell* t = cells<Cell>();
+  bool saturated = false;
+  std::uint64_t est = UINT64_MAX;
+  if (update_ == UpdateRule::conservative) {
+    // Two passes over the rows: find the current estimate, then lift only the cells below est + c
+    for_each_cell<Depth>(x, [&](std::size_t idx) -> void { est = std::min<std::uint64_t>(est, t[idx]); });
+    const Cell target = sat_add(static_cast<Cell>(est), c, saturated);
+    for_each_cell<Depth>(x, [&](std::size_t idx) -> void { t[idx] = std::max(t[idx], target); });
+    est = target;
+  } else {
+    for_each_cell<Depth>(x, [&](std::size_t idx) -> void {
+      t[idx] = sat_add(t[idx], c, saturated);
+      est = std::min<std::uint64_t>(est, t[idx]);
+    });
+  }
+  if (cand_cap_ > 0U) {
+    offer(x, est);
+  }
+  return saturated;
+}
+
 auto sketch::inc(std::string_view x, std::uint64_t c) noexcept -> result<void> {
-  for (std::size_t r = 0; r < depth_; ++r) {
-    const std::uint64_t h = hash_row(x, hash_cfg_, r);
-    const auto col = static_cast<std::size_t>(h % static_cast<std::uint64_t>(width_));
-    const std::size_t idx = (r * width_) + col;
-    table_[idx] += c;
+  return inc_with<0>(x, c);
+}
+
+template <std::size_t Depth> auto sketch::inc_with(std::string_view x, std::uint64_t c) noexcept -> result<void> {
+  if (!table_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  const bool saturated =
+      with_cell_type(counter_width_, [&]<class Cell>(Cell) -> bool { return inc_as<Cell, Depth>(x, c); });
+  if (saturated) {
+    return result<void>::from_error(make_error(errc::overflow, "cms counter saturated"));
   }
-  // Optional: sparse candidate tracking can be added later when CLI needs Top-K streaming.
   return {};
 }
 
-auto sketch::estimate(std::string_view x) const noexcept -> result<std::uint64_t> {
+template <class Cell, std::size_t Depth>
+auto sketch::inc_batch_as(std::span<const std::string_view> xs, std::uint64_t c, const std::uint64_t* pre) noexcept
+    -> bool {
+  const std::size_t depth = Depth != 0U ? Depth : depth_;
+  Cell* t = cells<Cell>();
+  bool saturated = false;
+  std::array<std::uint64_t, kHashChunk> hs{};
+  // Per-key min of the counters right after its own increment; a lower bound on the final estimate
+  std::array<std::uint64_t, kHashChunk> ests{};
+  std::array<std::uint64_t, kHashChunk> steps{};
+  const bool conservative = update_ == UpdateRule::conservative;
+  if (conservative) {
+    cu_cells_.resize(depth * kHashChunk);
+  }
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    const std::size_t n = chunk.size();
+    std::fill_n(ests.begin(), n, UINT64_MAX);
+    if (conservative) {
+      // Collect every row's cell first: the update of one key reads all of its rows before writing any
+      if (row_hash_ == RowHash::double_hash) {
+        key_hashes(chunk, hash_cfg_, pre, off, hs);
+        for (std::size_t i = 0; i < n; ++i) {
+          steps[i] = row_step(hs[i]);
+        }
+      }
+      for (std::size_t r = 0; r < depth; ++r) {
+        if (row_hash_ == RowHash::double_hash) {
+          for (std::size_t i = 0; i < n; ++i) {
+            cu_cells_[(r * n) + i] = (r * width_) + row_col(hs[i], steps[i], r);
+          }
+        } else {
+          hash64_batch(chunk, row_config(hash_cfg_, r), hs);
+          for (std::size_t i = 0; i < n; ++i) {
+            cu_cells_[(r * n) + i] = (r * width_) + col_of(hs[i]);
+          }
+        }
+      }
+      // Keys in order, so repeats within the chunk see each other's updates
+      for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t r = 0; r < depth; ++r) {
+          ests[i] = std::min<std::uint64_t>(ests[i], t[cu_cells_[(r * n) + i]]);
+        }
+        const Cell target = sat_add(static_cast<Cell>(ests[i]), c, saturated);
+        for (std::size_t r = 0; r < depth; ++r) {
+          Cell& cell = t[cu_cells_[(r * n) + i]];
+          cell = std::max(cell, target);
+        }
+        ests[i] = target;
+      }
+    } else if (row_hash_ == RowHash::double_hash) {
+      key_hashes(chunk, hash_cfg_, pre, off, hs);
+      for (std::size_t i = 0; i < n; ++i) {
+        steps[i] = row_step(hs[i]);
+      }
+      for (std::size_t r = 0; r < depth; ++r) {
+        const std::size_t base = r * width_;
+        for (std::size_t i = 0; i < n; ++i) {
+          Cell& cell = t[base + row_col(hs[i], steps[i], r)];
+          cell = sat_add(cell, c, saturated);
+          ests[i] = std::min<std::uint64_t>(ests[i], cell);
+        }
+      }
+    } else {
+      // Row-major: one batch hash per row keeps each row's counters hot while the chunk is applied
+      for (std::size_t r = 0; r < depth; ++r) {
+        hash64_batch(chunk, row_config(hash_cfg_, r), hs);
+        const std::size_t base = r * width_;
+        for (std::size_t i = 0; i < n; ++i) {
+          Cell& cell = t[base + col_of(hs[i])];
+          cell = sat_add(cell, c, saturated);
+          ests[i] = std::min<std::uint64_t>(ests[i], cell);
+        }
+      }
+    }
+    if (cand_cap_ > 0U) {
+      for (std::size_t i = 0; i < n; ++i) {
+        offer(chunk[i], ests[i]);
+      }
+    }
+  }
+  return saturated;
+}
+
+auto sketch::inc_batch(std::span<const std::string_view> xs, std::uint64_t c) noexcept -> result<void> {
+  return inc_batch_with<0>(xs, c);
+}
+
+auto sketch::inc_hashed_batch(std::span<const std::string_view> xs, std::span<const std::uint64_t> hs,
+                              std::uint64_t c) noexcept -> result<void> {
+  if (row_hash_ != RowHash::double_hash) {
+    return result<void>::from_error(make_error(errc::not_supported, "hashed inc needs RowHash::double_hash"));
+  }
+  if (hs.size() != xs.size()) {
+    return result<void>::from_error(make_error(errc::invalid_argument, "one hash per key required"));
+  }
+  return inc_batch_with<0>(xs, c, hs.data());
+}
+
+template <std::size_t Depth>
+auto sketch::inc_batch_with(std::span<const std::string_view> xs, std::uint64_t c, const std::uint64_t* hs) noexcept
+    -> result<void> {
+  if (!table_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  const bool saturated =
+      with_cell_type(counter_width_, [&]<class Cell>(Cell) -> bool { return inc_batch_as<Cell, Depth>(xs, c, hs); });
+  if (saturated) {
+    return result<void>::from_error(make_error(errc::overflow, "cms counter saturated"));
+  }
+  return {};
+}
+
+template <class Cell, std::size_t Depth> auto sketch::estimate_as(std::string_view x) const noexcept -> std::uint64_t {
+  const Cell* t = cells<Cell>();
   std::uint64_t est = UINT64_MAX;
-  for (std::size_t r = 0; r < depth_; ++r) {
-    const std::uint64_t h = hash_row(x, hash_cfg_, r);
-    const auto col = static_cast<std::size_t>(h % static_cast<std::uint64_t>(width_));
-    const std::size_t idx = (r * width_) + col;
-    est = std::min(est, table_[idx]);
+  for_each_cell<Depth>(x, [&](std::size_t idx) -> void { est = std::min<std::uint64_t>(est, t[idx]); });
+  return depth_ == 0U ? 0U : est;
+}
+
+auto sketch::estimate(std::string_view x) const noexcept -> result<std::uint64_t> {
+  return estimate_with<0>(x);
+}
+
+template <std::size_t Depth> auto sketch::estimate_with(std::string_view x) const noexcept -> std::uint64_t {
+  return with_cell_type(counter_width_,
+                        [&]<class Cell>(Cell) -> std::uint64_t { return estimate_as<Cell, Depth>(x); });
+}
+
+void sketch::offer(std::string_view x, std::uint64_t est) {
+  if (cand_heap_.size() == cand_cap_ && est <= cand_heap_.front().est) {
+    return; // cannot displace the current minimum (and a tracked key already holds at least this much)
+  }
+  if (const auto id = cand_keys_.find(x); id != probkit::detail::key_arena::npos) {
+    const std::size_t slot = cand_keys_.value(id);
+    auto& e = cand_heap_[slot];
+    if (est > e.est) {
+      e.est = est;
+      sift_down(slot);
+    }
+    return;
+  }
+  if (cand_heap_.size() < cand_cap_) {
+    push_candidate(x, est);
+    sift_up(cand_heap_.size() - 1U);
+    return;
+  }
+  // Evict the minimum; the newcomer takes over its slot at the root (its bytes reuse the slab)
+  cand_keys_.erase(cand_heap_.front().key);
+  cand_heap_.front() = candidate{.est = est, .key = cand_keys_.insert(x, 0U)};
+  sift_down(0);
+}
+
+void sketch::push_candidate(std::string_view x, std::uint64_t est) {
+  cand_heap_.push_back(candidate{.est = est, .key = cand_keys_.insert(x, cand_heap_.size())});
+}
+
+void sketch::sift_up(std::size_t i) noexcept {
+  while (i > 0U) {
+    const std::size_t parent = (i - 1U) / 2U;
+    if (cand_heap_[parent].est <= cand_heap_[i].est) {
+      break;
+    }
+    std::swap(cand_heap_[parent], cand_heap_[i]);
+    cand_keys_.value(cand_heap_[i].key) = i;
+    i = parent;
+  }
+  cand_keys_.value(cand_heap_[i].key) = i;
+}
+
+void sketch::sift_down(std::size_t i) noexcept {
+  const std::size_t n = cand_heap_.size();
+  for (;;) {
+    const std::size_t l = (2U * i) + 1U;
+    if (l >= n) {
+      break;
+    }
+    const std::size_t r = l + 1U;
+    const std::size_t child = (r < n && cand_heap_[r].est < cand_heap_[l].est) ? r : l;
+    if (cand_heap_[i].est <= cand_heap_[child].est) {
+      break;
+    }
+    std::swap(cand_heap_[i], cand_heap_[child]);
+    cand_keys_.value(cand_heap_[i].key) = i;
+    i = child;
   }
-  if (est == UINT64_MAX) {
-    est = 0;
+  cand_keys_.value(cand_heap_[i].key) = i;
+}
+
+auto sketch::topk(std::size_t k, std::vector<PairView>& out) const -> result<void> {
+  out.clear();
+  if (cand_cap_ == 0U) {
+    return result<void>::from_error(make_error(errc::invalid_argument, "topk tracking disabled"));
+  }
+  out.reserve(cand_heap_.size());
+  for (const auto& e : cand_heap_) {
+    // Report the current estimate: the table may have grown since the candidate was last offered
+    const std::string_view key = cand_keys_.key(e.key);
+    out.push_back(PairView{.key = key, .est = estimate(key).value()});
+  }
+  std::sort(out.begin(), out.end(), [](const PairView& a, const PairView& b) -> bool {
+    return a.est != b.est ? a.est > b.est : a.key < b.key;
+  });
+  if (out.size() > k) {
+    out.resize(k);
   }
-  return est;
+  return {};
 }
 
 auto sketch::topk(std::size_t k) const -> result<std::vector<Pair>> {
-  (void)k;
-  (void)depth_;
-  return std::vector<Pair>{};
+  std::vector<PairView> views;
+  if (auto r = topk(k, views); !r) {
+    return result<std::vector<Pair>>::from_error(r.error());
+  }
+  std::vector<Pair> out;
+  out.reserve(views.size());
+  for (const auto& v : views) {
+    out.push_back(Pair{.key = std::string(v.key), .est = v.est});
+  }
+  return out;
+}
+
+template <class Cell> auto sketch::merge_as(const sketch& other) noexcept -> bool {
+  return sat_merge(cells<Cell>(), other.cells<Cell>(), depth_ * width_);
 }
 
 auto sketch::merge(const sketch& other) noexcept -> result<void> {
   if (!same_params(other)) {
     return result<void>::from_error(make_error(errc::invalid_argument, "incompatible cms merge"));
   }
-  for (std::size_t i = 0; i < table_.size(); ++i) {
-    table_[i] += other.table_[i];
+  if (!table_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  const bool saturated =
+      with_cell_type(counter_width_, [&]<class Cell>(Cell) -> bool { return merge_as<Cell>(other); });
+  if (cand_cap_ != 0U) {
+    merge_candidates(other);
+  }
+  if (saturated) {
+    return result<void>::from_error(make_error(errc::overflow, "cms counter saturated"));
   }
-  // Candidate structures intentionally ignored for now.
   return {};
 }
 
+auto sketch::reset() noexcept -> result<void> {
+  if (!table_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  if (!table_.empty()) {
+    std::memset(table_.data(), 0, table_.size());
+  }
+  cand_heap_.clear();
+  cand_keys_.clear();
+  return {};
+}
+
+void sketch::merge_candidates(const sketch& other) {
+  // Union of both candidate sets, re-estimated against the merged counters; keep the largest cand_cap_.
+  // Own keys are re-estimated in place and re-heaped, then other's are offered: each one either joins,
+  // displaces the current minimum or is dropped, so the key copies go straight into the arena.
+  for (auto& e : cand_heap_) {
+    e.est = estimate(cand_keys_.key(e.key)).value();
+  }
+  for (std::size_t i = cand_heap_.size() / 2U; i-- > 0U;) {
+    sift_down(i);
+  }
+  if (&other == this) {
+    return;
+  }
+  for (const auto& e : other.cand_heap_) {
+    const std::string_view key = other.cand_keys_.key(e.key);
+    offer(key, estimate(key).value());
+  }
+}
+
+void sketch::rebuild_candidates(std::vector<Pair>&& pool) {
+  for (auto& p : pool) {
+    p.est = estimate(p.key).value();
+  }
+  const std::size_t keep = std::min(cand_cap_, pool.size());
+  std::partial_sort(pool.begin(), pool.begin() + static_cast<std::ptrdiff_t>(keep), pool.end(),
+                    [](const Pair& a, const Pair& b) -> bool { return a.est > b.est; });
+  cand_heap_.clear();
+  cand_keys_.clear();
+  for (std::size_t i = 0; i < keep; ++i) {
+    push_candidate(pool[i].key, pool[i].est);
+  }
+  for (std::size_t i = cand_heap_.size() / 2U; i-- > 0U;) {
+    sift_down(i);
+  }
+}
+
+auto concurrent_sketch::make(const Config& c, HashConfig h, std::size_t shards) -> result<concurrent_sketch> {
+  if (c.update != UpdateRule::standard) {
+    return result<concurrent_sketch>::from_error(
+        make_error(errc::not_supported, "conservative update needs a single writer"));
+  }
+  auto base = sketch::make(c, h);
+  if (!base) {
+    return result<concurrent_sketch>::from_error(base.error());
+  }
+  std::unique_ptr<tracker[]> trackers; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+  const std::size_t count = c.topk > 0U ? std::max<std::size_t>(shards, 1U) : 0U;
+  if (count != 0U) {
+    trackers = std::make_unique<tracker[]>(count); // NOLINT(cppcoreguidelines-avoid-c-arrays)
+    const sketch& b = base.value();
+    for (std::size_t i = 0; i < count; ++i) {
+      trackers[i].cands = sketch{b.geo(), h, probkit::detail::buffer<std::byte>{}, b.cand_cap_};
+    }
+  }
+  concurrent_sketch s{std::move(base.value()), std::move(trackers), count};
+  return s;
+}
+
+// CAS rather than fetch_add so that a full counter stays at its maximum instead of wrapping
+template <class Cell>
+auto concurrent_sketch::add_cell(std::size_t idx, std::uint64_t c, bool& saturated) noexcept -> std::uint64_t {
+  std::atomic_ref<Cell> cell(base_.cells<Cell>()[idx]);
+  Cell cur = cell.load(std::memory_order_relaxed);
+  Cell next = sat_add(cur, c, saturated);
+  while (!cell.compare_exchange_weak(cur, next, std::memory_order_relaxed)) {
+    next = sat_add(cur, c, saturated);
+  }
+  return next;
+}
+
+template <class Cell> auto concurrent_sketch::load_cell(std::size_t idx) const noexcept -> std::uint64_t {
+  // atomic_ref needs a mutable referent; the load itself does not write
+  auto& cell = const_cast<Cell&>(base_.cells<Cell>()[idx]); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  return std::atomic_ref<Cell>(cell).load(std::memory_order_relaxed);
+}
+
+auto concurrent_sketch::inc(std::string_view x, std::uint64_t c, std::size_t shard) noexcept -> result<void> {
+  return inc_batch(std::span<const std::string_view>(&x, 1), c, shard);
+}
+
+template <class Cell>
+auto concurrent_sketch::inc_batch_as(std::span<const std::string_view> xs, std::uint64_t c, std::size_t shard) noexcept
+    -> bool {
+  const std::size_t depth = base_.depth_;
+  const std::size_t width = base_.width_;
+  bool saturated = false;
+  std::array<std::uint64_t, kHashChunk> hs{};
+  std::array<std::uint64_t, kHashChunk> ests{};
+  std::array<std::uint64_t, kHashChunk> steps{};
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    std::fill_n(ests.begin(), chunk.size(), UINT64_MAX);
+    if (base_.row_hash_ == RowHash::double_hash) {
+      hash64_batch(chunk, base_.hash_cfg_, hs);
+      for (std::size_t i = 0; i < chunk.size(); ++i) {
+        steps[i] = row_step(hs[i]);
+      }
+      for (std::size_t r = 0; r < depth; ++r) {
+        for (std::size_t i = 0; i < chunk.size(); ++i) {
+          ests[i] =
+              std::min(ests[i], add_cell<Cell>((r * width) + base_.row_col(hs[i], steps[i], r), c, saturated));
+        }
+      }
+    } else {
+      for (std::size_t r = 0; r < depth; ++r) {
+        hash64_batch(chunk, row_config(base_.hash_cfg_, r), hs);
+        for (std::size_t i = 0; i < chunk.size(); ++i) {
+          ests[i] = std::min(ests[i], add_cell<Cell>((r * width) + base_.col_of(hs[i]), c, saturated));
+        }
+      }
+    }
+    if (tracker_count_ != 0U) {
+      offer(shard % tracker_count_, chunk, std::span<const std::uint64_t>(ests.data(), chunk.size()));
+    }
+  }
+  return saturated;
+}
+
+auto concurrent_sketch::inc_batch(std::span<const std::string_view> xs, std::uint64_t c, std::size_t shard) noexcept
+    -> result<void> {
+  const bool saturated = with_cell_type(base_.counter_width_, [&]<class Cell>(Cell) -> bool {
+    return inc_batch_as<Cell>(xs, c, shard);
+  });
+  if (saturated) {
+    return result<void>::from_error(make_error(errc::overflow, "cms counter saturated"));
+  }
+  return {};
+}
+
+void concurrent_sketch::offer(std::size_t shard, std::span<const std::string_view> xs,
+                              std::span<const std::uint64_t> ests) {
+  tracker& t = trackers_[shard];
+  const std::scoped_lock lk(t.mu);
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    t.cands.offer(xs[i], ests[i]);
+  }
+}
+
+template <class Cell> auto concurrent_sketch::estimate_as(std::string_view x) const noexcept -> std::uint64_t {
+  std::uint64_t est = UINT64_MAX;
+  base_.for_each_cell(x, [&](std::size_t idx) -> void { est = std::min(est, load_cell<Cell>(idx)); });
+  return base_.depth_ == 0U ? 0U : est;
+}
+
+auto concurrent_sketch::estimate(std::string_view x) const noexcept -> result<std::uint64_t> {
+  return with_cell_type(base_.counter_width_,
+                        [&]<class Cell>(Cell) -> std::uint64_t { return estimate_as<Cell>(x); });
+}
+
+auto concurrent_sketch::candidate_pool() const -> std::vector<Pair> {
+  std::vector<Pair> pool;
+  std::unordered_set<std::string_view> seen; // views into tracker keys, alive while pooling
+  for (std::size_t i = 0; i < tracker_count_; ++i) {
+    tracker& t = trackers_[i];
+    const std::scoped_lock lk(t.mu);
+    for (const auto& e : t.cands.cand_heap_) {
+      const std::string_view key = t.cands.cand_keys_.key(e.key);
+      if (seen.insert(key).second) {
+        pool.push_back(Pair{.key = std::string(key), .est = 0});
+      }
+    }
+  }
+  return pool;
+}
+
+auto concurrent_sketch::snapshot() const -> result<sketch> {
+  sketch out{base_.geo(), base_.hash_cfg_, probkit::detail::buffer<std::byte>(base_.table_.size()), base_.cand_cap_};
+  with_cell_type(base_.counter_width_, [&]<class Cell>(Cell) -> void {
+    Cell* dst = out.cells<Cell>();
+    for (std::size_t i = 0; i < base_.depth_ * base_.width_; ++i) {
+      dst[i] = static_cast<Cell>(load_cell<Cell>(i));
+    }
+  });
+  if (out.cand_cap_ != 0U) {
+    out.rebuild_candidates(candidate_pool());
+  }
+  return out;
+}
+
+auto concurrent_sketch::release() && -> sketch {
+  if (base_.cand_cap_ != 0U) {
+    base_.rebuild_candidates(candidate_pool());
+  }
+  trackers_.reset();
+  tracker_count_ = 0;
+  return std::move(base_);
+}
+
+namespace {
+using serialize::detail::header_fields;
+using serialize::detail::SketchKind;
+
+// Image params: [depth, width, index_map, row_hash, candidate capacity, counter bytes, update rule].
+// Images from before counter widths carry 0 counter bytes and hold 64-bit standard counters.
+enum : std::size_t {
+  kParamDepth,
+  kParamWidth,
+  kParamIndexMap,
+  kParamRowHash,
+  kParamCandCap,
+  kParamCounterBytes,
+  kParamUpdate
+};
+
+inline auto image_header(const sketch& s) -> header_fields {
+  header_fields hdr{};
+  hdr.kind = SketchKind::cms;
+  hdr.hash = s.hash_config();
+  hdr.params[kParamDepth] = s.dims().first;
+  hdr.params[kParamWidth] = s.dims().second;
+  hdr.params[kParamIndexMap] = static_cast<std::uint64_t>(s.index_map());
+  hdr.params[kParamRowHash] = static_cast<std::uint64_t>(s.row_hash());
+  hdr.params[kParamCandCap] = s.candidate_capacity();
+  hdr.params[kParamCounterBytes] = cell_bytes(s.counter_width());
+  hdr.params[kParamUpdate] = static_cast<std::uint64_t>(s.update_rule());
+  return hdr;
+}
+} // namespace
+
+// Extra section: [count] then per candidate [est][key length][key bytes]
+auto sketch::candidate_bytes() const -> std::vector<std::byte> {
+  std::vector<std::byte> out;
+  if (cand_cap_ == 0U) {
+    return out;
+  }
+  serialize::detail::put_u64(out, cand_heap_.size());
+  for (const auto& e : cand_heap_) {
+    const std::string_view key = cand_keys_.key(e.key);
+    serialize::detail::put_u64(out, e.est);
+    serialize::detail::put_u64(out, key.size());
+    const auto kb = std::as_bytes(std::span(key.data(), key.size()));
+    out.insert(out.end(), kb.begin(), kb.end());
+  }
+  return out;
+}
+
+auto sketch::save(const std::string& path) const -> result<void> {
+  const auto extra = candidate_bytes();
+  return serialize::detail::save_image(path, image_header(*this), std::as_bytes(std::span(table_)), extra);
+}
+
+auto sketch::to_bytes() const -> std::vector<std::byte> {
+  return serialize::detail::image_bytes(image_header(*this), std::as_bytes(std::span(table_)), candidate_bytes());
+}
+
+auto sketch::load(const std::string& path, serialize::LoadOptions opt) -> result<sketch> {
+  auto img = serialize::detail::load_image(path, opt, SketchKind::cms);
+  if (!img) {
+    return result<sketch>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto sketch::from_bytes(std::span<const std::byte> bytes) -> result<sketch> {
+  auto img = serialize::detail::parse_image(bytes, SketchKind::cms);
+  if (!img) {
+    return result<sketch>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto sketch::from_image(serialize::detail::image&& img) -> result<sketch> {
+  const auto& p = img.hdr.params;
+  const std::uint64_t d = p[kParamDepth];
+  const std::uint64_t w = p[kParamWidth];
+  const auto map = static_cast<hashing::IndexMap>(p[kParamIndexMap]);
+  const std::uint64_t cb = p[kParamCounterBytes] == 0U ? cell_bytes(CounterWidth::u64) : p[kParamCounterBytes];
+  const bool shape_ok = d > 0U && w > 0U && valid_width(cb) && d <= UINT64_MAX / cb / w &&
+                        img.hdr.payload_bytes == d * w * cb &&
+                        p[kParamIndexMap] <= static_cast<std::uint64_t>(hashing::IndexMap::fastrange) &&
+                        p[kParamRowHash] <= static_cast<std::uint64_t>(RowHash::double_hash) &&
+                        p[kParamUpdate] <= static_cast<std::uint64_t>(UpdateRule::conservative) &&
+                        p[kParamCandCap] <= kMaxCandidates &&
+                        (map != hashing::IndexMap::pow2 || std::has_single_bit(w));
+  if (!shape_ok) {
+    return result<sketch>::from_error(make_error(errc::parse_error, "invalid cms image"));
+  }
+  // The payload is 64-byte aligned within the image, so it serves as the cell table in place
+  const auto bytes = static_cast<std::size_t>(d * w * cb);
+  const geometry geo{.depth = static_cast<std::size_t>(d),
+                     .width = static_cast<std::size_t>(w),
+                     .index_map = map,
+                     .row_hash = static_cast<RowHash>(p[kParamRowHash]),
+                     .counter_width = static_cast<CounterWidth>(cb),
+                     .update = static_cast<UpdateRule>(p[kParamUpdate])};
+  sketch s{geo, img.hdr.hash, probkit::detail::buffer<std::byte>::adopt(img.owner, img.payload, bytes, img.writable),
+           static_cast<std::size_t>(p[kParamCandCap])};
+
+  const auto bad_extra = [] { return result<sketch>::from_error(make_error(errc::parse_error, "invalid cms image")); };
+  auto in = img.extra;
+  if (s.cand_cap_ == 0U) {
+    if (!in.empty()) {
+      return bad_extra();
+    }
+    return s;
+  }
+  std::uint64_t count = 0;
+  if (!serialize::detail::get_u64(in, count) || count > s.cand_cap_) {
+    return bad_extra();
+  }
+  for (std::uint64_t i = 0; i < count; ++i) {
+    std::uint64_t est = 0;
+    std::uint64_t len = 0;
+    if (!serialize::detail::get_u64(in, est) || !serialize::detail::get_u64(in, len) || len > in.size()) {
+      return bad_extra();
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const std::string_view key(reinterpret_cast<const char*>(in.data()), static_cast<std::size_t>(len));
+    in = in.subspan(key.size());
+    if (s.cand_keys_.find(key) != probkit::detail::key_arena::npos) {
+      return bad_extra();
+    }
+    s.push_candidate(key, est);
+    s.sift_up(s.cand_heap_.size() - 1U);
+  }
+  if (!in.empty()) {
+    return bad_extra();
+  }
+  return s;
+}
+
+namespace {
+inline auto mismatch() -> probkit::error {
+  return make_error(errc::invalid_argument, "sketch does not match fixed_sketch");
+}
+} // namespace
+
+template <std::size_t Depth> auto fixed_sketch<Depth>::make(const Config& c, HashConfig h) -> result<fixed_sketch> {
+  auto s = sketch::make(c, h);
+  if (!s) {
+    return result<fixed_sketch>::from_error(s.error());
+  }
+  return wrap(std::move(s.value()));
+}
+
+template <std::size_t Depth> auto fixed_sketch<Depth>::wrap(sketch&& s) -> result<fixed_sketch> {
+  if (!fits(s)) {
+    return result<fixed_sketch>::from_error(mismatch());
+  }
+  return fixed_sketch{std::move(s)};
+}
+
+template <std::size_t Depth>
+auto fixed_sketch<Depth>::inc(sketch& s, std::string_view x, std::uint64_t c) noexcept -> result<void> {
+  if (!fits(s)) {
+    return result<void>::from_error(mismatch());
+  }
+  return s.inc_with<Depth>(x, c);
+}
+
+template <std::size_t Depth>
+auto fixed_sketch<Depth>::inc_batch(sketch& s, std::span<const std::string_view> xs, std::uint64_t c) noexcept
+    -> result<void> {
+  if (!fits(s)) {
+    return result<void>::from_error(mismatch());
+  }
+  return s.inc_batch_with<Depth>(xs, c);
+}
+
+template <std::size_t Depth>
+auto fixed_sketch<Depth>::estimate(const sketch& s, std::string_view x) noexcept -> result<std::uint64_t> {
+  if (!fits(s)) {
+    return result<std::uint64_t>::from_error(mismatch());
+  }
+  return s.estimate_with<Depth>(x);
+}
+
+template <std::size_t Depth>
+auto fixed_sketch<Depth>::load(const std::string& path, serialize::LoadOptions opt) -> result<fixed_sketch> {
+  auto s = sketch::load(path, opt);
+  if (!s) {
+    return result<fixed_sketch>::from_error(s.error());
+  }
+  return wrap(std::move(s.value()));
+}
+
+template <std::size_t Depth>
+auto fixed_sketch<Depth>::from_bytes(std::span<const std::byte> bytes) -> result<fixed_sketch> {
+  auto s = sketch::from_bytes(bytes);
+  if (!s) {
+    return result<fixed_sketch>::from_error(s.error());
+  }
+  return wrap(std::move(s.value()));
+}
+
+template class fixed_sketch<3>;
+template class fixed_sketch<4>;
+template class fixed_sketch<5>;
+template class fixed_sketch<6>;
+template class fixed_sketch<7>;
+template class fixed_sketch<8>;
+template class fixed_sketch<9>;
+template class fixed_sketch<10>;
+
 } // namespace probkit::cms
@@ -0,0 +1,378 @@
+#include "format.hpp"
+#include "probkit/error.hpp"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+#if __has_include(<sys/mman.h>) && __has_include(<sys/stat.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+#define PROBKIT_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PROBKIT_HAS_MMAP 0
+#endif
+
+using probkit::errc;
+using probkit::make_error;
+using probkit::result;
+
+namespace probkit::serialize::detail {
+
+namespace {
+constexpr std::array<char, 8> kMagic{'P', 'R', 'O', 'B', 'K', 'I', 'T', '\0'};
+constexpr std::uint64_t kChecksumSeed = 0x50524F424B495431ULL; // "PROBKIT1"
+constexpr std::size_t kImageAlign = 64;
+
+// Header byte offsets
+constexpr std::size_t kOffVersion = 8;
+constexpr std::size_t kOffKind = 10;
+constexpr std::size_t kOffHashKind = 11;
+constexpr std::size_t kOffHeaderBytes = 12;
+constexpr std::size_t kOffSeed = 16;
+constexpr std::size_t kOffSalt = 24;
+constexpr std::size_t kOffPayload = 32;
+constexpr std::size_t kOffExtra = 40;
+constexpr std::size_t kOffBodySum = 48;
+constexpr std::size_t kOffParams = 56;
+constexpr std::size_t kOffHeaderSum = kHeaderBytes - 8U;
+static_assert(kOffParams + (8U * kParamCount) <= kOffHeaderSum, "params overlap the header checksum");
+
+using header_bytes = std::array<std::byte, kHeaderBytes>;
+
+inline void store_le(header_bytes& h, std::size_t off, std::uint64_t v, unsigned width) noexcept {
+  for (unsigned i = 0; i < width; ++i) {
+    h[off + i] = static_cast<std::byte>((v >> (8U * i)) & 0xFFU);
+  }
+}
+
+inline auto load_le(std::span<const std::byte> h, std::size_t off, unsigned width) noexcept -> std::uint64_t {
+  std::uint64_t v = 0;
+  for (unsigned i = 0; i < width; ++i) {
+    v |= static_cast<std::uint64_t>(std::to_integer<std::uint8_t>(h[off + i])) << (8U * i);
+  }
+  return v;
+}
+
+inline auto checksum(std::span<const std::byte> bytes, std::uint64_t seed) noexcept -> std::uint64_t {
+  hashing::HashConfig cfg{};
+  cfg.kind = hashing::HashKind::xxhash;
+  cfg.seed = seed;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return hashing::hash64(std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()}, cfg);
+}
+
+// Chained so payload and extra need not be contiguous in memory when saving
+inline auto body_checksum(std::span<const std::byte> payload, std::span<const std::byte> extra) noexcept
+    -> std::uint64_t {
+  return checksum(extra, checksum(payload, kChecksumSeed));
+}
+
+auto encode_header(const header_fields& f) noexcept -> header_bytes {
+  header_bytes h{};
+  std::memcpy(h.data(), kMagic.data(), kMagic.size());
+  store_le(h, kOffVersion, kFormatVersion, 2);
+  store_le(h, kOffKind, static_cast<std::uint64_t>(f.kind), 1);
+  store_le(h, kOffHashKind, static_cast<std::uint64_t>(f.hash.kind), 1);
+  store_le(h, kOffHeaderBytes, kHeaderBytes, 4);
+  store_le(h, kOffSeed, f.hash.seed, 8);
+  store_le(h, kOffSalt, f.hash.thread_salt, 8);
+  store_le(h, kOffPayload, f.payload_bytes, 8);
+  store_le(h, kOffExtra, f.extra_bytes, 8);
+  store_le(h, kOffBodySum, f.body_checksum, 8);
+  for (std::size_t i = 0; i < kParamCount; ++i) {
+    store_le(h, kOffParams + (8U * i), f.params[i], 8);
+  }
+  store_le(h, kOffHeaderSum, checksum(std::span<const std::byte>(h.data(), kOffHeaderSum), kChecksumSeed), 8);
+  return h;
+}
+
+// Magic, header checksum and version: what every header must pass before any field is trusted
+auto check_header(std::span<const std::byte> bytes) -> result<void> {
+  if (bytes.size() < kHeaderBytes || std::memcmp(bytes.data(), kMagic.data(), kMagic.size()) != 0) {
+    return result<void>::from_error(make_error(errc::parse_error, "not a probkit image"));
+  }
+  if (load_le(bytes, kOffHeaderSum, 8) != checksum(bytes.first(kOffHeaderSum), kChecksumSeed)) {
+    return result<void>::from_error(make_error(errc::parse_error, "header checksum mismatch"));
+  }
+  const auto version = load_le(bytes, kOffVersion, 2);
+  if (version == 0U || version > kFormatVersion || load_le(bytes, kOffHeaderBytes, 4) != kHeaderBytes) {
+    return result<void>::from_error(make_error(errc::not_supported, "unsupported image version"));
+  }
+  return {};
+}
+
+auto decode_header(std::span<const std::byte> bytes, SketchKind kind) -> result<header_fields> {
+  if (auto ok = check_header(bytes); !ok) {
+    return result<header_fields>::from_error(ok.error());
+  }
+  if (load_le(bytes, kOffKind, 1) != static_cast<std::uint64_t>(kind)) {
+    return result<header_fields>::from_error(make_error(errc::invalid_argument, "image holds a different sketch"));
+  }
+  const auto hash_kind = load_le(bytes, kOffHashKind, 1);
+  if (hash_kind > static_cast<std::uint64_t>(hashing::HashKind::aes)) {
+    return result<header_fields>::from_error(make_error(errc::not_supported, "unknown hash kind"));
+  }
+  header_fields f{};
+  f.kind = kind;
+  f.hash.kind = static_cast<hashing::HashKind>(hash_kind);
+  f.hash.seed = load_le(bytes, kOffSeed, 8);
+  f.hash.thread_salt = load_le(bytes, kOffSalt, 8);
+  f.payload_bytes = load_le(bytes, kOffPayload, 8);
+  f.extra_bytes = load_le(bytes, kOffExtra, 8);
+  f.body_checksum = load_le(bytes, kOffBodySum, 8);
+  for (std::size_t i = 0; i < kParamCount; ++i) {
+    f.params[i] = load_le(bytes, kOffParams + (8U * i), 8);
+  }
+  if (f.payload_bytes > bytes.size() - kHeaderBytes || f.extra_bytes != bytes.size() - kHeaderBytes - f.payload_bytes) {
+    return result<header_fields>::from_error(make_error(errc::parse_error, "image size mismatch"));
+  }
+  return f;
+}
+
+// Validates a whole image held in [data, data + size) and wraps it
+auto make_image(std::shared_ptr<void> owner, std::byte* data, std::size_t size, bool writable, bool verify,
+                SketchKind kind) -> result<image> {
+  const std::span<const std::byte> all(data, size);
+  auto hdr = decode_header(all, kind);
+  if (!hdr) {
+    return result<image>::from_error(hdr.error());
+  }
+  const auto payload = all.subspan(kHeaderBytes, static_cast<std::size_t>(hdr.value().payload_bytes));
+  const auto extra = all.subspan(kHeaderBytes + payload.size());
+  if (verify && body_checksum(payload, extra) != hdr.value().body_checksum) {
+    return result<image>::from_error(make_error(errc::parse_error, "body checksum mismatch"));
+  }
+  image img{};
+  img.hdr = hdr.value();
+  img.owner = std::move(owner);
+  img.payload = data + kHeaderBytes; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  img.extra = extra;
+  img.writable = writable;
+  return img;
+}
+
+auto make_owned_block(std::size_t size) -> std::pair<std::shared_ptr<void>, std::byte*> {
+  auto* p = static_cast<std::byte*>(::operator new(size == 0U ? 1U : size, std::align_val_t{kImageAlign}));
+  std::shared_ptr<void> owner(p, [](void* q) { ::operator delete(q, std::align_val_t{kImageAlign}); });
+  return {std::move(owner), p};
+}
+
+#if PROBKIT_HAS_MMAP
+struct mapping {
+  void* addr{nullptr};
+  std::size_t len{0};
+  mapping(void* a, std::size_t l) noexcept : addr(a), len(l) {}
+  mapping(const mapping&) = delete;
+  auto operator=(const mapping&) -> mapping& = delete;
+  mapping(mapping&&) = delete;
+  auto operator=(mapping&&) -> mapping& = delete;
+  ~mapping() {
+    ::munmap(addr, len);
+  }
+};
+
+auto map_file(const std::string& path, const LoadOptions& opt, SketchKind kind) -> result<image> {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return result<image>::from_error(make_error(errc::io_error, "open failed"));
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kHeaderBytes)) {
+    ::close(fd);
+    return result<image>::from_error(make_error(errc::parse_error, "not a probkit image"));
+  }
+  const auto len = static_cast<std::size_t>(st.st_size);
+  const bool cow = opt.mode == LoadMode::map_copy_on_write;
+  const int prot = cow ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  const int flags = cow ? MAP_PRIVATE : MAP_SHARED;
+  void* addr = ::mmap(nullptr, len, prot, flags, fd, 0);
+  ::close(fd); // the mapping keeps the file referenced
+  if (addr == MAP_FAILED) {
+    return result<image>::from_error(make_error(errc::io_error, "mmap failed"));
+  }
+  auto owner = std::make_shared<mapping>(addr, len);
+  return make_image(std::move(owner), static_cast<std::byte*>(addr), len, cow, opt.verify_checksum, kind);
+}
+
+// The process umask, read from /proc (umask(2) reads it only by replacing it, which races with other
+// threads creating files); 022 when /proc is unavailable
+auto current_umask() noexcept -> ::mode_t {
+  ::mode_t mask = 022;
+  std::FILE* f = std::fopen("/proc/self/status", "r");
+  if (f == nullptr) {
+    return mask;
+  }
+  std::array<char, 256> line{};
+  while (std::fgets(line.data(), static_cast<int>(line.size()), f) != nullptr) {
+    unsigned v = 0;
+    if (std::sscanf(line.data(), "Umask: %o", &v) == 1) {
+      mask = static_cast<::mode_t>(v);
+      break;
+    }
+  }
+  std::fclose(f);
+  return mask;
+}
+
+// A new, uniquely named sibling of path (mkstemp), so concurrent saves to one path never share a temp
+// file; it gets the permissions fopen would have created path with
+auto open_temp(const std::string& path, std::string& tmp) -> std::FILE* {
+  tmp = path + ".XXXXXX";
+  const int fd = ::mkstemp(tmp.data());
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::FILE* f = nullptr;
+  if (::fchmod(fd, static_cast<::mode_t>(0666U & ~static_cast<unsigned>(current_umask()))) == 0) {
+    f = ::fdopen(fd, "wb");
+  }
+  if (f == nullptr) {
+    ::close(fd);
+    ::unlink(tmp.c_str());
+  }
+  return f;
+}
+
+// Flush f's data to the device, so the rename never publishes a file whose blocks are not yet written
+auto sync_file(std::FILE* f) noexcept -> bool {
+  return std::fflush(f) == 0 && ::fsync(::fileno(f)) == 0;
+}
+#else
+auto open_temp(const std::string& path, std::string& tmp) -> std::FILE* {
+  tmp = path + ".tmp";
+  return std::fopen(tmp.c_str(), "wb");
+}
+
+auto sync_file(std::FILE* f) noexcept -> bool {
+  return std::fflush(f) == 0;
+}
+#endif
+
+auto read_file(const std::string& path, const LoadOptions& opt, SketchKind kind) -> result<image> {
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return result<image>::from_error(make_error(errc::io_error, "open failed"));
+  }
+  long end = -1;
+  if (std::fseek(f, 0, SEEK_END) == 0) {
+    end = std::ftell(f);
+  }
+  if (end < static_cast<long>(kHeaderBytes) || std::fseek(f, 0, SEEK_SET) != 0) {
+    std::fclose(f);
+    return result<image>::from_error(make_error(errc::parse_error, "not a probkit image"));
+  }
+  const auto size = static_cast<std::size_t>(end);
+  auto [owner, data] = make_owned_block(size);
+  const std::size_t got = std::fread(data, 1, size, f);
+  std::fclose(f);
+  if (got != size) {
+    return result<image>::from_error(make_error(errc::io_error, "short read"));
+  }
+  return make_image(std::move(owner), data, size, true, opt.verify_checksum, kind);
+}
+} // namespace
+
+auto image_bytes(header_fields hdr, std::span<const std::byte> payload, std::span<const std::byte> extra)
+    -> std::vector<std::byte> {
+  hdr.payload_bytes = payload.size();
+  hdr.extra_bytes = extra.size();
+  hdr.body_checksum = body_checksum(payload, extra);
+  const header_bytes h = encode_header(hdr);
+  std::vector<std::byte> out(h.size() + payload.size() + extra.size());
+  std::byte* dst = out.data();
+  std::memcpy(dst, h.data(), h.size());
+  if (!payload.empty()) {
+    std::memcpy(dst + h.size(), payload.data(), payload.size()); // NOLINT(*-pointer-arithmetic)
+  }
+  if (!extra.empty()) {
+    std::memcpy(dst + h.size() + payload.size(), extra.data(), extra.size()); // NOLINT(*-pointer-arithmetic)
+  }
+  return out;
+}
+
+auto save_image(const std::string& path, header_fields hdr, std::span<const std::byte> payload,
+                std::span<const std::byte> extra) -> result<void> {
+  if (!kNativeLittleEndian) {
+    return result<void>::from_error(make_error(errc::not_supported, "images are little-endian only"));
+  }
+  hdr.payload_bytes = payload.size();
+  hdr.extra_bytes = extra.size();
+  hdr.body_checksum = body_checksum(payload, extra);
+  const header_bytes h = encode_header(hdr);
+  // Write a sibling temp file and rename it over the target so readers never observe a partial image
+  std::string tmp;
+  std::FILE* f = open_temp(path, tmp);
+  if (f == nullptr) {
+    return result<void>::from_error(make_error(errc::io_error, "open failed"));
+  }
+  bool ok = std::fwrite(h.data(), 1, h.size(), f) == h.size();
+  // An empty span may hold a null pointer, which fwrite must not be given
+  if (!payload.empty()) {
+    ok = ok && std::fwrite(payload.data(), 1, payload.size(), f) == payload.size();
+  }
+  if (!extra.empty()) {
+    ok = ok && std::fwrite(extra.data(), 1, extra.size(), f) == extra.size();
+  }
+  ok = ok && sync_file(f);
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return result<void>::from_error(make_error(errc::io_error, "write failed"));
+  }
+  return {};
+}
+
+auto load_image(const std::string& path, const LoadOptions& opt, SketchKind kind) -> result<image> {
+  if (!kNativeLittleEndian) {
+    return result<image>::from_error(make_error(errc::not_supported, "images are little-endian only"));
+  }
+  if (opt.mode == LoadMode::copy) {
+    return read_file(path, opt, kind);
+  }
+#if PROBKIT_HAS_MMAP
+  return map_file(path, opt, kind);
+#else
+  return result<image>::from_error(make_error(errc::not_supported, "mmap unavailable"));
+#endif
+}
+
+auto parse_image(std::span<const std::byte> bytes, SketchKind kind) -> result<image> {
+  if (!kNativeLittleEndian) {
+    return result<image>::from_error(make_error(errc::not_supported, "images are little-endian only"));
+  }
+  auto [owner, data] = make_owned_block(bytes.size());
+  if (!bytes.empty()) {
+    std::memcpy(data, bytes.data(), bytes.size());
+  }
+  return make_image(std::move(owner), data, bytes.size(), true, true, kind);
+}
+
+} // namespace probkit::serialize::detail
+
+namespace probkit::serialize {
+
+auto sketch_kind(const std::string& path) -> result<SketchKind> {
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return result<SketchKind>::from_error(make_error(errc::io_error, "open failed"));
+  }
+  std::array<std::byte, detail::kHeaderBytes> h{};
+  const std::size_t got = std::fread(h.data(), 1, h.size(), f);
+  std::fclose(f);
+  auto ok = detail::check_header(std::span<const std::byte>(h.data(), got));
+  if (!ok) {
+    return result<SketchKind>::from_error(ok.error());
+  }
+  const auto kind = detail::load_le(h, detail::kOffKind, 1);
+  if (kind < static_cast<std::uint64_t>(SketchKind::bloom) || kind > static_cast<std::uint64_t>(SketchKind::fuse)) {
+    return result<SketchKind>::from_error(make_error(errc::not_supported, "unknown sketch kind"));
+  }
+  return static_cast<SketchKind>(kind);
+}
+
+} // namespace probkit::serialize
@@ -0,0 +1,77 @@
+#pragma once
+
+// Internal helpers shared by the sketch save/load implementations; see probkit/serialize.hpp for the layout.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "probkit/expected.hpp"
+#include "probkit/hash.hpp"
+#include "probkit/serialize.hpp"
+
+namespace probkit::serialize::detail {
+
+inline constexpr std::size_t kHeaderBytes = 128;
+inline constexpr std::size_t kParamCount = 7;
+
+using serialize::SketchKind;
+
+struct header_fields {
+  SketchKind kind{};
+  hashing::HashConfig hash{};
+  std::array<std::uint64_t, kParamCount> params{}; // per-sketch geometry
+  std::uint64_t payload_bytes{};
+  std::uint64_t extra_bytes{};
+  std::uint64_t body_checksum{};
+};
+
+// A validated image: payload points kHeaderBytes into a region kept alive by owner
+struct image {
+  header_fields hdr{};
+  std::shared_ptr<void> owner;
+  std::byte* payload{nullptr};
+  std::span<const std::byte> extra;
+  bool writable{false};
+};
+
+[[nodiscard]] auto save_image(const std::string& path, header_fields hdr, std::span<const std::byte> payload,
+                              std::span<const std::byte> extra) -> result<void>;
+[[nodiscard]] auto image_bytes(header_fields hdr, std::span<const std::byte> payload, std::span<const std::byte> extra)
+    -> std::vector<std::byte>;
+[[nodiscard]] auto load_image(const std::string& path, const LoadOptions& opt, SketchKind kind) -> result<image>;
+// Copies bytes into owned, aligned memory first; the returned image is writable
+[[nodiscard]] auto parse_image(std::span<const std::byte> bytes, SketchKind kind) -> result<image>;
+
+// Little-endian field codec for the extra section
+inline void put_u64(std::vector<std::byte>& out, std::uint64_t v) {
+  for (unsigned i = 0; i < 8U; ++i) {
+    out.push_back(static_cast<std::byte>((v >> (8U * i)) & 0xFFU));
+  }
+}
+
+inline auto get_u64(std::span<const std::byte>& in, std::uint64_t& v) noexcept -> bool {
+  if (in.size() < 8U) {
+    return false;
+  }
+  v = 0;
+  for (unsigned i = 0; i < 8U; ++i) {
+    v |= static_cast<std::uint64_t>(std::to_integer<std::uint8_t>(in[i])) << (8U * i);
+  }
+  in = in.subspan(8);
+  return true;
+}
+
+// In-place payloads are native integers; images are little-endian
+inline constexpr bool kNativeLittleEndian =
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    false;
+#else
+    true;
+#endif
+
+} // namespace probkit::serialize::detail
@@ -0,0 +1,482 @@
+#include "probkit/fuse.hpp"
+#include "format.hpp"
+#include "memory.hpp"
+#include "threads.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using probkit::errc;
+using probkit::make_error;
+using probkit::result;
+using probkit::hashing::HashConfig;
+
+namespace probkit::fuse {
+
+namespace {
+constexpr std::size_t kArity = 3;
+constexpr std::uint64_t kMaxSegmentLength = std::uint64_t{1} << 18U;
+constexpr unsigned kMaxAttempts = 100; // seeds tried per partition; a handful suffices in practice
+constexpr std::size_t kHashChunk = 256; // keys hashed per hash64_batch call
+constexpr std::size_t kPrefetchGroup = 8; // batch queries: keys whose cells are prefetched together
+
+// murmur3 fmix64: the per-partition seeded remix of a key hash
+inline auto mix(std::uint64_t h) noexcept -> std::uint64_t {
+  h = (h ^ (h >> 33U)) * 0xFF51AFD7ED558CCDULL;
+  h = (h ^ (h >> 33U)) * 0xC4CEB9FE1A85EC53ULL;
+  return h ^ (h >> 33U);
+}
+
+inline auto splitmix(std::uint64_t& state) noexcept -> std::uint64_t {
+  std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31U);
+}
+
+inline auto mulhi(std::uint64_t a, std::uint64_t b) noexcept -> std::uint64_t {
+  return static_cast<std::uint64_t>((static_cast<__uint128_t>(a) * static_cast<__uint128_t>(b)) >> 64U);
+}
+
+// The three cells of a remixed hash: one per consecutive segment, the first segment picked by the high bits
+struct cells3 {
+  std::array<std::uint64_t, kArity + 2U> at{}; // at[3], at[4] repeat at[0], at[1] so at[found + j] needs no mod
+};
+
+inline auto cells_of(std::uint64_t k, std::uint64_t seg_len, std::uint64_t seg_count_len) noexcept -> cells3 {
+  const std::uint64_t mask = seg_len - 1U;
+  cells3 c;
+  c.at[0] = mulhi(k, seg_count_len);
+  c.at[1] = (c.at[0] + seg_len) ^ ((k >> 18U) & mask);
+  c.at[2] = (c.at[0] + (2U * seg_len)) ^ (k & mask);
+  c.at[3] = c.at[0];
+  c.at[4] = c.at[1];
+  return c;
+}
+
+template <class F> inline auto fingerprint_of(std::uint64_t k) noexcept -> F {
+  return static_cast<F>(k ^ (k >> 32U));
+}
+
+// Fingerprints are accessed bytewise so one table type serves both widths and mapped images need no alignment
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+template <class F> inline auto load_fp(const std::uint8_t* t, std::uint64_t i) noexcept -> F {
+  F v{};
+  std::memcpy(&v, t + (i * sizeof(F)), sizeof(F));
+  return v;
+}
+template <class F> inline void store_fp(std::uint8_t* t, std::uint64_t i, F v) noexcept {
+  std::memcpy(t + (i * sizeof(F)), &v, sizeof(F));
+}
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+struct shape {
+  std::uint64_t segment_length{};
+  std::uint64_t segment_count_length{};
+  std::uint64_t cells{};
+};
+
+// Segment length and count for n keys, per the reference construction: arity 3 needs about 1.125 n cells
+// for large n, more for small sets, and segments shrink with n so that peeling still succeeds
+inline auto shape_for(std::uint64_t n) -> shape {
+  std::uint64_t seg_len = 4;
+  if (n > 1U) {
+    seg_len = std::uint64_t{1}
+              << static_cast<unsigned>(std::floor((std::log(static_cast<double>(n)) / std::log(3.33)) + 2.25));
+  }
+  seg_len = std::min(seg_len, kMaxSegmentLength);
+  std::uint64_t capacity = 0;
+  if (n > 1U) {
+    const double factor =
+        std::max(1.125, 0.875 + (0.25 * std::log(1000000.0) / std::log(static_cast<double>(n))));
+    capacity = static_cast<std::uint64_t>(std::llround(static_cast<double>(n) * factor));
+  }
+  const std::uint64_t segments = (capacity + seg_len - 1U) / seg_len;
+  const std::uint64_t seg_count = segments > kArity - 1U ? segments - (kArity - 1U) : 1U;
+  return shape{.segment_length = seg_len,
+               .segment_count_length = seg_count * seg_len,
+               .cells = (seg_count + kArity - 1U) * seg_len};
+}
+
+// Scratch of one partition build, reused across the partitions a thread builds
+struct scratch {
+  std::vector<std::uint64_t> order; // remixed hashes bucketed by segment, then in peeling order
+  std::vector<std::uint8_t> found;  // per peeled key: which of its three cells it was peeled from
+  std::vector<std::uint8_t> count;  // per cell: (keys << 2) | xor of the cell slots (0, 1, 2) those keys use
+  std::vector<std::uint64_t> xors;  // per cell: xor of its keys
+  std::vector<std::uint64_t> queue; // cells holding one key
+  std::vector<std::uint64_t> start;
+};
+
+// Peels keys (distinct hash64 values) into the cells of one partition and writes its fingerprints.
+// Returns false only after kMaxAttempts seeds.
+template <class F>
+auto build_partition(std::span<const std::uint64_t> keys, const shape& s, std::uint64_t seed_state, scratch& w,
+                     std::uint8_t* table, std::uint64_t& seed_out, std::uint64_t& distinct) -> bool {
+  const std::size_t n = keys.size();
+  if (n == 0U) {
+    seed_out = splitmix(seed_state);
+    distinct = 0;
+    return true;
+  }
+  const auto cells = static_cast<std::size_t>(s.cells);
+  w.order.assign(n + 1U, 0U);
+  w.found.assign(n, 0U);
+  w.count.assign(cells, 0U);
+  w.xors.assign(cells, 0U);
+  w.queue.resize(cells);
+  unsigned block_bits = 1;
+  while ((std::uint64_t{1} << block_bits) < s.segment_count_length / s.segment_length) {
+    ++block_bits;
+  }
+  const std::size_t blocks = std::size_t{1} << block_bits;
+  w.start.resize(blocks);
+
+  for (unsigned attempt = 0; attempt < kMaxAttempts; ++attempt) {
+    const std::uint64_t seed = splitmix(seed_state);
+    // Bucket the remixed hashes by their first segment, so the counting pass walks memory in order
+    w.order[n] = 1U; // sentinel: a taken slot that ends the last bucket
+    for (std::size_t b = 0; b < blocks; ++b) {
+      w.start[b] = (static_cast<std::uint64_t>(b) * n) >> block_bits;
+    }
+    bool zero_hash = false;
+    for (std::size_t i = 0; i < n; ++i) {
+      const std::uint64_t k = mix(keys[i] + seed);
+      zero_hash = zero_hash || k == 0U; // 0 marks a free bucket slot
+      auto b = static_cast<std::size_t>(k >> (64U - block_bits));
+      while (w.order[w.start[b]] != 0U) {
+        b = (b + 1U) & (blocks - 1U);
+      }
+      w.order[w.start[b]++] = k;
+    }
+
+    bool overflow = zero_hash;
+    for (std::size_t i = 0; i < n; ++i) {
+      const std::uint64_t k = w.order[i];
+      const cells3 c = cells_of(k, s.segment_length, s.segment_count_length);
+      for (std::uint8_t j = 0; j < kArity; ++j) {
+        w.count[c.at[j]] = static_cast<std::uint8_t>((w.count[c.at[j]] + 4U) ^ j);
+        w.xors[c.at[j]] ^= k;
+      }
+      for (std::uint8_t j = 0; j < kArity; ++j) {
+        overflow = overflow || w.count[c.at[j]] < 4U; // more than 63 keys wrapped a cell's count
+      }
+    }
+
+    std::size_t peeled = 0;
+    if (!overflow) {
+      std::size_t q = 0;
+      for (std::size_t i = 0; i < cells; ++i) {
+        w.queue[q] = i;
+        q += (w.count[i] >> 2U) == 1U ? 1U : 0U;
+      }
+      while (q > 0U) {
+        const auto cell = static_cast<std::size_t>(w.queue[--q]);
+        if ((w.count[cell] >> 2U) != 1U) {
+          continue;
+        }
+        const std::uint64_t k = w.xors[cell];
+        const auto slot = static_cast<std::uint8_t>(w.count[cell] & 3U);
+        w.found[peeled] = slot;
+        w.order[peeled] = k;
+        ++peeled;
+        const cells3 c = cells_of(k, s.segment_length, s.segment_count_length);
+        for (std::uint8_t j = 1; j < kArity; ++j) {
+          const std::uint64_t other = c.at[slot + j];
+          w.queue[q] = other;
+          q += (w.count[other] >> 2U) == 2U ? 1U : 0U;
+          const auto other_slot = static_cast<std::uint8_t>((slot + j) % kArity);
+          w.count[other] = static_cast<std::uint8_t>((w.count[other] - 4U) ^ other_slot);
+          w.xors[other] ^= k;
+        }
+      }
+    }
+    if (!overflow && peeled == n) {
+      seed_out = seed;
+      distinct = n;
+      break;
+    }
+    if (attempt + 1U == kMaxAttempts) {
+      return false;
+    }
+    std::fill(w.order.begin(), w.order.end(), 0U);
+    std::fill(w.count.begin(), w.count.end(), 0U);
+    std::fill(w.xors.begin(), w.xors.end(), 0U);
+  }
+
+  // Assign in reverse peeling order: each key's cell is the only one of its three not yet final
+  for (std::size_t i = n; i-- > 0U;) {
+    const std::uint64_t k = w.order[i];
+    const cells3 c = cells_of(k, s.segment_length, s.segment_count_length);
+    const std::uint8_t slot = w.found[i];
+    const F v = fingerprint_of<F>(k) ^ load_fp<F>(table, c.at[slot + 1U]) ^ load_fp<F>(table, c.at[slot + 2U]);
+    store_fp<F>(table, c.at[slot], v);
+  }
+  return true;
+}
+
+// A query key's remixed hash, cells and partition table
+struct located {
+  std::uint64_t k{};
+  cells3 cells;
+  const std::uint8_t* table{nullptr};
+  bool empty{false};
+};
+
+template <class F> inline auto matches(const located& l) noexcept -> bool {
+  const F v = fingerprint_of<F>(l.k) ^ load_fp<F>(l.table, l.cells.at[0]) ^ load_fp<F>(l.table, l.cells.at[1]) ^
+              load_fp<F>(l.table, l.cells.at[2]);
+  return v == 0U;
+}
+} // namespace
+
+auto filter::build(std::span<const std::string_view> keys, const Config& c, HashConfig h) -> result<filter> {
+  std::vector<std::uint64_t> hashes(keys.size());
+  for (std::size_t off = 0; off < keys.size(); off += kHashChunk) {
+    const std::size_t len = std::min(kHashChunk, keys.size() - off);
+    hashing::hash64_batch(keys.subspan(off, len), h, std::span(hashes).subspan(off, len));
+  }
+  return build_hashed(hashes, c, h);
+}
+
+auto filter::build_hashed(std::span<const std::uint64_t> hashes, const Config& c, HashConfig h) -> result<filter> {
+  if (c.fingerprint != Fingerprint::f8 && c.fingerprint != Fingerprint::f16) {
+    return result<filter>::from_error(make_error(errc::invalid_argument, "fingerprint must be 8 or 16 bits"));
+  }
+  if (c.partitions == 0U) {
+    return result<filter>::from_error(make_error(errc::invalid_argument, "partitions must be > 0"));
+  }
+  // Split the keys by partition (counting sort), drop repeated keys, then size every partition from its
+  // distinct key count
+  filter f;
+  f.hash_cfg_ = h;
+  f.fingerprint_ = c.fingerprint;
+  f.parts_.resize(c.partitions);
+  std::vector<std::vector<std::uint64_t>> split(c.partitions);
+  if (c.partitions == 1U) {
+    split[0].assign(hashes.begin(), hashes.end());
+  } else {
+    std::vector<std::size_t> counts(c.partitions, 0U);
+    for (const std::uint64_t x : hashes) {
+      ++counts[f.partition_of_hash(x)];
+    }
+    for (std::size_t p = 0; p < c.partitions; ++p) {
+      split[p].reserve(counts[p]);
+    }
+    for (const std::uint64_t x : hashes) {
+      split[f.partition_of_hash(x)].push_back(x);
+    }
+  }
+  // Partitions p, p + threads, ... on thread p; a partition's keys, scratch and table range are its own
+  const std::size_t threads = std::clamp<std::size_t>(c.build_threads, 1U, c.partitions);
+  const auto for_each_partition = [&](const auto& fn) -> void {
+    const auto run = [&](std::size_t first) -> void {
+      scratch w;
+      for (std::size_t p = first; p < c.partitions; p += threads) {
+        fn(p, w);
+      }
+    };
+    probkit::detail::run_shares(threads, run);
+  };
+  for_each_partition([&](std::size_t p, scratch&) -> void {
+    std::sort(split[p].begin(), split[p].end());
+    split[p].erase(std::unique(split[p].begin(), split[p].end()), split[p].end());
+  });
+
+  const std::size_t width = c.fingerprint == Fingerprint::f16 ? 2U : 1U;
+  std::vector<shape> shapes(c.partitions);
+  std::uint64_t total_cells = 0;
+  for (std::size_t p = 0; p < c.partitions; ++p) {
+    shapes[p] = shape_for(split[p].size());
+    f.parts_[p].segment_length = shapes[p].segment_length;
+    f.parts_[p].segment_count_length = shapes[p].segment_count_length;
+    f.parts_[p].offset = total_cells;
+    f.parts_[p].cells = shapes[p].cells;
+    total_cells += shapes[p].cells;
+  }
+  auto table = probkit::detail::make_table<std::uint8_t>(static_cast<std::size_t>(total_cells) * width, {});
+  if (!table) {
+    return result<filter>::from_error(table.error());
+  }
+  f.table_ = std::move(table.value());
+
+  // Every partition seeds its own generator, so the filter does not depend on the thread count
+  std::vector<char> ok(c.partitions, 0);
+  for_each_partition([&](std::size_t p, scratch& w) -> void {
+    partition& part = f.parts_[p];
+    std::uint8_t* base = f.table_.data() + (part.offset * width); // NOLINT(*-pointer-arithmetic)
+    std::uint64_t seed_state = h.seed ^ (0x726B2B9D438B9D4DULL + p);
+    const bool built =
+        width == 2U ? build_partition<std::uint16_t>(split[p], shapes[p], seed_state, w, base, part.seed, part.keys)
+                    : build_partition<std::uint8_t>(split[p], shapes[p], seed_state, w, base, part.seed, part.keys);
+    ok[p] = built ? 1 : 0;
+    std::vector<std::uint64_t>().swap(split[p]);
+  });
+  if (std::find(ok.begin(), ok.end(), 0) != ok.end()) {
+    return result<filter>::from_error(make_error(errc::internal_error, "fuse filter construction did not converge"));
+  }
+  for (const partition& part : f.parts_) {
+    f.keys_ += part.keys;
+  }
+  return f;
+}
+
+auto filter::contains_hash(std::uint64_t h) const noexcept -> bool {
+  if (parts_.empty()) {
+    return false;
+  }
+  const partition& p = parts_[partition_of_hash(h)];
+  if (p.keys == 0U) {
+    return false; // an empty partition's zero fingerprints would match one key in 2^bits
+  }
+  const std::uint64_t k = mix(h + p.seed);
+  const std::size_t width = fingerprint_ == Fingerprint::f16 ? 2U : 1U;
+  const located l{.k = k,
+                  .cells = cells_of(k, p.segment_length, p.segment_count_length),
+                  .table = table_.data() + (p.offset * width)}; // NOLINT(*-pointer-arithmetic)
+  return width == 2U ? matches<std::uint16_t>(l) : matches<std::uint8_t>(l);
+}
+
+auto filter::might_contain_batch(std::span<const std::string_view> xs, std::span<bool> out) const noexcept
+    -> result<void> {
+  if (out.size() < xs.size()) {
+    return result<void>::from_error(make_error(errc::invalid_argument, "output span shorter than keys"));
+  }
+  const std::size_t width = fingerprint_ == Fingerprint::f16 ? 2U : 1U;
+  std::array<std::uint64_t, kHashChunk> hs{};
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    hashing::hash64_batch(chunk, hash_cfg_, hs);
+    if (parts_.empty()) {
+      std::fill_n(out.begin() + static_cast<std::ptrdiff_t>(off), chunk.size(), false);
+      continue;
+    }
+    // Locate and touch the cells of a group of keys before testing any of them, so their misses overlap
+    for (std::size_t g = 0; g < chunk.size(); g += kPrefetchGroup) {
+      const std::size_t end = std::min(chunk.size(), g + kPrefetchGroup);
+      std::array<located, kPrefetchGroup> at{};
+      for (std::size_t i = g; i < end; ++i) {
+        const partition& p = parts_[partition_of_hash(hs[i])];
+        located& l = at[i - g];
+        l.k = mix(hs[i] + p.seed);
+        l.cells = cells_of(l.k, p.segment_length, p.segment_count_length);
+        l.table = table_.data() + (p.offset * width); // NOLINT(*-pointer-arithmetic)
+        l.empty = p.keys == 0U;
+        for (std::size_t j = 0; j < kArity; ++j) {
+          __builtin_prefetch(l.table + (l.cells.at[j] * width)); // NOLINT(*-pointer-arithmetic)
+        }
+      }
+      for (std::size_t i = g; i < end; ++i) {
+        const located& l = at[i - g];
+        out[off + i] = !l.empty && (width == 2U ? matches<std::uint16_t>(l) : matches<std::uint8_t>(l));
+      }
+    }
+  }
+  return {};
+}
+
+namespace {
+using serialize::detail::header_fields;
+using serialize::detail::SketchKind;
+
+// Image params: [fingerprint bits, partitions, keys, cells]; the extra section holds kPartFields u64s per
+// partition: seed, segment_length, segment_count_length, offset, cells, keys
+enum : std::size_t { kParamFingerprint, kParamPartitions, kParamKeys, kParamCells };
+constexpr std::size_t kPartFields = 6;
+
+inline auto image_header(const filter& f) -> header_fields {
+  header_fields hdr{};
+  hdr.kind = SketchKind::fuse;
+  hdr.hash = f.hash_config();
+  hdr.params[kParamFingerprint] = static_cast<std::uint64_t>(f.fingerprint());
+  hdr.params[kParamPartitions] = f.partitions();
+  hdr.params[kParamKeys] = f.size();
+  hdr.params[kParamCells] = f.byte_size() / (static_cast<std::size_t>(f.fingerprint()) / 8U);
+  return hdr;
+}
+} // namespace
+
+auto filter::image_extra() const -> std::vector<std::byte> {
+  std::vector<std::byte> extra;
+  extra.reserve(parts_.size() * kPartFields * 8U);
+  for (const partition& p : parts_) {
+    for (const std::uint64_t v : {p.seed, p.segment_length, p.segment_count_length, p.offset, p.cells, p.keys}) {
+      serialize::detail::put_u64(extra, v);
+    }
+  }
+  return extra;
+}
+
+auto filter::save(const std::string& path) const -> result<void> {
+  return serialize::detail::save_image(path, image_header(*this), std::as_bytes(std::span(table_)), image_extra());
+}
+
+auto filter::to_bytes() const -> std::vector<std::byte> {
+  return serialize::detail::image_bytes(image_header(*this), std::as_bytes(std::span(table_)), image_extra());
+}
+
+auto filter::load(const std::string& path, serialize::LoadOptions opt) -> result<filter> {
+  auto img = serialize::detail::load_image(path, opt, SketchKind::fuse);
+  if (!img) {
+    return result<filter>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto filter::from_bytes(std::span<const std::byte> bytes) -> result<filter> {
+  auto img = serialize::detail::parse_image(bytes, SketchKind::fuse);
+  if (!img) {
+    return result<filter>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto filter::from_image(serialize::detail::image&& img) -> result<filter> {
+  const auto& prm = img.hdr.params;
+  const auto invalid = []() -> result<filter> {
+    return result<filter>::from_error(make_error(errc::parse_error, "invalid fuse image"));
+  };
+  const std::uint64_t bits = prm[kParamFingerprint];
+  const std::uint64_t parts = prm[kParamPartitions];
+  const std::uint64_t width = bits / 8U;
+  if ((bits != 8U && bits != 16U) || parts == 0U || img.extra.size() / kPartFields / 8U != parts ||
+      img.extra.size() % (kPartFields * 8U) != 0U || img.hdr.payload_bytes / width != prm[kParamCells] ||
+      img.hdr.payload_bytes % width != 0U) {
+    return invalid();
+  }
+  // Partitions must tile the table in order, each with the cell count its segments imply
+  std::vector<partition> ps(static_cast<std::size_t>(parts));
+  std::span<const std::byte> in = img.extra;
+  std::uint64_t next = 0;
+  std::uint64_t keys = 0;
+  for (partition& p : ps) {
+    (void)serialize::detail::get_u64(in, p.seed);
+    (void)serialize::detail::get_u64(in, p.segment_length);
+    (void)serialize::detail::get_u64(in, p.segment_count_length);
+    (void)serialize::detail::get_u64(in, p.offset);
+    (void)serialize::detail::get_u64(in, p.cells);
+    (void)serialize::detail::get_u64(in, p.keys);
+    const bool ok = p.segment_length >= 4U && p.segment_length <= kMaxSegmentLength &&
+                    std::has_single_bit(p.segment_length) && p.segment_count_length >= p.segment_length &&
+                    p.segment_count_length % p.segment_length == 0U &&
+                    p.cells == p.segment_count_length + (2U * p.segment_length) && p.offset == next &&
+                    p.cells <= prm[kParamCells] - next;
+    if (!ok) {
+      return invalid();
+    }
+    next += p.cells;
+    keys += p.keys;
+  }
+  if (next != prm[kParamCells] || keys != prm[kParamKeys]) {
+    return invalid();
+  }
+  auto table = probkit::detail::buffer<std::uint8_t>::adopt(
+      std::move(img.owner), reinterpret_cast<std::uint8_t*>(img.payload), // NOLINT(*-reinterpret-cast)
+      static_cast<std::size_t>(img.hdr.payload_bytes), img.writable);
+  return filter{std::move(table), std::move(ps), static_cast<Fingerprint>(bits), keys, img.hdr.hash};
+}
+
+} // namespace probkit::fuse
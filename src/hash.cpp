@@ -1,15 +1,32 @@
 #include "probkit/hash.hpp"
 #include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define PROBKIT_HASH_X86_AES 1
+#include <immintrin.h>
+#else
+#define PROBKIT_HASH_X86_AES 0
+#endif
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO))
+#define PROBKIT_HASH_ARM_AES 1
+#include <arm_neon.h>
+#else
+#define PROBKIT_HASH_ARM_AES 0
+#endif
+
 namespace probkit::hashing {
 
 namespace {
 inline auto splitmix64(std::uint64_t value) noexcept -> std::uint64_t;
 inline auto wyhash_impl(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t;
 inline auto xxhash64_impl(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t;
+inline auto xxh3_impl(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t;
+auto aes_impl(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t;
+void aes_batch(std::span<const std::string_view> keys, std::uint64_t seed, std::span<std::uint64_t> out) noexcept;
 } // namespace
 
 // ------------------------------------------------------------------
@@ -28,10 +45,45 @@ auto hash64(std::string_view input, const HashConfig& cfg) noexcept -> std::uint
     return wyhash_impl(input, seed);
   case HashKind::xxhash:
     return xxhash64_impl(input, seed);
+  case HashKind::xxh3:
+    return xxh3_impl(input, seed);
+  case HashKind::aes:
+    return aes_impl(input, seed);
   }
   return wyhash_impl(input, seed);
 }
 
+void hash64_batch(std::span<const std::string_view> keys, const HashConfig& cfg,
+                  std::span<std::uint64_t> out) noexcept {
+  const std::size_t n = std::min(keys.size(), out.size());
+  const std::uint64_t seed = cfg.seed ^ cfg.thread_salt;
+  // Dispatch once per batch; the per-kind loops carry no branches besides the hash itself
+  switch (cfg.kind) {
+  case HashKind::wyhash:
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = wyhash_impl(keys[i], seed);
+    }
+    return;
+  case HashKind::xxhash:
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = xxhash64_impl(keys[i], seed);
+    }
+    return;
+  case HashKind::xxh3:
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = xxh3_impl(keys[i], seed);
+    }
+    return;
+  case HashKind::aes:
+    aes_batch(keys.first(n), seed, out);
+    return;
+  }
+  // Out-of-range kinds hash as wyhash, as in hash64()
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = wyhash_impl(keys[i], seed);
+  }
+}
+
 // ------------------------------------------------------------------
 // Implementation details
 // ------------------------------------------------------------------
@@ -70,33 +122,23 @@ inline auto splitmix64(std::uint64_t value) noexcept -> std::uint64_t {
   return value;
 }
 
+// Word loads via memcpy compile to single unaligned loads. Callers guarantee off + width <= s.size();
+// big-endian hosts byte-swap so the hash value does not depend on the platform.
 inline auto load_u64_le(std::string_view s, std::size_t off) noexcept -> std::uint64_t {
   std::uint64_t v = 0;
-  const std::size_t n = s.size();
-  std::size_t rem = 0;
-  if (off < n) {
-    rem = n - off;
-  }
-  std::size_t lim = rem;
-  lim = std::min<std::size_t>(lim, 8);
-  for (std::size_t i = 0; i < lim; ++i) {
-    v |= (std::uint64_t)(unsigned char)s[off + i] << (8 * i);
-  }
+  std::memcpy(&v, s.data() + off, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap64(v);
+#endif
   return v;
 }
 
 inline auto load_u32_le(std::string_view s, std::size_t off) noexcept -> std::uint32_t {
   std::uint32_t v = 0;
-  const std::size_t n = s.size();
-  std::size_t rem = 0;
-  if (off < n) {
-    rem = n - off;
-  }
-  std::size_t lim = rem;
-  lim = std::min<std::size_t>(lim, 4);
-  for (std::size_t i = 0; i < lim; ++i) {
-    v |= (std::uint32_t)(unsigned char)s[off + i] << (8 * i);
-  }
+  std::memcpy(&v, s.data() + off, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap32(v);
+#endif
   return v;
 }
 
@@ -207,6 +249,487 @@ inline auto xxhash64_impl(std::string_view s, std::uint64_t seed) noexcept -> st
   h ^= h >> 32;
   return h;
 }
+
+// ------------------------------------------------------------------
+// XXH3-64
+// ------------------------------------------------------------------
+// Same values as XXH3_64bits_withSeed from xxHash 0.8. Keys up to 240 bytes take a fixed number of
+// independent 64x64->128 multiplies against the secret; longer keys run the striped accumulator, with
+// SSE2 on x86-64.
+
+constexpr std::size_t kXxh3SecretSize = 192;
+constexpr std::size_t kXxh3Stripe = 64;
+constexpr std::size_t kXxh3StripesPerBlock = (kXxh3SecretSize - kXxh3Stripe) / 8U;
+constexpr std::size_t kXxh3LastStripeSecret = kXxh3SecretSize - kXxh3Stripe - 7U;
+constexpr std::size_t kXxh3MergeSecret = 11;
+
+using xxh3_secret_bytes = std::array<std::uint8_t, kXxh3SecretSize>;
+constexpr xxh3_secret_bytes kXxh3Secret{
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d,
+    0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0,
+    0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21, 0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0,
+    0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b,
+    0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac,
+    0xd8, 0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51,
+    0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83, 0x34,
+    0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb, 0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49,
+    0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8,
+    0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b,
+    0x40, 0x7e,
+};
+
+// The XXH64 primes (kXxPrime*) serve XXH3 too
+constexpr std::uint64_t kXxh3Prime32_1 = 0x9E3779B1ULL;
+constexpr std::uint64_t kXxh3Prime32_2 = 0x85EBCA77ULL;
+constexpr std::uint64_t kXxh3Prime32_3 = 0xC2B2AE3DULL;
+constexpr std::uint64_t kXxh3Mx1 = 0x165667919E3779F9ULL;
+constexpr std::uint64_t kXxh3Mx2 = 0x9FB21C651E98DF25ULL;
+
+// Secrets are read through the same word loads as keys
+inline auto secret_view(const xxh3_secret_bytes& secret) noexcept -> std::string_view {
+  return {reinterpret_cast<const char*>(secret.data()), secret.size()}; // NOLINT(*-pro-type-reinterpret-cast)
+}
+
+inline void store_u64_le(xxh3_secret_bytes& dst, std::size_t off, std::uint64_t v) noexcept {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap64(v);
+#endif
+  std::memcpy(dst.data() + off, &v, sizeof(v)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+inline auto xxh64_avalanche(std::uint64_t h) noexcept -> std::uint64_t {
+  h ^= h >> 33U;
+  h *= kXxPrime2;
+  h ^= h >> 29U;
+  h *= kXxPrime3;
+  return h ^ (h >> 32U);
+}
+
+inline auto xxh3_avalanche(std::uint64_t h) noexcept -> std::uint64_t {
+  h ^= h >> 37U;
+  h *= kXxh3Mx1;
+  return h ^ (h >> 32U);
+}
+
+inline auto xxh3_rrmxmx(std::uint64_t h, std::uint64_t len) noexcept -> std::uint64_t {
+  h ^= rotl_const<49U>(h) ^ rotl_const<24U>(h);
+  h *= kXxh3Mx2;
+  h ^= (h >> 35U) + len;
+  h *= kXxh3Mx2;
+  return h ^ (h >> 28U);
+}
+
+// wymum is XXH3's 128-bit multiply-fold as well
+inline auto xxh3_mix16(std::string_view s, std::size_t off, std::string_view secret, std::size_t soff,
+                       std::uint64_t seed) noexcept -> std::uint64_t {
+  return wymum(load_u64_le(s, off) ^ (load_u64_le(secret, soff) + seed),
+               load_u64_le(s, off + 8U) ^ (load_u64_le(secret, soff + 8U) - seed));
+}
+
+inline auto xxh3_0to16(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t {
+  const std::string_view k = secret_view(kXxh3Secret);
+  const std::size_t n = s.size();
+  if (n > 8U) {
+    const std::uint64_t lo = load_u64_le(s, 0) ^ ((load_u64_le(k, 24) ^ load_u64_le(k, 32)) + seed);
+    const std::uint64_t hi = load_u64_le(s, n - 8U) ^ ((load_u64_le(k, 40) ^ load_u64_le(k, 48)) - seed);
+    return xxh3_avalanche(n + __builtin_bswap64(lo) + hi + wymum(lo, hi));
+  }
+  if (n >= 4U) {
+    seed ^= static_cast<std::uint64_t>(__builtin_bswap32(static_cast<std::uint32_t>(seed))) << 32U;
+    const std::uint64_t in = load_u32_le(s, n - 4U) + (static_cast<std::uint64_t>(load_u32_le(s, 0)) << 32U);
+    return xxh3_rrmxmx(in ^ ((load_u64_le(k, 8) ^ load_u64_le(k, 16)) - seed), n);
+  }
+  if (n > 0U) {
+    const auto c1 = static_cast<std::uint32_t>(static_cast<unsigned char>(s[0]));
+    const auto c2 = static_cast<std::uint32_t>(static_cast<unsigned char>(s[n >> 1U]));
+    const auto c3 = static_cast<std::uint32_t>(static_cast<unsigned char>(s[n - 1U]));
+    const std::uint32_t combined = (c1 << 16U) | (c2 << 24U) | c3 | (static_cast<std::uint32_t>(n) << 8U);
+    return xxh64_avalanche(combined ^ ((load_u32_le(k, 0) ^ load_u32_le(k, 4)) + seed));
+  }
+  return xxh64_avalanche(seed ^ load_u64_le(k, 56) ^ load_u64_le(k, 64));
+}
+
+inline auto xxh3_17to128(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t {
+  const std::string_view k = secret_view(kXxh3Secret);
+  const std::size_t n = s.size();
+  std::uint64_t acc = n * kXxPrime1;
+  if (n > 32U) {
+    if (n > 64U) {
+      if (n > 96U) {
+        acc += xxh3_mix16(s, 48, k, 96, seed);
+        acc += xxh3_mix16(s, n - 64U, k, 112, seed);
+      }
+      acc += xxh3_mix16(s, 32, k, 64, seed);
+      acc += xxh3_mix16(s, n - 48U, k, 80, seed);
+    }
+    acc += xxh3_mix16(s, 16, k, 32, seed);
+    acc += xxh3_mix16(s, n - 32U, k, 48, seed);
+  }
+  acc += xxh3_mix16(s, 0, k, 0, seed);
+  acc += xxh3_mix16(s, n - 16U, k, 16, seed);
+  return xxh3_avalanche(acc);
+}
+
+inline auto xxh3_129to240(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t {
+  const std::string_view k = secret_view(kXxh3Secret);
+  const std::size_t n = s.size();
+  std::uint64_t acc = n * kXxPrime1;
+  for (std::size_t i = 0; i < 8U; ++i) {
+    acc += xxh3_mix16(s, 16U * i, k, 16U * i, seed);
+  }
+  std::uint64_t acc_end = xxh3_mix16(s, n - 16U, k, 136U - 17U, seed);
+  acc = xxh3_avalanche(acc);
+  for (std::size_t i = 8; i < n / 16U; ++i) {
+    acc_end += xxh3_mix16(s, 16U * i, k, (16U * (i - 8U)) + 3U, seed);
+  }
+  return xxh3_avalanche(acc + acc_end);
+}
+
+using xxh3_acc = std::array<std::uint64_t, 8>;
+
+#if defined(__SSE2__)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+// Two of the eight accumulators: acc += swap64(data) + lo32(data ^ key) * hi32(data ^ key)
+inline auto xxh3_lane(__m128i acc, const char* in, const char* key) noexcept -> __m128i {
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  const __m128i dk = _mm_xor_si128(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(key)));
+  const __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, 0x31));
+  return _mm_add_epi64(_mm_add_epi64(acc, _mm_shuffle_epi32(v, 0x4E)), product);
+}
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+#endif
+
+// Folds stripes [off, off + 64 * stripes) of s into acc; stripe i is keyed by the secret from soff + 8 * i
+inline void xxh3_accumulate(xxh3_acc& acc, std::string_view s, std::size_t off, std::string_view secret,
+                            std::size_t soff, std::size_t stripes) noexcept {
+#if defined(__SSE2__)
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+  auto* lanes = reinterpret_cast<__m128i*>(acc.data());
+  __m128i a0 = _mm_loadu_si128(lanes);
+  __m128i a1 = _mm_loadu_si128(lanes + 1);
+  __m128i a2 = _mm_loadu_si128(lanes + 2);
+  __m128i a3 = _mm_loadu_si128(lanes + 3);
+  for (std::size_t st = 0; st < stripes; ++st) {
+    const char* in = s.data() + off + (kXxh3Stripe * st);
+    const char* key = secret.data() + soff + (8U * st);
+    a0 = xxh3_lane(a0, in, key);
+    a1 = xxh3_lane(a1, in + 16, key + 16);
+    a2 = xxh3_lane(a2, in + 32, key + 32);
+    a3 = xxh3_lane(a3, in + 48, key + 48);
+  }
+  _mm_storeu_si128(lanes, a0);
+  _mm_storeu_si128(lanes + 1, a1);
+  _mm_storeu_si128(lanes + 2, a2);
+  _mm_storeu_si128(lanes + 3, a3);
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+#else
+  for (std::size_t st = 0; st < stripes; ++st) {
+    const std::size_t in = off + (kXxh3Stripe * st);
+    const std::size_t key = soff + (8U * st);
+    for (std::size_t i = 0; i < acc.size(); ++i) {
+      const std::uint64_t v = load_u64_le(s, in + (8U * i));
+      const std::uint64_t dk = v ^ load_u64_le(secret, key + (8U * i));
+      acc[i ^ 1U] += v;
+      acc[i] += (dk & 0xFFFFFFFFULL) * (dk >> 32U);
+    }
+  }
+#endif
+}
+
+inline void xxh3_scramble(xxh3_acc& acc, std::string_view secret, std::size_t soff) noexcept {
+  for (std::size_t i = 0; i < acc.size(); ++i) {
+    std::uint64_t a = acc[i];
+    a ^= a >> 47U;
+    a ^= load_u64_le(secret, soff + (8U * i));
+    acc[i] = a * kXxh3Prime32_1;
+  }
+}
+
+inline auto xxh3_long(std::string_view s, std::string_view secret) noexcept -> std::uint64_t {
+  constexpr std::size_t kBlock = kXxh3Stripe * kXxh3StripesPerBlock;
+  xxh3_acc acc{kXxh3Prime32_3, kXxPrime1, kXxPrime2, kXxPrime3, kXxPrime4, kXxh3Prime32_2, kXxPrime5, kXxh3Prime32_1};
+  const std::size_t n = s.size();
+  const std::size_t blocks = (n - 1U) / kBlock;
+  for (std::size_t b = 0; b < blocks; ++b) {
+    xxh3_accumulate(acc, s, b * kBlock, secret, 0, kXxh3StripesPerBlock);
+    xxh3_scramble(acc, secret, kXxh3SecretSize - kXxh3Stripe);
+  }
+  const std::size_t tail = blocks * kBlock;
+  xxh3_accumulate(acc, s, tail, secret, 0, (n - 1U - tail) / kXxh3Stripe);
+  xxh3_accumulate(acc, s, n - kXxh3Stripe, secret, kXxh3LastStripeSecret, 1);
+
+  std::uint64_t h = n * kXxPrime1;
+  for (std::size_t i = 0; i < 4U; ++i) {
+    const std::size_t soff = kXxh3MergeSecret + (16U * i);
+    h += wymum(acc[2U * i] ^ load_u64_le(secret, soff), acc[(2U * i) + 1U] ^ load_u64_le(secret, soff + 8U));
+  }
+  return xxh3_avalanche(h);
+}
+
+inline auto xxh3_impl(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t {
+  const std::size_t n = s.size();
+  if (n <= 16U) {
+    return xxh3_0to16(s, seed);
+  }
+  if (n <= 128U) {
+    return xxh3_17to128(s, seed);
+  }
+  if (n <= 240U) {
+    return xxh3_129to240(s, seed);
+  }
+  const std::string_view k = secret_view(kXxh3Secret);
+  if (seed == 0U) {
+    return xxh3_long(s, k);
+  }
+  // Long keys are hashed against a secret derived from the seed, as xxHash does
+  xxh3_secret_bytes derived{};
+  for (std::size_t off = 0; off < kXxh3SecretSize; off += 16U) {
+    store_u64_le(derived, off, load_u64_le(k, off) + seed);
+    store_u64_le(derived, off + 8U, load_u64_le(k, off + 8U) - seed);
+  }
+  return xxh3_long(s, secret_view(derived));
+}
+
+// ------------------------------------------------------------------
+// AES-round hash
+// ------------------------------------------------------------------
+// A keyed hash built from single AES rounds (aesenc: ShiftRows, SubBytes, MixColumns, xor key; two
+// rounds diffuse every input bit over the 128-bit block). Keys are absorbed 32 bytes per step by two
+// independent lanes, and the lanes are merged through three more rounds. Not a MAC. The value is that
+// of the portable round below, so images written on a CPU with AES instructions read the same where the
+// software round stands in for them (several times slower; pick another kind on such CPUs).
+
+constexpr std::array<std::uint64_t, 8> kAesKeys{0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL,
+                                               0x082EFA98EC4E6C89ULL, 0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL,
+                                               0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL};
+
+constexpr auto gf_xtime(std::uint8_t b) noexcept -> std::uint8_t {
+  return static_cast<std::uint8_t>((static_cast<unsigned>(b) << 1U) ^ ((b & 0x80U) != 0U ? 0x1BU : 0x00U));
+}
+
+constexpr auto gf_mul(std::uint8_t a, std::uint8_t b) noexcept -> std::uint8_t {
+  std::uint8_t r = 0;
+  for (; b != 0U; b = static_cast<std::uint8_t>(b >> 1U)) {
+    if ((b & 1U) != 0U) {
+      r ^= a;
+    }
+    a = gf_xtime(a);
+  }
+  return r;
+}
+
+constexpr auto rotl8(std::uint8_t v, unsigned r) noexcept -> std::uint8_t {
+  return static_cast<std::uint8_t>((static_cast<unsigned>(v) << r) | (static_cast<unsigned>(v) >> (8U - r)));
+}
+
+// S-box: multiplicative inverse in GF(2^8) (x^254; 0 stays 0) followed by the affine map
+constexpr auto make_aes_sbox() noexcept -> std::array<std::uint8_t, 256> {
+  std::array<std::uint8_t, 256> box{};
+  for (unsigned x = 0; x < box.size(); ++x) {
+    std::uint8_t inv = 1;
+    std::uint8_t base = static_cast<std::uint8_t>(x);
+    for (unsigned e = 254U; e != 0U; e >>= 1U) {
+      if ((e & 1U) != 0U) {
+        inv = gf_mul(inv, base);
+      }
+      base = gf_mul(base, base);
+    }
+    box[x] = static_cast<std::uint8_t>(inv ^ rotl8(inv, 1) ^ rotl8(inv, 2) ^ rotl8(inv, 3) ^ rotl8(inv, 4) ^ 0x63U);
+  }
+  return box;
+}
+constexpr std::array<std::uint8_t, 256> kAesSbox = make_aes_sbox();
+static_assert(kAesSbox[0x00] == 0x63U && kAesSbox[0x01] == 0x7CU && kAesSbox[0x53] == 0xEDU);
+
+// 128-bit block as two little-endian words: byte i of the block is byte i % 8 of lo (i < 8) or hi
+struct aes_words {
+  std::uint64_t lo;
+  std::uint64_t hi;
+};
+
+inline auto aes_round_soft(aes_words x, aes_words key) noexcept -> aes_words {
+  std::array<std::uint8_t, 16> in{};
+  for (unsigned i = 0; i < 8U; ++i) {
+    in[i] = static_cast<std::uint8_t>(x.lo >> (8U * i));
+    in[i + 8U] = static_cast<std::uint8_t>(x.hi >> (8U * i));
+  }
+  // ShiftRows and SubBytes; byte r + 4c is row r of column c
+  std::array<std::uint8_t, 16> t{};
+  for (unsigned c = 0; c < 4U; ++c) {
+    for (unsigned r = 0; r < 4U; ++r) {
+      t[r + (4U * c)] = kAesSbox[in[r + (4U * ((c + r) & 3U))]];
+    }
+  }
+  std::array<std::uint64_t, 2> words{};
+  for (unsigned c = 0; c < 4U; ++c) {
+    const std::uint8_t a0 = t[4U * c];
+    const std::uint8_t a1 = t[(4U * c) + 1U];
+    const std::uint8_t a2 = t[(4U * c) + 2U];
+    const std::uint8_t a3 = t[(4U * c) + 3U];
+    const auto m0 = static_cast<std::uint32_t>(gf_xtime(a0) ^ gf_xtime(a1) ^ a1 ^ a2 ^ a3);
+    const auto m1 = static_cast<std::uint32_t>(a0 ^ gf_xtime(a1) ^ gf_xtime(a2) ^ a2 ^ a3);
+    const auto m2 = static_cast<std::uint32_t>(a0 ^ a1 ^ gf_xtime(a2) ^ gf_xtime(a3) ^ a3);
+    const auto m3 = static_cast<std::uint32_t>(gf_xtime(a0) ^ a0 ^ a1 ^ a2 ^ gf_xtime(a3));
+    const std::uint32_t column = m0 | (m1 << 8U) | (m2 << 16U) | (m3 << 24U);
+    words[c / 2U] |= static_cast<std::uint64_t>(column) << (32U * (c % 2U));
+  }
+  return {words[0] ^ key.lo, words[1] ^ key.hi};
+}
+
+// Block operations the hash is written against, one set per instruction set
+struct aes_soft {
+  using block = aes_words;
+  static auto make(std::uint64_t lo, std::uint64_t hi) noexcept -> block {
+    return {lo, hi};
+  }
+  static auto load(std::string_view s, std::size_t off) noexcept -> block {
+    return {load_u64_le(s, off), load_u64_le(s, off + 8U)};
+  }
+  static auto mix(block a, block b) noexcept -> block {
+    return {a.lo ^ b.lo, a.hi ^ b.hi};
+  }
+  static auto round(block x, block key) noexcept -> block {
+    return aes_round_soft(x, key);
+  }
+  static auto fold(block x) noexcept -> std::uint64_t {
+    return x.lo ^ x.hi;
+  }
+};
+
+#if PROBKIT_HASH_X86_AES
+// Compiled per function and picked at runtime, like the bloom/hll AVX2 kernels. The aes_hash template
+// carries the target too so that these inline into it; the aes_soft instance uses no AES instruction.
+#define PROBKIT_HASH_AES_TARGET __attribute__((target("aes")))
+struct aes_x86 {
+  using block = __m128i;
+  PROBKIT_HASH_AES_TARGET static auto make(std::uint64_t lo, std::uint64_t hi) noexcept -> block {
+    return _mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo));
+  }
+  PROBKIT_HASH_AES_TARGET static auto load(std::string_view s, std::size_t off) noexcept -> block {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + off));
+  }
+  PROBKIT_HASH_AES_TARGET static auto mix(block a, block b) noexcept -> block {
+    return _mm_xor_si128(a, b);
+  }
+  PROBKIT_HASH_AES_TARGET static auto round(block x, block key) noexcept -> block {
+    return _mm_aesenc_si128(x, key);
+  }
+  PROBKIT_HASH_AES_TARGET static auto fold(block x) noexcept -> std::uint64_t {
+    return static_cast<std::uint64_t>(_mm_cvtsi128_si64(x)) ^
+           static_cast<std::uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(x, x)));
+  }
+};
+#else
+#define PROBKIT_HASH_AES_TARGET
+#endif
+
+#if PROBKIT_HASH_ARM_AES
+// ARMv8 crypto extension, chosen at compile time (-march=armv8-a+crypto or later)
+struct aes_arm {
+  using block = uint8x16_t;
+  static auto make(std::uint64_t lo, std::uint64_t hi) noexcept -> block {
+    return vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(lo), vcreate_u64(hi)));
+  }
+  static auto load(std::string_view s, std::size_t off) noexcept -> block {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return vld1q_u8(reinterpret_cast<const std::uint8_t*>(s.data() + off));
+  }
+  static auto mix(block a, block b) noexcept -> block {
+    return veorq_u8(a, b);
+  }
+  // AESE xors its key in before SubBytes; with a zero key and the xor after MixColumns it matches aesenc
+  static auto round(block x, block key) noexcept -> block {
+    return veorq_u8(vaesmcq_u8(vaeseq_u8(x, vdupq_n_u8(0))), key);
+  }
+  static auto fold(block x) noexcept -> std::uint64_t {
+    const uint64x2_t w = vreinterpretq_u64_u8(x);
+    return vgetq_lane_u64(w, 0) ^ vgetq_lane_u64(w, 1);
+  }
+};
+#endif
+
+template <class Ops> PROBKIT_HASH_AES_TARGET inline auto aes_hash(std::string_view s, std::uint64_t seed) noexcept
+    -> std::uint64_t {
+  using block = typename Ops::block;
+  const std::size_t n = s.size();
+  const block k0 = Ops::make(kAesKeys[0], kAesKeys[1]);
+  const block k1 = Ops::make(kAesKeys[2], kAesKeys[3]);
+  const block k2 = Ops::make(kAesKeys[4], kAesKeys[5]);
+  block a = Ops::make(seed ^ kAesKeys[6], n ^ kAesKeys[7]);
+  block b = Ops::make(n ^ kAesKeys[0], seed ^ kAesKeys[3]);
+  if (n <= 16U) {
+    // Short keys as two possibly overlapping words; the length in the state tells overlaps apart
+    std::uint64_t lo = 0;
+    std::uint64_t hi = 0;
+    if (n >= 8U) {
+      lo = load_u64_le(s, 0);
+      hi = load_u64_le(s, n - 8U);
+    } else if (n >= 4U) {
+      lo = load_u32_le(s, 0) | (static_cast<std::uint64_t>(load_u32_le(s, n - 4U)) << 32U);
+    } else if (n > 0U) {
+      lo = static_cast<std::uint64_t>(static_cast<unsigned char>(s[0])) |
+           (static_cast<std::uint64_t>(static_cast<unsigned char>(s[n >> 1U])) << 8U) |
+           (static_cast<std::uint64_t>(static_cast<unsigned char>(s[n - 1U])) << 16U);
+    }
+    a = Ops::round(Ops::mix(a, Ops::make(lo, hi)), k1);
+  } else {
+    for (std::size_t i = 0; i + 32U < n; i += 32U) {
+      a = Ops::round(Ops::mix(a, Ops::load(s, i)), k1);
+      b = Ops::round(Ops::mix(b, Ops::load(s, i + 16U)), k2);
+    }
+    // The last 32 bytes (overlapping what came before, or the whole key up to 32 bytes)
+    a = Ops::round(Ops::mix(a, Ops::load(s, n >= 32U ? n - 32U : 0U)), k1);
+    b = Ops::round(Ops::mix(b, Ops::load(s, n - 16U)), k2);
+  }
+  block h = Ops::mix(Ops::round(a, k2), b);
+  h = Ops::round(h, k0);
+  h = Ops::round(h, k1);
+  return Ops::fold(h);
+}
+
+#if PROBKIT_HASH_X86_AES
+PROBKIT_HASH_AES_TARGET auto aes_hash_x86(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t {
+  return aes_hash<aes_x86>(s, seed);
+}
+
+PROBKIT_HASH_AES_TARGET void aes_batch_x86(std::span<const std::string_view> keys, std::uint64_t seed,
+                                           std::span<std::uint64_t> out) noexcept {
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    out[i] = aes_hash<aes_x86>(keys[i], seed);
+  }
+}
+
+auto cpu_has_aes() noexcept -> bool {
+  static const bool has_aes = __builtin_cpu_supports("aes") != 0;
+  return has_aes;
+}
+#endif
+
+auto aes_impl(std::string_view s, std::uint64_t seed) noexcept -> std::uint64_t {
+#if PROBKIT_HASH_ARM_AES
+  return aes_hash<aes_arm>(s, seed);
+#else
+#if PROBKIT_HASH_X86_AES
+  if (cpu_has_aes()) {
+    return aes_hash_x86(s, seed);
+  }
+#endif
+  return aes_hash<aes_soft>(s, seed);
+#endif
+}
+
+void aes_batch(std::span<const std::string_view> keys, std::uint64_t seed, std::span<std::uint64_t> out) noexcept {
+#if PROBKIT_HASH_X86_AES
+  if (cpu_has_aes()) {
+    aes_batch_x86(keys, seed, out);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    out[i] = aes_impl(keys[i], seed);
+  }
+}
 } // namespace
 
 } // namespace probkit::hashing
@@ -1,17 +1,166 @@
 #include "probkit/hll.hpp"
+#include "format.hpp"
 #include "probkit/error.hpp"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define PROBKIT_HLL_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define PROBKIT_HLL_X86_SIMD 0
+#endif
 
 using probkit::errc;
 using probkit::make_error;
 using probkit::result;
 using probkit::hashing::hash64;
+using probkit::hashing::hash64_batch;
 using probkit::hashing::HashConfig;
 
 namespace probkit::hll {
 
 namespace {
+constexpr std::size_t kHashChunk = 256; // keys hashed per hash64_batch call
+constexpr unsigned kRankBits = 6;       // packed register width; also the rank field of a sparse entry
+constexpr std::uint32_t kRankMask = (1U << kRankBits) - 1U;
+
+// 6 bits per register plus one pad byte so the 16-bit window read in get_reg never runs past the end
+inline auto packed_bytes(std::size_t m) noexcept -> std::size_t {
+  return (((m * kRankBits) + 7U) / 8U) + 1U;
+}
+
+inline auto dense_bytes(Encoding enc, std::size_t m) noexcept -> std::size_t {
+  return enc == Encoding::packed ? packed_bytes(m) : m;
+}
+
+inline auto sparse_index(std::uint32_t e) noexcept -> std::uint32_t {
+  return e >> kRankBits;
+}
+
+// New sparse entries collect unsorted in a buffer of this share of the sparse limit, so the sorted
+// list takes them in one merge per buffer (as in HLL++) instead of one insertion each
+constexpr std::size_t kSparseBufferShare = 8;
+
+// Sort entries by index, keeping one per index: sorting the raw entries orders equal indices by
+// rank, so the last of each run carries the largest
+inline void sort_unique(std::vector<std::uint32_t>& v) {
+  std::sort(v.begin(), v.end());
+  std::size_t n = 0;
+  for (const std::uint32_t e : v) {
+    if (n != 0U && sparse_index(v[n - 1U]) == sparse_index(e)) {
+      v[n - 1U] = e;
+    } else {
+      v[n++] = e;
+    }
+  }
+  v.resize(n);
+}
+
+// Sorted union of two sorted sparse lists; on equal index the larger entry carries the larger rank
+inline void union_sorted(std::span<const std::uint32_t> a, std::span<const std::uint32_t> b,
+                         std::vector<std::uint32_t>& out) {
+  out.clear();
+  out.reserve(a.size() + b.size());
+  std::size_t i = 0;
+  std::size_t j = 0;
+  while (i < a.size() || j < b.size()) {
+    if (j == b.size() || (i < a.size() && sparse_index(a[i]) < sparse_index(b[j]))) {
+      out.push_back(a[i++]);
+    } else if (i == a.size() || sparse_index(b[j]) < sparse_index(a[i])) {
+      out.push_back(b[j++]);
+    } else {
+      out.push_back(std::max(a[i++], b[j++]));
+    }
+  }
+}
+
+// 2^-v for every possible register value; replaces a std::ldexp call per register
+constexpr auto make_inv_pow2() -> std::array<double, 64> {
+  std::array<double, 64> t{};
+  double v = 1.0;
+  for (double& x : t) {
+    x = v;
+    v *= 0.5;
+  }
+  return t;
+}
+constexpr std::array<double, 64> kInvPow2 = make_inv_pow2();
+
+// Byte-wise register max: dst[i] = max(dst[i], src[i])
+inline void max_merge_scalar(std::uint8_t* dst, const std::uint8_t* src, std::size_t n) noexcept {
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = std::max(dst[i], src[i]);
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+#if PROBKIT_HLL_X86_SIMD
+// SSE2 is part of the x86-64 baseline; AVX2 is compiled per function and selected at runtime
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+inline void max_merge_sse2(std::uint8_t* dst, const std::uint8_t* src, std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 16U <= n; i += 16U) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_max_epu8(a, b));
+  }
+  max_merge_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) void max_merge_avx2(std::uint8_t* dst, const std::uint8_t* src,
+                                                    std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 32U <= n; i += 32U) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_max_epu8(a, b));
+  }
+  max_merge_scalar(dst + i, src + i, n - i);
+}
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+#endif
+
+inline void max_merge(std::uint8_t* dst, const std::uint8_t* src, std::size_t n) noexcept {
+#if PROBKIT_HLL_X86_SIMD
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+  if (has_avx2) {
+    max_merge_avx2(dst, src, n);
+    return;
+  }
+  max_merge_sse2(dst, src, n);
+#else
+  max_merge_scalar(dst, src, n);
+#endif
+}
+
+// Rank histogram of byte registers. Four interleaved banks break the store-to-load dependency
+// between neighbouring equal values; registers are < 64, so 8 bytes are consumed per word load.
+inline void histogram_bytes(std::span<const std::uint8_t> regs, std::span<std::uint32_t, 64> hist) noexcept {
+  std::array<std::array<std::uint32_t, 64>, 4> banks{};
+  std::size_t i = 0;
+  for (; i + 8U <= regs.size(); i += 8U) {
+    std::uint64_t w = 0;
+    std::memcpy(&w, regs.data() + i, sizeof(w));
+    for (unsigned b = 0; b < 8U; b += 4U) {
+      ++banks[0][(w >> (8U * b)) & 63U];
+      ++banks[1][(w >> (8U * (b + 1U))) & 63U];
+      ++banks[2][(w >> (8U * (b + 2U))) & 63U];
+      ++banks[3][(w >> (8U * (b + 3U))) & 63U];
+    }
+  }
+  for (; i < regs.size(); ++i) {
+    ++banks[0][regs[i] & 63U];
+  }
+  for (std::size_t v = 0; v < 64U; ++v) {
+    hist[v] = banks[0][v] + banks[1][v] + banks[2][v] + banks[3][v];
+  }
+}
+
 // Empirical alpha_m constant per classical HLL
 inline auto alpha(std::size_t m) noexcept -> double {
   switch (m) {
@@ -46,6 +195,29 @@ inline auto leading_zeroes_64(std::uint64_t v) noexcept -> int {
 #endif
 }
 
+// Bias-corrected HLL estimate from the register histogram hist[0..63] of m registers
+inline auto estimate_from_histogram(const std::array<std::uint32_t, 64>& hist, std::size_t m) noexcept -> double {
+  // Sum from the highest rank down so the small terms are accumulated first
+  double sum = 0.0;
+  for (std::size_t v = hist.size(); v-- > 0U;) {
+    sum += static_cast<double>(hist[v]) * kInvPow2[v];
+  }
+  const std::size_t zeros = hist[0];
+  const double inv_sum = 1.0 / sum;
+  const double am = alpha(m);
+  double E = am * static_cast<double>(m) * static_cast<double>(m) * inv_sum;
+
+  // Small range correction (linear counting) per original HLL
+  if (E <= 2.5 * static_cast<double>(m) && zeros > 0) {
+    E = static_cast<double>(m) * std::log(static_cast<double>(m) / static_cast<double>(zeros));
+  } else if (E > (1.0 / 30.0) * 4294967296.0) { // 2^32 / 30
+    // Large-range correction (compat: many HLL impls base this on 2^32)
+    const double two32 = 4294967296.0;
+    E = -two32 * std::log(1.0 - (E / two32));
+  }
+  return E;
+}
+
 inline auto rho_from_hash(std::uint64_t h, std::uint8_t p) noexcept -> std::uint8_t {
   // OR with bit (p-1): if the shifted tail is all-zero, CLZ becomes (64-p),
   // yielding rank = (64 - p) + 1 = max_rho. For non-zero tails it doesn't affect CLZ.
@@ -56,59 +228,495 @@ inline auto rho_from_hash(std::uint64_t h, std::uint8_t p) noexcept -> std::uint
 }
 } // namespace
 
-auto sketch::make_by_precision(std::uint8_t p, HashConfig h) -> result<sketch> {
+auto sketch::make(const Config& c, HashConfig h) -> result<sketch> {
+  const std::uint8_t p = c.precision;
   if (p < 4U || p > 20U) { // guard reasonable bounds
     return result<sketch>::from_error(make_error(errc::invalid_argument, "precision out of range"));
   }
   const std::size_t m = 1ULL << p;
-  std::vector<std::uint8_t> regs(m, 0U);
-  sketch s{p, h, std::move(regs)};
+  probkit::detail::buffer<std::uint8_t> regs;
+  if (!c.sparse) {
+    regs.assign(dense_bytes(c.encoding, m), 0U);
+  }
+  std::vector<std::uint32_t> hist;
+  if (c.track_estimate) {
+    hist.assign(kRanks, 0U);
+    hist[0] = static_cast<std::uint32_t>(m);
+  }
+  sketch s{p, h, c.encoding, c.sparse, std::move(regs), std::move(hist)};
   return s;
 }
 
+auto sketch::make_by_precision(std::uint8_t p, HashConfig h) -> result<sketch> {
+  return make(Config{.precision = p}, h);
+}
+
+auto sketch::dense_byte_size(const Config& c) noexcept -> std::size_t {
+  return dense_bytes(c.encoding, std::size_t{1} << c.precision);
+}
+
 auto sketch::add(std::string_view x) noexcept -> result<void> {
-  const std::uint64_t h = hash64(x, hash_cfg_);
+  if (!registers_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  add_hash(hash64(x, hash_cfg_));
+  return {};
+}
+
+auto sketch::add_batch(std::span<const std::string_view> xs) noexcept -> result<void> {
+  if (!registers_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  std::array<std::uint64_t, kHashChunk> hs{};
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    hash64_batch(chunk, hash_cfg_, hs);
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+      add_hash(hs[i]);
+    }
+  }
+  return {};
+}
+
+auto sketch::add_hashed(std::uint64_t h) noexcept -> result<void> {
+  if (!registers_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  add_hash(h);
+  return {};
+}
+
+auto sketch::add_hashed_batch(std::span<const std::uint64_t> hs) noexcept -> result<void> {
+  if (!registers_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  for (const std::uint64_t h : hs) {
+    add_hash(h);
+  }
+  return {};
+}
+
+void sketch::add_hash(std::uint64_t h) noexcept {
   const auto mval = static_cast<std::size_t>(1ULL << p_);
   const std::size_t idx = static_cast<std::size_t>(h >> (64U - p_)) & (mval - 1U);
   const std::uint8_t r = rho_from_hash(h, p_);
-  std::uint8_t& cell = registers_[idx];
-  cell = std::max(r, cell);
-  return {};
+  if (!sparse_ && encoding_ == Encoding::dense && rank_hist_.empty()) {
+    std::uint8_t& cell = registers_[idx];
+    cell = std::max(r, cell);
+    return;
+  }
+  if (sparse_) {
+    add_sparse(static_cast<std::uint32_t>(idx), r);
+    return;
+  }
+  raise_reg(idx, r);
 }
 
-auto sketch::estimate() const noexcept -> result<double> {
-  const auto m = static_cast<std::size_t>(1ULL << p_);
-  double sum = 0.0;
-  std::size_t zeros = 0;
-  for (std::uint8_t v : registers_) {
-    if (v == 0U) {
-      ++zeros;
+template <std::uint8_t P> void sketch::add_dense_batch(std::span<const std::string_view> xs) noexcept {
+  constexpr unsigned kIndexShift = 64U - P;
+  std::array<std::uint64_t, kHashChunk> hs{};
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    hash64_batch(chunk, hash_cfg_, hs);
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+      std::uint8_t& cell = registers_[static_cast<std::size_t>(hs[i] >> kIndexShift)];
+      cell = std::max(rho_from_hash(hs[i], P), cell);
     }
-    sum += std::ldexp(1.0, -static_cast<int>(v)); // 2^{-v}
   }
-  const double inv_sum = 1.0 / sum;
-  const double am = alpha(m);
-  double E = am * static_cast<double>(m) * static_cast<double>(m) * inv_sum;
+}
 
-  // Small range correction (linear counting) per original HLL
-  if (E <= 2.5 * static_cast<double>(m) && zeros > 0) {
-    E = static_cast<double>(m) * std::log(static_cast<double>(m) / static_cast<double>(zeros));
-  } else if (E > (1.0 / 30.0) * 4294967296.0) { // 2^32 / 30
-    // Large-range correction (compat: many HLL impls base this on 2^32)
-    const double two32 = 4294967296.0;
-    E = -two32 * std::log(1.0 - (E / two32));
+void sketch::add_sparse(std::uint32_t idx, std::uint8_t r) noexcept {
+  sparse_buf_.push_back((idx << kRankBits) | r);
+  if (sparse_buf_.size() >= sparse_buffer_limit()) {
+    flush_sparse();
+  }
+}
+
+void sketch::flush_sparse() noexcept {
+  if (sparse_buf_.empty()) {
+    return;
+  }
+  sort_unique(sparse_buf_);
+  std::vector<std::uint32_t> merged;
+  union_sorted(sparse_list_, sparse_buf_, merged);
+  sparse_list_.swap(merged);
+  sparse_buf_.clear();
+  if (sparse_full(sparse_list_.size())) {
+    to_dense();
+    return;
+  }
+  rebuild_histogram();
+}
+
+auto sketch::sparse_entries(std::vector<std::uint32_t>& scratch) const -> std::span<const std::uint32_t> {
+  if (sparse_buf_.empty()) {
+    return sparse_list_;
+  }
+  std::vector<std::uint32_t> pending(sparse_buf_);
+  sort_unique(pending);
+  union_sorted(sparse_list_, pending, scratch);
+  return scratch;
+}
+
+auto sketch::sparse_limit() const noexcept -> std::size_t {
+  return dense_bytes(encoding_, m()) / sizeof(std::uint32_t);
+}
+
+auto sketch::sparse_buffer_limit() const noexcept -> std::size_t {
+  return std::max<std::size_t>(sparse_limit() / kSparseBufferShare, 1U);
+}
+
+void sketch::to_dense() noexcept {
+  registers_.assign(dense_bytes(encoding_, m()), 0U);
+  sparse_ = false;
+  for (const std::uint32_t e : sparse_list_) {
+    put_reg(sparse_index(e), static_cast<std::uint8_t>(e & kRankMask));
+  }
+  for (const std::uint32_t e : sparse_buf_) {
+    const auto r = static_cast<std::uint8_t>(e & kRankMask);
+    if (r > get_reg(sparse_index(e))) {
+      put_reg(sparse_index(e), r);
+    }
+  }
+  std::vector<std::uint32_t>{}.swap(sparse_list_);
+  std::vector<std::uint32_t>{}.swap(sparse_buf_);
+  rebuild_histogram();
+}
+
+auto sketch::get_reg(std::size_t i) const noexcept -> std::uint8_t {
+  if (encoding_ == Encoding::dense) {
+    return registers_[i];
+  }
+  const std::size_t bit = i * kRankBits;
+  const std::size_t byte = bit >> 3U;
+  const auto window = static_cast<unsigned>(registers_[byte]) | (static_cast<unsigned>(registers_[byte + 1U]) << 8U);
+  return static_cast<std::uint8_t>((window >> (bit & 7U)) & kRankMask);
+}
+
+void sketch::put_reg(std::size_t i, std::uint8_t v) noexcept {
+  if (encoding_ == Encoding::dense) {
+    registers_[i] = v;
+    return;
+  }
+  const std::size_t bit = i * kRankBits;
+  const std::size_t byte = bit >> 3U;
+  const unsigned shift = static_cast<unsigned>(bit & 7U);
+  unsigned window = static_cast<unsigned>(registers_[byte]) | (static_cast<unsigned>(registers_[byte + 1U]) << 8U);
+  window = (window & ~(kRankMask << shift)) | (static_cast<unsigned>(v) << shift);
+  registers_[byte] = static_cast<std::uint8_t>(window & 0xFFU);
+  registers_[byte + 1U] = static_cast<std::uint8_t>(window >> 8U);
+}
+
+void sketch::raise_reg(std::size_t i, std::uint8_t r) noexcept {
+  const std::uint8_t old = get_reg(i);
+  if (r > old) {
+    put_reg(i, r);
+    note_rise(old, r);
+  }
+}
+
+void sketch::fill_histogram(std::span<std::uint32_t, kRanks> hist) const noexcept {
+  const std::size_t m_regs = m();
+  if (sparse_) {
+    std::vector<std::uint32_t> scratch;
+    const auto entries = sparse_entries(scratch);
+    std::fill(hist.begin(), hist.end(), 0U);
+    hist[0] = static_cast<std::uint32_t>(m_regs - entries.size()); // absent registers are zero
+    for (const std::uint32_t e : entries) {
+      ++hist[e & kRankMask];
+    }
+    return;
+  }
+  if (encoding_ == Encoding::dense) {
+    histogram_bytes(registers_, hist);
+    return;
+  }
+  std::fill(hist.begin(), hist.end(), 0U);
+  for (std::size_t i = 0; i < m_regs; ++i) {
+    ++hist[get_reg(i)];
+  }
+}
+
+void sketch::rebuild_histogram() noexcept {
+  if (!rank_hist_.empty()) {
+    fill_histogram(std::span<std::uint32_t, kRanks>(rank_hist_.data(), kRanks));
   }
-  return E;
+}
+
+auto sketch::estimate() const noexcept -> result<double> {
+  std::array<std::uint32_t, kRanks> hist{};
+  // The tracked histogram lags entries still pending in the sparse buffer
+  if (rank_hist_.empty() || !sparse_buf_.empty()) {
+    fill_histogram(hist);
+  } else {
+    std::copy(rank_hist_.begin(), rank_hist_.end(), hist.begin());
+  }
+  return estimate_from_histogram(hist, m());
 }
 
 auto sketch::merge(const sketch& other) noexcept -> result<void> {
   if (!same_params(other)) {
     return result<void>::from_error(make_error(errc::invalid_argument, "incompatible hll merge"));
   }
-  for (std::size_t i = 0; i < registers_.size(); ++i) {
-    registers_[i] = std::max(other.registers_[i], registers_[i]);
+  if (!registers_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  flush_sparse();
+  if (other.sparse_) {
+    std::vector<std::uint32_t> scratch;
+    const auto theirs = other.sparse_entries(scratch);
+    if (!sparse_) {
+      for (const std::uint32_t e : theirs) {
+        raise_reg(sparse_index(e), static_cast<std::uint8_t>(e & kRankMask));
+      }
+      return {};
+    }
+    std::vector<std::uint32_t> merged;
+    union_sorted(sparse_list_, theirs, merged);
+    sparse_list_ = std::move(merged);
+    if (sparse_full(sparse_list_.size())) {
+      to_dense();
+      return {};
+    }
+    rebuild_histogram();
+    return {};
+  }
+  if (sparse_) {
+    to_dense();
+  }
+  if (encoding_ == Encoding::dense && other.encoding_ == Encoding::dense) {
+    max_merge(registers_.data(), other.registers_.data(), registers_.size());
+  } else {
+    const std::size_t m_regs = m();
+    for (std::size_t i = 0; i < m_regs; ++i) {
+      const std::uint8_t v = other.get_reg(i);
+      if (v > get_reg(i)) {
+        put_reg(i, v);
+      }
+    }
+  }
+  rebuild_histogram();
+  return {};
+}
+
+auto concurrent_sketch::make(const Config& c, HashConfig h) -> result<concurrent_sketch> {
+  auto base = sketch::make(Config{.precision = c.precision}, h); // dense, untracked
+  if (!base) {
+    return result<concurrent_sketch>::from_error(base.error());
+  }
+  concurrent_sketch s{std::move(base.value())};
+  return s;
+}
+
+auto concurrent_sketch::add(std::string_view x) noexcept -> result<void> {
+  add_hash(hash64(x, base_.hash_cfg_));
+  return {};
+}
+
+auto concurrent_sketch::add_batch(std::span<const std::string_view> xs) noexcept -> result<void> {
+  std::array<std::uint64_t, kHashChunk> hs{};
+  for (std::size_t off = 0; off < xs.size(); off += kHashChunk) {
+    const auto chunk = xs.subspan(off, std::min(kHashChunk, xs.size() - off));
+    hash64_batch(chunk, base_.hash_cfg_, hs);
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+      add_hash(hs[i]);
+    }
+  }
+  return {};
+}
+
+void concurrent_sketch::add_hash(std::uint64_t h) noexcept {
+  const std::uint8_t p = base_.p_;
+  const std::size_t idx = static_cast<std::size_t>(h >> (64U - p)) & (base_.m() - 1U);
+  const std::uint8_t r = rho_from_hash(h, p);
+  const std::atomic_ref<std::uint8_t> cell(base_.registers_[idx]);
+  std::uint8_t cur = cell.load(std::memory_order_relaxed);
+  while (r > cur && !cell.compare_exchange_weak(cur, r, std::memory_order_relaxed)) {
+  }
+}
+
+auto concurrent_sketch::load_reg(std::size_t i) const noexcept -> std::uint8_t {
+  // atomic_ref needs a mutable referent; the load itself does not write
+  auto& cell = const_cast<std::uint8_t&>(base_.registers_[i]); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  return std::atomic_ref<std::uint8_t>(cell).load(std::memory_order_relaxed);
+}
+
+auto concurrent_sketch::estimate() const noexcept -> result<double> {
+  std::array<std::uint32_t, sketch::kRanks> hist{};
+  const std::size_t m_regs = base_.m();
+  for (std::size_t i = 0; i < m_regs; ++i) {
+    ++hist[load_reg(i) & kRankMask];
+  }
+  return estimate_from_histogram(hist, m_regs);
+}
+
+auto concurrent_sketch::snapshot() const -> result<sketch> {
+  auto copy = sketch::make(Config{.precision = base_.p_}, base_.hash_cfg_);
+  if (!copy) {
+    return copy;
+  }
+  sketch& out = copy.value();
+  for (std::size_t i = 0; i < out.registers_.size(); ++i) {
+    out.registers_[i] = load_reg(i);
+  }
+  return copy;
+}
+
+namespace {
+using serialize::detail::header_fields;
+using serialize::detail::SketchKind;
+
+// Image params: [p, encoding, sparse, track_estimate]; the payload is the sparse list or the registers
+enum : std::size_t { kParamPrecision, kParamEncoding, kParamSparse, kParamTrack };
+
+inline auto image_header(const sketch& s) -> header_fields {
+  header_fields hdr{};
+  hdr.kind = SketchKind::hll;
+  hdr.hash = s.hash_config();
+  hdr.params[kParamPrecision] = s.precision();
+  hdr.params[kParamEncoding] = static_cast<std::uint64_t>(s.encoding());
+  hdr.params[kParamSparse] = s.is_sparse() ? 1U : 0U;
+  hdr.params[kParamTrack] = s.tracks_estimate() ? 1U : 0U;
+  return hdr;
+}
+} // namespace
+
+auto sketch::payload_bytes(std::vector<std::uint32_t>& scratch) const -> std::span<const std::byte> {
+  if (sparse_) {
+    return std::as_bytes(sparse_entries(scratch));
+  }
+  return std::as_bytes(std::span(registers_));
+}
+
+auto sketch::save(const std::string& path) const -> result<void> {
+  std::vector<std::uint32_t> scratch;
+  return serialize::detail::save_image(path, image_header(*this), payload_bytes(scratch), {});
+}
+
+auto sketch::to_bytes() const -> std::vector<std::byte> {
+  std::vector<std::uint32_t> scratch;
+  return serialize::detail::image_bytes(image_header(*this), payload_bytes(scratch), {});
+}
+
+auto sketch::load(const std::string& path, serialize::LoadOptions opt) -> result<sketch> {
+  auto img = serialize::detail::load_image(path, opt, SketchKind::hll);
+  if (!img) {
+    return result<sketch>::from_error(img.error());
   }
+  return from_image(std::move(img.value()));
+}
+
+auto sketch::from_bytes(std::span<const std::byte> bytes) -> result<sketch> {
+  auto img = serialize::detail::parse_image(bytes, SketchKind::hll);
+  if (!img) {
+    return result<sketch>::from_error(img.error());
+  }
+  return from_image(std::move(img.value()));
+}
+
+auto sketch::from_image(serialize::detail::image&& img) -> result<sketch> {
+  const auto& prm = img.hdr.params;
+  const auto bad = [] { return result<sketch>::from_error(make_error(errc::parse_error, "invalid hll image")); };
+  if (prm[kParamPrecision] < 4U || prm[kParamPrecision] > 20U ||
+      prm[kParamEncoding] > static_cast<std::uint64_t>(Encoding::packed) || prm[kParamSparse] > 1U ||
+      prm[kParamTrack] > 1U || !img.extra.empty()) {
+    return bad();
+  }
+  const auto p = static_cast<std::uint8_t>(prm[kParamPrecision]);
+  const auto enc = static_cast<Encoding>(prm[kParamEncoding]);
+  const bool sparse = prm[kParamSparse] == 1U;
+  const std::size_t m_regs = 1ULL << p;
+  const std::size_t dense = dense_bytes(enc, m_regs);
+  const auto bytes = static_cast<std::size_t>(img.hdr.payload_bytes);
+
+  probkit::detail::buffer<std::uint8_t> regs;
+  std::vector<std::uint32_t> list;
+  if (sparse) {
+    if (bytes % sizeof(std::uint32_t) != 0U || bytes / sizeof(std::uint32_t) > dense / sizeof(std::uint32_t)) {
+      return bad();
+    }
+    list.resize(bytes / sizeof(std::uint32_t));
+    std::memcpy(list.data(), img.payload, bytes);
+    for (std::size_t i = 0; i < list.size(); ++i) {
+      const bool sorted = i == 0U || sparse_index(list[i - 1U]) < sparse_index(list[i]);
+      if (!sorted || sparse_index(list[i]) >= m_regs || (list[i] & kRankMask) > 64U - p + 1U) {
+        return bad();
+      }
+    }
+  } else {
+    if (bytes != dense) {
+      return bad();
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): byte payload, no alignment needed
+    auto* data = reinterpret_cast<std::uint8_t*>(img.payload);
+    regs = probkit::detail::buffer<std::uint8_t>::adopt(std::move(img.owner), data, dense, img.writable);
+  }
+  std::vector<std::uint32_t> hist;
+  if (prm[kParamTrack] == 1U) {
+    hist.assign(kRanks, 0U);
+  }
+  sketch s{p, img.hdr.hash, enc, sparse, std::move(regs), std::move(hist)};
+  s.sparse_list_ = std::move(list);
+  if (s.sparse_ && s.sparse_full(s.sparse_list_.size())) {
+    s.to_dense(); // leave room for a full pending buffer, as flush_sparse() does
+    return s;
+  }
+  s.rebuild_histogram();
+  return s;
+}
+
+template <std::uint8_t P> auto fixed_sketch<P>::make(HashConfig h) -> result<fixed_sketch> {
+  auto s = sketch::make(Config{.precision = P}, h);
+  if (!s) {
+    return result<fixed_sketch>::from_error(s.error());
+  }
+  return fixed_sketch{std::move(s.value())};
+}
+
+template <std::uint8_t P> auto fixed_sketch<P>::wrap(sketch&& s) -> result<fixed_sketch> {
+  if (!fits(s)) {
+    return result<fixed_sketch>::from_error(make_error(errc::invalid_argument, "sketch does not match fixed_sketch"));
+  }
+  return fixed_sketch{std::move(s)};
+}
+
+template <std::uint8_t P>
+auto fixed_sketch<P>::add_batch(sketch& s, std::span<const std::string_view> xs) noexcept -> result<void> {
+  if (!fits(s)) {
+    return result<void>::from_error(make_error(errc::invalid_argument, "sketch does not match fixed_sketch"));
+  }
+  if (!s.registers_.writable()) {
+    return result<void>::from_error(make_error(errc::not_supported, "read-only mapping"));
+  }
+  s.add_dense_batch<P>(xs);
   return {};
 }
 
+template <std::uint8_t P>
+auto fixed_sketch<P>::load(const std::string& path, serialize::LoadOptions opt) -> result<fixed_sketch> {
+  auto s = sketch::load(path, opt);
+  if (!s) {
+    return result<fixed_sketch>::from_error(s.error());
+  }
+  return wrap(std::move(s.value()));
+}
+
+template <std::uint8_t P> auto fixed_sketch<P>::from_bytes(std::span<const std::byte> bytes) -> result<fixed_sketch> {
+  auto s = sketch::from_bytes(bytes);
+  if (!s) {
+    return result<fixed_sketch>::from_error(s.error());
+  }
+  return wrap(std::move(s.value()));
+}
+
+template class fixed_sketch<10>;
+template class fixed_sketch<11>;
+template class fixed_sketch<12>;
+template class fixed_sketch<13>;
+template class fixed_sketch<14>;
+template class fixed_sketch<15>;
+template class fixed_sketch<16>;
+template class fixed_sketch<17>;
+template class fixed_sketch<18>;
+
 } // namespace probkit::hll
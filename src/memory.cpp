@@ -0,0 +1,130 @@
+#include "memory.hpp"
+#include "probkit/error.hpp"
+#include "threads.hpp"
+#include <algorithm>
+#include <cstdint>
+
+#if __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+#define PROBKIT_HAS_MMAP 1
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define PROBKIT_HAS_MMAP 0
+#endif
+
+namespace probkit::detail {
+
+#if PROBKIT_HAS_MMAP
+namespace {
+constexpr std::size_t kHugePage = std::size_t{2} << 20U; // x86-64 / arm64 default huge page
+
+auto round_up(std::size_t n, std::size_t to) noexcept -> std::size_t {
+  return (n + to - 1U) / to * to;
+}
+
+struct mapping {
+  void* addr{nullptr};
+  std::size_t len{0};
+  mapping(void* a, std::size_t l) noexcept : addr(a), len(l) {}
+  mapping(const mapping&) = delete;
+  auto operator=(const mapping&) -> mapping& = delete;
+  mapping(mapping&&) = delete;
+  auto operator=(mapping&&) -> mapping& = delete;
+  ~mapping() {
+    ::munmap(addr, len);
+  }
+};
+
+auto map_failed(const char* what) -> result<zeroed_block> {
+  const errc code = errno == ENOMEM ? errc::out_of_memory : errc::not_supported;
+  return result<zeroed_block>::from_error(make_error(code, what));
+}
+
+// Write-fault every page of [p, p + len): MADV_POPULATE_WRITE (Linux 5.14) where the kernel has it, else
+// a store per page. Split on huge page bounds across up to threads threads.
+void prefault(std::byte* p, std::size_t len, unsigned threads) {
+  const auto page = static_cast<std::size_t>(std::max(::sysconf(_SC_PAGESIZE), 4096L));
+  const auto touch = [p, page](std::size_t lo, std::size_t hi) -> void {
+    // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+#ifdef MADV_POPULATE_WRITE
+    if (::madvise(p + lo, hi - lo, MADV_POPULATE_WRITE) == 0) {
+      return;
+    }
+#endif
+    volatile std::byte* v = p;
+    for (std::size_t i = lo; i < hi; i += page) {
+      v[i] = std::byte{0};
+    }
+    // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  };
+  const std::size_t share = round_up((len + threads - 1U) / threads, kHugePage);
+  run_shares((len + share - 1U) / share,
+             [&](std::size_t i) -> void { touch(i * share, std::min(len, (i + 1U) * share)); });
+}
+} // namespace
+
+auto map_zeroed(std::size_t bytes, const AllocPolicy& a) -> result<zeroed_block> {
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  std::shared_ptr<mapping> m;
+  switch (a.backing) {
+  case Backing::lazy: {
+    void* addr = ::mmap(nullptr, bytes, prot, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+      return map_failed("anonymous mmap failed");
+    }
+    m = std::make_shared<mapping>(addr, bytes);
+    break;
+  }
+  case Backing::thp: {
+    // Over-map by one huge page and trim both ends so the table starts on a huge page boundary
+    const std::size_t len = round_up(bytes, kHugePage);
+    void* raw = ::mmap(nullptr, len + kHugePage, prot, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+      return map_failed("anonymous mmap failed");
+    }
+    const auto base = reinterpret_cast<std::uintptr_t>(raw); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    const std::uintptr_t start = round_up(base, kHugePage);
+    if (start != base) {
+      ::munmap(raw, start - base);
+    }
+    if (const std::uintptr_t tail = base + len + kHugePage - (start + len); tail != 0U) {
+      ::munmap(reinterpret_cast<void*>(start + len), tail); // NOLINT(*-reinterpret-cast, performance-no-int-to-ptr)
+    }
+    void* addr = reinterpret_cast<void*>(start); // NOLINT(*-reinterpret-cast, performance-no-int-to-ptr)
+    m = std::make_shared<mapping>(addr, len);
+#ifdef MADV_HUGEPAGE
+    (void)::madvise(addr, len, MADV_HUGEPAGE); // advisory: THP may be off (or madvise-only) system wide
+#endif
+    break;
+  }
+  case Backing::hugetlb: {
+#ifdef MAP_HUGETLB
+    const std::size_t len = round_up(bytes, kHugePage);
+    void* addr = ::mmap(nullptr, len, prot, flags | MAP_HUGETLB, -1, 0);
+    if (addr == MAP_FAILED) {
+      return map_failed("hugetlb mmap failed (see vm.nr_hugepages)");
+    }
+    m = std::make_shared<mapping>(addr, len);
+    break;
+#else
+    return result<zeroed_block>::from_error(make_error(errc::not_supported, "MAP_HUGETLB unavailable"));
+#endif
+  }
+  default:
+    return result<zeroed_block>::from_error(make_error(errc::invalid_argument, "not a mapped backing"));
+  }
+  if (a.prefault_threads > 0U) {
+    prefault(static_cast<std::byte*>(m->addr), m->len, a.prefault_threads);
+  }
+  void* data = m->addr;
+  return zeroed_block{.owner = std::move(m), .data = data};
+}
+#else
+auto map_zeroed(std::size_t /*bytes*/, const AllocPolicy& /*a*/) -> result<zeroed_block> {
+  return result<zeroed_block>::from_error(make_error(errc::not_supported, "mmap unavailable"));
+}
+#endif
+
+} // namespace probkit::detail
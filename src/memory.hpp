@@ -0,0 +1,36 @@
+#pragma once
+
+// Table allocation per probkit::AllocPolicy (see probkit/memory.hpp), shared by the sketch factories.
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "probkit/detail/buffer.hpp"
+#include "probkit/expected.hpp"
+#include "probkit/memory.hpp"
+
+namespace probkit::detail {
+
+// Zeroed, 64-byte aligned bytes kept alive by owner
+struct zeroed_block {
+  std::shared_ptr<void> owner;
+  void* data{nullptr};
+};
+
+// bytes (> 0) of anonymous mapped memory per a.backing (not Backing::heap), prefaulted when a asks for it
+[[nodiscard]] auto map_zeroed(std::size_t bytes, const AllocPolicy& a) -> result<zeroed_block>;
+
+// n zeroed elements: an owned heap buffer, or an adopted mapping for the mapped backings
+template <class T> [[nodiscard]] auto make_table(std::size_t n, const AllocPolicy& a) -> result<buffer<T>> {
+  if (a.backing == Backing::heap || n == 0U) {
+    return buffer<T>(n);
+  }
+  auto b = map_zeroed(n * sizeof(T), a);
+  if (!b) {
+    return result<buffer<T>>::from_error(b.error());
+  }
+  return buffer<T>::adopt(std::move(b.value().owner), static_cast<T*>(b.value().data), n, true);
+}
+
+} // namespace probkit::detail
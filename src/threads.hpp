@@ -0,0 +1,61 @@
+#pragma once
+
+// Fork/join over worker threads that cannot throw, for the build paths of this -fno-exceptions library.
+
+#include <cstddef>
+#include <vector>
+
+#if __has_include(<pthread.h>)
+#define PROBKIT_HAS_PTHREAD 1
+#include <pthread.h>
+#else
+#define PROBKIT_HAS_PTHREAD 0
+#endif
+
+namespace probkit::detail {
+
+// fn(i) for each i in [0, n), concurrently: share 0 runs on the calling thread and each other share on a
+// thread of its own. A share whose thread cannot start (pthread_create's EAGAIN, where std::thread would
+// throw and so terminate) runs on the calling thread after share 0 instead. Returns once every share has.
+template <class Fn> void run_shares(std::size_t n, const Fn& fn) noexcept {
+#if PROBKIT_HAS_PTHREAD
+  struct share {
+    const Fn* fn;
+    std::size_t i;
+    pthread_t tid{};
+    bool started{false};
+  };
+  std::vector<share> shares;
+  shares.reserve(n > 1U ? n - 1U : 0U); // stable addresses: each thread gets a pointer to its share
+  for (std::size_t i = 1; i < n; ++i) {
+    share& s = shares.emplace_back(share{&fn, i});
+    s.started = ::pthread_create(
+                    &s.tid, nullptr,
+                    [](void* arg) -> void* {
+                      const auto* t = static_cast<const share*>(arg);
+                      (*t->fn)(t->i);
+                      return nullptr;
+                    },
+                    &s) == 0;
+  }
+  if (n > 0U) {
+    fn(std::size_t{0});
+  }
+  for (const share& s : shares) {
+    if (!s.started) {
+      fn(s.i);
+    }
+  }
+  for (const share& s : shares) {
+    if (s.started) {
+      ::pthread_join(s.tid, nullptr);
+    }
+  }
+#else
+  for (std::size_t i = 0; i < n; ++i) {
+    fn(i);
+  }
+#endif
+}
+
+} // namespace probkit::detail
@@ -1,9 +1,17 @@
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <cstdio>
+#include <filesystem>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "probkit/bloom.hpp"
+#include "probkit/hash.hpp"
 
 using probkit::bloom::filter;
 using probkit::hashing::HashConfig;
@@ -103,11 +111,318 @@ static void test_merge_rejects_incompatible() {
   assert(!m.has_value()); // must fail
 }
 
+static void test_add_batch_no_false_negative() {
+  auto f = filter::make_by_mem(16UL * 1024UL, HashConfig{});
+  assert(f.has_value());
+  filter bf = std::move(f.value());
+  std::vector<std::string> owned;
+  for (int i = 0; i < 3000; ++i) {
+    owned.push_back(std::string("batch-") + std::to_string(i));
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  [[maybe_unused]] auto ok = bf.add_batch(keys);
+  assert(ok.has_value());
+  for (const auto& k : owned) {
+    auto q = bf.might_contain(k);
+    assert(q.has_value() && q.value());
+  }
+}
+
+static void test_blocked_no_false_negative_and_fp_target() {
+  const double target = 0.01;
+  const int n = 20000;
+  auto f = filter::make_blocked_by_fp(target, HashConfig{}, static_cast<std::size_t>(n));
+  assert(f.has_value());
+  filter bf = std::move(f.value());
+  assert(bf.layout() == probkit::bloom::Layout::blocked);
+  assert(bf.bit_size() % 512U == 0U);
+  for (int i = 0; i < n; ++i) {
+    [[maybe_unused]] auto ok = bf.add(std::string("A-") + std::to_string(i));
+  }
+  for (int i = 0; i < n; ++i) {
+    auto q = bf.might_contain(std::string("A-") + std::to_string(i));
+    assert(q.has_value() && q.value());
+  }
+  int fp = 0;
+  const int trials = 50000;
+  for (int i = 0; i < trials; ++i) {
+    auto q = bf.might_contain(std::string("B-") + std::to_string(i));
+    fp += q.value() ? 1 : 0;
+  }
+  const double rate = static_cast<double>(fp) / static_cast<double>(trials);
+  const double se = std::sqrt(target * (1.0 - target) / static_cast<double>(trials));
+  if (rate > target + (3.0 * se)) {
+    std::fprintf(stderr, "blocked FP rate %.6f above target %.6f\n", rate, target);
+  }
+  assert(rate <= target + (3.0 * se));
+}
+
+static void test_merge_rejects_layout_mismatch() {
+  auto a = filter::make_by_mem(4096, HashConfig{});
+  auto b = filter::make_blocked_by_mem(4096, HashConfig{});
+  assert(a.has_value() && b.has_value());
+  assert(a.value().bit_size() == b.value().bit_size());
+  assert(!a.value().same_params(b.value()));
+  assert(!a.value().merge(b.value()).has_value());
+}
+
+static void test_index_maps_no_false_negative() {
+  using probkit::bloom::Config;
+  using probkit::bloom::Layout;
+  using probkit::hashing::IndexMap;
+  const int n = 5000;
+  for (Layout layout : {Layout::standard, Layout::blocked}) {
+    for (IndexMap map : {IndexMap::modulo, IndexMap::pow2, IndexMap::fastrange}) {
+      auto f = filter::make(Config{.fp = 0.01, .capacity_hint = n, .layout = layout, .index_map = map}, HashConfig{});
+      assert(f.has_value());
+      filter bf = std::move(f.value());
+      assert(bf.index_map() == map);
+      if (map == IndexMap::pow2) {
+        assert(std::has_single_bit(bf.bit_size()));
+      }
+      for (int i = 0; i < n; ++i) {
+        [[maybe_unused]] auto ok = bf.add(std::string("M-") + std::to_string(i));
+      }
+      for (int i = 0; i < n; ++i) {
+        auto q = bf.might_contain(std::string("M-") + std::to_string(i));
+        assert(q.has_value() && q.value());
+      }
+    }
+  }
+  // Memory sizing with pow2 rounds down so the budget is never exceeded
+  auto m = filter::make(Config{.mem_budget_bytes = 3000, .index_map = IndexMap::pow2}, HashConfig{});
+  assert(m.has_value() && m.value().byte_size() == 2048U);
+  auto other = filter::make(Config{.mem_budget_bytes = 2048}, HashConfig{});
+  assert(other.has_value() && !m.value().same_params(other.value()));
+  assert(!m.value().merge(other.value()).has_value());
+}
+
+static void test_save_load_round_trip() {
+  using probkit::bloom::Config;
+  using probkit::bloom::Layout;
+  using probkit::serialize::LoadMode;
+  auto f = filter::make(Config{.fp = 0.01, .capacity_hint = 2000, .layout = Layout::blocked}, HashConfig{.seed = 7});
+  assert(f.has_value());
+  filter bf = std::move(f.value());
+  for (int i = 0; i < 2000; ++i) {
+    [[maybe_unused]] auto ok = bf.add(std::string("S-") + std::to_string(i));
+  }
+  [[maybe_unused]] const auto contains_all = [](const filter& g) -> bool {
+    for (int i = 0; i < 2000; ++i) {
+      auto q = g.might_contain(std::string("S-") + std::to_string(i));
+      if (!q.has_value() || !q.value()) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  auto bytes = bf.to_bytes();
+  auto back = filter::from_bytes(bytes);
+  assert(back.has_value() && back.value().same_params(bf) && contains_all(back.value()));
+  bytes[bytes.size() / 2U] ^= std::byte{0x01};
+  assert(!filter::from_bytes(bytes).has_value());
+
+  std::error_code ec;
+  const std::string path = (std::filesystem::temp_directory_path(ec) / "probkit_bloom_test.pk").string();
+  assert(bf.save(path).has_value());
+  assert(probkit::serialize::sketch_kind(path).value() == probkit::serialize::SketchKind::bloom);
+  for (LoadMode mode : {LoadMode::copy, LoadMode::map_read_only, LoadMode::map_copy_on_write}) {
+    auto g = filter::load(path, {.mode = mode});
+    assert(g.has_value() && g.value().same_params(bf) && contains_all(g.value()));
+    assert(g.value().writable() == (mode != LoadMode::map_read_only));
+    [[maybe_unused]] auto added = g.value().add("extra-key");
+    assert(added.has_value() == g.value().writable());
+  }
+  // Copy-on-write additions never reach the file
+  auto again = filter::load(path);
+  assert(again.has_value() && !again.value().might_contain("extra-key").value());
+  std::filesystem::remove(path, ec);
+}
+
+static void test_partitioned_concurrent_adds_and_round_trip() {
+  using probkit::bloom::Config;
+  using probkit::bloom::Layout;
+  using probkit::hashing::IndexMap;
+  constexpr std::size_t kParts = 4;
+  const int n = 8000;
+  for (Layout layout : {Layout::standard, Layout::blocked}) {
+    for (IndexMap map : {IndexMap::modulo, IndexMap::pow2, IndexMap::fastrange}) {
+      const Config whole{.fp = 0.01, .capacity_hint = n, .layout = layout, .index_map = map};
+      Config split = whole;
+      split.partitions = kParts;
+      auto w = filter::make(whole, HashConfig{});
+      auto f = filter::make(split, HashConfig{});
+      assert(w.has_value() && f.has_value());
+      filter bf = std::move(f.value());
+      assert(bf.partitions() == kParts && bf.bit_size() % (kParts * 512U) == 0U);
+      // Splitting keeps the total size of the unpartitioned filter, up to per-partition rounding
+      assert(bf.bit_size() >= w.value().bit_size());
+      assert(map == IndexMap::pow2 || bf.bit_size() <= w.value().bit_size() + (kParts * 512U));
+      assert(!bf.same_params(w.value()));
+
+      // One thread per partition, each adding only the keys routed to it
+      std::vector<std::thread> threads;
+      for (std::size_t p = 0; p < kParts; ++p) {
+        threads.emplace_back([&bf, p]() -> void {
+          for (int i = 0; i < n; ++i) {
+            const std::string key = "P-" + std::to_string(i);
+            if (bf.partition_of(key) == p) {
+              [[maybe_unused]] auto ok = bf.add(key);
+            }
+          }
+        });
+      }
+      for (auto& t : threads) {
+        t.join();
+      }
+      std::vector<std::size_t> per_part(kParts, 0);
+      for (int i = 0; i < n; ++i) {
+        const std::string key = "P-" + std::to_string(i);
+        ++per_part[bf.partition_of(key)];
+        auto q = bf.might_contain(key);
+        assert(q.has_value() && q.value());
+      }
+      for ([[maybe_unused]] const std::size_t c : per_part) {
+        assert(c > static_cast<std::size_t>(n) / (2U * kParts));
+      }
+      int fp = 0;
+      for (int i = 0; i < n; ++i) {
+        fp += bf.might_contain("Q-" + std::to_string(i)).value() ? 1 : 0;
+      }
+      assert(fp < n / 40); // target 1%
+
+      auto back = filter::from_bytes(bf.to_bytes());
+      assert(back.has_value() && back.value().same_params(bf));
+      for (int i = 0; i < n; ++i) {
+        assert(back.value().might_contain("P-" + std::to_string(i)).value());
+      }
+    }
+  }
+  auto tiny = filter::make(Config{.mem_budget_bytes = 256, .partitions = 8}, HashConfig{});
+  assert(!tiny.has_value());
+  auto none = filter::make(Config{.mem_budget_bytes = 4096, .partitions = 0}, HashConfig{});
+  assert(!none.has_value());
+  auto budget = filter::make(Config{.mem_budget_bytes = 4096, .partitions = 3}, HashConfig{});
+  assert(budget.has_value() && budget.value().byte_size() <= 4096U && budget.value().partitions() == 3U);
+}
+
+static void test_fixed_filter_matches_runtime() {
+  using probkit::bloom::Config;
+  using probkit::bloom::fixed_filter;
+  using probkit::bloom::Layout;
+  for (Layout layout : {Layout::standard, Layout::blocked}) {
+    // fp = 1% sizes the standard layout with k = 7
+    const Config c{.fp = 0.01, .capacity_hint = 5000, .layout = layout, .partitions = 2};
+    auto rr = filter::make(c, HashConfig{.seed = 9});
+    assert(rr.has_value());
+    filter r = std::move(rr.value());
+    const std::uint8_t k = r.k();
+    assert(layout == Layout::blocked || k == 7U);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5000; ++i) {
+      keys.push_back("K-" + std::to_string(i));
+    }
+    const std::vector<std::string_view> views(keys.begin(), keys.end());
+    assert(r.add_batch(views).has_value());
+    if (k != 7U) {
+      assert(!fixed_filter<7>::fits(r) && !fixed_filter<7>::might_contain(r, "K-1").has_value());
+      continue;
+    }
+    auto fr = fixed_filter<7>::make(c, HashConfig{.seed = 9});
+    assert(fr.has_value());
+    fixed_filter<7> f = std::move(fr.value());
+    assert(f.add_batch(std::span(views).first(2500)).has_value());
+    for (std::size_t i = 2500; i < views.size(); ++i) {
+      assert(f.add(views[i]).has_value());
+    }
+    assert(f.to_bytes() == r.to_bytes());
+    for (int i = 0; i < 5000; ++i) {
+      const std::string q = "Q-" + std::to_string(i);
+      assert(f.might_contain(q).value() == r.might_contain(q).value());
+      assert(fixed_filter<7>::might_contain(r, views[static_cast<std::size_t>(i)]).value());
+    }
+    assert(f.merge(r).has_value() && r.merge(f.base()).has_value() && f.to_bytes() == r.to_bytes());
+    auto back = fixed_filter<7>::from_bytes(r.to_bytes());
+    assert(back.has_value() && std::move(back.value()).release().same_params(r));
+  }
+  // Sizing that picks another k does not fit K = 7
+  assert(!fixed_filter<7>::make(Config{.fp = 0.001}, HashConfig{}).has_value());
+  assert(fixed_filter<10>::make(Config{.fp = 0.001}, HashConfig{}).has_value());
+}
+
+static void test_derived_probe_hash_matches_hashed_calls() {
+  using probkit::bloom::Config;
+  using probkit::bloom::Layout;
+  using probkit::bloom::ProbeHash;
+  const HashConfig h{.seed = 9};
+  for (const Layout layout : {Layout::standard, Layout::blocked}) {
+    const Config cfg{
+        .fp = 0.01, .capacity_hint = 3000, .layout = layout, .partitions = 3, .probe_hash = ProbeHash::derived};
+    auto a = filter::make(cfg, h);
+    auto b = filter::make(cfg, h);
+    assert(a.has_value() && b.has_value() && a.value().probe_hash() == ProbeHash::derived);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; ++i) {
+      keys.push_back("D-" + std::to_string(i));
+    }
+    const std::vector<std::string_view> views(keys.begin(), keys.end());
+    assert(a.value().add_batch(views).has_value());
+    for (const auto& k : keys) {
+      [[maybe_unused]] const std::uint64_t hk = probkit::hashing::hash64(k, h);
+      assert(b.value().partition_of_hashed(hk) == b.value().partition_of(k));
+      assert(b.value().add_hashed(hk).has_value());
+      assert(a.value().might_contain(k).value() && a.value().might_contain_hashed(hk).value());
+    }
+    assert(a.value().to_bytes() == b.value().to_bytes());
+    // The probe mode is part of the image and of merge compatibility
+    auto back = filter::from_bytes(b.value().to_bytes());
+    assert(back.has_value() && back.value().same_params(a.value()));
+    auto ind = filter::make(Config{.fp = 0.01, .capacity_hint = 3000, .layout = layout, .partitions = 3}, h);
+    assert(ind.has_value() && !ind.value().same_params(a.value()) && !ind.value().merge(a.value()).has_value());
+    assert(!ind.value().add_hashed(1U).has_value() && !ind.value().might_contain_hashed(1U).has_value());
+  }
+}
+
+static void test_mapped_backings_match_heap() {
+  using probkit::AllocPolicy;
+  using probkit::Backing;
+  auto heap = filter::make_by_mem(3UL << 20U, HashConfig{});
+  assert(heap.has_value());
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; ++i) {
+    keys.push_back("key-" + std::to_string(i));
+    assert(heap.value().add(keys.back()).has_value());
+  }
+  for (const auto& a : {AllocPolicy{.backing = Backing::lazy}, AllocPolicy{.backing = Backing::thp},
+                        AllocPolicy{.backing = Backing::thp, .prefault_threads = 3},
+                        AllocPolicy{.backing = Backing::hugetlb}}) {
+    auto f = filter::make_by_mem(3UL << 20U, HashConfig{}, a);
+    if (a.backing == Backing::hugetlb && !f.has_value()) {
+      continue; // no reserved huge pages on this machine
+    }
+    assert(f.has_value() && f.value().writable() && f.value().bit_size() == heap.value().bit_size());
+    for ([[maybe_unused]] const auto& k : keys) {
+      assert(f.value().add(k).has_value());
+    }
+    assert(f.value().to_bytes() == heap.value().to_bytes());
+  }
+}
+
 void run_bloom_tests() {
   test_insert_and_query_no_false_negative();
   test_false_positive_rate_matches_theory();
   test_merge_union_and_no_false_negative();
   test_merge_rejects_incompatible();
+  test_add_batch_no_false_negative();
+  test_blocked_no_false_negative_and_fp_target();
+  test_merge_rejects_layout_mismatch();
+  test_index_maps_no_false_negative();
+  test_save_load_round_trip();
+  test_partitioned_concurrent_adds_and_round_trip();
+  test_fixed_filter_matches_runtime();
+  test_derived_probe_hash_matches_hashed_calls();
+  test_mapped_backings_match_heap();
 }
 
 } // namespace tests
@@ -0,0 +1,51 @@
+#!/bin/sh
+# probkit merge over hll/cms/bloom images written by the CLI's own --save: merging the images of two
+# inputs must report what one run over their concatenation does
+# usage: cli_merge_test.sh <probkit>
+set -eu
+
+probkit=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+# Overlapping key ranges plus a heavy hitter split across both inputs
+{ seq 1 60000; yes hot | head -n 500; } >"$dir/a.txt"
+{ seq 40001 100000; yes hot | head -n 300; } >"$dir/b.txt"
+cat "$dir/a.txt" "$dir/b.txt" >"$dir/ab.txt"
+
+for part in a b; do
+  "$probkit" --file="$dir/$part.txt" --threads=2 hll --save="$dir/$part.hll" >/dev/null
+  "$probkit" --file="$dir/$part.txt" --threads=2 cms --topk=1 --save="$dir/$part.cms" >/dev/null
+done
+[ -s "$dir/a.hll" ] && [ -s "$dir/b.hll" ] || fail "hll --save wrote no image"
+[ -s "$dir/a.cms" ] && [ -s "$dir/b.cms" ] || fail "cms --save wrote no image"
+
+# hll registers merge by max, so the union estimate is exact against the single run
+want_hll=$("$probkit" --file="$dir/ab.txt" hll)
+got=$("$probkit" merge "$dir/a.hll" "$dir/b.hll" | tail -n 1)
+[ "$got" = "$want_hll" ] || fail "hll merge: got '$got', want '$want_hll'"
+
+# cms counters add, so the heavy hitter's estimate matches the single run's
+want=$("$probkit" --file="$dir/ab.txt" cms --topk=1)
+got=$("$probkit" merge --topk=1 "$dir/a.cms" "$dir/b.cms" | tail -n 1)
+[ "$got" = "$want" ] || fail "cms merge: got '$got', want '$want'"
+
+# --out writes an image that merges again
+"$probkit" merge --out="$dir/ab.hll" "$dir/a.hll" "$dir/b.hll" >/dev/null
+got=$("$probkit" merge "$dir/ab.hll" | tail -n 1)
+[ "$got" = "$want_hll" ] || fail "merge of a merged image: got '$got', want '$want_hll'"
+
+# Dedup filters saved with different --threads share the default partition count, so they merge,
+# and the union holds every line of both inputs
+"$probkit" --file="$dir/a.txt" --threads=1 bloom --fp=0.01 --capacity-hint=200000 --action=dedup \
+  --save="$dir/a.bf" >/dev/null
+"$probkit" --file="$dir/b.txt" --threads=4 bloom --fp=0.01 --capacity-hint=200000 --action=dedup \
+  --save="$dir/b.bf" >/dev/null
+"$probkit" merge --out="$dir/ab.bf" "$dir/a.bf" "$dir/b.bf" >/dev/null || fail "bloom merge across --threads"
+fresh=$("$probkit" --file="$dir/ab.txt" --threads=3 bloom --load="$dir/ab.bf" --action=dedup | wc -l)
+[ "$fresh" -eq 0 ] || fail "merged bloom passed $fresh seen lines"
@@ -1,9 +1,18 @@
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <filesystem>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "probkit/cms.hpp"
+#include "probkit/hash.hpp"
 
 using probkit::cms::sketch;
 using probkit::hashing::HashConfig;
@@ -51,8 +60,536 @@ static void test_cms_basic_bounds_and_merge() {
   }
 }
 
+static void test_cms_inc_batch_matches_inc() {
+  auto a = sketch::make_by_eps_delta(1e-2, 1e-3, HashConfig{});
+  auto b = sketch::make_by_eps_delta(1e-2, 1e-3, HashConfig{});
+  assert(a.has_value() && b.has_value());
+  auto sa = std::move(a.value());
+  auto sb = std::move(b.value());
+  std::vector<std::string> owned;
+  for (int i = 0; i < 700; ++i) {
+    owned.push_back(std::string("k-") + std::to_string(i % 97));
+    (void)sa.inc(owned.back(), 2);
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  [[maybe_unused]] auto ok = sb.inc_batch(keys, 2);
+  assert(ok.has_value());
+  for ([[maybe_unused]] const auto& k : owned) {
+    assert(sa.estimate(k).value() == sb.estimate(k).value());
+  }
+}
+
+static void test_cms_index_maps_never_underestimate() {
+  using probkit::hashing::IndexMap;
+  for (IndexMap map : {IndexMap::modulo, IndexMap::pow2, IndexMap::fastrange}) {
+    auto r = sketch::make(probkit::cms::Config{.eps = 1e-2, .delta = 1e-3, .index_map = map}, HashConfig{});
+    assert(r.has_value());
+    auto s = std::move(r.value());
+    if (map == IndexMap::pow2) {
+      assert(std::has_single_bit(s.dims().second));
+    }
+    std::unordered_map<std::string, std::uint64_t> truth;
+    for (int i = 0; i < 5000; ++i) {
+      std::string key = std::string("k-") + std::to_string((i * 31) % 400);
+      (void)s.inc(key);
+      ++truth[key];
+    }
+    for ([[maybe_unused]] const auto& [key, count] : truth) {
+      assert(s.estimate(key).value() >= count);
+    }
+  }
+  auto a =
+      sketch::make(probkit::cms::Config{.eps = 1e-2, .delta = 1e-3, .index_map = IndexMap::fastrange}, HashConfig{});
+  auto b = sketch::make_by_eps_delta(1e-2, 1e-3, HashConfig{});
+  assert(a.has_value() && b.has_value());
+  assert(!a.value().same_params(b.value()));
+  assert(!a.value().merge(b.value()).has_value());
+}
+
+static void test_cms_double_hash_rows() {
+  using probkit::cms::RowHash;
+  const probkit::cms::Config cfg{.eps = 1e-2, .delta = 1e-3, .row_hash = RowHash::double_hash};
+  auto a = sketch::make(cfg, HashConfig{});
+  auto b = sketch::make(cfg, HashConfig{});
+  assert(a.has_value() && b.has_value());
+  auto sa = std::move(a.value());
+  auto sb = std::move(b.value());
+  assert(sa.row_hash() == RowHash::double_hash);
+  std::unordered_map<std::string, std::uint64_t> truth;
+  std::vector<std::string> owned;
+  for (int i = 0; i < 3000; ++i) {
+    owned.push_back(std::string("https://example.com/path/") + std::to_string((i * 17) % 300));
+    (void)sa.inc(owned.back());
+    ++truth[owned.back()];
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  assert(sb.inc_batch(keys).has_value());
+  for ([[maybe_unused]] const auto& [key, count] : truth) {
+    assert(sa.estimate(key).value() >= count);
+    assert(sa.estimate(key).value() == sb.estimate(key).value());
+  }
+  auto other = sketch::make_by_eps_delta(1e-2, 1e-3, HashConfig{});
+  assert(other.has_value() && !sa.same_params(other.value()));
+  assert(!sa.merge(other.value()).has_value());
+}
+
+// Zipf-like stream: key i appears ~ (n / (i + 1)) times, interleaved with a long tail of singletons
+static void feed_skewed(sketch& s, std::string_view prefix, int hot, int tail) {
+  for (int round = 0; round < 200; ++round) {
+    for (int i = 0; i < hot; ++i) {
+      if (round % (i + 1) == 0) {
+        (void)s.inc(std::string(prefix) + "hot-" + std::to_string(i));
+      }
+    }
+    for (int t = 0; t < tail; ++t) {
+      (void)s.inc(std::string(prefix) + "tail-" + std::to_string((round * tail) + t));
+    }
+  }
+}
+
+static void test_cms_topk_tracks_heavy_hitters() {
+  auto r = sketch::make(probkit::cms::Config{.eps = 1e-3, .delta = 1e-3, .topk = 5}, HashConfig{});
+  assert(r.has_value());
+  auto s = std::move(r.value());
+  assert(s.candidate_capacity() >= 5U);
+  feed_skewed(s, "", 5, 50);
+  auto top = s.topk(5);
+  assert(top.has_value() && top.value().size() == 5U);
+  for (std::size_t i = 0; i < top.value().size(); ++i) {
+    assert(top.value()[i].key == std::string("hot-") + std::to_string(i));
+    assert(top.value()[i].est >= static_cast<std::uint64_t>(200 / (i + 1)));
+  }
+  auto none = sketch::make_by_eps_delta(1e-3, 1e-3, HashConfig{});
+  assert(none.has_value() && !none.value().topk(5).has_value());
+}
+
+static void test_cms_topk_above_max_is_rejected() {
+  using probkit::cms::kMaxTopk;
+  for (const std::size_t k : {kMaxTopk + 1U, std::size_t{4'000'000'000'000'000'000U}}) {
+    [[maybe_unused]] auto r = sketch::make(probkit::cms::Config{.eps = 1e-2, .delta = 1e-2, .topk = k}, HashConfig{});
+    assert(!r.has_value() && r.error().code == probkit::make_error_code(probkit::errc::invalid_argument));
+  }
+  [[maybe_unused]] auto at_max = sketch::make(probkit::cms::Config{.eps = 1e-2, .delta = 1e-2, .topk = kMaxTopk}, {});
+  assert(at_max.has_value() && at_max.value().candidate_capacity() >= kMaxTopk);
+}
+
+static void test_cms_topk_merge_combines_candidates() {
+  const probkit::cms::Config cfg{.eps = 1e-3, .delta = 1e-3, .topk = 3};
+  auto a = sketch::make(cfg, HashConfig{});
+  auto b = sketch::make(cfg, HashConfig{});
+  assert(a.has_value() && b.has_value());
+  auto sa = std::move(a.value());
+  auto sb = std::move(b.value());
+  // "shared" is moderately hot in both halves; only the merged view sees it as the top key
+  for (int i = 0; i < 300; ++i) {
+    (void)sa.inc("a-only");
+    (void)sb.inc("b-only");
+    if (i % 3 != 0) {
+      (void)sa.inc("shared");
+      (void)sb.inc("shared");
+    }
+  }
+  std::vector<std::string> owned;
+  for (int i = 0; i < 2000; ++i) {
+    owned.push_back(std::string("noise-") + std::to_string(i));
+  }
+  const std::vector<std::string_view> noise(owned.begin(), owned.end());
+  assert(sb.inc_batch(noise).has_value());
+  assert(sa.merge(sb).has_value());
+  auto top = sa.topk(3);
+  assert(top.has_value() && top.value().size() == 3U);
+  assert(top.value()[0].key == "shared" && top.value()[0].est >= 400U);
+  assert(top.value()[1].est >= 300U && top.value()[2].est >= 300U);
+}
+
+static void test_cms_topk_views_survive_key_churn() {
+  // Capacity 8, long keys and constant eviction: the candidate arena has to compact and grow
+  auto r = sketch::make(probkit::cms::Config{.eps = 1e-3, .delta = 1e-3, .topk = 2}, HashConfig{});
+  assert(r.has_value());
+  auto s = std::move(r.value());
+  const std::string pad(100, 'x');
+  for (int round = 0; round < 200; ++round) {
+    for (int i = 0; i < 3; ++i) {
+      (void)s.inc(pad + "hot-" + std::to_string(i), static_cast<std::uint64_t>(10 - i));
+    }
+    for (int t = 0; t < 20; ++t) {
+      (void)s.inc(pad.substr(0, static_cast<std::size_t>((round + t) % 100)) + std::to_string((round * 20) + t));
+    }
+  }
+  std::vector<probkit::cms::PairView> views;
+  assert(s.topk(3, views).has_value() && views.size() == 3U);
+  const auto owned = s.topk(3).value();
+  for (std::size_t i = 0; i < views.size(); ++i) {
+    assert(views[i].key == pad + "hot-" + std::to_string(i));
+    assert(views[i].key == owned[i].key && views[i].est == owned[i].est);
+  }
+
+  // Merging offers the other side's keys into this arena
+  auto o = sketch::make(probkit::cms::Config{.eps = 1e-3, .delta = 1e-3, .topk = 2}, HashConfig{});
+  assert(o.has_value() && o.value().inc("merged-top", 5000).has_value());
+  assert(s.merge(o.value()).has_value());
+  assert(s.topk(1, views).has_value() && views.size() == 1U && views[0].key == "merged-top");
+
+  assert(s.reset().has_value());
+  assert(s.estimate(pad + "hot-0").value() == 0U);
+  assert(s.topk(3, views).has_value() && views.empty());
+  (void)s.inc("after-reset", 3);
+  assert(s.topk(3, views).has_value() && views.size() == 1U && views[0].key == "after-reset" && views[0].est == 3U);
+  auto none = sketch::make_by_eps_delta(1e-3, 1e-3, HashConfig{});
+  assert(none.has_value() && !none.value().topk(3, views).has_value() && views.empty());
+}
+
+static void test_cms_save_load_keeps_counts_and_candidates() {
+  using probkit::serialize::LoadMode;
+  const probkit::cms::Config cfg{.eps = 1e-3, .delta = 1e-3, .topk = 5, .row_hash = probkit::cms::RowHash::double_hash};
+  auto r = sketch::make(cfg, HashConfig{.seed = 11});
+  assert(r.has_value());
+  auto s = std::move(r.value());
+  feed_skewed(s, "", 5, 50);
+  const auto want = s.topk(5).value();
+
+  auto bytes = s.to_bytes();
+  auto back = sketch::from_bytes(bytes);
+  assert(back.has_value() && back.value().same_params(s));
+  assert(back.value().candidate_capacity() == s.candidate_capacity());
+  auto got = back.value().topk(5);
+  assert(got.has_value() && got.value().size() == want.size());
+  for (std::size_t i = 0; i < want.size(); ++i) {
+    assert(got.value()[i].key == want[i].key && got.value()[i].est == want[i].est);
+  }
+  bytes.back() ^= std::byte{0x80}; // last byte of the candidate section
+  assert(!sketch::from_bytes(bytes).has_value());
+
+  std::error_code ec;
+  const std::string path = (std::filesystem::temp_directory_path(ec) / "probkit_cms_test.pk").string();
+  assert(s.save(path).has_value());
+  assert(probkit::serialize::sketch_kind(path).value() == probkit::serialize::SketchKind::cms);
+  assert(!probkit::serialize::sketch_kind(path + ".missing").has_value());
+  for (LoadMode mode : {LoadMode::copy, LoadMode::map_read_only, LoadMode::map_copy_on_write}) {
+    auto l = sketch::load(path, {.mode = mode, .verify_checksum = mode != LoadMode::map_read_only});
+    assert(l.has_value());
+    [[maybe_unused]] auto& loaded = l.value();
+    assert(loaded.estimate("hot-0").value() == s.estimate("hot-0").value());
+    assert(loaded.topk(1).value()[0].key == "hot-0");
+    assert(loaded.inc("hot-0").has_value() == (mode != LoadMode::map_read_only));
+    assert(loaded.merge(s).has_value() == loaded.writable());
+  }
+  auto again = sketch::load(path);
+  assert(again.has_value() && again.value().estimate("hot-0").value() == s.estimate("hot-0").value());
+  std::filesystem::remove(path, ec);
+}
+
+// Rewrite one header param of a cms image and re-seal the header checksum, as a crafted file would
+// (offsets per src/format.cpp: params from byte 56, checksum in the last 8 of 128 header bytes)
+static void patch_header_param(std::vector<std::byte>& bytes, std::size_t param, std::uint64_t v) {
+  constexpr std::size_t kOffParams = 56;
+  constexpr std::size_t kOffHeaderSum = 120;
+  const auto put = [&](std::size_t off, std::uint64_t x) -> void {
+    for (std::size_t i = 0; i < 8U; ++i) {
+      bytes[off + i] = static_cast<std::byte>((x >> (8U * i)) & 0xFFU);
+    }
+  };
+  put(kOffParams + (8U * param), v);
+  const HashConfig sum{.kind = probkit::hashing::HashKind::xxhash, .seed = 0x50524F424B495431ULL};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  put(kOffHeaderSum, probkit::hashing::hash64({reinterpret_cast<const char*>(bytes.data()), kOffHeaderSum}, sum));
+}
+
+static void test_cms_image_candidate_capacity_is_bounded() {
+  constexpr std::size_t kParamCandCap = 4;
+  auto r = sketch::make(probkit::cms::Config{.eps = 1e-2, .delta = 1e-2, .topk = 1}, HashConfig{});
+  assert(r.has_value());
+  auto s = std::move(r.value());
+  (void)s.inc("only", 3);
+  auto bytes = s.to_bytes();
+  patch_header_param(bytes, kParamCandCap, s.candidate_capacity() + 1U);
+  assert(sketch::from_bytes(bytes).has_value()); // the resealed header itself is accepted
+  for (const std::uint64_t cap : {std::uint64_t{1} << 40, std::uint64_t{UINT32_MAX}, ~std::uint64_t{0}}) {
+    patch_header_param(bytes, kParamCandCap, cap);
+    [[maybe_unused]] auto bad = sketch::from_bytes(bytes);
+    assert(!bad.has_value() && bad.error().code == probkit::make_error_code(probkit::errc::parse_error));
+  }
+
+  // The largest capacity costs only what is tracked
+  auto big = sketch::make(probkit::cms::Config{.eps = 1e-2, .delta = 1e-2, .topk = probkit::cms::kMaxTopk}, {});
+  assert(big.has_value());
+  for (int i = 0; i < 1000; ++i) {
+    (void)big.value().inc("k" + std::to_string(i), static_cast<std::uint64_t>(i + 1));
+  }
+  [[maybe_unused]] auto top = big.value().topk(2);
+  assert(top.has_value() && top.value().size() == 2U && top.value()[0].est >= 1000U);
+}
+
+static void test_cms_concurrent_matches_sequential() {
+  constexpr std::size_t kThreads = 4;
+  const probkit::cms::Config cfg{.eps = 1e-3, .delta = 1e-3, .topk = 3};
+  auto cr = probkit::cms::concurrent_sketch::make(cfg, HashConfig{}, kThreads);
+  auto seq_r = sketch::make(cfg, HashConfig{});
+  assert(cr.has_value() && seq_r.has_value());
+  auto shared = std::move(cr.value());
+  auto& seq = seq_r.value();
+  // Each thread sees a different slice: "hot-i" stands out only once all shards are combined
+  std::vector<std::vector<std::string>> keys(kThreads);
+  for (std::size_t t = 0; t < kThreads; ++t) {
+    for (int i = 0; i < 3000; ++i) {
+      keys[t].push_back(i % 3 == 0 ? "hot-" + std::to_string(i % 9)
+                                   : "t" + std::to_string(t) + "-" + std::to_string(i));
+      (void)seq.inc(keys[t].back());
+    }
+  }
+  std::vector<std::thread> writers;
+  for (std::size_t t = 0; t < kThreads; ++t) {
+    writers.emplace_back([&shared, &keys, t]() -> void {
+      const std::vector<std::string_view> views(keys[t].begin(), keys[t].end());
+      assert(shared.inc_batch(views, 1, t).has_value());
+    });
+  }
+  for (auto& w : writers) {
+    w.join();
+  }
+  // Counter sums are order-independent, so every estimate equals the sequential one
+  for ([[maybe_unused]] const auto& k : keys[0]) {
+    assert(shared.estimate(k).value() == seq.estimate(k).value());
+  }
+  auto snap = shared.snapshot();
+  assert(snap.has_value());
+  const sketch released = std::move(shared).release();
+  for (const sketch* s : std::array<const sketch*, 2>{&snap.value(), &released}) {
+    auto top = s->topk(3);
+    assert(top.has_value() && top.value().size() == 3U);
+    for ([[maybe_unused]] const auto& pr : top.value()) {
+      assert(pr.key.starts_with("hot-") && pr.est == seq.estimate(pr.key).value());
+    }
+  }
+}
+
+static void test_cms_narrow_counters_saturate() {
+  using probkit::cms::CounterWidth;
+  const probkit::cms::Config wide{.eps = 1e-2, .delta = 1e-3};
+  probkit::cms::Config narrow = wide;
+  narrow.counter_width = CounterWidth::u32;
+  auto w = sketch::make(wide, HashConfig{});
+  auto n = sketch::make(narrow, HashConfig{});
+  assert(w.has_value() && n.has_value());
+  assert(n.value().counter_width() == CounterWidth::u32 && n.value().byte_size() * 2U == w.value().byte_size());
+  std::vector<std::string> owned;
+  for (int i = 0; i < 2000; ++i) {
+    owned.push_back("k-" + std::to_string(i % 113));
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  assert(w.value().inc_batch(keys).has_value() && n.value().inc_batch(keys).has_value());
+  for ([[maybe_unused]] const auto& k : keys) {
+    assert(w.value().estimate(k).value() == n.value().estimate(k).value());
+  }
+  assert(!w.value().merge(n.value()).has_value()); // widths must match
+
+  // 16-bit counters clamp at 65535 and say so, through inc, inc_batch and merge alike
+  probkit::cms::Config tiny = wide;
+  tiny.counter_width = CounterWidth::u16;
+  auto a = sketch::make(tiny, HashConfig{});
+  auto b = sketch::make(tiny, HashConfig{});
+  assert(a.has_value() && b.has_value());
+  assert(a.value().inc("hot", 60000).has_value());
+  auto over = a.value().inc("hot", 10000);
+  assert(!over.has_value() && over.error().code == probkit::make_error_code(probkit::errc::overflow));
+  assert(a.value().estimate("hot").value() == 65535U);
+  assert(!a.value().inc_batch(std::vector<std::string_view>{"hot"}).has_value());
+  assert(b.value().inc("hot", 40000).has_value());
+  assert(!b.value().merge(a.value()).has_value() && b.value().estimate("hot").value() == 65535U);
+}
+
+static void test_cms_conservative_update_tightens_estimates() {
+  // Narrow table so that collisions matter
+  probkit::cms::Config cfg{.eps = 5e-2, .delta = 1e-2};
+  auto s = sketch::make(cfg, HashConfig{});
+  cfg.update = probkit::cms::UpdateRule::conservative;
+  auto cu = sketch::make(cfg, HashConfig{});
+  auto cu_batch = sketch::make(cfg, HashConfig{});
+  assert(s.has_value() && cu.has_value() && cu_batch.has_value());
+  std::unordered_map<std::string, std::uint64_t> truth;
+  std::vector<std::string> owned;
+  for (int i = 0; i < 5000; ++i) {
+    owned.push_back("k-" + std::to_string((i * 7) % (1 + (i % 400))));
+    ++truth[owned.back()];
+    (void)s.value().inc(owned.back());
+    (void)cu.value().inc(owned.back());
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  assert(cu_batch.value().inc_batch(keys).has_value());
+  std::uint64_t over_std = 0;
+  std::uint64_t over_cu = 0;
+  for (const auto& [k, t] : truth) {
+    const auto e_std = s.value().estimate(k).value();
+    const auto e_cu = cu.value().estimate(k).value();
+    assert(t <= e_cu && e_cu <= e_std);
+    assert(cu_batch.value().estimate(k).value() == e_cu);
+    over_std += e_std - t;
+    over_cu += e_cu - t;
+  }
+  assert(over_cu < over_std);
+
+  // The rule survives a round trip; a shared table cannot offer it
+  auto back = sketch::from_bytes(cu.value().to_bytes());
+  assert(back.has_value() && back.value().update_rule() == probkit::cms::UpdateRule::conservative);
+  assert(back.value().estimate("k-0").value() == cu.value().estimate("k-0").value());
+  assert(!probkit::cms::concurrent_sketch::make(cfg, HashConfig{}).has_value());
+}
+
+static void test_cms_fixed_matches_runtime() {
+  using probkit::cms::Config;
+  using probkit::cms::CounterWidth;
+  using probkit::cms::fixed_sketch;
+  using probkit::cms::RowHash;
+  using probkit::cms::UpdateRule;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 4000; ++i) {
+    keys.push_back("C-" + std::to_string(i % 700));
+  }
+  const std::vector<std::string_view> views(keys.begin(), keys.end());
+  for (RowHash rh : {RowHash::independent, RowHash::double_hash}) {
+    for (UpdateRule rule : {UpdateRule::standard, UpdateRule::conservative}) {
+      // delta = 1% gives depth 5
+      const Config c{.eps = 1e-2,
+                     .delta = 1e-2,
+                     .topk = 5,
+                     .row_hash = rh,
+                     .counter_width = CounterWidth::u32,
+                     .update = rule};
+      auto rr = sketch::make(c, HashConfig{.seed = 4});
+      auto fr = fixed_sketch<5>::make(c, HashConfig{.seed = 4});
+      assert(rr.has_value() && fr.has_value());
+      sketch r = std::move(rr.value());
+      fixed_sketch<5> f = std::move(fr.value());
+      assert(f.dims() == r.dims());
+      assert(r.inc_batch(views).has_value());
+      assert(f.inc_batch(std::span(views).first(2000)).has_value());
+      for (std::size_t i = 2000; i < views.size(); ++i) {
+        assert(f.inc(views[i]).has_value());
+      }
+      assert(f.to_bytes() == r.to_bytes());
+      for (int i = 0; i < 700; ++i) {
+        const std::string k = "C-" + std::to_string(i);
+        assert(f.estimate(k).value() == r.estimate(k).value());
+      }
+      assert(f.topk(5).value().front().key == r.topk(5).value().front().key);
+      assert(f.merge(r).has_value() && r.merge(f.base()).has_value());
+      assert(fixed_sketch<5>::estimate(r, "C-1").value() == r.estimate("C-1").value());
+    }
+  }
+  auto deep = sketch::make(Config{.eps = 1e-2, .delta = 1e-4}, HashConfig{});
+  assert(deep.has_value() && !fixed_sketch<5>::fits(deep.value()) && fixed_sketch<10>::fits(deep.value()));
+  assert(!fixed_sketch<5>::inc(deep.value(), "x").has_value());
+  auto back = fixed_sketch<10>::from_bytes(deep.value().to_bytes());
+  assert(back.has_value() && std::move(back.value()).release().same_params(deep.value()));
+}
+
+static void test_cms_inc_hashed_batch_matches_inc_batch() {
+  using probkit::cms::RowHash;
+  using probkit::cms::UpdateRule;
+  const HashConfig h{.seed = 5};
+  std::vector<std::string> owned;
+  std::vector<std::uint64_t> hs;
+  for (int i = 0; i < 4000; ++i) {
+    owned.push_back("k-" + std::to_string((i * 31) % 700));
+    hs.push_back(probkit::hashing::hash64(owned.back(), h));
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  for (const UpdateRule rule : {UpdateRule::standard, UpdateRule::conservative}) {
+    const probkit::cms::Config cfg{
+        .eps = 1e-2, .delta = 1e-3, .topk = 5, .row_hash = RowHash::double_hash, .update = rule};
+    auto a = sketch::make(cfg, h);
+    auto b = sketch::make(cfg, h);
+    assert(a.has_value() && b.has_value());
+    assert(a.value().inc_batch(keys, 2).has_value());
+    assert(b.value().inc_hashed_batch(keys, hs, 2).has_value());
+    assert(a.value().to_bytes() == b.value().to_bytes());
+    assert(!b.value().inc_hashed_batch(keys, std::span(hs).first(3)).has_value());
+  }
+  // Independent rows hash each row separately, so one key hash is not enough
+  auto ind = sketch::make_by_eps_delta(1e-2, 1e-3, h);
+  assert(ind.has_value() && !ind.value().inc_hashed_batch(keys, hs).has_value());
+}
+
+static void test_cms_merge_matches_replay_at_every_width() {
+  using probkit::cms::CounterWidth;
+  std::vector<std::string> owned;
+  for (int i = 0; i < 3000; ++i) {
+    owned.push_back("k-" + std::to_string((i * 17) % 911));
+  }
+  const std::vector<std::string_view> keys(owned.begin(), owned.end());
+  [[maybe_unused]] const auto half = keys.size() / 2U;
+  for (const CounterWidth w : {CounterWidth::u16, CounterWidth::u32, CounterWidth::u64}) {
+    // An odd width leaves a scalar tail after the vector loop
+    const probkit::cms::Config cfg{.eps = 0.0137, .delta = 1e-3, .counter_width = w};
+    auto a = sketch::make(cfg, HashConfig{});
+    auto b = sketch::make(cfg, HashConfig{});
+    auto replay = sketch::make(cfg, HashConfig{});
+    assert(a.has_value() && b.has_value() && replay.has_value() && a.value().dims().second % 2U == 1U);
+    assert(a.value().inc_batch(std::span(keys).first(half), 3).has_value());
+    assert(b.value().inc_batch(std::span(keys).subspan(half), 5).has_value());
+    assert(replay.value().inc_batch(std::span(keys).first(half), 3).has_value());
+    assert(replay.value().inc_batch(std::span(keys).subspan(half), 5).has_value());
+    assert(a.value().merge(b.value()).has_value());
+    assert(a.value().to_bytes() == replay.value().to_bytes());
+
+    // Clamping is reported, and cells away from the clamped key keep their exact sums
+    [[maybe_unused]] const std::uint64_t top =
+        w == CounterWidth::u16 ? 0xFFFFU : w == CounterWidth::u32 ? 0xFFFFFFFFU : ~0ULL;
+    auto c = sketch::make(cfg, HashConfig{});
+    assert(c.has_value() && c.value().inc("hot", top - 7U).has_value() && a.value().inc("hot", 8).has_value());
+    [[maybe_unused]] const std::uint64_t cold = a.value().estimate("k-1").value();
+    auto merged = c.value().merge(a.value());
+    assert(!merged.has_value() && merged.error().code == probkit::make_error_code(probkit::errc::overflow));
+    assert(c.value().estimate("hot").value() == top);
+    assert(c.value().estimate("k-1").value() >= cold);
+  }
+}
+
+static void test_cms_mapped_backings_match_heap() {
+  using probkit::AllocPolicy;
+  using probkit::Backing;
+  const probkit::cms::Config cfg{.eps = 1e-4, .delta = 1e-3, .topk = 3};
+  auto heap = sketch::make(cfg, HashConfig{});
+  assert(heap.has_value());
+  feed_skewed(heap.value(), "", 5, 20);
+  for (const auto& a : {AllocPolicy{.backing = Backing::lazy, .prefault_threads = 2},
+                        AllocPolicy{.backing = Backing::thp}, AllocPolicy{.backing = Backing::hugetlb}}) {
+    auto s = sketch::make_by_eps_delta(cfg.eps, cfg.delta, HashConfig{}, a);
+    if (a.backing == Backing::hugetlb && !s.has_value()) {
+      assert(s.error().code == probkit::make_error_code(probkit::errc::out_of_memory) ||
+             s.error().code == probkit::make_error_code(probkit::errc::not_supported));
+      continue; // no reserved huge pages on this machine
+    }
+    assert(s.has_value() && s.value().same_params(heap.value()));
+    auto c = probkit::cms::Config{cfg};
+    c.alloc = a;
+    auto t = sketch::make(c, HashConfig{});
+    assert(t.has_value());
+    feed_skewed(t.value(), "", 5, 20);
+    assert(t.value().to_bytes() == heap.value().to_bytes());
+    assert(s.value().merge(t.value()).has_value());
+    assert(s.value().estimate("hot-0").value() == t.value().estimate("hot-0").value());
+  }
+}
+
 void run_cms_tests() {
   test_cms_basic_bounds_and_merge();
+  test_cms_inc_batch_matches_inc();
+  test_cms_index_maps_never_underestimate();
+  test_cms_double_hash_rows();
+  test_cms_topk_tracks_heavy_hitters();
+  test_cms_topk_above_max_is_rejected();
+  test_cms_topk_merge_combines_candidates();
+  test_cms_topk_views_survive_key_churn();
+  test_cms_save_load_keeps_counts_and_candidates();
+  test_cms_image_candidate_capacity_is_bounded();
+  test_cms_concurrent_matches_sequential();
+  test_cms_narrow_counters_saturate();
+  test_cms_conservative_update_tightens_estimates();
+  test_cms_fixed_matches_runtime();
+  test_cms_inc_hashed_batch_matches_inc_batch();
+  test_cms_merge_matches_replay_at_every_width();
+  test_cms_mapped_backings_match_heap();
 }
 
 } // namespace tests
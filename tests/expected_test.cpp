@@ -13,6 +13,7 @@ void run_hash_tests();
 void run_bloom_tests();
 void run_hll_tests();
 void run_cms_tests();
+void run_fuse_tests();
 } // namespace tests
 
 static void copy_move_value() {
@@ -52,6 +53,7 @@ auto main() -> int {
     tests::run_bloom_tests();
     tests::run_hll_tests();
     tests::run_cms_tests();
+    tests::run_fuse_tests();
     return 0;
   } catch (const std::exception& e) {
     std::fprintf(stderr, "unexpected exception: %s\n", e.what());
@@ -0,0 +1,165 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "probkit/fuse.hpp"
+#include "probkit/hash.hpp"
+
+using probkit::fuse::Config;
+using probkit::fuse::filter;
+using probkit::fuse::Fingerprint;
+using probkit::hashing::HashConfig;
+
+namespace tests {
+
+namespace {
+struct keys {
+  std::vector<std::string> owned;
+  std::vector<std::string_view> views;
+};
+
+auto make_keys(const char* prefix, std::size_t n) -> keys {
+  keys k;
+  k.owned.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    k.owned.push_back(prefix + std::to_string(i));
+  }
+  k.views.assign(k.owned.begin(), k.owned.end());
+  return k;
+}
+
+[[maybe_unused]] auto contains_all(const filter& f, std::span<const std::string_view> xs) -> bool {
+  for (const auto x : xs) {
+    auto q = f.might_contain(x);
+    if (!q.has_value() || !q.value()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto false_positives(const filter& f, std::span<const std::string_view> xs) -> std::size_t {
+  std::size_t hits = 0;
+  for (const auto x : xs) {
+    hits += f.might_contain(x).value() ? 1U : 0U;
+  }
+  return hits;
+}
+} // namespace
+
+static void test_fuse_no_false_negatives_and_fp_rate() {
+  const auto in = make_keys("member-", 100000);
+  const auto out = make_keys("absent-", 200000);
+  for (const Fingerprint fp : {Fingerprint::f8, Fingerprint::f16}) {
+    auto f = filter::build(in.views, Config{.fingerprint = fp}, HashConfig{.seed = 3});
+    assert(f.has_value());
+    assert(f.value().size() == in.views.size() && contains_all(f.value(), in.views));
+    [[maybe_unused]] const double bits = fp == Fingerprint::f8 ? 8.0 : 16.0;
+    assert(f.value().bits_per_key() < bits * 1.2); // 1.125 for large sets, more below a million keys
+    [[maybe_unused]] const double rate = static_cast<double>(false_positives(f.value(), out.views)) / 200000.0;
+    [[maybe_unused]] const double expected = fp == Fingerprint::f8 ? 1.0 / 256.0 : 1.0 / 65536.0;
+    assert(rate < expected * 1.5 + 1e-4);
+  }
+}
+
+static void test_fuse_small_sets_and_duplicates() {
+  for (const std::size_t n : {std::size_t{0}, std::size_t{1}, std::size_t{2}, std::size_t{3}, std::size_t{17},
+                              std::size_t{500}}) {
+    auto k = make_keys("k", n);
+    // Every key three times, the copies spread out
+    std::vector<std::string_view> tripled;
+    for (int r = 0; r < 3; ++r) {
+      tripled.insert(tripled.end(), k.views.begin(), k.views.end());
+    }
+    auto f = filter::build(tripled);
+    assert(f.has_value() && f.value().size() == n && contains_all(f.value(), k.views));
+  }
+  auto empty = filter::build({});
+  assert(empty.has_value() && !empty.value().might_contain("anything").value());
+  assert(!filter{}.might_contain("x").value());
+}
+
+// A key set read from a log repeats most keys: the table is sized for the distinct ones
+static void test_fuse_repeated_keys_do_not_grow_table() {
+  const auto in = make_keys("r-", 200000);
+  std::vector<std::string_view> repeated;
+  for (int r = 0; r < 4; ++r) {
+    repeated.insert(repeated.end(), in.views.begin(), in.views.end());
+  }
+  for (const std::size_t parts : {std::size_t{1}, std::size_t{3}}) {
+    auto f = filter::build(repeated, Config{.fingerprint = Fingerprint::f8, .partitions = parts});
+    assert(f.has_value() && f.value().size() == in.views.size() && contains_all(f.value(), in.views));
+    assert(f.value().bits_per_key() < 10.0);
+  }
+}
+
+static void test_fuse_partitions_match_batch_and_hashed() {
+  const auto in = make_keys("p-", 50000);
+  const HashConfig h{.seed = 11};
+  auto f = filter::build(in.views, Config{.fingerprint = Fingerprint::f8, .partitions = 4, .build_threads = 4}, h);
+  assert(f.has_value() && f.value().partitions() == 4U && contains_all(f.value(), in.views));
+  // Partitioned builds are deterministic regardless of the thread count
+  auto serial = filter::build(in.views, Config{.partitions = 4, .build_threads = 1}, h);
+  assert(serial.has_value() && serial.value().to_bytes() == f.value().to_bytes());
+
+  std::vector<std::uint64_t> hashes;
+  for (const auto x : in.views) {
+    hashes.push_back(probkit::hashing::hash64(x, h));
+  }
+  auto hashed = filter::build_hashed(hashes, Config{.partitions = 4}, h);
+  assert(hashed.has_value() && hashed.value().to_bytes() == f.value().to_bytes());
+
+  const auto probes = make_keys("q-", 3000);
+  std::vector<std::string_view> mixed(in.views.begin(), in.views.begin() + 3000);
+  mixed.insert(mixed.end(), probes.views.begin(), probes.views.end());
+  auto out = std::make_unique<bool[]>(mixed.size()); // NOLINT(*-avoid-c-arrays)
+  assert(f.value().might_contain_batch(mixed, std::span<bool>(out.get(), mixed.size())).has_value());
+  for (std::size_t i = 0; i < mixed.size(); ++i) {
+    assert(out[i] == f.value().might_contain(mixed[i]).value());
+    assert(f.value().might_contain_hashed(probkit::hashing::hash64(mixed[i], h)).value() == out[i]);
+  }
+  assert(!f.value().might_contain_batch(mixed, std::span<bool>(out.get(), 1)).has_value());
+  assert(!filter::build(in.views, Config{.partitions = 0}).has_value());
+}
+
+static void test_fuse_save_load_round_trip() {
+  using probkit::serialize::LoadMode;
+  const auto in = make_keys("S-", 20000);
+  // A hash kind added after the image format keeps its kind through a round trip
+  const HashConfig h{.kind = probkit::hashing::HashKind::aes, .seed = 7};
+  auto f = filter::build(in.views, Config{.fingerprint = Fingerprint::f16, .partitions = 3}, h);
+  assert(f.has_value());
+  auto bytes = f.value().to_bytes();
+  auto back = filter::from_bytes(bytes);
+  assert(back.has_value() && back.value().to_bytes() == bytes && contains_all(back.value(), in.views));
+  assert(back.value().hash_config().kind == probkit::hashing::HashKind::aes);
+  bytes[bytes.size() / 2U] ^= std::byte{0x01};
+  assert(!filter::from_bytes(bytes).has_value());
+
+  std::error_code ec;
+  const std::string path = (std::filesystem::temp_directory_path(ec) / "probkit_fuse_test.pk").string();
+  assert(f.value().save(path).has_value());
+  assert(probkit::serialize::sketch_kind(path).value() == probkit::serialize::SketchKind::fuse);
+  for (LoadMode mode : {LoadMode::copy, LoadMode::map_read_only, LoadMode::map_copy_on_write}) {
+    auto g = filter::load(path, {.mode = mode});
+    assert(g.has_value() && g.value().fingerprint() == Fingerprint::f16 && g.value().partitions() == 3U);
+    assert(g.value().size() == f.value().size() && contains_all(g.value(), in.views));
+  }
+  std::filesystem::remove(path, ec);
+}
+
+void run_fuse_tests() {
+  test_fuse_no_false_negatives_and_fp_rate();
+  test_fuse_small_sets_and_duplicates();
+  test_fuse_repeated_keys_do_not_grow_table();
+  test_fuse_partitions_match_batch_and_hashed();
+  test_fuse_save_load_round_trip();
+}
+
+} // namespace tests
@@ -12,8 +12,11 @@
 
 using probkit::hashing::derive_thread_salt;
 using probkit::hashing::hash64;
+using probkit::hashing::hash64_batch;
 using probkit::hashing::HashConfig;
 using probkit::hashing::HashKind;
+using probkit::hashing::IndexMap;
+using probkit::hashing::map_index;
 
 namespace tests {
 
@@ -102,6 +105,13 @@ static void test_kinds_produce_different_values() {
   const auto hw = hash64(input, w);
   const auto hx = hash64(input, x);
   check(hw != hx, "wyhash vs xxhash should differ");
+  HashConfig x3 = w;
+  x3.kind = HashKind::xxh3;
+  HashConfig a = w;
+  a.kind = HashKind::aes;
+  const auto h3 = hash64(input, x3);
+  const auto ha = hash64(input, a);
+  check(h3 != hw && h3 != hx && ha != hw && ha != hx && ha != h3, "all kinds should differ");
 }
 
 static void test_thread_salt_derivation() {
@@ -141,6 +151,97 @@ static void test_boundary_lengths_xxhash() {
   run_boundary_lengths(HashKind::xxhash, "xxhash");
 }
 
+static void test_boundary_lengths_xxh3_aes() {
+  run_boundary_lengths(HashKind::xxh3, "xxh3");
+  run_boundary_lengths(HashKind::aes, "aes");
+}
+
+// Values from the xxHash reference (XXH3_64bits_withSeed) and pinned aes values: the aes kind must hash
+// the same with AES-NI, ARMv8 crypto or the software round, or saved images stop matching their keys.
+static void test_known_values() {
+  struct vec {
+    std::size_t len;
+    std::uint64_t xxh3_seed0;
+    std::uint64_t xxh3_seed42;
+    std::uint64_t aes_seed42;
+  };
+  // Lengths from each XXH3 code path: empty, 1-3, 4-16, 17-128, 129-240 and the striped loop
+  constexpr std::array<vec, 6> kVectors{
+      vec{0, 0x2D06800538D394C2ULL, 0xB029411FF43D84D2ULL, 0x5D26A103149F0343ULL},
+      vec{3, 0x9CC1FEC95EBF51C9ULL, 0x2470D7D0CF55C091ULL, 0x14A9F4224F9C0EE6ULL},
+      vec{12, 0x8EB739A3D670A63CULL, 0x3BFD50F6B3BFB7C7ULL, 0xE24F439618AAC25AULL},
+      vec{100, 0xB67D8ADB35CDDC5AULL, 0x06FD2984F1990402ULL, 0x11D8E83C20D5D2FFULL},
+      vec{200, 0xCF625DB5CBBEFFE0ULL, 0xD61A61F569CD45C8ULL, 0xA704EF54A4295314ULL},
+      vec{1000, 0xCC3530792177BF4CULL, 0xB3DE07AEF40073B2ULL, 0x70DBCE734AF79C79ULL},
+  };
+  std::string pattern;
+  for (int i = 0; i < 1000; ++i) {
+    pattern.push_back(static_cast<char>('!' + ((i * 7) % 90)));
+  }
+  for (const vec& v : kVectors) {
+    const std::string_view s{pattern.data(), v.len};
+    check(hash64(s, HashConfig{.kind = HashKind::xxh3}) == v.xxh3_seed0, "xxh3 must match the reference");
+    check(hash64(s, HashConfig{.kind = HashKind::xxh3, .seed = 42}) == v.xxh3_seed42, "seeded xxh3 mismatch");
+    check(hash64(s, HashConfig{.kind = HashKind::aes, .seed = 42}) == v.aes_seed42, "aes value changed");
+  }
+  HashKind k{};
+  check(probkit::hashing::parse_hash_kind("xxh3", k) && k == HashKind::xxh3, "parse xxh3");
+  check(probkit::hashing::parse_hash_kind("aes", k) && k == HashKind::aes, "parse aes");
+  check(probkit::hashing::to_string(HashKind::aes) == "aes", "aes name");
+}
+
+// hash64_batch must agree bit-for-bit with hash64 for every kind, every key length and every batch size.
+static void test_batch_matches_scalar() {
+  std::vector<std::string> owned;
+  for (int len = 0; len <= 300; ++len) { // past 240, where XXH3 switches to its striped loop
+    std::string s;
+    for (int i = 0; i < len; ++i) {
+      s.push_back(static_cast<char>('a' + ((i * 7 + len) % 26)));
+    }
+    owned.push_back(std::move(s));
+  }
+  std::vector<std::string_view> keys(owned.begin(), owned.end());
+  for (HashKind kind : {HashKind::wyhash, HashKind::xxhash, HashKind::xxh3, HashKind::aes}) {
+    HashConfig cfg{};
+    cfg.kind = kind;
+    cfg.seed = 42ULL;
+    cfg.thread_salt = derive_thread_salt(7ULL, 3);
+    // Full, odd-sized and single-key batches
+    for (std::size_t count : {keys.size(), keys.size() - 3, std::size_t{1}}) {
+      std::vector<std::uint64_t> out(count, 0);
+      hash64_batch(std::span<const std::string_view>(keys.data(), count), cfg, out);
+      for (std::size_t i = 0; i < count; ++i) {
+        check(out[i] == hash64(keys[i], cfg), "hash64_batch must match hash64");
+      }
+    }
+  }
+  // A kind value past the last one (e.g. from a newer image) hashes as wyhash through both entry points
+  HashConfig bad{};
+  bad.kind = static_cast<HashKind>(0xFF);
+  std::vector<std::uint64_t> out(keys.size(), 0);
+  hash64_batch(keys, bad, out);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    check(out[i] == hash64(keys[i], bad) && out[i] == hash64(keys[i], HashConfig{}), "fallback must be wyhash");
+  }
+}
+
+static void test_map_index_in_range() {
+  const std::array<std::uint64_t, 5> samples{0ULL, 1ULL, 0x8000000000000000ULL, 0xDEADBEEFCAFEF00DULL, UINT64_MAX};
+  for (std::uint64_t n : {std::uint64_t{1}, std::uint64_t{7}, std::uint64_t{1000}, std::uint64_t{1} << 20U}) {
+    for (std::uint64_t h : samples) {
+      check(map_index(h, n, IndexMap::modulo) == h % n, "modulo must match %");
+      check(map_index(h, n, IndexMap::fastrange) < n, "fastrange must stay below n");
+    }
+  }
+  check(map_index(0x12345ULL, 256U, IndexMap::pow2) == 0x45ULL, "pow2 must mask low bits");
+  // fastrange takes the high bits: the top of the hash range maps to the last slot
+  check(map_index(UINT64_MAX, 10U, IndexMap::fastrange) == 9U, "fastrange top maps to n-1");
+  check(map_index(0ULL, 10U, IndexMap::fastrange) == 0U, "fastrange zero maps to 0");
+  IndexMap m{};
+  check(probkit::hashing::parse_index_map("fastrange", m) && m == IndexMap::fastrange, "parse fastrange");
+  check(!probkit::hashing::parse_index_map("mod", m), "reject unknown mapping");
+}
+
 void run_hash_tests() {
   test_reproducible_same_config();
   test_kinds_produce_different_values();
@@ -149,6 +250,10 @@ void run_hash_tests() {
   test_seed_effect();
   test_boundary_lengths();
   test_boundary_lengths_xxhash();
+  test_boundary_lengths_xxh3_aes();
+  test_known_values();
+  test_batch_matches_scalar();
+  test_map_index_in_range();
 }
 
 } // namespace tests
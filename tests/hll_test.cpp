@@ -1,8 +1,18 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <cstdio>
+#include <filesystem>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "probkit/hash.hpp"
 #include "probkit/hll.hpp"
 
 using probkit::hashing::HashConfig;
@@ -63,9 +73,344 @@ static void test_hll_linear_counting_region() {
   assert(v >= lo && v <= hi);
 }
 
+static void test_hll_add_batch_matches_add() {
+  for (auto kind : {probkit::hashing::HashKind::wyhash, probkit::hashing::HashKind::xxhash}) {
+    HashConfig h{};
+    h.kind = kind;
+    auto ar = sketch::make_by_precision(10, h);
+    auto br = sketch::make_by_precision(10, h);
+    assert(ar.has_value() && br.has_value());
+    auto a = std::move(ar.value());
+    auto b = std::move(br.value());
+    std::vector<std::string> owned;
+    for (int i = 0; i < 1000; ++i) {
+      owned.push_back(std::string("user-") + std::to_string(i * 31));
+      (void)a.add(owned.back());
+    }
+    const std::vector<std::string_view> keys(owned.begin(), owned.end());
+    [[maybe_unused]] auto ok = b.add_batch(keys);
+    assert(ok.has_value());
+    assert(a.estimate().value() == b.estimate().value());
+  }
+}
+
+static auto make_hll(probkit::hll::Encoding enc, bool sparse) -> sketch {
+  auto r = sketch::make(probkit::hll::Config{.precision = 12, .encoding = enc, .sparse = sparse}, HashConfig{});
+  assert(r.has_value());
+  return std::move(r.value());
+}
+
+[[maybe_unused]] static auto close_to(double a, double b) -> bool {
+  return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(b));
+}
+
+static void test_hll_encodings_agree() {
+  using probkit::hll::Encoding;
+  [[maybe_unused]] const std::size_t m = 1U << 12U;
+  for (int n : {0, 50, 700, 20000}) {
+    sketch dense = make_hll(Encoding::dense, false);
+    sketch packed = make_hll(Encoding::packed, false);
+    sketch sparse_dense = make_hll(Encoding::dense, true);
+    sketch sparse_packed = make_hll(Encoding::packed, true);
+    assert(packed.byte_size() < dense.byte_size() * 4U / 5U);
+    assert(sparse_dense.byte_size() == 0U);
+    for (int i = 0; i < n; ++i) {
+      const std::string k = std::string("e-") + std::to_string(i);
+      (void)dense.add(k);
+      (void)packed.add(k);
+      (void)sparse_dense.add(k);
+      (void)sparse_packed.add(k);
+    }
+    [[maybe_unused]] const double want = dense.estimate().value();
+    assert(close_to(packed.estimate().value(), want));
+    assert(close_to(sparse_dense.estimate().value(), want));
+    assert(close_to(sparse_packed.estimate().value(), want));
+    if (n <= 50) {
+      assert(sparse_dense.is_sparse() && sparse_dense.byte_size() <= static_cast<std::size_t>(n) * 4U);
+    }
+    if (n >= 20000) {
+      assert(!sparse_dense.is_sparse() && sparse_dense.byte_size() == m);
+      assert(!sparse_packed.is_sparse() && sparse_packed.encoding() == Encoding::packed);
+    }
+  }
+}
+
+static void test_hll_merge_across_encodings() {
+  using probkit::hll::Encoding;
+  // Reference: dense union of both halves
+  sketch ref = make_hll(Encoding::dense, false);
+  for (int i = 0; i < 3000; ++i) {
+    (void)ref.add(std::string("m-") + std::to_string(i));
+  }
+  [[maybe_unused]] const double want = ref.estimate().value();
+  const std::array<std::pair<Encoding, bool>, 4> modes{
+      {{Encoding::dense, false}, {Encoding::packed, false}, {Encoding::dense, true}, {Encoding::packed, true}}};
+  for (const auto& [enc_a, sparse_a] : modes) {
+    for (const auto& [enc_b, sparse_b] : modes) {
+      sketch a = make_hll(enc_a, sparse_a);
+      sketch b = make_hll(enc_b, sparse_b);
+      // Small halves keep sparse sides sparse until the merge pushes them over the limit
+      for (int i = 0; i < 3000; ++i) {
+        (void)(i < 400 ? a : b).add(std::string("m-") + std::to_string(i));
+      }
+      assert(a.merge(b).has_value());
+      assert(close_to(a.estimate().value(), want));
+      assert(a.same_params(b));
+    }
+  }
+}
+
+static void test_hll_tracked_estimate_matches_scan() {
+  using probkit::hll::Encoding;
+  for (const auto& [enc, sparse] : std::array<std::pair<Encoding, bool>, 3>{
+           {{Encoding::dense, false}, {Encoding::packed, false}, {Encoding::dense, true}}}) {
+    auto tr = sketch::make(
+        probkit::hll::Config{.precision = 10, .encoding = enc, .sparse = sparse, .track_estimate = true}, HashConfig{});
+    auto pr = sketch::make(probkit::hll::Config{.precision = 10, .encoding = enc, .sparse = sparse}, HashConfig{});
+    auto orr = sketch::make_by_precision(10, HashConfig{});
+    assert(tr.has_value() && pr.has_value() && orr.has_value());
+    auto tracked = std::move(tr.value());
+    auto plain = std::move(pr.value());
+    auto other = std::move(orr.value());
+    assert(tracked.tracks_estimate() && !plain.tracks_estimate());
+    assert(tracked.estimate().value() == plain.estimate().value());
+    for (int i = 0; i < 5000; ++i) {
+      const std::string k = std::string("t-") + std::to_string(i);
+      (void)tracked.add(k);
+      (void)plain.add(k);
+      (void)other.add(std::string("o-") + std::to_string(i));
+      if (i % 997 == 0) {
+        assert(tracked.estimate().value() == plain.estimate().value());
+      }
+    }
+    assert(tracked.merge(other).has_value());
+    assert(plain.merge(other).has_value());
+    assert(tracked.estimate().value() == plain.estimate().value());
+  }
+}
+
+// Sparse sketches at high precision, where the sparse phase runs to tens of thousands of entries:
+// registers match a dense sketch on the way up to and across the conversion, including entries still
+// buffered when estimate(), to_bytes() and merge() run
+static void test_hll_sparse_crosses_to_dense_at_high_precision() {
+  for (const std::uint8_t p : {std::uint8_t{16}, std::uint8_t{18}}) {
+    for (const bool tracked : {false, true}) {
+      const probkit::hll::Config sc{.precision = p, .sparse = true, .track_estimate = tracked};
+      auto sr = sketch::make(sc, HashConfig{});
+      auto dr = sketch::make_by_precision(p, HashConfig{});
+      auto hr = sketch::make(sc, HashConfig{});
+      assert(sr.has_value() && dr.has_value() && hr.has_value());
+      auto sparse = std::move(sr.value());
+      auto dense = std::move(dr.value());
+      auto other = std::move(hr.value()); // a second sparse sketch, merged into both at the end
+      const int n = static_cast<int>(sparse.m() / 2U);
+      bool was_sparse_late = false;
+      for (int i = 0; i < n; ++i) {
+        const std::string k = "hp-" + std::to_string(i);
+        (void)sparse.add(k);
+        (void)dense.add(k);
+        if (i < n / 8) {
+          (void)other.add(k + "-o");
+        }
+        if (i % 4099 == 0 || i + 1 == n) {
+          [[maybe_unused]] const double want = dense.estimate().value();
+          assert(sparse.estimate().value() == want);
+          auto copy = sketch::from_bytes(sparse.to_bytes());
+          assert(copy.has_value() && copy.value().is_sparse() == sparse.is_sparse());
+          assert(copy.value().estimate().value() == want);
+        }
+        was_sparse_late = was_sparse_late || (i > n / 4 && sparse.is_sparse());
+      }
+      assert(was_sparse_late && !sparse.is_sparse() && sparse.byte_size() == dense.byte_size());
+      assert(other.is_sparse());
+      assert(sparse.merge(other).has_value() && dense.merge(other).has_value());
+      assert(sparse.estimate().value() == dense.estimate().value());
+    }
+  }
+}
+
+static void test_hll_save_load_all_encodings() {
+  using probkit::hll::Encoding;
+  using probkit::serialize::LoadMode;
+  std::error_code ec;
+  const std::string path = (std::filesystem::temp_directory_path(ec) / "probkit_hll_test.pk").string();
+  for (const auto& [enc, sparse] : std::array<std::pair<Encoding, bool>, 3>{
+           {{Encoding::dense, false}, {Encoding::packed, false}, {Encoding::dense, true}}}) {
+    auto r = sketch::make(
+        probkit::hll::Config{.precision = 12, .encoding = enc, .sparse = sparse, .track_estimate = true},
+        HashConfig{.seed = 3});
+    assert(r.has_value());
+    auto s = std::move(r.value());
+    for (int i = 0; i < 200; ++i) {
+      (void)s.add(std::string("L-") + std::to_string(i));
+    }
+    assert(s.is_sparse() == sparse);
+    [[maybe_unused]] const double want = s.estimate().value();
+
+    auto bytes = s.to_bytes();
+    auto back = sketch::from_bytes(bytes);
+    assert(back.has_value() && back.value().same_params(s));
+    assert(back.value().encoding() == enc && back.value().is_sparse() == sparse);
+    assert(back.value().tracks_estimate() && back.value().estimate().value() == want);
+    bytes[bytes.size() - 1U] ^= std::byte{0x01};
+    assert(!sketch::from_bytes(bytes).has_value());
+
+    assert(s.save(path).has_value());
+    assert(probkit::serialize::sketch_kind(path).value() == probkit::serialize::SketchKind::hll);
+    for (LoadMode mode : {LoadMode::copy, LoadMode::map_read_only, LoadMode::map_copy_on_write}) {
+      auto l = sketch::load(path, {.mode = mode});
+      assert(l.has_value() && l.value().estimate().value() == want);
+      // Sparse payloads are always copied, so only a mapped dense register array is read-only
+      [[maybe_unused]] const bool read_only = mode == LoadMode::map_read_only && !sparse;
+      assert(l.value().writable() == !read_only);
+      assert(l.value().add("one-more").has_value() == !read_only);
+    }
+  }
+  std::filesystem::remove(path, ec);
+}
+
+// Saves racing on one path each write their own temp file, so the survivor is one whole image
+static void test_hll_concurrent_saves_to_one_path() {
+  constexpr std::size_t kWriters = 4;
+  std::error_code ec;
+  const auto dir = std::filesystem::temp_directory_path(ec) / "probkit_hll_save_race";
+  std::filesystem::remove_all(dir, ec);
+  std::filesystem::create_directory(dir, ec);
+  const std::string path = (dir / "shared.pk").string();
+  std::vector<sketch> sketches;
+  std::vector<double> want;
+  for (std::size_t w = 0; w < kWriters; ++w) {
+    sketches.push_back(sketch::make_by_precision(14, HashConfig{}).value());
+    for (std::size_t i = 0; i < 1000U * (w + 1U); ++i) {
+      (void)sketches.back().add("race-" + std::to_string(i));
+    }
+    want.push_back(sketches.back().estimate().value());
+  }
+  for (int round = 0; round < 20; ++round) {
+    std::vector<std::thread> threads;
+    for (std::size_t w = 0; w < kWriters; ++w) {
+      threads.emplace_back([&, w] { assert(sketches[w].save(path).has_value()); });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    auto l = sketch::load(path, {.mode = probkit::serialize::LoadMode::copy});
+    assert(l.has_value() && std::find(want.begin(), want.end(), l.value().estimate().value()) != want.end());
+  }
+  std::size_t files = 0;
+  for ([[maybe_unused]] const auto& e : std::filesystem::directory_iterator(dir, ec)) {
+    ++files;
+  }
+  assert(files == 1U); // no temp file left behind
+  std::filesystem::remove_all(dir, ec);
+}
+
+static void test_hll_concurrent_matches_sequential() {
+  constexpr std::size_t kThreads = 4;
+  constexpr int kPerThread = 20000;
+  auto cr = probkit::hll::concurrent_sketch::make(probkit::hll::Config{.precision = 12}, HashConfig{});
+  auto seq = sketch::make_by_precision(12, HashConfig{});
+  assert(cr.has_value() && seq.has_value());
+  auto shared = std::move(cr.value());
+  std::vector<std::vector<std::string>> keys(kThreads);
+  for (std::size_t t = 0; t < kThreads; ++t) {
+    for (int i = 0; i < kPerThread; ++i) {
+      // Half of every thread's keys overlap with its neighbour's, so registers race on equal ranks
+      keys[t].push_back("c-" + std::to_string((static_cast<int>(t) * kPerThread / 2) + i));
+      (void)seq.value().add(keys[t].back());
+    }
+  }
+  std::vector<std::thread> writers;
+  for (std::size_t t = 0; t < kThreads; ++t) {
+    writers.emplace_back([&shared, &keys, t]() -> void {
+      const std::vector<std::string_view> views(keys[t].begin(), keys[t].end());
+      assert(shared.add_batch(views).has_value());
+    });
+  }
+  for (auto& w : writers) {
+    w.join();
+  }
+  // Register max is order-independent, so the shared sketch equals the sequential one exactly
+  [[maybe_unused]] const double want = seq.value().estimate().value();
+  assert(shared.estimate().value() == want);
+  auto snap = shared.snapshot();
+  assert(snap.has_value() && snap.value().estimate().value() == want);
+  const sketch released = std::move(shared).release();
+  assert(released.same_params(seq.value()) && released.estimate().value() == want);
+}
+
+static void test_hll_fixed_matches_runtime() {
+  using probkit::hll::fixed_sketch;
+  auto fr = fixed_sketch<14>::make(HashConfig{.seed = 3});
+  auto rr = sketch::make(probkit::hll::Config{.precision = 14}, HashConfig{.seed = 3});
+  assert(fr.has_value() && rr.has_value());
+  fixed_sketch<14> f = std::move(fr.value());
+  sketch r = std::move(rr.value());
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; ++i) {
+    keys.push_back("F-" + std::to_string(i));
+  }
+  const std::vector<std::string_view> views(keys.begin(), keys.end());
+  assert(f.add_batch(std::span(views).first(10000)).has_value());
+  for (std::size_t i = 10000; i < views.size(); ++i) {
+    assert(f.add(views[i]).has_value());
+  }
+  assert(r.add_batch(views).has_value());
+  // Same registers, so the same image and estimate
+  assert(f.to_bytes() == r.to_bytes());
+  assert(f.estimate().value() == r.estimate().value());
+
+  // The runtime entry point updates a plain sketch in place; merge() works across both types
+  auto other = sketch::make(probkit::hll::Config{.precision = 14}, HashConfig{.seed = 3});
+  assert(other.has_value());
+  assert(fixed_sketch<14>::add_batch(other.value(), views).has_value() && other.value().to_bytes() == r.to_bytes());
+  assert(f.merge(other.value()).has_value() && f.to_bytes() == r.to_bytes());
+  assert(r.merge(f.base()).has_value());
+
+  // Only dense, untracked sketches of the same precision fit
+  assert(!fixed_sketch<12>::fits(r) && !fixed_sketch<12>::add_batch(r, views).has_value());
+  auto packed = sketch::make(probkit::hll::Config{.precision = 14, .encoding = probkit::hll::Encoding::packed});
+  assert(packed.has_value() && !fixed_sketch<14>::wrap(std::move(packed.value())).has_value());
+
+  auto back = fixed_sketch<14>::from_bytes(r.to_bytes());
+  assert(back.has_value() && back.value().to_bytes() == r.to_bytes());
+  const sketch released = std::move(back.value()).release();
+  assert(released.same_params(r));
+}
+
+static void test_hll_add_hashed_matches_add() {
+  const HashConfig cfg{.seed = 11};
+  for (const bool sparse : {false, true}) {
+    auto a = sketch::make(probkit::hll::Config{.precision = 12, .sparse = sparse}, cfg);
+    auto b = sketch::make(probkit::hll::Config{.precision = 12, .sparse = sparse}, cfg);
+    assert(a.has_value() && b.has_value());
+    std::vector<std::string> keys;
+    std::vector<std::uint64_t> hs;
+    for (int i = 0; i < 5000; ++i) {
+      keys.push_back("H-" + std::to_string(i));
+      hs.push_back(probkit::hashing::hash64(keys.back(), cfg));
+    }
+    const std::vector<std::string_view> views(keys.begin(), keys.end());
+    assert(a.value().add_batch(views).has_value());
+    assert(b.value().add_hashed(hs.front()).has_value());
+    assert(b.value().add_hashed_batch(std::span(hs).subspan(1)).has_value());
+    assert(a.value().to_bytes() == b.value().to_bytes());
+  }
+}
+
 void run_hll_tests() {
   test_hll_basic_accuracy_and_merge();
   test_hll_linear_counting_region();
+  test_hll_add_batch_matches_add();
+  test_hll_encodings_agree();
+  test_hll_merge_across_encodings();
+  test_hll_tracked_estimate_matches_scan();
+  test_hll_sparse_crosses_to_dense_at_high_precision();
+  test_hll_save_load_all_encodings();
+  test_hll_concurrent_matches_sequential();
+  test_hll_concurrent_saves_to_one_path();
+  test_hll_fixed_matches_runtime();
+  test_hll_add_hashed_matches_add();
 }
 
 } // namespace tests